@@ -0,0 +1,307 @@
+﻿// IndexSegmentTests.cpp
+#include "Tests.h"
+#include "IndexSegment.h"
+#include "TextAnalyzer.h"
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+namespace {
+    // Токенизатор для проверки: число слов
+    uint32_t countWords(std::string_view text) {
+        uint32_t words = 0;
+        bool inWord = false;
+        for (char c : text) {
+            const bool space = c == ' ' || c == '\n';
+            if (!space && !inWord) {
+                ++words;
+            }
+            inWord = !space;
+        }
+        return words;
+    }
+
+    // Документ для записи: текст чанков хранится в chunks, DocumentData ссылается на него
+    struct TestDocument {
+        std::vector<std::string> chunks;
+        IndexSegment::DocumentData data;
+    };
+
+    TestDocument makeDocument(const std::string& name, uint32_t part, IndexSegment::ChunkId firstId, size_t count) {
+        TestDocument document;
+        for (size_t i = 0; i < count; ++i) {
+            document.chunks.push_back("Документ " + name + " часть " + std::to_string(part) + " чанк " + std::to_string(i)
+                + ": поставка насосного оборудования, гарантия " + std::to_string(i + 1) + " лет.");
+        }
+
+        IndexSegment::DocumentInfo& info = document.data.info;
+        info.name = name;
+        info.ocrProfile = "default";
+        info.originalSize = 1000 * (part + 1);
+        info.addedTime = 1700000000 + part;
+        info.sourceStamp = part == 0 ? 0 : 12345;
+        info.chunkSize = 500;
+        info.chunkOverlap = 30;
+
+        uint64_t offset = 0;
+        for (size_t i = 0; i < count; ++i) {
+            document.data.chunks.push_back(document.chunks[i]);
+            document.data.chunkIds.push_back(firstId + static_cast<IndexSegment::ChunkId>(i));
+            document.data.sources.push_back({ offset, part + 1, part + 2 });
+            offset += document.chunks[i].size() + 1;
+        }
+        return document;
+    }
+
+    // Сегмент хранит документ как записан: описание, текст, идентификаторы, места и токены чанков
+    void checkDocument(const IndexSegment& segment, uint32_t index, const TestDocument& expected) {
+        const IndexSegment::DocumentInfo info = segment.getDocument(index);
+        const IndexSegment::DocumentInfo& written = expected.data.info;
+        CHECK(info.name == written.name);
+        CHECK(info.ocrProfile == written.ocrProfile);
+        CHECK(info.originalSize == written.originalSize);
+        CHECK(info.addedTime == written.addedTime);
+        CHECK(info.sourceStamp == written.sourceStamp);
+        CHECK(info.chunkSize == written.chunkSize);
+        CHECK(info.chunkOverlap == written.chunkOverlap);
+        CHECK(info.chunkCount == expected.chunks.size());
+        if (info.chunkCount != expected.chunks.size()) {
+            return;
+        }
+
+        for (uint32_t i = 0; i < info.chunkCount; ++i) {
+            const uint32_t chunk = info.firstChunk + i;
+            CHECK(segment.getChunk(chunk) == expected.chunks[i]);
+            CHECK(segment.getChunkId(chunk) == expected.data.chunkIds[i]);
+            CHECK(segment.getChunkDocument(chunk) == index);
+            CHECK(segment.getTokenCount(chunk) == countWords(expected.chunks[i]));
+
+            const ChunkList::Source source = segment.getChunkSource(chunk);
+            CHECK(source.offset == expected.data.sources[i].offset);
+            CHECK(source.firstPage == expected.data.sources[i].firstPage);
+            CHECK(source.lastPage == expected.data.sources[i].lastPage);
+
+            uint32_t found = 0;
+            CHECK(segment.findChunk(expected.data.chunkIds[i], found) && found == chunk);
+        }
+    }
+
+    // Термин "насосн..." есть во всех неудаленных чанках
+    void checkTerms(const IndexSegment& segment, const TextAnalyzer& analyzer, size_t liveChunks) {
+        std::string buffer;
+        std::vector<std::string_view> terms;
+        analyzer.analyze("насосного", buffer, terms);
+        CHECK(terms.size() == 1);
+        if (terms.size() == 1) {
+            const uint32_t term = segment.findTerm(terms[0]);
+            CHECK(term != IndexSegment::INVALID_TERM);
+            CHECK(term != IndexSegment::INVALID_TERM && segment.getDocumentFrequency(term) == liveChunks);
+        }
+        CHECK(segment.getCollectionStats().chunkCount == liveChunks);
+    }
+
+    void writeAndOpen(const fs::path& directory, const TextAnalyzer& analyzer,
+        const IndexSegment::Tokenizer& tokenizer) {
+        std::vector<TestDocument> documents;
+        documents.push_back(makeDocument("a.pdf", 0, 100, 5));
+        documents.push_back(makeDocument("b.pdf", 0, 200, 3));
+        std::vector<IndexSegment::DocumentData> data;
+        for (const auto& document : documents) {
+            data.push_back(document.data);
+        }
+
+        std::string error;
+        const std::string path = (directory / "write.seg").string();
+        auto written = IndexSegment::write(path, data, analyzer, 0, 0, nullptr, tokenizer, error);
+        CHECK(written != nullptr);
+        auto opened = IndexSegment::open(path, error);
+        CHECK(opened != nullptr);
+        auto memory = IndexSegment::write("", data, analyzer, 0, 0, nullptr, tokenizer, error);
+        CHECK(memory != nullptr);
+        if (!opened || !memory) {
+            return;
+        }
+
+        for (const IndexSegment* segment : { opened.get(), memory.get() }) {
+            CHECK(segment->verify(error));
+            CHECK(segment->getTokenizer() == tokenizer.tag);
+            CHECK(segment->getDocumentCount() == 2);
+            CHECK(segment->getChunkCount() == 8);
+            if (segment->getDocumentCount() == 2) {
+                checkDocument(*segment, 0, documents[0]);
+                checkDocument(*segment, 1, documents[1]);
+            }
+            checkTerms(*segment, analyzer, 8);
+        }
+        CHECK(opened->getFingerprint(0) == memory->getFingerprint(0));
+
+        // Поврежденный раздел не проходит проверку контрольных сумм
+        opened.reset();
+        written.reset();
+        {
+            std::fstream file(path, std::ios::in | std::ios::out | std::ios::binary);
+            file.seekp(-16, std::ios::end);
+            file.put('\x5A');
+        }
+        auto damaged = IndexSegment::open(path, error);
+        CHECK(!damaged || !damaged->verify(error));
+    }
+
+    // Документ b.pdf загружался частями, по части в каждом сегменте
+    struct PartedSegments {
+        TestDocument a = makeDocument("a.pdf", 0, 100, 4);
+        TestDocument b0 = makeDocument("b.pdf", 0, 200, 3);
+        TestDocument c = makeDocument("c.pdf", 0, 300, 2);
+        TestDocument b1 = makeDocument("b.pdf", 1, 203, 2);
+        std::shared_ptr<IndexSegment> first;
+        std::shared_ptr<IndexSegment> second;
+
+        PartedSegments(const fs::path& directory, const TextAnalyzer& analyzer,
+            const IndexSegment::Tokenizer& tokenizer) {
+            std::string error;
+            first = IndexSegment::write((directory / "first.seg").string(), { a.data, b0.data }, analyzer, 0, 0,
+                nullptr, tokenizer, error);
+            second = IndexSegment::write("", { c.data, b1.data }, analyzer, 0, 0, nullptr, tokenizer, error);
+            CHECK(first != nullptr && second != nullptr);
+        }
+
+        // b.pdf после слияния - один документ из двух частей по порядку, описание - у последней части,
+        // время добавления - у первой
+        TestDocument joined() const {
+            TestDocument b = b1;
+            b.chunks.insert(b.chunks.begin(), b0.chunks.begin(), b0.chunks.end());
+            b.data.chunkIds.insert(b.data.chunkIds.begin(), b0.data.chunkIds.begin(), b0.data.chunkIds.end());
+            b.data.sources.insert(b.data.sources.begin(), b0.data.sources.begin(), b0.data.sources.end());
+            b.data.info.addedTime = b0.data.info.addedTime;
+            return b;
+        }
+    };
+
+    // Слияние в файл: результат в памяти и открытый файл совпадают; nullptr, если слияние не удалось
+    std::shared_ptr<IndexSegment> mergeToFile(const fs::path& path,
+        const std::vector<std::shared_ptr<const IndexSegment>>& sources, const IndexSegment::Tokenizer& tokenizer,
+        std::shared_ptr<IndexSegment>& opened) {
+        std::string error;
+        auto merged = IndexSegment::merge(path.string(), sources, 0, 0, nullptr, tokenizer, error);
+        CHECK(merged != nullptr);
+        opened = IndexSegment::open(path.string(), error);
+        CHECK(opened != nullptr);
+        return opened ? merged : nullptr;
+    }
+
+    void mergeParts(const fs::path& directory, const TextAnalyzer& analyzer,
+        const IndexSegment::Tokenizer& tokenizer) {
+        PartedSegments parts(directory, analyzer, tokenizer);
+        if (!parts.first || !parts.second) {
+            return;
+        }
+
+        std::shared_ptr<IndexSegment> opened;
+        auto merged = mergeToFile(directory / "parts.seg", { parts.first, parts.second }, tokenizer, opened);
+        if (!merged) {
+            return;
+        }
+
+        const TestDocument b = parts.joined();
+        std::string error;
+        for (const IndexSegment* segment : { merged.get(), opened.get() }) {
+            CHECK(segment->verify(error));
+            CHECK(segment->getDocumentCount() == 3);
+            CHECK(segment->getChunkCount() == 11);
+
+            uint32_t document = 0;
+            CHECK(segment->findDocument("a.pdf", document));
+            checkDocument(*segment, document, parts.a);
+            CHECK(segment->findDocument("b.pdf", document));
+            checkDocument(*segment, document, b);
+            CHECK(segment->findDocument("c.pdf", document));
+            checkDocument(*segment, document, parts.c);
+            checkTerms(*segment, analyzer, 11);
+        }
+    }
+
+    void mergeRemoved(const fs::path& directory, const TextAnalyzer& analyzer,
+        const IndexSegment::Tokenizer& tokenizer) {
+        PartedSegments parts(directory, analyzer, tokenizer);
+        if (!parts.first || !parts.second) {
+            return;
+        }
+
+        // a.pdf удален: его чанки уходят при слиянии
+        std::shared_ptr<const IndexSegment> withoutA = parts.first->withRemoved({ 0 }, analyzer);
+        CHECK(withoutA->isDocumentRemoved(0));
+        CHECK(withoutA->getRemovedChunkCount() == 4);
+        checkTerms(*withoutA, analyzer, 3);
+
+        std::shared_ptr<IndexSegment> opened;
+        auto merged = mergeToFile(directory / "removed.seg", { withoutA, parts.second }, tokenizer, opened);
+        if (!merged) {
+            return;
+        }
+
+        const TestDocument b = parts.joined();
+        std::string error;
+        for (const IndexSegment* segment : { merged.get(), opened.get() }) {
+            CHECK(segment->verify(error));
+            CHECK(segment->getDocumentCount() == 2);
+            CHECK(segment->getChunkCount() == 7);
+            CHECK(segment->getRemovedChunkCount() == 0);
+
+            uint32_t document = 0;
+            CHECK(!segment->findDocument("a.pdf", document));
+            CHECK(segment->findDocument("b.pdf", document));
+            checkDocument(*segment, document, b);
+            CHECK(segment->findDocument("c.pdf", document));
+            checkDocument(*segment, document, parts.c);
+            checkTerms(*segment, analyzer, 7);
+        }
+    }
+
+    // Числа токенов другого токенизатора при слиянии считаются заново
+    void recountTokens(const fs::path& directory, const TextAnalyzer& analyzer,
+        const IndexSegment::Tokenizer& tokenizer) {
+        PartedSegments parts(directory, analyzer, tokenizer);
+        if (!parts.first || !parts.second) {
+            return;
+        }
+
+        IndexSegment::Tokenizer other;
+        other.tag = tokenizer.tag + 1;
+        other.count = [](std::string_view text) { return static_cast<uint32_t>(text.size()); };
+
+        std::string error;
+        auto recounted = IndexSegment::merge("", { parts.first, parts.second }, 0, 0, nullptr, other, error);
+        CHECK(recounted != nullptr);
+        if (recounted) {
+            CHECK(recounted->getTokenizer() == other.tag);
+            for (uint32_t chunk = 0; chunk < recounted->getChunkCount(); ++chunk) {
+                CHECK(recounted->getTokenCount(chunk) == recounted->getChunk(chunk).size());
+            }
+        }
+    }
+}
+
+namespace Tests {
+    // Сегмент после записи, открытия файла и слияния хранит то же, что было записано
+    void indexSegment() {
+        std::error_code ec;
+        const fs::path directory = fs::temp_directory_path(ec) / "sU-100-tests";
+        fs::remove_all(directory, ec);
+        fs::create_directories(directory, ec);
+
+        TextAnalyzer analyzer;
+        IndexSegment::Tokenizer tokenizer;
+        tokenizer.tag = 7;
+        tokenizer.count = countWords;
+
+        writeAndOpen(directory, analyzer, tokenizer);
+        mergeParts(directory, analyzer, tokenizer);
+        mergeRemoved(directory, analyzer, tokenizer);
+        recountTokens(directory, analyzer, tokenizer);
+
+        fs::remove_all(directory, ec);
+    }
+}
@@ -0,0 +1,62 @@
+﻿// TestMain.cpp
+#include "Tests.h"
+#include <iostream>
+
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+namespace {
+    // Подробно печатаются только первые MAX_REPORTED неудачи: случайные тесты могут дать тысячи
+    constexpr size_t MAX_REPORTED = 20;
+
+    size_t failures = 0;
+}
+
+namespace Tests {
+    bool check(bool condition, const char* expression, const char* file, int line) {
+        if (!condition) {
+            if (failures < MAX_REPORTED) {
+                std::cout << "  ✗ " << file << ":" << line << ": " << expression << std::endl;
+            }
+            failures++;
+        }
+        return condition;
+    }
+
+    size_t getFailures() {
+        return failures;
+    }
+}
+
+int main() {
+#ifdef _WIN32
+    SetConsoleOutputCP(CP_UTF8);
+#endif
+
+    struct Group {
+        const char* name;
+        void (*run)();
+    };
+    const Group groups[] = {
+        { "TextChunker", Tests::textChunker },
+        { "VectorKernels", Tests::vectorKernels },
+        { "IndexSegment", Tests::indexSegment },
+    };
+
+    size_t failedGroups = 0;
+    for (const auto& group : groups) {
+        const size_t before = Tests::getFailures();
+        group.run();
+        const size_t failed = Tests::getFailures() - before;
+        if (failed == 0) {
+            std::cout << "✓ " << group.name << std::endl;
+        } else {
+            std::cout << "✗ " << group.name << ": " << failed << " failed check(s)" << std::endl;
+            failedGroups++;
+        }
+    }
+
+    std::cout << (failedGroups == 0 ? "All tests passed" : "Tests failed") << std::endl;
+    return failedGroups == 0 ? 0 : 1;
+}
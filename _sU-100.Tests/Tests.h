@@ -0,0 +1,19 @@
+﻿// Tests.h
+#pragma once
+
+#include <cstddef>
+
+// Проверка условия: неудача печатается с местом в исходном тексте и засчитывается тесту
+#define CHECK(condition) Tests::check((condition), #condition, __FILE__, __LINE__)
+
+namespace Tests {
+    bool check(bool condition, const char* expression, const char* file, int line);
+
+    // Число неудачных проверок с начала запуска
+    size_t getFailures();
+
+    // Группы тестов
+    void textChunker();
+    void vectorKernels();
+    void indexSegment();
+}
@@ -0,0 +1,157 @@
+﻿// TextChunkerTests.cpp
+#include "Tests.h"
+#include "TextChunker.h"
+#include <cstring>
+#include <random>
+#include <string>
+
+namespace {
+    // Случайный документ из строк разного вида: предложения, заголовки, пункты списков,
+    // номера разделов, разметка страниц и слова длиннее чанка
+    std::string randomDocument(std::mt19937& random) {
+        const char* words[] = { "поставка", "Договор", "срок", "оплата", "товар", "А.", "неустойка", "суд",
+            "Поставщик", "x", "оборудование", "длинноесловобезпробеловдлинноесловобезпробелов" };
+        const size_t wordCount = sizeof(words) / sizeof(words[0]);
+
+        std::string document;
+        const int lines = static_cast<int>(random() % 30) + 1;
+        for (int line = 0; line < lines; ++line) {
+            switch (random() % 10) {
+            case 0:
+                document += "\n";
+                break;
+            case 1:
+                document += "# Заголовок " + std::to_string(random() % 100) + "\n";
+                break;
+            case 2:
+                document += std::to_string(random() % 9 + 1) + ". Пункт " + words[random() % wordCount] + "\n";
+                break;
+            case 3:
+                document += "2." + std::to_string(random() % 9) + " Сроки поставки\n";
+                break;
+            case 4:
+                document += "=== Page " + std::to_string(line + 1) + " ===\n";
+                break;
+            case 5:
+                document += "ГЛАВА ПЕРВАЯ\n";
+                break;
+            default: {
+                const int count = static_cast<int>(random() % 40) + 1;
+                for (int i = 0; i < count; ++i) {
+                    document += words[random() % wordCount];
+                    document += random() % 6 == 0 ? ". " : " ";
+                }
+                document += random() % 2 ? "\n" : ". Далее\n";
+            }
+            }
+        }
+        return document;
+    }
+
+    bool sameChunks(const ChunkList& a, const ChunkList& b) {
+        if (a.size() != b.size()) {
+            return false;
+        }
+        for (size_t i = 0; i < a.size(); ++i) {
+            const ChunkList::Source& x = a.getSource(i);
+            const ChunkList::Source& y = b.getSource(i);
+            if (a[i] != b[i] || x.offset != y.offset || x.firstPage != y.firstPage || x.lastPage != y.lastPage) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // Разбиение по фрагментам случайной длины совпадает с разбиением целиком; чанки не длиннее
+    // maxChunkSize и не короче MIN_CHUNK_LENGTH, смещение указывает на текст чанка в документе
+    void streamingMatchesSplit() {
+        std::mt19937 random(42);
+        for (int iteration = 0; iteration < 3000; ++iteration) {
+            const std::string document = randomDocument(random);
+            const size_t maxChunkSize = 50 + random() % 300;
+            const size_t overlapTokens = random() % 3 == 0 ? 0 : random() % 40;
+            TextChunker chunker(maxChunkSize, overlapTokens);
+
+            const ChunkList whole = chunker.split(document);
+
+            TextChunker::State state;
+            ChunkList streamed;
+            const size_t step = random() % 13 + 1;
+            for (size_t pos = 0; pos < document.size(); pos += step) {
+                chunker.append(std::string_view(document).substr(pos, step), state, streamed);
+            }
+            chunker.flush(state, streamed);
+
+            CHECK(sameChunks(whole, streamed));
+            for (size_t i = 0; i < whole.size(); ++i) {
+                const ChunkList::Source& source = whole.getSource(i);
+                CHECK(whole[i].size() <= maxChunkSize);
+                CHECK(whole[i].size() >= TextChunker::MIN_CHUNK_LENGTH);
+                CHECK(source.offset + whole[i].size() <= document.size()
+                    && document.compare(source.offset, whole[i].size(), whole[i]) == 0);
+                CHECK(source.firstPage <= source.lastPage);
+            }
+        }
+    }
+
+    // Короткие пункты нумерованного списка не делят текст на чанки
+    void listItemsAreNotHeadings() {
+        std::string document = "Поставщик обязуется выполнить следующие условия договора.\n";
+        for (int i = 1; i <= 5; ++i) {
+            document += std::to_string(i) + ". Пункт условий номер " + std::to_string(i) + "\n";
+        }
+
+        const ChunkList chunks = TextChunker(1000).split(document);
+        CHECK(chunks.size() == 1);
+    }
+
+    // Заголовок "Глава", "Раздел", "Статья" начинает новый чанк после содержания в четверть чанка
+    void keywordHeadingsStartChunks() {
+        for (const char* heading : { "Глава 3 Порядок расчетов", "Раздел 2 Сроки поставки",
+            "Статья 5 Ответственность сторон", "Article 5 Liability" }) {
+            const std::string document = std::string("Поставщик выполняет условия договора.\n") + heading
+                + "\nОплата в течение десяти дней.\n";
+
+            const ChunkList chunks = TextChunker(200).split(document);
+            CHECK(chunks.size() == 2);
+            CHECK(chunks.size() == 2 && chunks[1].substr(0, std::strlen(heading)) == heading);
+        }
+    }
+
+    // Повторное разбиение по сохраненным чанкам: чанк начинается с текста документа по своему
+    // смещению (до первого перевода строки - дальше промежутки между чанками заполнены переводами строк)
+    void rechunkKeepsOffsets() {
+        std::mt19937 random(7);
+        for (int iteration = 0; iteration < 300; ++iteration) {
+            const std::string document = randomDocument(random);
+            const ChunkList original = TextChunker(200, 20).split(document);
+
+            const size_t maxChunkSize = 120 + random() % 200;
+            TextChunker chunker(maxChunkSize, random() % 30);
+            TextChunker::State state;
+            ChunkList rechunked;
+            for (size_t i = 0; i < original.size(); ++i) {
+                const ChunkList::Source& source = original.getSource(i);
+                chunker.appendAt(source.offset, source.firstPage, original[i], state, rechunked);
+            }
+            chunker.flush(state, rechunked);
+
+            for (size_t i = 0; i < rechunked.size(); ++i) {
+                const ChunkList::Source& source = rechunked.getSource(i);
+                const std::string_view firstLine = rechunked[i].substr(0, rechunked[i].find('\n'));
+                CHECK(rechunked[i].size() <= maxChunkSize);
+                CHECK(source.offset + firstLine.size() <= document.size()
+                    && document.compare(source.offset, firstLine.size(), firstLine) == 0);
+            }
+        }
+    }
+}
+
+namespace Tests {
+    void textChunker() {
+        streamingMatchesSplit();
+        listItemsAreNotHeadings();
+        keywordHeadingsStartChunks();
+        rechunkKeepsOffsets();
+    }
+}
@@ -0,0 +1,64 @@
+﻿// VectorKernelsTests.cpp
+#include "Tests.h"
+#include "VectorKernels.h"
+#include <cmath>
+#include <iostream>
+#include <random>
+#include <vector>
+
+namespace {
+    // Длины векторов: пустой, хвосты короче регистра и размерности моделей эмбеддингов
+    const size_t LENGTHS[] = { 0, 1, 3, 7, 15, 16, 17, 31, 32, 33, 63, 64, 65, 100, 127, 128, 129, 384, 768, 1027 };
+}
+
+namespace Tests {
+    // Ядра выбранного набора инструкций дают тот же результат, что и прямой расчет
+    void vectorKernels() {
+        std::cout << "  instruction set: " << VectorKernels::getInstructionSet() << std::endl;
+
+        std::mt19937 random(1);
+        std::uniform_real_distribution<float> real(-1.0f, 1.0f);
+        std::uniform_int_distribution<int> signedCode(-127, 127);
+        std::uniform_int_distribution<int> unsignedCode(0, 255);
+
+        for (size_t n : LENGTHS) {
+            for (int repeat = 0; repeat < 20; ++repeat) {
+                std::vector<float> fa(n), fb(n);
+                std::vector<int8_t> ia(n), ib(n);
+                std::vector<uint8_t> ua(n);
+                double dotFloat = 0.0;
+                double magnitude = 0.0;
+                int32_t dotInt8 = 0;
+                int32_t dotUint8Int8 = 0;
+                for (size_t i = 0; i < n; ++i) {
+                    fa[i] = real(random);
+                    fb[i] = real(random);
+                    ia[i] = static_cast<int8_t>(signedCode(random));
+                    ib[i] = static_cast<int8_t>(signedCode(random));
+                    ua[i] = static_cast<uint8_t>(unsignedCode(random));
+                    dotFloat += static_cast<double>(fa[i]) * fb[i];
+                    magnitude += std::fabs(static_cast<double>(fa[i]) * fb[i]);
+                    dotInt8 += static_cast<int32_t>(ia[i]) * ib[i];
+                    dotUint8Int8 += static_cast<int32_t>(ua[i]) * ib[i];
+                }
+
+                // Порядок сложения у ядер свой: погрешность в пределах точности float
+                CHECK(std::fabs(VectorKernels::dotFloat(fa.data(), fb.data(), n) - dotFloat) <= 1e-5 * (magnitude + 1.0));
+                CHECK(VectorKernels::dotInt8(ia.data(), ib.data(), n) == dotInt8);
+                CHECK(VectorKernels::dotUint8Int8(ua.data(), ib.data(), n) == dotUint8Int8);
+
+                const size_t words = n / 8 + 1;
+                std::vector<uint64_t> ha(words), hb(words);
+                uint32_t hamming = 0;
+                for (size_t i = 0; i < words; ++i) {
+                    ha[i] = (static_cast<uint64_t>(random()) << 32) | random();
+                    hb[i] = (static_cast<uint64_t>(random()) << 32) | random();
+                    for (uint64_t x = ha[i] ^ hb[i]; x != 0; x &= x - 1) {
+                        hamming++;
+                    }
+                }
+                CHECK(VectorKernels::hamming(ha.data(), hb.data(), words) == hamming);
+            }
+        }
+    }
+}
@@ -0,0 +1,86 @@
+﻿// BoundedQueue.h
+#pragma once
+
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+
+// Потокобезопасная очередь ограниченной емкости.
+// push блокируется, пока очередь заполнена (обратное давление на предыдущий этап)
+template <typename T>
+class BoundedQueue {
+public:
+    explicit BoundedQueue(size_t capacity)
+        : maxSize(capacity > 0 ? capacity : 1), closed(false) {
+    }
+
+    BoundedQueue(const BoundedQueue&) = delete;
+    BoundedQueue& operator=(const BoundedQueue&) = delete;
+
+    // Добавление элемента; false, если очередь закрыта (элемент при этом остается у вызывающего)
+    bool push(T&& item) {
+        std::unique_lock<std::mutex> lock(mtx);
+        notFull.wait(lock, [this]() { return closed || items.size() < maxSize; });
+
+        if (closed) {
+            return false;
+        }
+
+        items.push_back(std::move(item));
+        lock.unlock();
+        notEmpty.notify_one();
+        return true;
+    }
+
+    // Извлечение элемента; false, если очередь закрыта и пуста
+    bool pop(T& item) {
+        std::unique_lock<std::mutex> lock(mtx);
+        notEmpty.wait(lock, [this]() { return closed || !items.empty(); });
+
+        if (items.empty()) {
+            return false;
+        }
+
+        item = std::move(items.front());
+        items.pop_front();
+        lock.unlock();
+        notFull.notify_one();
+        return true;
+    }
+
+    // Закрытие очереди: новые элементы не принимаются, ожидающие потоки просыпаются
+    void close() {
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            closed = true;
+        }
+        notFull.notify_all();
+        notEmpty.notify_all();
+    }
+
+    // Извлечение всех оставшихся элементов (после закрытия)
+    std::deque<T> drain() {
+        std::lock_guard<std::mutex> lock(mtx);
+        std::deque<T> rest;
+        rest.swap(items);
+        return rest;
+    }
+
+    size_t size() const {
+        std::lock_guard<std::mutex> lock(mtx);
+        return items.size();
+    }
+
+    size_t capacity() const {
+        return maxSize;
+    }
+
+private:
+    std::deque<T> items;
+    size_t maxSize;
+    bool closed;
+
+    mutable std::mutex mtx;
+    std::condition_variable notFull;
+    std::condition_variable notEmpty;
+};
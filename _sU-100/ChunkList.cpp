@@ -0,0 +1,56 @@
+﻿// ChunkList.cpp
+#include "ChunkList.h"
+
+void ChunkList::add(std::string_view chunk, const Source& source) {
+    spans.push_back({ text.size(), chunk.size() });
+    sources.push_back(source);
+    text.append(chunk);
+}
+
+void ChunkList::append(const ChunkList& other) {
+    const size_t base = text.size();
+    text.append(other.text);
+
+    spans.reserve(spans.size() + other.spans.size());
+    for (const Span& span : other.spans) {
+        spans.push_back({ base + span.offset, span.length });
+    }
+    sources.insert(sources.end(), other.sources.begin(), other.sources.end());
+}
+
+std::string_view ChunkList::operator[](size_t index) const {
+    const Span& span = spans[index];
+    return std::string_view(text.data() + span.offset, span.length);
+}
+
+const ChunkList::Source& ChunkList::getSource(size_t index) const {
+    return sources[index];
+}
+
+size_t ChunkList::size() const {
+    return spans.size();
+}
+
+bool ChunkList::empty() const {
+    return spans.empty();
+}
+
+size_t ChunkList::getTextSize() const {
+    return text.size();
+}
+
+size_t ChunkList::getMemoryUsage() const {
+    return text.capacity() + spans.capacity() * sizeof(Span) + sources.capacity() * sizeof(Source);
+}
+
+void ChunkList::shrinkToFit() {
+    text.shrink_to_fit();
+    spans.shrink_to_fit();
+    sources.shrink_to_fit();
+}
+
+void ChunkList::clear() {
+    text.clear();
+    spans.clear();
+    sources.clear();
+}
@@ -0,0 +1,56 @@
+﻿// ChunkList.h
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <cstdint>
+
+// Чанки текста подряд в одном буфере: чанк - участок буфера (смещение, длина),
+// а не отдельная строка. Текст хранится один раз и выдается как string_view без копирования.
+// У каждого чанка - его место в документе (смещение в тексте и страницы)
+class ChunkList {
+public:
+    // Участок буфера, занятый чанком
+    struct Span {
+        size_t offset;
+        size_t length;
+    };
+
+    // Место чанка в документе: смещение в байтах в тексте документа (с разметкой страниц)
+    // и страницы первой и последней строки чанка (0 - текст без разметки страниц)
+    struct Source {
+        uint64_t offset;
+        uint32_t firstPage;
+        uint32_t lastPage;
+    };
+
+    // Добавление чанка в конец буфера
+    void add(std::string_view chunk, const Source& source = Source());
+
+    // Добавление всех чанков другого списка
+    void append(const ChunkList& other);
+
+    // Текст чанка; действителен до следующего изменения списка
+    std::string_view operator[](size_t index) const;
+
+    // Место чанка в документе
+    const Source& getSource(size_t index) const;
+
+    size_t size() const;
+    bool empty() const;
+
+    // Объем текста и занимаемая память в байтах
+    size_t getTextSize() const;
+    size_t getMemoryUsage() const;
+
+    // Освобождение запаса буфера после завершения документа
+    void shrinkToFit();
+
+    void clear();
+
+private:
+    std::string text;
+    std::vector<Span> spans;
+    std::vector<Source> sources;
+};
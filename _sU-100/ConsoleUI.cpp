@@ -2,6 +2,7 @@
 #include "ConsoleUI.h"
 #include "LLMInterface.h"
 #include "ContextManager.h"
+#include "IngestionPipeline.h"
 
 #include <iostream>
 #include <sstream>
@@ -45,10 +46,22 @@ void ConsoleUI::startInteractiveMode(
     displayWelcome();
 
     while (running) {
-        std::cout << "\n" << COLOR_CYAN << "> " << COLOR_RESET;
+        std::cout << "\n";
+
+        // Количество файлов, ожидающих загрузки в фоне
+        size_t pending = ingestion ? ingestion->getPendingCount() : 0;
+        if (pending > 0) {
+            std::cout << COLOR_YELLOW << "[ingesting " << pending << "] " << COLOR_RESET;
+        }
+        std::cout << COLOR_CYAN << "> " << COLOR_RESET;
 
         std::string input = getUserInput();
 
+        // Ввод закрыт - выходим, а не крутимся в пустом цикле
+        if (!std::cin) {
+            break;
+        }
+
         if (input.empty()) {
             continue;
         }
@@ -69,6 +82,32 @@ void ConsoleUI::startInteractiveMode(
         << COLOR_RESET << std::endl;
 }
 
+void ConsoleUI::setIngestionPipeline(std::shared_ptr<IngestionPipeline> pipeline) {
+    ingestion = pipeline;
+}
+
+void ConsoleUI::showNotification(const std::string& message) {
+    std::lock_guard<std::mutex> lock(outputMutex);
+
+    // Не разрываем потоковый вывод ответа
+    if (generating) {
+        deferredNotifications.push_back(message);
+        return;
+    }
+
+    std::cout << "\n" << COLOR_BLUE << message << COLOR_RESET << std::endl;
+}
+
+void ConsoleUI::flushNotifications() {
+    std::lock_guard<std::mutex> lock(outputMutex);
+
+    for (const auto& message : deferredNotifications) {
+        std::cout << COLOR_BLUE << message << COLOR_RESET << "\n";
+    }
+    deferredNotifications.clear();
+    std::cout.flush();
+}
+
 std::string ConsoleUI::getUserInput() {
     std::string input;
     std::getline(std::cin, input);
@@ -120,6 +159,29 @@ bool ConsoleUI::processCommand(const std::string& command) {
     else if (action == "stats" || action == "s") {
         std::cout << contextManager->getDocumentStats() << std::endl;
     }
+    else if (action == "recall") {
+        size_t queries = 100;
+        iss >> queries;
+        std::cout << contextManager->measureVectorRecall(queries) << std::endl;
+    }
+    else if (action == "bench") {
+        size_t queries = 100;
+        iss >> queries;
+        std::cout << contextManager->benchmarkSearch(queries) << std::endl;
+    }
+    else if (action == "verify") {
+        std::cout << contextManager->verifyIndex() << std::endl;
+    }
+    else if (action == "ef") {
+        size_t width = 0;
+        if (iss >> width && width > 0) {
+            contextManager->setVectorSearchWidth(width);
+        }
+        else {
+            std::cout << COLOR_RED << "✗ Error: Please specify a positive ef value" << COLOR_RESET << std::endl;
+            std::cout << "Usage: /ef <value>" << std::endl;
+        }
+    }
     else if (action == "config" || action == "set") {
         configureSettings();
     }
@@ -153,7 +215,11 @@ void ConsoleUI::displayHelp() {
     std::cout << "  /list, /l        - List all documents in context\n";
     std::cout << "  /stats, /s       - Show detailed document statistics\n";
     std::cout << "  /remove, /rm <name> - Remove specific document from context\n";
-    std::cout << "  /clear, /c       - Remove all documents and clear context\n\n";
+    std::cout << "  /clear, /c       - Remove all documents and clear context\n";
+    std::cout << "  /recall [n]      - Measure vector search recall@10 on n queries\n";
+    std::cout << "  /ef <value>      - Set vector search width: HNSW ef or rerank candidates\n";
+    std::cout << "  /bench [n]       - Benchmark keyword search: query terms vs BM25 ranking\n";
+    std::cout << "  /verify          - Verify persistent index checksums\n\n";
 
     std::cout << COLOR_CYAN << "Model Control:" << COLOR_RESET << "\n";
     std::cout << "  /info, /i        - Show model and system information\n";
@@ -212,6 +278,8 @@ void ConsoleUI::processQuery(const std::string& query) {
     // Показываем статистику генерации
     std::cout << "\n\n" << COLOR_YELLOW << "📊 Generation completed in "
         << duration.count() << "ms" << COLOR_RESET << std::endl;
+
+    flushNotifications();
 }
 
 void ConsoleUI::displayWelcome() {
@@ -259,6 +327,11 @@ void ConsoleUI::displaySystemStats() {
     auto docNames = contextManager->getDocumentNames();
     std::cout << COLOR_BLUE << "📚 Documents: " << docNames.size() << " loaded" << COLOR_RESET << "\n";
 
+    if (ingestion) {
+        std::cout << COLOR_BLUE << "📥 Ingest queue: " << ingestion->getPendingCount() << " file(s)"
+            << COLOR_RESET << "\n";
+    }
+
     if (!docNames.empty()) {
         for (const auto& name : docNames) {
             std::cout << "   • " << COLOR_CYAN << name << COLOR_RESET << "\n";
@@ -273,7 +346,7 @@ void ConsoleUI::displayDocumentInfo() {
 
     if (docNames.empty()) {
         std::cout << COLOR_YELLOW << "No documents currently loaded" << COLOR_RESET << std::endl;
-        std::cout << "Place PDF files in the 'documents' folder and restart the application" << std::endl;
+        std::cout << "Place PDF files in the 'documents' folder - they are picked up automatically" << std::endl;
         return;
     }
 
@@ -295,10 +368,14 @@ void ConsoleUI::configureSettings() {
 
     std::cout << "Available settings:\n";
     std::cout << "1. Max context tokens (current: affects how much document content to include)\n";
-    std::cout << "2. Max chunk size (current: how documents are split)\n";
-    std::cout << "3. Back to main menu\n\n";
-
-    std::cout << "Select option (1-3): ";
+    std::cout << "2. Max chunk size (current: " << contextManager->getMaxChunkSize() << " chars, how documents are split)\n";
+    std::cout << "3. Context compression ratio (current: " << std::fixed << std::setprecision(2)
+        << contextManager->getCompressionRatio() << ", share of context tokens kept)\n";
+    std::cout << "4. Chunk overlap (current: " << contextManager->getChunkOverlap()
+        << " tokens repeated from the previous chunk)\n";
+    std::cout << "5. Back to main menu\n\n";
+
+    std::cout << "Select option (1-5): ";
     std::string choice;
     std::getline(std::cin, choice);
 
@@ -330,7 +407,8 @@ void ConsoleUI::configureSettings() {
             size_t size = std::stoul(input);
             if (size >= 500 && size <= 2000) {
                 contextManager->setMaxChunkSize(size);
-                std::cout << COLOR_GREEN << "✓ Max chunk size set to " << size << COLOR_RESET << std::endl;
+                std::cout << COLOR_GREEN << "✓ Max chunk size set to " << size
+                    << ", loaded documents are re-chunked in the background" << COLOR_RESET << std::endl;
             }
             else {
                 std::cout << COLOR_RED << "✗ Invalid range. Use 500-2000" << COLOR_RESET << std::endl;
@@ -340,6 +418,45 @@ void ConsoleUI::configureSettings() {
             std::cout << COLOR_RED << "✗ Invalid number format" << COLOR_RESET << std::endl;
         }
     }
+    else if (choice == "3") {
+        std::cout << "Enter compression ratio (0.1-1.0, 1.0 - no compression): ";
+        std::string input;
+        std::getline(std::cin, input);
+
+        try {
+            double ratio = std::stod(input);
+            if (ratio >= 0.1 && ratio <= 1.0) {
+                contextManager->setCompressionRatio(ratio);
+                std::cout << COLOR_GREEN << "✓ Compression ratio set to " << ratio << COLOR_RESET << std::endl;
+            }
+            else {
+                std::cout << COLOR_RED << "✗ Invalid range. Use 0.1-1.0" << COLOR_RESET << std::endl;
+            }
+        }
+        catch (...) {
+            std::cout << COLOR_RED << "✗ Invalid number format" << COLOR_RESET << std::endl;
+        }
+    }
+    else if (choice == "4") {
+        std::cout << "Enter chunk overlap in tokens (0-200, 0 - no overlap): ";
+        std::string input;
+        std::getline(std::cin, input);
+
+        try {
+            size_t tokens = std::stoul(input);
+            if (tokens <= 200) {
+                contextManager->setChunkOverlap(tokens);
+                std::cout << COLOR_GREEN << "✓ Chunk overlap set to " << tokens
+                    << " tokens, loaded documents are re-chunked in the background" << COLOR_RESET << std::endl;
+            }
+            else {
+                std::cout << COLOR_RED << "✗ Invalid range. Use 0-200" << COLOR_RESET << std::endl;
+            }
+        }
+        catch (...) {
+            std::cout << COLOR_RED << "✗ Invalid number format" << COLOR_RESET << std::endl;
+        }
+    }
 }
 
 void ConsoleUI::inputMonitorThread_func() {
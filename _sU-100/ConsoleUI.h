@@ -1,4 +1,4 @@
-// ConsoleUI.h
+﻿// ConsoleUI.h
 #pragma once
 
 #include <string>
@@ -9,76 +9,91 @@
 #include <mutex>
 #include <condition_variable>
 #include <chrono>
+#include <vector>
 
-//  
+// Предварительные объявления
 class LLMInterface;
 class ContextManager;
+class IngestionPipeline;
 
 class ConsoleUI {
 public:
     ConsoleUI();
     ~ConsoleUI();
 
-    //   
+    // Запуск интерактивного режима
     void startInteractiveMode(
         std::shared_ptr<LLMInterface> llm,
         std::shared_ptr<ContextManager> contextManager
     );
 
+    // Фоновая загрузка документов: глубина очереди показывается в приглашении
+    void setIngestionPipeline(std::shared_ptr<IngestionPipeline> pipeline);
+
+    // Сообщение из фонового потока (во время генерации откладывается до ее завершения)
+    void showNotification(const std::string& message);
+
 private:
-    //  
+    // Компоненты системы
     std::shared_ptr<LLMInterface> llm;
     std::shared_ptr<ContextManager> contextManager;
+    std::shared_ptr<IngestionPipeline> ingestion;
 
-    //  
+    // Флаги состояния
     std::atomic<bool> running;
     std::atomic<bool> generating;
     std::atomic<bool> stopRequested;
 
-    // 
+    // Синхронизация
     std::mutex outputMutex;
     std::thread inputMonitorThread;
 
-    //   
+    // Сообщения, отложенные на время генерации
+    std::vector<std::string> deferredNotifications;
+
+    // Вывод отложенных сообщений
+    void flushNotifications();
+
+    // Получение ввода пользователя
     std::string getUserInput();
 
-    //  
+    // Обработка команд
     bool processCommand(const std::string& command);
 
-    //  
+    // Отображение справки
     void displayHelp();
 
-    //    LLM
+    // Обработка запроса к LLM
     void processQuery(const std::string& query);
 
-    //  
+    // Отображение приветствия
     void displayWelcome();
 
-    //   
+    // Отображение статистики системы
     void displaySystemStats();
 
-    //    
+    // Отображение информации о документах
     void displayDocumentInfo();
 
-    //  
+    // Настройка параметров
     void configureSettings();
 
-    //       
+    // Поток для мониторинга ввода во время генерации
     void inputMonitorThread_func();
 
-    // Callback   
+    // Callback для потоковой генерации
     void streamCallback(const std::string& chunk);
 
-    //   
+    // Форматированный вывод времени
     std::string getCurrentTimeString();
 
-    //    
+    // Форматирование текста для вывода
     std::string formatOutput(const std::string& text, const std::string& prefix = "");
 
-    //  
+    // Отображение прогресса
     void showProgress(const std::string& message);
 
-    //    (ANSI    )
+    // Цвета и форматирование (ANSI коды для поддерживающих терминалов)
     static const std::string COLOR_RESET;
     static const std::string COLOR_BOLD;
     static const std::string COLOR_GREEN;
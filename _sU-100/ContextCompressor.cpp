@@ -0,0 +1,93 @@
+﻿// ContextCompressor.cpp
+#include "ContextCompressor.h"
+#include <algorithm>
+#include <numeric>
+
+std::vector<bool> ContextCompressor::selectSentences(const std::vector<Sentence>& sentences, double ratio) {
+    std::vector<bool> kept(sentences.size(), ratio >= 1.0);
+    if (ratio >= 1.0 || sentences.empty()) {
+        return kept;
+    }
+
+    size_t total = 0;
+    for (const auto& sentence : sentences) {
+        total += sentence.tokens;
+    }
+    const size_t target = static_cast<size_t>(total * std::max(ratio, 0.0) + 0.5);
+
+    // По убыванию оценки, при равенстве - по порядку в тексте
+    std::vector<size_t> order(sentences.size());
+    std::iota(order.begin(), order.end(), size_t(0));
+    std::stable_sort(order.begin(), order.end(), [&sentences](size_t a, size_t b) {
+        return sentences[a].score > sentences[b].score;
+    });
+
+    size_t keptTokens = 0;
+    auto keep = [&](size_t index) {
+        for (size_t i = index > 0 ? index - 1 : 0; i <= index + 1 && i < sentences.size(); ++i) {
+            if (!kept[i] && sentences[i].block == sentences[index].block) {
+                kept[i] = true;
+                keptTokens += sentences[i].tokens;
+            }
+        }
+    };
+
+    // Блок выбран упаковкой по релевантности, поэтому в нем остается хотя бы лучшее предложение
+    std::vector<bool> seeded;
+    for (size_t index : order) {
+        const size_t block = sentences[index].block;
+        if (block >= seeded.size()) {
+            seeded.resize(block + 1, false);
+        }
+        if (!seeded[block]) {
+            seeded[block] = true;
+            keep(index);
+        }
+    }
+
+    for (size_t index : order) {
+        if (keptTokens >= target) {
+            break;
+        }
+        if (!kept[index] && sentences[index].score > 0.0f) {
+            keep(index);
+        }
+    }
+    return kept;
+}
+
+std::string ContextCompressor::joinSentences(const std::vector<Sentence>& sentences, const std::vector<bool>& kept,
+    size_t block, size_t& gaps) {
+    std::string result;
+    gaps = 0;
+
+    bool skipped = false;
+    const char* runEnd = nullptr;
+    for (size_t i = 0; i < sentences.size(); ++i) {
+        const Sentence& sentence = sentences[i];
+        if (sentence.block != block) {
+            continue;
+        }
+        if (!kept[i]) {
+            skipped = true;
+            continue;
+        }
+
+        if (skipped) {
+            result += result.empty() ? "... " : " ... ";
+            gaps++;
+            skipped = false;
+        } else if (runEnd) {
+            // Соседние предложения - вместе с разделителем исходного текста
+            result.append(runEnd, sentence.text.data() - runEnd);
+        }
+        result += sentence.text;
+        runEnd = sentence.text.data() + sentence.text.size();
+    }
+
+    if (skipped && !result.empty()) {
+        result += " ...";
+        gaps++;
+    }
+    return result;
+}
@@ -0,0 +1,31 @@
+﻿// ContextCompressor.h
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Извлекающее сжатие контекста: из выбранных чанков остаются предложения, полезные для вопроса,
+// и их соседи (связность текста), остальные заменяются многоточием. Предложения оценивает
+// вызывающий (по терминам запроса или эмбеддингам, предложения - TextChunker::splitSentences),
+// здесь - выбор лучших под заданную долю токенов
+class ContextCompressor {
+public:
+    // Предложение блока контекста
+    struct Sentence {
+        size_t block;            // номер блока
+        std::string_view text;   // часть текста блока
+        size_t tokens = 0;
+        float score = 0.0f;      // полезность для вопроса (больше - полезнее)
+    };
+
+    // Выбор предложений: сначала лучшее предложение каждого блока, затем лучшие по оценке,
+    // каждое - вместе с соседями в своем блоке, пока не набрано ratio токенов всех предложений.
+    // Результат - отметка оставленных предложений
+    static std::vector<bool> selectSentences(const std::vector<Sentence>& sentences, double ratio);
+
+    // Текст блока из оставленных предложений: подряд идущие - как в исходном тексте,
+    // пропуски - многоточием. gaps - число пропусков
+    static std::string joinSentences(const std::vector<Sentence>& sentences, const std::vector<bool>& kept,
+        size_t block, size_t& gaps);
+};
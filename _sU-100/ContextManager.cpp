@@ -1,406 +1,2472 @@
 ﻿// ContextManager.cpp
 #include "ContextManager.h"
+#include "TextChunker.h"
+#include "EmbeddingModel.h"
+#include "ThreadPool.h"
+#include "QuantizedIndex.h"
+#include "ExtractionCache.h"
+#include "VectorKernels.h"
 #include <iostream>
 #include <sstream>
 #include <algorithm>
 #include <cctype>
-#include <unordered_set>
+#include <unordered_map>
+#include <set>
 #include <cmath>
 #include <ctime>
 #include <iomanip>
+#include <chrono>
+#include <future>
+#include <condition_variable>
+#include <random>
+#include <filesystem>
 #pragma warning(disable:4996)
 
+namespace {
+    // Минимальное число лучших чанков для поиска
+    constexpr size_t MIN_TOP_K = 10;
+
+    // Сглаживание рангов при объединении результатов (RRF): 1 / (RRF_K + ранг)
+    constexpr float RRF_K = 60.0f;
+
+    // Объем сегментов в памяти, после которого они записываются на диск
+    constexpr uint64_t FLUSH_SEGMENT_BYTES = 64ull * 1024 * 1024;
+
+    // Слияние: больше MAX_SEGMENTS сегментов одного уровня - сливаются MERGE_FACTOR самых маленьких;
+    // сегмент, где удалено больше половины чанков, переписывается
+    constexpr size_t MAX_SEGMENTS = 8;
+    constexpr size_t MERGE_FACTOR = 4;
+
+    // Чанков сегмента на задачу векторизации: большой сегмент векторизуется всеми потоками
+    constexpr uint32_t EMBEDDING_SLICE = 64;
+
+    // Сжатие контекста: больше MAX_EMBEDDED_SENTENCES предложений оцениваются только по терминам
+    constexpr size_t MAX_EMBEDDED_SENTENCES = 256;
+
+    // Параллельный поиск: коллекция меньше PARALLEL_MIN_CHUNKS чанков ранжируется в потоке запроса,
+    // иначе сегменты делятся на части не меньше PARTITION_MIN_CHUNKS чанков
+    constexpr size_t PARALLEL_MIN_CHUNKS = 32768;
+    constexpr uint32_t PARTITION_MIN_CHUNKS = 8192;
+
+    // Часть коллекции для поиска: диапазон чанков сегмента
+    struct SearchPartition {
+        size_t segment;
+        uint32_t firstChunk;
+        uint32_t endChunk;
+    };
+
+    // Общее состояние поиска по частям. Задачи пула держат его через shared_ptr: задача, до которой
+    // очередь дошла уже после ответа на запрос, не находит свободных частей и завершается
+    struct PartitionedSearch {
+        std::shared_ptr<const CompiledQuery> query;
+        size_t topK = 0;
+        std::vector<SearchPartition> partitions;
+        std::atomic<size_t> nextPartition{ 0 };
+
+        // Результаты потоков
+        std::mutex mtx;
+        std::condition_variable finished;
+        size_t finishedPartitions = 0;
+        std::vector<InvertedIndex::Hit> hits;
+        InvertedIndex::SearchStats stats;
+    };
+
+    // Лучшие topK чанков: по убыванию оценки, при равенстве - по идентификатору
+    void keepTop(std::vector<InvertedIndex::Hit>& hits, size_t topK) {
+        std::sort(hits.begin(), hits.end(), [](const InvertedIndex::Hit& a, const InvertedIndex::Hit& b) {
+            return a.score != b.score ? a.score > b.score : a.chunkId < b.chunkId;
+        });
+        if (hits.size() > topK) {
+            hits.resize(topK);
+        }
+    }
+
+    // Ранжирование свободных частей, пока они есть; лучшие чанки потока добавляются к общим в конце
+    void searchPartitions(PartitionedSearch& search) {
+        std::vector<InvertedIndex::Hit> local;
+        InvertedIndex::SearchStats localStats;
+        size_t done = 0;
+
+        for (size_t i = search.nextPartition++; i < search.partitions.size(); i = search.nextPartition++) {
+            const SearchPartition& part = search.partitions[i];
+            const IndexSegment& segment = *search.query->segments[part.segment];
+
+            InvertedIndex::SearchStats partStats;
+            for (auto hit : segment.search(search.query->queries[part.segment], search.query->collection, search.topK,
+                &partStats, part.firstChunk, part.endChunk)) {
+                local.push_back({ segment.getChunkId(hit.chunkId), hit.score });
+            }
+            if (local.size() > 2 * search.topK) {
+                keepTop(local, search.topK);
+            }
+
+            localStats.postingsTotal += partStats.postingsTotal;
+            localStats.postingsScored += partStats.postingsScored;
+            localStats.candidates += partStats.candidates;
+            ++done;
+        }
+
+        if (done == 0) {
+            return;
+        }
+        keepTop(local, search.topK);
+
+        std::lock_guard<std::mutex> lock(search.mtx);
+        search.hits.insert(search.hits.end(), local.begin(), local.end());
+        search.stats.postingsTotal += localStats.postingsTotal;
+        search.stats.postingsScored += localStats.postingsScored;
+        search.stats.candidates += localStats.candidates;
+        search.stats.threads++;
+        search.finishedPartitions += done;
+        if (search.finishedPartitions == search.partitions.size()) {
+            search.finished.notify_all();
+        }
+    }
+
+    // Общее состояние векторизации предложений при сжатии контекста, как у поиска по частям:
+    // задача пула, до которой очередь дошла уже после ответа, не находит свободных предложений
+    struct SentenceEmbedding {
+        std::shared_ptr<EmbeddingModel> model;
+        std::vector<std::string> texts;
+        std::vector<std::vector<float>> embeddings;
+        std::atomic<size_t> nextSentence{ 0 };
+
+        std::mutex mtx;
+        std::condition_variable finished;
+        size_t finishedSentences = 0;
+    };
+
+    // Векторизация свободных предложений, пока они есть
+    void embedSentences(SentenceEmbedding& work) {
+        size_t done = 0;
+        for (size_t i = work.nextSentence++; i < work.texts.size(); i = work.nextSentence++) {
+            work.model->embed(work.texts[i], work.embeddings[i]);
+            ++done;
+        }
+
+        if (done == 0) {
+            return;
+        }
+        std::lock_guard<std::mutex> lock(work.mtx);
+        work.finishedSentences += done;
+        if (work.finishedSentences == work.texts.size()) {
+            work.finished.notify_all();
+        }
+    }
+
+    // Емкость кэша контекста по умолчанию
+    constexpr size_t QUERY_CACHE_BYTES = 16 * 1024 * 1024;
+
+    double elapsedMs(std::chrono::steady_clock::time_point start) {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    // Описание части документа для сегмента. Отпечаток исходного файла есть только у завершающей
+    // части: документ, загрузка которого прервалась, при следующем запуске загружается заново
+    IndexSegment::DocumentInfo describePart(const Document& doc, bool final) {
+        IndexSegment::DocumentInfo info;
+        info.name = doc.name;
+        info.ocrProfile = doc.ocrProfile;
+        info.originalSize = doc.originalSize;
+        info.addedTime = static_cast<int64_t>(doc.addedTime);
+        info.sourceStamp = final ? doc.sourceStamp : 0;
+        info.chunkSize = static_cast<uint32_t>(doc.chunkSize);
+        info.chunkOverlap = static_cast<uint32_t>(doc.chunkOverlap);
+        return info;
+    }
+
+    // Все документы сегмента удалены
+    bool isEmpty(const IndexSegment& segment) {
+        return segment.getRemovedDocuments().size() == segment.getDocumentCount();
+    }
+
+    // Источники группы почти дубликатов, кроме source: до MAX_DUPLICATE_SOURCES имен документов
+    // и число остальных. Большие группы (колонтитул на каждой странице) просматриваются не целиком
+    std::string describeDuplicateSources(const IndexSnapshot& current,
+        const std::vector<InvertedIndex::ChunkId>& group, std::string_view source) {
+        constexpr size_t MAX_DUPLICATE_SOURCES = 3;
+        constexpr size_t MAX_GROUP_SCAN = 100;
+
+        std::vector<std::string_view> names;
+        for (size_t i = 0; i < group.size() && i < MAX_GROUP_SCAN; ++i) {
+            for (const auto& segment : current.segments) {
+                uint32_t chunk;
+                if (!segment->findChunk(group[i], chunk)) {
+                    continue;
+                }
+                std::string_view name = segment->getDocumentName(segment->getChunkDocument(chunk));
+                if (name != source && std::find(names.begin(), names.end(), name) == names.end()) {
+                    names.push_back(name);
+                }
+                break;
+            }
+        }
+
+        std::string result;
+        for (size_t i = 0; i < names.size() && i < MAX_DUPLICATE_SOURCES; ++i) {
+            result += (i > 0 ? ", " : "") + std::string(names[i]);
+        }
+        if (names.size() > MAX_DUPLICATE_SOURCES) {
+            result += " and " + std::to_string(names.size() - MAX_DUPLICATE_SOURCES) + " more";
+        }
+        return result;
+    }
+
+    // Кандидат в контекст: чанк, его релевантность и токены текста и заголовка блока
+    struct ContextCandidate {
+        const IndexSegment* segment = nullptr;
+        uint32_t chunk = 0;
+        uint32_t document = 0;
+        float relevance = 0.0f;
+        size_t tokens = 0;
+        size_t headerTokens = 0;
+        std::string otherSources;       // другие документы с почти тем же текстом
+    };
+
+    // Блок контекста: подряд идущие чанки одного документа под одним заголовком
+    struct ContextBlock {
+        std::vector<size_t> members;    // номера кандидатов по порядку чанков
+        float relevance = 0.0f;         // лучшая релевантность блока
+        std::string otherSources;
+    };
+
+    // Страницы блока контекста: ", p. 3", ", pp. 3-4" (пусто - текст без разметки страниц)
+    std::string describePages(uint32_t firstPage, uint32_t lastPage) {
+        if (firstPage == 0) {
+            return "";
+        }
+        if (lastPage <= firstPage) {
+            return ", p. " + std::to_string(firstPage);
+        }
+        return ", pp. " + std::to_string(firstPage) + "-" + std::to_string(lastPage);
+    }
+
+    std::string formatContextHeader(std::string_view source, const std::string& pages, float relevance,
+        const std::string& otherSources) {
+        std::ostringstream header;
+        header << "Document: " << source << pages << " (relevance: " << std::fixed << std::setprecision(2) << relevance
+            << (otherSources.empty() ? "" : "; also in: " + otherSources) << ")";
+        return header.str();
+    }
+
+    // Задача о рюкзаке 0/1: наибольшая сумма values при сумме weights не больше budget (динамика
+    // по весу). Большой бюджет считается в единицах по step токенов с округлением весов вверх,
+    // поэтому выбранный набор всегда помещается
+    std::vector<bool> selectByKnapsack(const std::vector<size_t>& weights, const std::vector<float>& values,
+        size_t budget) {
+        constexpr size_t MAX_CAPACITY = 4096;
+
+        const size_t count = weights.size();
+        std::vector<bool> selected(count, false);
+        if (budget == 0) {
+            return selected;
+        }
+
+        const size_t step = (budget + MAX_CAPACITY - 1) / MAX_CAPACITY;
+        const size_t capacity = budget / step;
+
+        std::vector<float> best(capacity + 1, 0.0f);
+        std::vector<std::vector<bool>> taken(count, std::vector<bool>(capacity + 1, false));
+        for (size_t i = 0; i < count; ++i) {
+            const size_t weight = (weights[i] + step - 1) / step;
+            if (weight > capacity) {
+                continue;
+            }
+            for (size_t c = capacity; c >= weight && c > 0; --c) {
+                if (best[c - weight] + values[i] > best[c]) {
+                    best[c] = best[c - weight] + values[i];
+                    taken[i][c] = true;
+                }
+            }
+        }
+
+        // Восстановление набора от последнего кандидата к первому
+        size_t c = capacity;
+        for (size_t i = count; i-- > 0;) {
+            if (taken[i][c]) {
+                selected[i] = true;
+                c -= (weights[i] + step - 1) / step;
+            }
+        }
+        return selected;
+    }
+
+    // Байты начала чанка candidate, повторяющие конец предыдущего чанка блока (перекрытие чанков)
+    size_t overlapWithPrevious(const ContextCandidate& previous, const ContextCandidate& candidate) {
+        const uint64_t previousOffset = previous.segment->getChunkSource(previous.chunk).offset;
+        const uint64_t previousEnd = previousOffset + previous.segment->getChunk(previous.chunk).size();
+        const uint64_t offset = candidate.segment->getChunkSource(candidate.chunk).offset;
+        if (offset <= previousOffset || offset >= previousEnd) {
+            return 0;
+        }
+        return static_cast<size_t>(std::min<uint64_t>(previousEnd - offset,
+            candidate.segment->getChunk(candidate.chunk).size()));
+    }
+
+    // Блоки контекста, собираемые по одному кандидату. Кандидат меняет только блоки соседних
+    // чанков своего документа, поэтому токены добавления считаются по ним, а не по всему контексту
+    class ContextBlockSet {
+    public:
+        // headerTokens - токены заголовка блока, memberTokens(previous, next) - токены чанка next
+        // без перекрытия с чанком previous
+        ContextBlockSet(const std::vector<ContextCandidate>& candidates,
+            std::function<size_t(const ContextBlock&)> headerTokens,
+            std::function<size_t(size_t previous, size_t next)> memberTokens)
+            : candidates(candidates), headerTokens(std::move(headerTokens)), memberTokens(std::move(memberTokens)),
+            blockOf(candidates.size(), NONE), tokensOf(candidates.size(), 0), total(0) {
+        }
+
+        // Токены контекста после добавления кандидата index
+        size_t tokensWith(size_t index) {
+            plan(index);
+            return planned.total;
+        }
+
+        // Добавление кандидата index (после tokensWith того же кандидата план уже готов)
+        void add(size_t index) {
+            if (planned.index != index) {
+                plan(index);
+            }
+
+            size_t target = blocks.size();
+            if (planned.previous != NONE) {
+                target = blockOf[planned.previous];
+            } else if (planned.next != NONE) {
+                target = blockOf[planned.next];
+            } else {
+                blocks.emplace_back();
+                blockHeaderTokens.push_back(0);
+            }
+            if (planned.previous != NONE && planned.next != NONE) {
+                const size_t absorbed = blockOf[planned.next];
+                blocks[absorbed] = ContextBlock();
+                blockHeaderTokens[absorbed] = 0;
+            }
+
+            for (size_t member : planned.block.members) {
+                blockOf[member] = target;
+            }
+            blocks[target] = std::move(planned.block);
+            blockHeaderTokens[target] = planned.headerTokens;
+            tokensOf[index] = planned.ownTokens;
+            if (planned.next != NONE) {
+                tokensOf[planned.next] = planned.nextTokens;
+            }
+
+            const ContextCandidate& candidate = candidates[index];
+            positions[{ candidate.segment, candidate.chunk }] = index;
+            total = planned.total;
+            planned = Plan();
+        }
+
+        size_t getTokens() const {
+            return total;
+        }
+
+        // Блоки по убыванию релевантности (при равной - по документу и порядку чанков)
+        std::vector<ContextBlock> getBlocks() const {
+            std::vector<ContextBlock> result;
+            for (const auto& block : blocks) {
+                if (!block.members.empty()) {
+                    result.push_back(block);
+                }
+            }
+            std::sort(result.begin(), result.end(), [this](const ContextBlock& a, const ContextBlock& b) {
+                const ContextCandidate& x = candidates[a.members.front()];
+                const ContextCandidate& y = candidates[b.members.front()];
+                return x.segment != y.segment ? std::less<const IndexSegment*>()(x.segment, y.segment) : x.chunk < y.chunk;
+            });
+            std::stable_sort(result.begin(), result.end(), [](const ContextBlock& a, const ContextBlock& b) {
+                return a.relevance > b.relevance;
+            });
+            return result;
+        }
+
+    private:
+        static constexpr size_t NONE = static_cast<size_t>(-1);
+
+        // Добавление кандидата: соседние выбранные чанки, блок после объединения и его токены
+        struct Plan {
+            size_t index = NONE;
+            size_t previous = NONE;
+            size_t next = NONE;
+            ContextBlock block;
+            size_t headerTokens = 0;
+            size_t ownTokens = 0;
+            size_t nextTokens = 0;
+            size_t total = 0;
+        };
+
+        const std::vector<ContextCandidate>& candidates;
+        std::function<size_t(const ContextBlock&)> headerTokens;
+        std::function<size_t(size_t, size_t)> memberTokens;
+
+        std::vector<ContextBlock> blocks;           // объединенные блоки остаются пустыми
+        std::vector<size_t> blockHeaderTokens;
+        std::vector<size_t> blockOf;                // блок выбранного кандидата
+        std::vector<size_t> tokensOf;               // токены выбранного кандидата в его блоке и перевод строки
+        std::map<std::pair<const IndexSegment*, uint32_t>, size_t> positions;
+        size_t total;
+        Plan planned;
+
+        // Выбранный кандидат с чанком chunk того же документа, что и candidate
+        size_t find(const ContextCandidate& candidate, uint32_t chunk) const {
+            auto it = positions.find({ candidate.segment, chunk });
+            if (it == positions.end() || candidates[it->second].document != candidate.document) {
+                return NONE;
+            }
+            return it->second;
+        }
+
+        void plan(size_t index) {
+            const ContextCandidate& candidate = candidates[index];
+            planned = Plan();
+            planned.index = index;
+            planned.previous = candidate.chunk > 0 ? find(candidate, candidate.chunk - 1) : NONE;
+            planned.next = find(candidate, candidate.chunk + 1);
+
+            std::vector<size_t> members;
+            if (planned.previous != NONE) {
+                members = blocks[blockOf[planned.previous]].members;
+            }
+            members.push_back(index);
+            if (planned.next != NONE) {
+                const auto& following = blocks[blockOf[planned.next]].members;
+                members.insert(members.end(), following.begin(), following.end());
+            }
+
+            for (size_t member : members) {
+                const ContextCandidate& other = candidates[member];
+                planned.block.relevance = std::max(planned.block.relevance, other.relevance);
+                if (!other.otherSources.empty() && planned.block.otherSources.find(other.otherSources) == std::string::npos) {
+                    planned.block.otherSources += (planned.block.otherSources.empty() ? "" : ", ") + other.otherSources;
+                }
+            }
+            planned.block.members = std::move(members);
+
+            // Одиночный чанк - заголовок уже посчитан у кандидата; текст чанка и перевод строки после него
+            const bool single = planned.previous == NONE && planned.next == NONE;
+            planned.headerTokens = single ? candidate.headerTokens : headerTokens(planned.block);
+            planned.ownTokens = (planned.previous != NONE ? memberTokens(planned.previous, index) : candidate.tokens) + 1;
+
+            size_t replaced = 0;
+            if (planned.previous != NONE) {
+                replaced += blockHeaderTokens[blockOf[planned.previous]];
+            }
+            if (planned.next != NONE) {
+                planned.nextTokens = memberTokens(index, planned.next) + 1;
+                replaced += blockHeaderTokens[blockOf[planned.next]] + tokensOf[planned.next];
+            }
+            planned.total = total - replaced + planned.headerTokens + planned.ownTokens + planned.nextTokens;
+        }
+    };
+}
+
 ContextManager::ContextManager(size_t maxContextTokens, size_t maxChunkSize)
-    : maxContextTokens(maxContextTokens), maxChunkSize(maxChunkSize) {
+    : maxContextTokens(maxContextTokens), maxChunkSize(maxChunkSize), chunkOverlap(0),
+    snapshot(std::make_shared<const IndexSnapshot>()), nextChunkId(0), compressionRatio(1.0),
+    queryCache(QUERY_CACHE_BYTES),
+    flushQueued(false), mergeQueued(false), rechunkQueued(false), embeddingModelTag(0),
+    pendingEmbeddings(0), stopping(false),
+    queryCount(0), totalQueryMs(0.0), lastQueryMs(0.0), postingsTotal(0), postingsScored(0), totalVectorMs(0.0),
+    totalCompileMs(0.0), parallelQueries(0), compressedQueries(0), tokensBeforeCompression(0),
+    tokensAfterCompression(0), totalPrefillMsSaved(0.0), cacheLookups(0), cacheHits(0), totalCacheMsSaved(0.0),
+    maintenanceWorker(std::make_unique<ThreadPool>(1)) {
     std::cout << "ContextManager initialized: max " << maxContextTokens
         << " tokens, chunk size " << maxChunkSize << " chars" << std::endl;
 }
 
-void ContextManager::addDocument(const std::string& docName, const std::string& content) {
-    std::lock_guard<std::mutex> lock(mtx);
+ContextManager::~ContextManager() {
+    // Оставшиеся в очереди чанки не векторизуются, начатая запись сегмента дописывается,
+    // слияния не начинаются. Флаг ставится под блокировкой записи: после этого поток
+    // обслуживания уже не ставит себе новых задач
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        stopping = true;
+    }
+    maintenanceWorker.reset();
+    embeddingWorkers.reset();
+}
+
+std::shared_ptr<VectorIndex> ContextManager::createVectorIndex(size_t dimension) const {
+    if (vectorConfig.storage == VectorStorage::Float) {
+        return std::make_shared<HNSWIndex>(dimension, vectorConfig.hnsw);
+    }
+    return std::make_shared<QuantizedIndex>(dimension, vectorConfig.storage, vectorConfig.vectorDirectory,
+        vectorConfig.rerankCandidates);
+}
+
+void ContextManager::setEmbeddingModel(std::shared_ptr<EmbeddingModel> model, const VectorSearchConfig& config,
+    size_t threads) {
+    // Прежние потоки останавливаются после снятия блокировки
+    std::unique_ptr<ThreadPool> previousWorkers;
+    std::lock_guard<std::mutex> lock(mtx);
+
+    previousWorkers = std::move(embeddingWorkers);
+    vectorConfig = config;
+    embeddingWorkers = std::make_unique<ThreadPool>(threads > 0 ? threads : model->getContextCount());
+
+    // Сохраненные в сегментах векторы годятся только для той же модели
+    const std::string modelInfo = model->getModelInfo();
+    embeddingModelTag = ExtractionCache::hashBytes(modelInfo.data(), modelInfo.size());
+
+    auto next = std::make_shared<IndexSnapshot>(*snapshot.load());
+    next->embeddingModel = model;
+    next->vectorIndex = createVectorIndex(model->getDimension());
+    publish(next);
+
+    // Уже загруженные документы тоже попадают в граф
+    for (const auto& segment : next->segments) {
+        enqueueEmbeddings(*next, segment);
+    }
+
+    std::cout << "✓ Vector search enabled: " << next->vectorIndex->describe() << ", search width "
+        << next->vectorIndex->getSearchWidth() << ", " << embeddingWorkers->size() << " embedding thread(s)" << std::endl;
+}
+
+void ContextManager::setThreadPool(std::shared_ptr<ThreadPool> pool) {
+    searchWorkers = std::move(pool);
+}
+
+void ContextManager::setTokenizer(const std::string& modelInfo, std::function<size_t(std::string_view)> count) {
+    std::lock_guard<std::mutex> lock(mtx);
+    tokenizer.tag = ExtractionCache::hashBytes(modelInfo.data(), modelInfo.size());
+    tokenizer.count = [count](std::string_view text) { return static_cast<uint32_t>(count(text)); };
+}
+
+void ContextManager::setPrefillRate(std::function<double()> tokensPerSecond) {
+    std::lock_guard<std::mutex> lock(mtx);
+    prefillRate = std::move(tokensPerSecond);
+}
+
+void ContextManager::setCompressionRatio(double ratio) {
+    compressionRatio = std::clamp(ratio, 0.1, 1.0);
+    queryCache.clear();
+    std::cout << "Context compression ratio set to: " << std::fixed << std::setprecision(2) << compressionRatio.load()
+        << (compressionRatio >= 1.0 ? " (off)" : "") << std::endl;
+}
+
+double ContextManager::getCompressionRatio() const {
+    return compressionRatio;
+}
+
+void ContextManager::setVectorSearchWidth(size_t width) {
+    std::lock_guard<std::mutex> lock(mtx);
+
+    vectorConfig.hnsw.efSearch = width;
+    vectorConfig.rerankCandidates = width;
+    std::shared_ptr<VectorIndex> index = snapshot.load()->vectorIndex;
+    if (index) {
+        index->setSearchWidth(width);
+    }
+    queryCache.clear();
+    std::cout << "Vector search width set to: " << width << std::endl;
+}
+
+std::string ContextManager::measureVectorRecall(size_t queries, size_t k) {
+    std::shared_ptr<VectorIndex> index = snapshot.load()->vectorIndex;
+
+    if (!index) {
+        return "Vector search is disabled (no embedding model)";
+    }
+
+    // Точный перебор медленный, но идет по снимку и не мешает поиску и загрузке
+    RecallStats stats = index->measureRecall(queries, k);
+    if (stats.queries == 0) {
+        return "Vector index is empty";
+    }
+
+    std::stringstream ss;
+    ss << "Recall@" << k << " vs float32: " << std::fixed << std::setprecision(3) << stats.recall
+        << " over " << stats.queries << " queries (" << index->size() << " vectors, " << index->describe()
+        << ", search width " << index->getSearchWidth() << ")\nSearch: " << std::setprecision(3) << stats.searchMs
+        << " ms, exact search: " << stats.exactMs << " ms";
+    return ss.str();
+}
+
+std::string ContextManager::benchmarkSearch(size_t queries) {
+    std::shared_ptr<const IndexSnapshot> current = snapshot.load();
+
+    uint64_t chunkCount = 0;
+    for (const auto& segment : current->segments) {
+        chunkCount += segment->getChunkCount();
+    }
+    if (chunkCount == 0 || queries == 0) {
+        return "Index is empty";
+    }
+
+    // Запросы - по три термина из случайных неудаленных чанков (генератор с постоянным зерном:
+    // прогоны сравнимы между собой)
+    std::mt19937_64 random(42);
+    std::vector<std::string> texts;
+    std::string buffer;
+    std::vector<std::string_view> terms;
+    for (size_t attempt = 0; texts.size() < queries && attempt < queries * 10; ++attempt) {
+        uint64_t position = random() % chunkCount;
+        const IndexSegment* segment = nullptr;
+        for (const auto& candidate : current->segments) {
+            if (position < candidate->getChunkCount()) {
+                segment = candidate.get();
+                break;
+            }
+            position -= candidate->getChunkCount();
+        }
+
+        const uint32_t chunk = static_cast<uint32_t>(position);
+        if (segment->isChunkRemoved(chunk)) {
+            continue;
+        }
+
+        analyzer.analyze(segment->getChunk(chunk), buffer, terms);
+        if (terms.empty()) {
+            continue;
+        }
+
+        std::string text;
+        for (int i = 0; i < 3; ++i) {
+            text += (i > 0 ? " " : "");
+            text += terms[random() % terms.size()];
+        }
+        texts.push_back(std::move(text));
+    }
+
+    if (texts.empty()) {
+        return "Index has no searchable chunks";
+    }
+
+    // Разбор всех запросов, затем ранжирование по уже разобранным
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::shared_ptr<const CompiledQuery>> compiled;
+    compiled.reserve(texts.size());
+    for (const auto& text : texts) {
+        compiled.push_back(compileQuery(*current, text));
+    }
+    const double compileMs = elapsedMs(start);
+
+    start = std::chrono::steady_clock::now();
+    const size_t topK = getTopK();
+    InvertedIndex::SearchStats total;
+    for (const auto& query : compiled) {
+        InvertedIndex::SearchStats stats;
+        searchLexical(query, topK, stats);
+        total.postingsTotal += stats.postingsTotal;
+        total.postingsScored += stats.postingsScored;
+    }
+    const double searchMs = elapsedMs(start);
+
+    const double count = static_cast<double>(texts.size());
+    std::stringstream ss;
+    ss << "Search benchmark: " << texts.size() << " queries, " << chunkCount << " chunks in "
+        << current->segments.size() << " segment(s), top " << topK << "\n"
+        << "Query terms (analysis, dictionary lookup, idf): " << std::fixed << std::setprecision(3)
+        << (compileMs / count) << " ms per query\n"
+        << "BM25 ranking: " << (searchMs / count) << " ms per query, "
+        << (total.postingsScored / texts.size()) << "/" << (total.postingsTotal / texts.size())
+        << " postings scored per query";
+    return ss.str();
+}
+
+bool ContextManager::isChunkLive(const std::shared_ptr<VectorIndex>& index, InvertedIndex::ChunkId chunkId) const {
+    std::shared_ptr<const IndexSnapshot> current = snapshot.load();
+    const IndexSegment* segment;
+    uint32_t chunk;
+    return current->vectorIndex == index && findChunk(*current, chunkId, segment, chunk);
+}
+
+void ContextManager::enqueueEmbeddings(const IndexSnapshot& current, const std::shared_ptr<const IndexSegment>& segment) {
+    std::shared_ptr<EmbeddingModel> model = current.embeddingModel;
+    std::shared_ptr<VectorIndex> index = current.vectorIndex;
+    if (!model || !index || !embeddingWorkers) {
+        return;
+    }
+
+    // Векторы, сохраненные той же моделью, вставляются без векторизации; сегмент удерживается
+    // задачей, поэтому текст читается из него без блокировки
+    const bool stored = segment->getDimension() == index->getDimension() &&
+        segment->getEmbeddingModel() == embeddingModelTag;
+    const uint32_t chunkCount = static_cast<uint32_t>(segment->getChunkCount());
+
+    for (uint32_t first = 0; first < chunkCount; first += EMBEDDING_SLICE) {
+        const uint32_t last = std::min(chunkCount, first + EMBEDDING_SLICE);
+        pendingEmbeddings += last - first;
+
+        embeddingWorkers->submit([this, model, index, segment, stored, first, last]() {
+            std::vector<float> embedding;
+            for (uint32_t chunk = first; chunk < last; ++chunk) {
+                const InvertedIndex::ChunkId chunkId = segment->getChunkId(chunk);
+
+                bool inserted = false;
+                if (!stopping && isChunkLive(index, chunkId)) {
+                    const float* vector = stored ? segment->getEmbedding(chunk) : nullptr;
+                    if (vector) {
+                        index->insert(chunkId, std::vector<float>(vector, vector + index->getDimension()));
+                        inserted = true;
+                    }
+                    else if (model->embed(std::string(segment->getChunk(chunk)), embedding)) {
+                        index->insert(chunkId, embedding);
+                        inserted = true;
+                    }
+                }
+
+                // Документ могли удалить или заменить, пока чанк векторизовался: удаление
+                // сначала публикует снимок, потом убирает векторы, поэтому одна из проверок это увидит
+                if (inserted && !isChunkLive(index, chunkId)) {
+                    index->remove(chunkId);
+                }
+                pendingEmbeddings--;
+            }
+        });
+    }
+}
+
+void ContextManager::publish(std::shared_ptr<IndexSnapshot> next) {
+    next->generation = snapshot.load()->generation + 1;
+    snapshot.store(std::move(next));
+}
+
+std::shared_ptr<const IndexSegment> ContextManager::buildSegment(const IndexSegment::DocumentInfo& info,
+    const ChunkList& chunks) {
+    IndexSegment::DocumentData data;
+    data.info = info;
+
+    const InvertedIndex::ChunkId firstId = nextChunkId.fetch_add(static_cast<InvertedIndex::ChunkId>(chunks.size()));
+    for (size_t i = 0; i < chunks.size(); ++i) {
+        data.chunks.push_back(chunks[i]);
+        data.chunkIds.push_back(firstId + static_cast<InvertedIndex::ChunkId>(i));
+        data.sources.push_back(chunks.getSource(i));
+    }
+
+    // Векторы в сегменте в памяти не хранятся: они в векторном индексе и попадут на диск при записи
+    std::string error;
+    std::shared_ptr<const IndexSegment> segment = IndexSegment::write("", { data }, analyzer, 0, 0, nullptr,
+        tokenizer, error);
+    if (!segment) {
+        std::cout << "✗ " << error << std::endl;
+    }
+    return segment;
+}
+
+bool ContextManager::publishSegment(const std::shared_ptr<Document>& doc, std::shared_ptr<const IndexSegment> segment) {
+    auto it = documents.find(doc->name);
+    if (!segment || it == documents.end() || it->second != doc) {
+        return false;
+    }
+
+    // Отпечатки - до публикации: запрос к новому снимку (и его запись в кэше) уже видит группы
+    // почти дубликатов с чанками сегмента
+    doc->duplicateChunks += indexDuplicates(*segment);
+
+    auto next = std::make_shared<IndexSnapshot>(*snapshot.load());
+    next->segments.push_back(segment);
+    publish(next);
+
+    doc->chunkCount += segment->getChunkCount();
+    enqueueEmbeddings(*next, segment);
+    scheduleMerge();
+    scheduleFlush();
+    return true;
+}
+
+void ContextManager::addDocument(const std::string& docName, const std::string& content,
+    const std::string& ocrProfile) {
+    if (content.empty()) {
+        std::cout << "Warning: Empty content for document " << docName << std::endl;
+        return;
+    }
+
+    auto doc = std::make_shared<Document>();
+    doc->name = docName;
+    doc->originalSize = content.size();
+    doc->ocrProfile = ocrProfile;
+    doc->addedTime = std::time(nullptr);
+    doc->complete = true;
+    doc->chunkSize = maxChunkSize;
+    doc->chunkOverlap = chunkOverlap;
+
+    // Разбиение и разбор терминов - без блокировки: запросы и другие загрузки не ждут
+    ChunkList chunks = createChunker(doc->chunkSize, doc->chunkOverlap).split(content);
+    auto segment = buildSegment(describePart(*doc, true), chunks);
+
+    std::lock_guard<std::mutex> lock(mtx);
+
+    if (unindexDocument(docName)) {
+        saveIndex();
+    }
+    documents[docName] = doc;
+    publishSegment(doc, segment);
+
+    std::cout << "✓ Added document '" << docName << "': "
+        << content.length() << " chars, "
+        << chunks.size() << " chunks, " << doc->duplicateChunks << " near-duplicate(s)" << std::endl;
+}
+
+void ContextManager::beginDocument(const std::string& docName, const std::string& ocrProfile, uint64_t sourceStamp) {
+    std::lock_guard<std::mutex> lock(mtx);
+
+    auto doc = std::make_shared<Document>();
+    doc->name = docName;
+    doc->originalSize = 0;
+    doc->ocrProfile = ocrProfile;
+    doc->addedTime = std::time(nullptr);
+    doc->complete = false;
+    doc->sourceStamp = sourceStamp;
+    doc->chunkSize = maxChunkSize;
+    doc->chunkOverlap = chunkOverlap;
+
+    if (unindexDocument(docName)) {
+        saveIndex();
+    }
+    documents[docName] = doc;
+}
+
+bool ContextManager::appendToDocument(const std::string& docName, int pageNumber, const std::string& pageText) {
+    std::shared_ptr<Document> doc;
+    ChunkList chunks;
+    IndexSegment::DocumentInfo info;
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+
+        auto it = documents.find(docName);
+        if (it == documents.end() || it->second->complete) {
+            return false;
+        }
+
+        doc = it->second;
+        doc->originalSize += pageText.size();
+        createChunker(doc->chunkSize, doc->chunkOverlap).appendPage(pageNumber, pageText, doc->chunkState, chunks);
+        info = describePart(*doc, false);
+    }
+
+    if (chunks.empty()) {
+        return true;
+    }
+
+    // Готовые чанки сразу становятся доступны для поиска
+    auto segment = buildSegment(info, chunks);
+    std::lock_guard<std::mutex> lock(mtx);
+    return publishSegment(doc, segment);
+}
+
+bool ContextManager::appendChunks(const std::string& docName, const ChunkList& chunks, size_t textSize) {
+    std::shared_ptr<Document> doc;
+    IndexSegment::DocumentInfo info;
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+
+        auto it = documents.find(docName);
+        if (it == documents.end() || it->second->complete) {
+            return false;
+        }
+
+        doc = it->second;
+        doc->originalSize += textSize;
+        info = describePart(*doc, false);
+    }
+
+    if (chunks.empty()) {
+        return true;
+    }
+
+    // Сегмент строится без блокировки: параллельные загрузки разбирают термины одновременно
+    auto segment = buildSegment(info, chunks);
+    std::lock_guard<std::mutex> lock(mtx);
+    return publishSegment(doc, segment);
+}
+
+void ContextManager::finishDocument(const std::string& docName) {
+    std::shared_ptr<Document> doc;
+    ChunkList chunks;
+    IndexSegment::DocumentInfo info;
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+
+        auto it = documents.find(docName);
+        if (it == documents.end() || it->second->complete) {
+            return;
+        }
+
+        doc = it->second;
+        createChunker(doc->chunkSize, doc->chunkOverlap).flush(doc->chunkState, chunks);
+        doc->complete = true;
+        info = describePart(*doc, true);
+    }
+
+    // Завершающая часть (возможно, без чанков) несет окончательное описание документа
+    auto segment = buildSegment(info, chunks);
+    std::lock_guard<std::mutex> lock(mtx);
+    publishSegment(doc, segment);
+
+    std::cout << "✓ Added document '" << docName << "': "
+        << doc->originalSize << " chars, "
+        << doc->chunkCount << " chunks, " << doc->duplicateChunks << " near-duplicate(s)" << std::endl;
+
+    // Параметры разбиения могли измениться, пока документ загружался
+    scheduleRechunk();
+}
+
+uint64_t ContextManager::getSourceStamp(const std::string& docName) const {
+    std::lock_guard<std::mutex> lock(mtx);
+
+    auto it = documents.find(docName);
+    return it != documents.end() && it->second->complete ? it->second->sourceStamp : 0;
+}
+
+std::string ContextManager::getContextForQuery(const std::string& query) {
+    auto start = std::chrono::steady_clock::now();
+
+    // Запрос работает со своим снимком: загрузка и слияния публикуют новые снимки, не задерживая его
+    std::shared_ptr<const IndexSnapshot> current = snapshot.load();
+
+    if (current->segments.empty()) {
+        return "";
+    }
+
+    if (query.empty()) {
+        std::cout << "Warning: Empty query provided" << std::endl;
+        return "";
+    }
+
+    // Тот же набор терминов по тому же снимку дает тот же контекст. Пока чанки векторизуются,
+    // векторный индекс меняется без нового снимка, поэтому результат не кэшируется
+    std::vector<std::string> keywords = extractKeywords(query);
+    const bool cacheable = !keywords.empty() && pendingEmbeddings == 0;
+    std::string cacheKey;
+    if (cacheable) {
+        cacheKey = QueryCache::makeKey(keywords);
+
+        std::string cached;
+        double buildMs = 0.0;
+        const bool hit = queryCache.find(current->generation, cacheKey, cached, buildMs);
+        const double lookupMs = elapsedMs(start);
+        {
+            std::lock_guard<std::mutex> statsLock(statsMtx);
+            cacheLookups++;
+            if (hit) {
+                cacheHits++;
+                totalCacheMsSaved += std::max(0.0, buildMs - lookupMs);
+            }
+        }
+
+        if (hit) {
+            std::ostringstream log;
+            log << "Context from cache: " << cached.size() << " chars in " << std::fixed << std::setprecision(0)
+                << (lookupMs * 1000.0) << " us (built in " << std::setprecision(2) << buildMs << " ms)\n";
+            std::cout << log.str() << std::flush;
+            return cached;
+        }
+    }
+
+    std::vector<float> queryVector;
+    if (current->embeddingModel) {
+        current->embeddingModel->embed(query, queryVector);
+    }
+
+    std::cout << "Building context for query: \"" << query.substr(0, 50)
+        << (query.length() > 50 ? "..." : "") << "\"" << std::endl;
+
+    // Получаем ранжированные чанки
+    auto rankedChunks = rankChunksByRelevance(*current, query, queryVector);
+
+    if (rankedChunks.empty()) {
+        std::cout << "No relevant chunks found" << std::endl;
+        return "";
+    }
+
+    std::string context = packContext(*current, rankedChunks, keywords, queryVector);
+    if (cacheable) {
+        queryCache.insert(current->generation, cacheKey, context, elapsedMs(start));
+    }
+    return context;
+}
+
+std::string ContextManager::packContext(const IndexSnapshot& current, const std::vector<RankedChunk>& rankedChunks,
+    const std::vector<std::string>& keywords, const std::vector<float>& queryVector) {
+    const std::string preamble = "=== CONTEXT INFORMATION ===\n\n";
+    const size_t preambleTokens = countTokens(preamble);
+    const size_t budget = maxContextTokens > preambleTokens ? maxContextTokens - preambleTokens : 0;
+
+    // Почти одинаковые чанки (редакции одного договора, колонтитулы) попадают в контекст один раз,
+    // остальные документы группы перечисляются как источники
+    std::set<InvertedIndex::ChunkId> included;
+    size_t skippedDuplicates = 0;
+    std::vector<ContextCandidate> candidates;
+
+    for (const auto& ranked : rankedChunks) {
+        ContextCandidate candidate;
+        if (!findChunk(current, ranked.chunkId, candidate.segment, candidate.chunk)) {
+            continue;
+        }
+        if (included.count(ranked.chunkId) > 0) {
+            skippedDuplicates++;
+            continue;
+        }
+
+        candidate.document = candidate.segment->getChunkDocument(candidate.chunk);
+        candidate.relevance = ranked.relevanceScore;
+        candidate.tokens = countChunkTokens(*candidate.segment, candidate.chunk);
+
+        std::vector<InvertedIndex::ChunkId> group = duplicates.getGroup(ranked.chunkId);
+        included.insert(group.begin(), group.end());
+        included.insert(ranked.chunkId);
+        candidate.otherSources = describeDuplicateSources(current, group,
+            candidate.segment->getDocumentName(candidate.document));
+
+        const ChunkList::Source source = candidate.segment->getChunkSource(candidate.chunk);
+        candidate.headerTokens = countTokens(formatContextHeader(candidate.segment->getDocumentName(candidate.document),
+            describePages(source.firstPage, source.lastPage), candidate.relevance, candidate.otherSources) + "\n\n");
+        candidates.push_back(std::move(candidate));
+    }
+
+    if (candidates.empty()) {
+        return "";
+    }
+
+    // Рюкзак считается с заголовком у каждого чанка; объединение соседних чанков освобождает
+    // заголовки, и в освободившееся место добавляются невыбранные чанки в порядке релевантности
+    std::vector<size_t> weights;
+    std::vector<float> values;
+    for (const auto& candidate : candidates) {
+        weights.push_back(candidate.tokens + candidate.headerTokens);
+        values.push_back(candidate.relevance);
+    }
+    std::vector<bool> selected = selectByKnapsack(weights, values, budget);
+
+    // Заголовок блока: документ и страницы от первого чанка до последнего
+    auto blockHeader = [&candidates](const ContextBlock& block) {
+        const ContextCandidate& first = candidates[block.members.front()];
+        const ContextCandidate& last = candidates[block.members.back()];
+        return formatContextHeader(first.segment->getDocumentName(first.document),
+            describePages(first.segment->getChunkSource(first.chunk).firstPage,
+                last.segment->getChunkSource(last.chunk).lastPage),
+            block.relevance, block.otherSources);
+    };
+    auto headerTokens = [this, &blockHeader](const ContextBlock& block) {
+        return countTokens(blockHeader(block) + "\n\n");
+    };
+
+    // Токены чанка next сразу после чанка previous: повтор конца previous в блоке пропускается
+    auto memberTokens = [this, &candidates](size_t previous, size_t next) {
+        const ContextCandidate& candidate = candidates[next];
+        const size_t overlap = overlapWithPrevious(candidates[previous], candidate);
+        return overlap > 0 ? countTokens(candidate.segment->getChunk(candidate.chunk).substr(overlap)) : candidate.tokens;
+    };
+
+    ContextBlockSet blockSet(candidates, headerTokens, memberTokens);
+    for (size_t i = 0; i < candidates.size(); ++i) {
+        if (selected[i]) {
+            blockSet.add(i);
+        }
+    }
+    for (size_t i = 0; i < candidates.size(); ++i) {
+        if (!selected[i] && blockSet.tokensWith(i) <= budget) {
+            blockSet.add(i);
+            selected[i] = true;
+        }
+    }
+
+    std::vector<ContextBlock> blocks = blockSet.getBlocks();
+    size_t totalTokens = blockSet.getTokens();
+
+    std::stringstream contextStream;
+    contextStream << preamble;
+    size_t selectedChunks = 0;
+
+    if (blocks.empty()) {
+        // Даже лучший чанк не помещается: берется его начало (по границе символа UTF-8)
+        const ContextCandidate& best = candidates.front();
+        std::string_view content = best.segment->getChunk(best.chunk);
+        size_t available = budget > best.headerTokens ? budget - best.headerTokens : 0;
+        size_t length = best.tokens > 0 ? content.size() * available / best.tokens : 0;
+        while (length > 0 && length < content.size() && (static_cast<unsigned char>(content[length]) & 0xC0) == 0x80) {
+            length--;
+        }
+        if (length == 0) {
+            std::cout << "No relevant chunk fits in " << maxContextTokens << " tokens" << std::endl;
+            return "";
+        }
+
+        const ChunkList::Source source = best.segment->getChunkSource(best.chunk);
+        contextStream << formatContextHeader(best.segment->getDocumentName(best.document),
+            describePages(source.firstPage, source.lastPage), best.relevance, best.otherSources) << "\n";
+        contextStream << content.substr(0, length) << "...\n\n";
+        totalTokens = best.headerTokens + countTokens(content.substr(0, length));
+        selectedChunks = 1;
+    }
+
+    // Текст блоков: чанки по порядку, каждый с новой строки. Начало чанка, повторяющее конец
+    // предыдущего (перекрытие чанков), в блоке пропускается
+    std::vector<std::string> texts;
+    for (const auto& block : blocks) {
+        std::string text;
+        for (size_t i = 0; i < block.members.size(); ++i) {
+            const ContextCandidate& candidate = candidates[block.members[i]];
+            std::string_view content = candidate.segment->getChunk(candidate.chunk);
+            if (i > 0) {
+                content.remove_prefix(overlapWithPrevious(candidates[block.members[i - 1]], candidate));
+            }
+
+            text += content;
+            text += '\n';
+        }
+        texts.push_back(std::move(text));
+        selectedChunks += block.members.size();
+    }
+
+    std::cout << "Context packed: " << selectedChunks << " chunks in " << std::max<size_t>(blocks.size(), 1)
+        << " block(s), " << totalTokens + preambleTokens << " of " << maxContextTokens << " tokens ("
+        << (tokenizer.count ? "exact" : "estimated") << "), " << skippedDuplicates
+        << " near-duplicate(s) skipped" << std::endl;
+
+    if (compressionRatio < 1.0 && !texts.empty()) {
+        compressContext(current, keywords, queryVector, texts);
+    }
+
+    for (size_t i = 0; i < blocks.size(); ++i) {
+        contextStream << blockHeader(blocks[i]) << "\n";
+        contextStream << texts[i] << "\n";
+    }
+
+    return contextStream.str();
+}
+
+void ContextManager::scoreSentences(const IndexSnapshot& current, const std::vector<std::string>& keywords,
+    const std::vector<float>& queryVector, std::vector<ContextCompressor::Sentence>& sentences) {
+    // Вес термина запроса - его idf по всей коллекции
+    InvertedIndex::CollectionStats collection;
+    for (const auto& segment : current.segments) {
+        InvertedIndex::CollectionStats stats = segment->getCollectionStats();
+        collection.chunkCount += stats.chunkCount;
+        collection.totalLength += stats.totalLength;
+    }
+
+    std::unordered_map<std::string_view, float> weights;
+    for (const auto& keyword : keywords) {
+        uint64_t documentFrequency = 0;
+        for (const auto& segment : current.segments) {
+            uint32_t term = segment->findTerm(keyword);
+            if (term != IndexSegment::INVALID_TERM) {
+                documentFrequency += segment->getDocumentFrequency(term);
+            }
+        }
+        weights[keyword] = InvertedIndex::idf(collection, documentFrequency);
+    }
+
+    // Лексическая оценка: сумма весов терминов запроса, встретившихся в предложении
+    std::string buffer;
+    std::vector<std::string_view> terms;
+    float maxLexical = 0.0f;
+    for (auto& sentence : sentences) {
+        analyzer.analyze(sentence.text, buffer, terms);
+        std::sort(terms.begin(), terms.end());
+        terms.erase(std::unique(terms.begin(), terms.end()), terms.end());
+
+        sentence.score = 0.0f;
+        for (std::string_view term : terms) {
+            auto weight = weights.find(term);
+            if (weight != weights.end()) {
+                sentence.score += weight->second;
+            }
+        }
+        maxLexical = std::max(maxLexical, sentence.score);
+    }
+
+    std::shared_ptr<EmbeddingModel> model = current.embeddingModel;
+    if (!model || queryVector.empty() || sentences.size() > MAX_EMBEDDED_SENTENCES) {
+        return;
+    }
+
+    // С моделью эмбеддингов к доле лексической оценки добавляется близость к вопросу по смыслу.
+    // Поток запроса векторизует предложения наравне с интерактивными задачами общего пула и ждет
+    // только начатые ими, поэтому занятый пул не задерживает сжатие
+    auto work = std::make_shared<SentenceEmbedding>();
+    work->model = model;
+    for (const auto& sentence : sentences) {
+        work->texts.emplace_back(sentence.text);
+    }
+    work->embeddings.resize(sentences.size());
+
+    std::shared_ptr<ThreadPool> pool = searchWorkers;
+    if (pool && sentences.size() > 1) {
+        const size_t helpers = std::min(pool->size(), sentences.size() - 1);
+        for (size_t i = 0; i < helpers; ++i) {
+            pool->submit([work]() { embedSentences(*work); }, TaskPriority::Interactive);
+        }
+    }
+    embedSentences(*work);
+
+    {
+        std::unique_lock<std::mutex> lock(work->mtx);
+        work->finished.wait(lock, [&work]() { return work->finishedSentences == work->texts.size(); });
+    }
+
+    for (size_t i = 0; i < sentences.size(); ++i) {
+        const std::vector<float>& embedding = work->embeddings[i];
+        float similarity = embedding.size() == queryVector.size()
+            ? VectorKernels::dotFloat(embedding.data(), queryVector.data(), embedding.size()) : 0.0f;
+        float lexical = maxLexical > 0.0f ? sentences[i].score / maxLexical : 0.0f;
+        sentences[i].score = lexical + std::max(similarity, 0.0f);
+    }
+}
+
+size_t ContextManager::compressContext(const IndexSnapshot& current, const std::vector<std::string>& keywords,
+    const std::vector<float>& queryVector, std::vector<std::string>& texts) {
+    auto start = std::chrono::steady_clock::now();
+
+    std::vector<ContextCompressor::Sentence> sentences;
+    for (size_t block = 0; block < texts.size(); ++block) {
+        for (std::string_view text : TextChunker::splitSentences(texts[block])) {
+            sentences.push_back({ block, text, countTokens(text), 0.0f });
+        }
+    }
+
+    scoreSentences(current, keywords, queryVector, sentences);
+    std::vector<bool> kept = ContextCompressor::selectSentences(sentences, compressionRatio);
+
+    size_t before = 0;
+    size_t after = 0;
+    size_t keptSentences = 0;
+    for (size_t i = 0; i < sentences.size(); ++i) {
+        before += sentences[i].tokens;
+        if (kept[i]) {
+            after += sentences[i].tokens;
+            keptSentences++;
+        }
+    }
+
+    std::vector<std::string> compressed;
+    const size_t gapTokens = countTokens(" ... ");
+    for (size_t block = 0; block < texts.size(); ++block) {
+        size_t gaps = 0;
+        compressed.push_back(ContextCompressor::joinSentences(sentences, kept, block, gaps) + "\n");
+        after += gaps * gapTokens;
+    }
+
+    if (after >= before) {
+        return 0;
+    }
+    texts = std::move(compressed);
+
+    // Сэкономленное время prefill - по измеренной скорости модели генерации
+    const size_t saved = before - after;
+    const double rate = prefillRate ? prefillRate() : 0.0;
+    const double prefillMs = rate > 0.0 ? 1000.0 * saved / rate : 0.0;
+    const double compressMs = elapsedMs(start);
+    {
+        std::lock_guard<std::mutex> statsLock(statsMtx);
+        compressedQueries++;
+        tokensBeforeCompression += before;
+        tokensAfterCompression += after;
+        totalPrefillMsSaved += prefillMs;
+    }
+
+    std::ostringstream log;
+    log << "Context compressed: " << before << " -> " << after << " tokens (" << std::fixed << std::setprecision(1)
+        << (100.0 * saved / before) << "% saved";
+    if (rate > 0.0) {
+        log << ", ~" << std::setprecision(0) << prefillMs << " ms prefill";
+    }
+    log << "), " << keptSentences << " of " << sentences.size() << " sentences kept, " << std::setprecision(2)
+        << compressMs << " ms\n";
+    std::cout << log.str() << std::flush;
+    return saved;
+}
+
+std::vector<std::string> ContextManager::getDocumentNames() const {
+    std::lock_guard<std::mutex> lock(mtx);
+
+    std::vector<std::string> names;
+    names.reserve(documents.size());
+
+    for (const auto& [name, doc] : documents) {
+        names.push_back(name);
+    }
+
+    return names;
+}
+
+std::string ContextManager::getDocumentStats() const {
+    std::lock_guard<std::mutex> lock(mtx);
+
+    if (documents.empty()) {
+        return "No documents loaded";
+    }
+
+    std::stringstream ss;
+    ss << "=== DOCUMENT STATISTICS ===\n";
+    ss << "Total documents: " << documents.size() << "\n\n";
+
+    size_t totalSize = 0;
+    size_t totalChunks = 0;
+    size_t rechunkPending = 0;
+
+    for (const auto& [name, doc] : documents) {
+        totalSize += doc->originalSize;
+        totalChunks += doc->chunkCount;
+        if (doc->complete && (doc->chunkSize != maxChunkSize || doc->chunkOverlap != chunkOverlap)) {
+            rechunkPending++;
+        }
+
+        // Форматируем время добавления
+        std::tm* timeInfo = std::localtime(&doc->addedTime);
+        char timeBuffer[100];
+        std::strftime(timeBuffer, sizeof(timeBuffer), "%Y-%m-%d %H:%M:%S", timeInfo);
+
+        ss << "📄 " << name << "\n";
+        ss << "   Size: " << doc->originalSize << " chars\n";
+        ss << "   Chunks: " << doc->chunkCount << (doc->complete ? "" : " (indexing...)");
+        if (doc->duplicateChunks > 0) {
+            ss << ", " << doc->duplicateChunks << " near-duplicate(s)";
+        }
+        ss << "\n";
+        if (!doc->ocrProfile.empty()) {
+            ss << "   OCR profile: " << doc->ocrProfile << "\n";
+        }
+        ss << "   Added: " << timeBuffer << "\n\n";
+    }
+
+    ss << "Total content: " << totalSize << " characters\n";
+    ss << "Total chunks: " << totalChunks << "\n";
+    ss << "Chunking: " << maxChunkSize << " chars, overlap " << chunkOverlap << " tokens";
+    if (rechunkPending > 0) {
+        ss << ", " << rechunkPending << " document(s) awaiting re-chunking";
+    }
+    ss << "\n";
+
+    // Сегменты на диске отображены в память: в ней только страницы, к которым обращался поиск
+    std::shared_ptr<const IndexSnapshot> current = snapshot.load();
+    size_t memorySegments = 0;
+    size_t diskSegments = 0;
+    uint64_t memoryBytes = 0;
+    uint64_t diskBytes = 0;
+    size_t removedChunks = 0;
+    for (const auto& segment : current->segments) {
+        (segment->isPersistent() ? diskSegments : memorySegments)++;
+        (segment->isPersistent() ? diskBytes : memoryBytes) += segment->getFileSize();
+        removedChunks += segment->getRemovedChunkCount();
+    }
+    ss << "Index segments: " << memorySegments << " in memory (" << std::fixed << std::setprecision(1)
+        << (memoryBytes / 1048576.0) << " MB), " << diskSegments << " on disk (" << (diskBytes / 1048576.0)
+        << " MB mapped), " << removedChunks << " removed chunks awaiting merge, snapshot "
+        << current->generation << "\n";
+
+    // Почти дубликаты - чанки сверх одного на группу; одинаковый текст в сегменте хранится один раз
+    const size_t fingerprinted = duplicates.size();
+    const size_t duplicateChunks = fingerprinted - duplicates.getGroupCount();
+    uint64_t textLength = 0;
+    uint64_t storedText = 0;
+    for (const auto& segment : current->segments) {
+        textLength += segment->getTextLength();
+        storedText += segment->getStoredTextSize();
+    }
+    ss << "Near-duplicates: " << duplicateChunks << " of " << fingerprinted << " chunks ("
+        << std::setprecision(1) << (fingerprinted > 0 ? 100.0 * duplicateChunks / fingerprinted : 0.0)
+        << "%), repeated text stored once: " << ((textLength - storedText) / 1048576.0) << " MB saved of "
+        << (textLength / 1048576.0) << " MB\n";
+
+    size_t queries;
+    double queryMs;
+    double lastMs;
+    double vectorMs;
+    double compileMs;
+    uint64_t total;
+    uint64_t scored;
+    size_t parallel;
+    size_t compressed;
+    uint64_t tokensBefore;
+    uint64_t tokensAfter;
+    double prefillSaved;
+    size_t lookups;
+    size_t hits;
+    double cacheSaved;
+    {
+        std::lock_guard<std::mutex> statsLock(statsMtx);
+        queries = queryCount;
+        queryMs = totalQueryMs;
+        lastMs = lastQueryMs;
+        vectorMs = totalVectorMs;
+        compileMs = totalCompileMs;
+        total = postingsTotal;
+        scored = postingsScored;
+        parallel = parallelQueries;
+        compressed = compressedQueries;
+        tokensBefore = tokensBeforeCompression;
+        tokensAfter = tokensAfterCompression;
+        prefillSaved = totalPrefillMsSaved;
+        lookups = cacheLookups;
+        hits = cacheHits;
+        cacheSaved = totalCacheMsSaved;
+    }
+
+    if (queries > 0) {
+        // Доля вхождений, пропущенных отсечением по верхним оценкам
+        double skipped = total > 0 ? 100.0 * (total - scored) / total : 0.0;
+        ss << "Search: " << queries << " queries, avg " << std::fixed << std::setprecision(2)
+            << (queryMs / queries) << " ms (query terms " << (compileMs / queries) << " ms), last " << lastMs << " ms, "
+            << std::setprecision(1) << skipped << "% postings skipped, " << parallel << " ranked in parallel\n";
+    }
+    if (compressed > 0) {
+        ss << "Context compression: ratio " << std::fixed << std::setprecision(2) << compressionRatio.load() << ", "
+            << compressed << " queries, avg " << ((tokensBefore - tokensAfter) / compressed) << " tokens saved ("
+            << std::setprecision(1) << (100.0 * (tokensBefore - tokensAfter) / tokensBefore) << "%), ~"
+            << std::setprecision(0) << (prefillSaved / compressed) << " ms prefill saved per query\n";
+    }
+    if (lookups > 0) {
+        ss << "Query cache: " << hits << " of " << lookups << " hits (" << std::fixed << std::setprecision(1)
+            << (100.0 * hits / lookups) << "%), " << queryCache.size() << " entries, "
+            << (queryCache.getMemoryUsage() / 1048576.0) << " of " << (queryCache.getCapacity() / 1048576.0)
+            << " MB, " << cacheSaved << " ms saved\n";
+    }
+
+    const std::shared_ptr<VectorIndex>& vectorIndex = current->vectorIndex;
+    if (vectorIndex) {
+        size_t vectors = vectorIndex->size();
+        ss << "Vector index: " << vectors << " vectors, " << vectorIndex->getDimension()
+            << " dims, " << vectorIndex->describe() << ", search width " << vectorIndex->getSearchWidth()
+            << ", " << vectorIndex->getDeletedCount() << " deleted, "
+            << pendingEmbeddings.load() << " chunks waiting for embedding\n";
+        if (vectors > 0) {
+            ss << "Vector memory: " << std::fixed << std::setprecision(1)
+                << (vectorIndex->getMemoryUsage() / 1048576.0) << " MB, "
+                << (vectorIndex->getMemoryUsage() / vectors) << " bytes per chunk\n";
+        }
+        if (queries > 0) {
+            ss << "Vector search: avg " << std::fixed << std::setprecision(2) << (vectorMs / queries) << " ms\n";
+        }
+    }
+
+    // Токены чанков - сохраненные в сегментах тем же токенизатором
+    if (tokenizer.tag == 0) {
+        ss << "Chunk tokens: not counted (generation model tokenizer not set)\n";
+    } else {
+        uint64_t chunkTokens = 0;
+        size_t countedChunks = 0;
+        size_t uncountedChunks = 0;
+        for (const auto& segment : current->segments) {
+            const bool counted = segment->getTokenizer() == tokenizer.tag;
+            for (uint32_t chunk = 0; chunk < segment->getChunkCount(); ++chunk) {
+                if (segment->isChunkRemoved(chunk)) {
+                    continue;
+                }
+                if (counted) {
+                    chunkTokens += segment->getTokenCount(chunk);
+                    countedChunks++;
+                } else {
+                    uncountedChunks++;
+                }
+            }
+        }
+        ss << "Chunk tokens: " << chunkTokens << " in " << countedChunks << " chunks";
+        if (uncountedChunks > 0) {
+            ss << ", " << uncountedChunks << " chunks without counts for the current tokenizer";
+        }
+        ss << "\n";
+    }
+
+    return ss.str();
+}
+
+void ContextManager::clearDocuments() {
+    std::lock_guard<std::mutex> lock(mtx);
+    documents.clear();
+
+    // Индекс не умеет массово удалять векторы: начинаем новый, векторизация старых чанков отбрасывается
+    std::shared_ptr<const IndexSnapshot> current = snapshot.load();
+    auto next = std::make_shared<IndexSnapshot>();
+    next->embeddingModel = current->embeddingModel;
+    if (current->vectorIndex) {
+        next->vectorIndex = createVectorIndex(current->vectorIndex->getDimension());
+    }
+    publish(next);
+    duplicates.clear();
+
+    // Сегменты выбывают из манифеста, их файлы удаляются
+    saveIndex();
+    std::cout << "✓ All documents cleared from context" << std::endl;
+}
+
+bool ContextManager::removeDocument(const std::string& docName) {
+    std::lock_guard<std::mutex> lock(mtx);
+
+    auto it = documents.find(docName);
+    if (it != documents.end()) {
+        documents.erase(it);
+        if (unindexDocument(docName)) {
+            saveIndex();
+        }
+        std::cout << "✓ Document '" << docName << "' removed from context" << std::endl;
+        return true;
+    }
+
+    std::cout << "✗ Document '" << docName << "' not found in context" << std::endl;
+    return false;
+}
+
+void ContextManager::setMaxContextTokens(size_t tokens) {
+    maxContextTokens = tokens;
+    queryCache.clear();
+    std::cout << "Max context tokens set to: " << tokens << std::endl;
+}
+
+void ContextManager::setQueryCacheSize(size_t bytes) {
+    queryCache.setCapacity(bytes);
+    std::cout << "Query cache size set to: " << std::fixed << std::setprecision(1) << (bytes / 1048576.0)
+        << " MB" << std::endl;
+}
+
+size_t ContextManager::getMaxChunkSize() const {
+    return maxChunkSize;
+}
+
+void ContextManager::setMaxChunkSize(size_t size) {
+    maxChunkSize = size;
+    std::cout << "Max chunk size set to: " << size << " characters" << std::endl;
+
+    std::lock_guard<std::mutex> lock(mtx);
+    scheduleRechunk();
+}
+
+size_t ContextManager::getChunkOverlap() const {
+    return chunkOverlap;
+}
+
+void ContextManager::setChunkOverlap(size_t tokens) {
+    chunkOverlap = tokens;
+    std::cout << "Chunk overlap set to: " << tokens << " tokens" << std::endl;
+
+    std::lock_guard<std::mutex> lock(mtx);
+    scheduleRechunk();
+}
+
+TextChunker ContextManager::createChunker() const {
+    return createChunker(maxChunkSize, chunkOverlap);
+}
+
+TextChunker ContextManager::createChunker(size_t chunkSize, size_t overlap) const {
+    return TextChunker(chunkSize, overlap, [this](std::string_view text) { return countTokens(text); });
+}
 
-    if (content.empty()) {
-        std::cout << "Warning: Empty content for document " << docName << std::endl;
-        return;
+size_t ContextManager::getTopK() const {
+    // Вдвое больше чанков полного размера, чем помещается в контекст: короткие чанки
+    // и чанки у границы лимита не должны оставлять контекст недозаполненным
+    size_t chunkTokens = std::max<size_t>(1, maxChunkSize / 4);
+    return std::max(MIN_TOP_K, 2 * maxContextTokens / chunkTokens);
+}
+
+std::vector<RankedChunk> ContextManager::rankChunksByRelevance(const IndexSnapshot& current, const std::string& query,
+    const std::vector<float>& queryVector) {
+    auto start = std::chrono::steady_clock::now();
+    size_t topK = getTopK();
+
+    // Запрос разбирается один раз, затем BM25 только по спискам его терминов,
+    // с отсечением заведомо слабых чанков
+    std::shared_ptr<const CompiledQuery> compiled = compileQuery(current, query);
+    const double compileMs = elapsedMs(start);
+
+    InvertedIndex::SearchStats searchStats;
+    auto hits = searchLexical(compiled, topK, searchStats);
+
+    std::vector<RankedChunk> rankedChunks;
+    rankedChunks.reserve(hits.size());
+    for (const auto& hit : hits) {
+        rankedChunks.push_back({ hit.chunkId, hit.score });
     }
 
-    auto doc = std::make_shared<Document>();
-    doc->name = docName;
-    doc->content = content;
-    doc->originalSize = content.size();
-    doc->addedTime = std::time(nullptr);
-    doc->chunks = chunkContent(content);
+    auto lexicalEnd = std::chrono::steady_clock::now();
+    const double lexicalMs = std::chrono::duration<double, std::milli>(lexicalEnd - start).count();
+    {
+        std::lock_guard<std::mutex> statsLock(statsMtx);
+        lastQueryMs = lexicalMs;
+        totalQueryMs += lexicalMs;
+        totalCompileMs += compileMs;
+        queryCount++;
+        postingsTotal += searchStats.postingsTotal;
+        postingsScored += searchStats.postingsScored;
+        if (searchStats.threads > 1) {
+            parallelQueries++;
+        }
+    }
 
-    documents[docName] = doc;
+    // Запросы идут параллельно: строка журнала собирается отдельно, формат std::cout не меняется
+    std::ostringstream log;
+    log << "Ranked " << rankedChunks.size() << " relevant chunks (" << searchStats.candidates
+        << " candidates, " << searchStats.postingsScored << "/" << searchStats.postingsTotal
+        << " postings scored, " << searchStats.threads << " thread(s), " << std::fixed << std::setprecision(2)
+        << lexicalMs << " ms, query terms " << compileMs << " ms)\n";
+    std::cout << log.str() << std::flush;
 
-    std::cout << "✓ Added document '" << docName << "': "
-        << content.length() << " chars, "
-        << doc->chunks.size() << " chunks" << std::endl;
-}
+    if (!current.vectorIndex || queryVector.empty()) {
+        return rankedChunks;
+    }
 
-std::string ContextManager::getContextForQuery(const std::string& query) {
-    std::lock_guard<std::mutex> lock(mtx);
+    // Векторный поиск находит перефразированные вопросы, которые не совпадают по словам
+    auto neighbors = current.vectorIndex->search(queryVector, topK);
+    double vectorMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - lexicalEnd).count();
+    {
+        std::lock_guard<std::mutex> statsLock(statsMtx);
+        totalVectorMs += vectorMs;
+    }
 
-    if (documents.empty()) {
-        return "";
+    // Оценки BM25 и косинусная близость несравнимы, поэтому объединяются ранги
+    std::unordered_map<InvertedIndex::ChunkId, float> fused;
+    for (size_t rank = 0; rank < rankedChunks.size(); ++rank) {
+        fused[rankedChunks[rank].chunkId] += 1.0f / (RRF_K + rank + 1);
     }
 
-    if (query.empty()) {
-        std::cout << "Warning: Empty query provided" << std::endl;
-        return "";
+    size_t vectorRank = 0;
+    for (const auto& neighbor : neighbors) {
+        // Чанк удаленного документа мог еще не уйти из графа
+        const IndexSegment* segment;
+        uint32_t chunk;
+        if (!findChunk(current, neighbor.label, segment, chunk)) {
+            continue;
+        }
+        fused[neighbor.label] += 1.0f / (RRF_K + ++vectorRank);
     }
 
-    std::cout << "Building context for query: \"" << query.substr(0, 50)
-        << (query.length() > 50 ? "..." : "") << "\"" << std::endl;
+    // Оценка приводится к [0, 1]: 1 - первое место в обоих списках
+    const float maxScore = 2.0f / (RRF_K + 1);
+    rankedChunks.clear();
+    for (const auto& [chunkId, score] : fused) {
+        rankedChunks.push_back({ chunkId, score / maxScore });
+    }
 
-    // Получаем ранжированные чанки
-    auto rankedChunks = rankChunksByRelevance(query);
+    std::sort(rankedChunks.begin(), rankedChunks.end(), [](const RankedChunk& a, const RankedChunk& b) {
+        return a.relevanceScore != b.relevanceScore ? a.relevanceScore > b.relevanceScore : a.chunkId < b.chunkId;
+    });
+    if (rankedChunks.size() > topK) {
+        rankedChunks.resize(topK);
+    }
 
-    if (rankedChunks.empty()) {
-        std::cout << "No relevant chunks found" << std::endl;
-        return "";
+    log.str("");
+    log << "Vector search: " << vectorRank << " neighbors in " << std::fixed << std::setprecision(2)
+        << vectorMs << " ms, " << rankedChunks.size() << " chunks after fusion\n";
+    std::cout << log.str() << std::flush;
+
+    return rankedChunks;
+}
+
+std::shared_ptr<const CompiledQuery> ContextManager::compileQuery(const IndexSnapshot& current,
+    const std::string& query) {
+    auto compiled = std::make_shared<CompiledQuery>();
+    compiled->keywords = extractKeywords(query);
+    const auto& segments = current.segments;
+
+    // Статистика BM25 (число чанков, средняя длина, idf) - по всей коллекции, иначе оценки
+    // из разных частей несравнимы
+    InvertedIndex::CollectionStats& collection = compiled->collection;
+    for (const auto& segment : segments) {
+        InvertedIndex::CollectionStats part = segment->getCollectionStats();
+        collection.chunkCount += part.chunkCount;
+        collection.totalLength += part.totalLength;
     }
 
-    // Формируем контекст
-    std::stringstream contextStream;
-    size_t totalTokens = 0;
-    size_t selectedChunks = 0;
+    // Термины по возрастанию - в порядке словарей сегментов
+    const std::vector<std::string>& keywords = compiled->keywords;
+    std::vector<size_t> order(keywords.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::sort(order.begin(), order.end(), [&keywords](size_t a, size_t b) { return keywords[a] < keywords[b]; });
 
-    contextStream << "=== CONTEXT INFORMATION ===\n\n";
+    std::vector<std::string_view> sortedKeywords;
+    sortedKeywords.reserve(order.size());
+    for (size_t keyword : order) {
+        sortedKeywords.push_back(keywords[keyword]);
+    }
 
-    // Добавляем наиболее релевантные чанки
-    for (const auto& chunk : rankedChunks) {
-        size_t chunkTokens = estimateTokenCount(chunk.content);
+    // Номера терминов в каждом сегменте: segmentTerms[сегмент][термин запроса]
+    std::vector<std::vector<uint32_t>> segmentTerms(segments.size(), std::vector<uint32_t>(keywords.size()));
+    std::vector<uint32_t> found;
+    for (size_t i = 0; i < segments.size(); ++i) {
+        segments[i]->findTerms(sortedKeywords, found);
+        for (size_t k = 0; k < order.size(); ++k) {
+            segmentTerms[i][order[k]] = found[k];
+        }
+    }
 
-        if (totalTokens + chunkTokens > maxContextTokens) {
-            if (selectedChunks == 0) {
-                // Если даже первый чанк не помещается, берем его частично
-                std::string truncated = chunk.content.substr(0, maxContextTokens * 4); // ~4 символа на токен
-                contextStream << "Document: " << chunk.source << " (relevance: "
-                    << std::fixed << std::setprecision(2) << chunk.relevanceScore << ")\n";
-                contextStream << truncated << "...\n\n";
-                selectedChunks++;
+    // Запрос каждой части - ее номера терминов с общим весом
+    std::vector<InvertedIndex::SparseVector> segmentQueries(segments.size());
+    for (size_t k = 0; k < keywords.size(); ++k) {
+        uint64_t documentFrequency = 0;
+        for (size_t i = 0; i < segments.size(); ++i) {
+            if (segmentTerms[i][k] != IndexSegment::INVALID_TERM) {
+                documentFrequency += segments[i]->getDocumentFrequency(segmentTerms[i][k]);
             }
-            break;
         }
 
-        contextStream << "Document: " << chunk.source << " (relevance: "
-            << std::fixed << std::setprecision(2) << chunk.relevanceScore << ")\n";
-        contextStream << chunk.content << "\n\n";
+        if (documentFrequency == 0) {
+            continue;
+        }
 
-        totalTokens += chunkTokens;
-        selectedChunks++;
+        float weight = InvertedIndex::idf(collection, documentFrequency);
+        for (size_t i = 0; i < segments.size(); ++i) {
+            if (segmentTerms[i][k] != IndexSegment::INVALID_TERM) {
+                segmentQueries[i].push_back({ segmentTerms[i][k], weight });
+            }
+        }
     }
 
-    std::cout << "Context built: " << selectedChunks << " chunks, ~"
-        << totalTokens << " tokens" << std::endl;
+    for (size_t i = 0; i < segments.size(); ++i) {
+        if (!segmentQueries[i].empty()) {
+            compiled->segments.push_back(segments[i]);
+            compiled->queries.push_back(std::move(segmentQueries[i]));
+        }
+    }
 
-    return contextStream.str();
+    return compiled;
 }
 
-std::vector<std::string> ContextManager::getDocumentNames() const {
-    std::lock_guard<std::mutex> lock(mtx);
+std::vector<InvertedIndex::Hit> ContextManager::searchLexical(std::shared_ptr<const CompiledQuery> query,
+    size_t topK, InvertedIndex::SearchStats& stats) const {
+    // Части поиска: сегменты с терминами запроса, в большой коллекции - диапазоны их чанков
+    auto search = std::make_shared<PartitionedSearch>();
+    search->query = query;
+    search->topK = topK;
 
-    std::vector<std::string> names;
-    names.reserve(documents.size());
+    size_t liveChunks = 0;
+    for (const auto& segment : query->segments) {
+        liveChunks += segment->getChunkCount() - segment->getRemovedChunkCount();
+    }
 
-    for (const auto& [name, doc] : documents) {
-        names.push_back(name);
+    std::shared_ptr<ThreadPool> pool = searchWorkers;
+    const bool parallel = pool && pool->size() > 1 && liveChunks >= PARALLEL_MIN_CHUNKS;
+    const size_t partitionChunks = parallel
+        ? std::max<size_t>(PARTITION_MIN_CHUNKS, liveChunks / (2 * (pool->size() + 1)))
+        : SIZE_MAX;
+
+    for (size_t i = 0; i < query->segments.size(); ++i) {
+        const size_t chunkCount = query->segments[i]->getChunkCount();
+        for (size_t first = 0; first < chunkCount; first += std::min(partitionChunks, chunkCount - first)) {
+            size_t end = first + std::min(partitionChunks, chunkCount - first);
+            search->partitions.push_back({ i, static_cast<uint32_t>(first), static_cast<uint32_t>(end) });
+        }
     }
 
-    return names;
+    // Поток запроса ранжирует части наравне с задачами пула и ждет только уже начатые ими части,
+    // поэтому занятый загрузкой пул не делает запрос медленнее последовательного
+    if (parallel && search->partitions.size() > 1) {
+        const size_t helpers = std::min(pool->size(), search->partitions.size() - 1);
+        for (size_t i = 0; i < helpers; ++i) {
+            pool->submit([search]() { searchPartitions(*search); }, TaskPriority::Interactive);
+        }
+    }
+    searchPartitions(*search);
+
+    std::unique_lock<std::mutex> lock(search->mtx);
+    search->finished.wait(lock, [&search]() {
+        return search->finishedPartitions == search->partitions.size();
+    });
+
+    // Объединение лучших чанков потоков
+    std::vector<InvertedIndex::Hit> hits = std::move(search->hits);
+    keepTop(hits, topK);
+    stats = search->stats;
+
+    return hits;
 }
 
-std::string ContextManager::getDocumentStats() const {
-    std::lock_guard<std::mutex> lock(mtx);
+bool ContextManager::findChunk(const IndexSnapshot& current, InvertedIndex::ChunkId chunkId,
+    const IndexSegment*& segment, uint32_t& chunk) {
+    // Чанк лежит ровно в одном сегменте снимка: слияние заменяет источники результатом одной публикацией
+    for (const auto& candidate : current.segments) {
+        if (candidate->findChunk(chunkId, chunk)) {
+            segment = candidate.get();
+            return true;
+        }
+    }
+    return false;
+}
 
-    if (documents.empty()) {
-        return "No documents loaded";
+size_t ContextManager::indexDuplicates(const IndexSegment& segment) {
+    size_t found = 0;
+    for (uint32_t chunk = 0; chunk < segment.getChunkCount(); ++chunk) {
+        if (!segment.isChunkRemoved(chunk) && duplicates.add(segment.getChunkId(chunk), segment.getFingerprint(chunk))) {
+            found++;
+        }
     }
+    return found;
+}
 
-    std::stringstream ss;
-    ss << "=== DOCUMENT STATISTICS ===\n";
-    ss << "Total documents: " << documents.size() << "\n\n";
+bool ContextManager::unindexDocument(const std::string& docName, std::shared_ptr<const IndexSegment> replacement,
+    size_t* replacementDuplicates) {
+    std::shared_ptr<const IndexSnapshot> current = snapshot.load();
+    auto next = std::make_shared<IndexSnapshot>(*current);
+    next->segments.clear();
+
+    std::vector<InvertedIndex::ChunkId> chunkIds;
+    bool found = false;
+    bool persistent = false;
+
+    for (const auto& segment : current->segments) {
+        uint32_t document;
+        if (!segment->findDocument(docName, document)) {
+            next->segments.push_back(segment);
+            continue;
+        }
 
-    size_t totalSize = 0;
-    size_t totalChunks = 0;
+        found = true;
+        persistent = persistent || segment->isPersistent();
+        IndexSegment::DocumentInfo info = segment->getDocument(document);
+        for (uint32_t chunk = info.firstChunk; chunk < info.firstChunk + info.chunkCount; ++chunk) {
+            chunkIds.push_back(segment->getChunkId(chunk));
+        }
 
-    for (const auto& [name, doc] : documents) {
-        totalSize += doc->originalSize;
-        totalChunks += doc->chunks.size();
+        // Часть документа отмечается удаленной в копии сегмента, данные уходят при слиянии;
+        // сегмент, где не осталось документов, выбывает сразу
+        std::shared_ptr<const IndexSegment> updated = segment->withRemoved({ document }, analyzer);
+        if (!isEmpty(*updated)) {
+            next->segments.push_back(updated);
+        }
+    }
 
-        // Форматируем время добавления
-        std::tm* timeInfo = std::localtime(&doc->addedTime);
-        char timeBuffer[100];
-        std::strftime(timeBuffer, sizeof(timeBuffer), "%Y-%m-%d %H:%M:%S", timeInfo);
+    if (!found && !replacement) {
+        return false;
+    }
 
-        ss << "📄 " << name << "\n";
-        ss << "   Size: " << doc->originalSize << " chars\n";
-        ss << "   Chunks: " << doc->chunks.size() << "\n";
-        ss << "   Added: " << timeBuffer << "\n\n";
+    // Отпечатки новой версии - до публикации, вместо отпечатков прежней (иначе ее чанки
+    // оказались бы почти дубликатами новых)
+    if (replacement) {
+        for (InvertedIndex::ChunkId chunkId : chunkIds) {
+            duplicates.remove(chunkId);
+        }
+        const size_t found = indexDuplicates(*replacement);
+        if (replacementDuplicates) {
+            *replacementDuplicates = found;
+        }
+        next->segments.push_back(replacement);
     }
+    publish(next);
 
-    ss << "Total content: " << totalSize << " characters\n";
-    ss << "Total chunks: " << totalChunks << "\n";
-    ss << "Estimated tokens: ~" << (totalSize / 4) << "\n";
+    // Векторы и отпечатки удаляются после публикации: запрос со старым снимком их просто
+    // не найдет в сегментах
+    if (next->vectorIndex) {
+        for (InvertedIndex::ChunkId chunkId : chunkIds) {
+            next->vectorIndex->remove(chunkId);
+        }
+    }
+    for (InvertedIndex::ChunkId chunkId : chunkIds) {
+        duplicates.remove(chunkId);
+    }
 
-    return ss.str();
+    scheduleMerge();
+    return persistent;
 }
 
-void ContextManager::clearDocuments() {
+void ContextManager::openIndex(const std::string& directory) {
+    auto start = std::chrono::steady_clock::now();
     std::lock_guard<std::mutex> lock(mtx);
-    documents.clear();
-    std::cout << "✓ All documents cleared from context" << std::endl;
+
+    store = std::make_unique<IndexStore>(directory);
+
+    IndexStore::State state;
+    std::string error;
+    if (!store->load(analyzer, state, error)) {
+        std::cout << "✗ " << error << ", documents will be indexed again" << std::endl;
+    }
+    nextChunkId = std::max(nextChunkId.load(), state.nextChunkId);
+
+    // Документы сегментов сразу доступны для поиска: в памяти только их описания.
+    // Части одного документа (загружался частями) могут лежать в разных сегментах
+    std::shared_ptr<const IndexSnapshot> current = snapshot.load();
+    auto next = std::make_shared<IndexSnapshot>(*current);
+    next->segments.clear();
+
+    std::set<std::string> loaded;
+    size_t chunkCount = 0;
+    uint64_t fileBytes = 0;
+    for (auto segment : state.segments) {
+        std::vector<uint32_t> replaced;
+
+        for (uint32_t document = 0; document < segment->getDocumentCount(); ++document) {
+            if (segment->isDocumentRemoved(document)) {
+                continue;
+            }
+
+            IndexSegment::DocumentInfo info = segment->getDocument(document);
+            if (documents.count(info.name) > 0 && loaded.count(info.name) == 0) {
+                // Документ с тем же именем уже загружен в этом запуске
+                replaced.push_back(document);
+                continue;
+            }
+
+            auto& doc = documents[info.name];
+            if (!doc) {
+                doc = std::make_shared<Document>();
+                doc->name = info.name;
+                doc->originalSize = 0;
+                doc->ocrProfile = info.ocrProfile;
+                doc->addedTime = static_cast<std::time_t>(info.addedTime);
+                doc->complete = true;
+                loaded.insert(info.name);
+            }
+            doc->originalSize = std::max(doc->originalSize, static_cast<size_t>(info.originalSize));
+            if (info.sourceStamp != 0) {
+                doc->sourceStamp = info.sourceStamp;
+            }
+            doc->chunkCount += info.chunkCount;
+            doc->chunkSize = info.chunkSize;
+            doc->chunkOverlap = info.chunkOverlap;
+            chunkCount += info.chunkCount;
+        }
+
+        if (!replaced.empty()) {
+            segment = segment->withRemoved(replaced, analyzer);
+        }
+        fileBytes += segment->getFileSize();
+        next->segments.push_back(segment);
+    }
+
+    // Сегменты этого запуска новее сохраненных; отпечатки - до публикации
+    next->segments.insert(next->segments.end(), current->segments.begin(), current->segments.end());
+    for (size_t i = 0; i < state.segments.size(); ++i) {
+        indexDuplicates(*next->segments[i]);
+    }
+    publish(next);
+
+    for (size_t i = 0; i < state.segments.size(); ++i) {
+        enqueueEmbeddings(*next, next->segments[i]);
+    }
+
+    // Манифест без сегментов, которые не открылись (их файлы удаляются)
+    saveIndex();
+    scheduleMerge();
+    scheduleRechunk();
+
+    std::cout << "✓ Index opened: " << loaded.size() << " documents, " << chunkCount << " chunks in "
+        << state.segments.size() << " segment(s), " << std::fixed << std::setprecision(1) << (fileBytes / 1048576.0)
+        << " MB mapped in " << std::setprecision(1) << elapsedMs(start) << " ms" << std::endl;
 }
 
-bool ContextManager::removeDocument(const std::string& docName) {
-    std::lock_guard<std::mutex> lock(mtx);
+void ContextManager::flushIndex(bool wait) {
+    std::future<void> written;
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        if (!store) {
+            return;
+        }
+        flushQueued = true;
+        written = maintenanceWorker->submit([this]() { writeSegment(); });
+    }
 
-    auto it = documents.find(docName);
-    if (it != documents.end()) {
-        documents.erase(it);
-        std::cout << "✓ Document '" << docName << "' removed from context" << std::endl;
-        return true;
+    if (wait) {
+        written.wait();
     }
+}
 
-    std::cout << "✗ Document '" << docName << "' not found in context" << std::endl;
-    return false;
+void ContextManager::scheduleFlush() {
+    if (stopping || !store || flushQueued) {
+        return;
+    }
+
+    uint64_t memoryBytes = 0;
+    for (const auto& segment : snapshot.load()->segments) {
+        if (!segment->isPersistent()) {
+            memoryBytes += segment->getFileSize();
+        }
+    }
+
+    if (memoryBytes >= FLUSH_SEGMENT_BYTES) {
+        flushQueued = true;
+        maintenanceWorker->submit([this]() { writeSegment(); });
+    }
 }
 
-void ContextManager::setMaxContextTokens(size_t tokens) {
+void ContextManager::writeSegment() {
+    auto start = std::chrono::steady_clock::now();
+
+    // Все сегменты в памяти текущего снимка сливаются в один сегмент на диске
+    std::vector<std::shared_ptr<const IndexSegment>> sources;
+    std::shared_ptr<VectorIndex> vectors;
+    uint64_t modelTag = 0;
+    std::string path;
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        flushQueued = false;
+
+        std::shared_ptr<const IndexSnapshot> current = snapshot.load();
+        for (const auto& segment : current->segments) {
+            if (!segment->isPersistent()) {
+                sources.push_back(segment);
+            }
+        }
+
+        if (sources.empty()) {
+            return;
+        }
+
+        vectors = current->vectorIndex;
+        modelTag = embeddingModelTag;
+        path = store->createSegmentPath();
+    }
+
+    // Запись без блокировки: поиск и загрузка продолжаются. Эмбеддинги берутся из векторного
+    // индекса, чанки, еще не векторизованные, сохраняются без них
+    const size_t dimension = vectors ? vectors->getDimension() : 0;
+    IndexSegment::EmbeddingLookup lookup;
+    if (vectors) {
+        lookup = [&vectors](InvertedIndex::ChunkId chunkId, std::vector<float>& embedding) {
+            return vectors->getVector(chunkId, embedding);
+        };
+    }
+
+    std::string error;
+    std::shared_ptr<const IndexSegment> segment = IndexSegment::merge(path, sources, dimension, modelTag, lookup,
+        tokenizer, error);
+    if (!segment) {
+        std::cout << "✗ " << error << std::endl;
+        return;
+    }
+
+    const size_t documentCount = segment->getDocumentCount();
+    const size_t chunkCount = segment->getChunkCount();
+    const uint64_t fileSize = segment->getFileSize();
+
     std::lock_guard<std::mutex> lock(mtx);
-    maxContextTokens = tokens;
-    std::cout << "Max context tokens set to: " << tokens << std::endl;
+    installMerged(sources, std::move(segment));
+
+    std::cout << "✓ Index segment written: " << documentCount << " documents, " << chunkCount << " chunks, "
+        << std::fixed << std::setprecision(1) << (fileSize / 1048576.0) << " MB in "
+        << std::setprecision(0) << elapsedMs(start) << " ms" << std::endl;
 }
 
-void ContextManager::setMaxChunkSize(size_t size) {
-    std::lock_guard<std::mutex> lock(mtx);
-    maxChunkSize = size;
-    std::cout << "Max chunk size set to: " << size << " characters" << std::endl;
+void ContextManager::scheduleMerge() {
+    if (stopping || !maintenanceWorker || mergeQueued) {
+        return;
+    }
+
+    if (!selectMergeSources(*snapshot.load()).empty()) {
+        mergeQueued = true;
+        maintenanceWorker->submit([this]() { mergeSegments(); });
+    }
 }
 
-std::vector<std::string> ContextManager::chunkContent(const std::string& content) {
-    std::vector<std::string> chunks;
+std::vector<std::shared_ptr<const IndexSegment>> ContextManager::selectMergeSources(const IndexSnapshot& current) const {
+    // Уровни сливаются отдельно: сначала сегменты в памяти (мелкие и частые), затем на диске
+    for (bool persistent : { false, true }) {
+        std::vector<std::shared_ptr<const IndexSegment>> level;
+        for (const auto& segment : current.segments) {
+            if (segment->isPersistent() == persistent) {
+                level.push_back(segment);
+            }
+        }
 
-    // Разбиваем на предложения и абзацы
-    std::istringstream stream(content);
-    std::string line;
-    std::stringstream currentChunk;
-    size_t currentSize = 0;
+        // Самые маленькие сегменты (по неудаленным чанкам) и сегменты, где удалено больше половины
+        std::vector<size_t> order(level.size());
+        std::iota(order.begin(), order.end(), 0);
+        auto liveChunks = [&level](size_t i) {
+            return level[i]->getChunkCount() - level[i]->getRemovedChunkCount();
+        };
+        std::sort(order.begin(), order.end(), [&](size_t a, size_t b) { return liveChunks(a) < liveChunks(b); });
+
+        std::vector<bool> selected(level.size(), false);
+        if (level.size() > MAX_SEGMENTS) {
+            for (size_t i = 0; i < MERGE_FACTOR && i < order.size(); ++i) {
+                selected[order[i]] = true;
+            }
+        }
 
-    while (std::getline(stream, line)) {
-        // Если строка пустая, это потенциальная граница чанка
-        if (line.empty()) {
-            if (currentSize > maxChunkSize / 2) { // Если чанк достаточно большой
-                chunks.push_back(currentChunk.str());
-                currentChunk.str("");
-                currentChunk.clear();
-                currentSize = 0;
-                continue;
+        // Порядок источников - от старых к новым
+        std::vector<std::shared_ptr<const IndexSegment>> sources;
+        for (size_t i = 0; i < level.size(); ++i) {
+            if (selected[i] || level[i]->getRemovedChunkCount() * 2 > level[i]->getChunkCount()) {
+                sources.push_back(level[i]);
             }
         }
 
-        // Добавляем строку к текущему чанку
-        size_t lineSize = line.size() + 1; // +1 для \n
+        if (!sources.empty()) {
+            return sources;
+        }
+    }
+    return {};
+}
+
+void ContextManager::mergeSegments() {
+    auto start = std::chrono::steady_clock::now();
+
+    std::vector<std::shared_ptr<const IndexSegment>> sources;
+    std::shared_ptr<VectorIndex> vectors;
+    uint64_t modelTag = 0;
+    std::string path;
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        mergeQueued = false;
+        if (stopping) {
+            return;
+        }
+
+        std::shared_ptr<const IndexSnapshot> current = snapshot.load();
+        sources = selectMergeSources(*current);
+        if (sources.empty()) {
+            return;
+        }
+
+        // Сегменты в памяти сливаются в памяти, сегменты на диске - в новый файл
+        if (sources.front()->isPersistent()) {
+            vectors = current->vectorIndex;
+            modelTag = embeddingModelTag;
+            path = store->createSegmentPath();
+        }
+    }
 
-        if (currentSize + lineSize > maxChunkSize && currentSize > 0) {
-            // Текущий чанк переполнен, сохраняем его
-            chunks.push_back(currentChunk.str());
-            currentChunk.str("");
-            currentChunk.clear();
-            currentSize = 0;
+    // Повреждение источника не должно попасть в слитый сегмент
+    std::string error;
+    for (const auto& source : sources) {
+        if (source->isPersistent() && !source->verify(error)) {
+            std::lock_guard<std::mutex> lock(mtx);
+            std::cout << "✗ " << error << std::endl;
+            dropSegment(*source);
+            scheduleMerge();
+            return;
         }
+    }
 
-        currentChunk << line << "\n";
-        currentSize += lineSize;
+    const size_t dimension = vectors ? vectors->getDimension() : 0;
+    IndexSegment::EmbeddingLookup lookup;
+    if (vectors) {
+        lookup = [&vectors](InvertedIndex::ChunkId chunkId, std::vector<float>& embedding) {
+            return vectors->getVector(chunkId, embedding);
+        };
     }
 
-    // Добавляем последний чанк
-    if (currentSize > 0) {
-        chunks.push_back(currentChunk.str());
+    std::shared_ptr<const IndexSegment> merged = IndexSegment::merge(path, sources, dimension, modelTag, lookup,
+        tokenizer, error);
+    if (!merged) {
+        std::cout << "✗ " << error << std::endl;
+        return;
     }
 
-    // Удаляем слишком короткие чанки
-    chunks.erase(
-        std::remove_if(chunks.begin(), chunks.end(),
-            [](const std::string& chunk) { return chunk.length() < 50; }),
-        chunks.end()
-    );
+    const size_t documentCount = merged->getDocumentCount();
+    const uint64_t fileSize = merged->getFileSize();
+
+    std::lock_guard<std::mutex> lock(mtx);
+    installMerged(sources, std::move(merged));
 
-    return chunks;
+    // Слияния в памяти частые и мелкие: в журнал попадают только слияния на диске
+    if (!path.empty()) {
+        std::cout << "✓ Index segments merged: " << sources.size() << " -> 1, " << documentCount
+            << " documents, " << std::fixed << std::setprecision(1) << (fileSize / 1048576.0) << " MB in "
+            << std::setprecision(0) << elapsedMs(start) << " ms" << std::endl;
+    }
 }
 
-std::vector<RankedChunk> ContextManager::rankChunksByRelevance(const std::string& query) {
-    std::vector<RankedChunk> rankedChunks;
+void ContextManager::installMerged(const std::vector<std::shared_ptr<const IndexSegment>>& sources,
+    std::shared_ptr<const IndexSegment> merged) {
+    std::shared_ptr<const IndexSnapshot> current = snapshot.load();
+    auto next = std::make_shared<IndexSnapshot>(*current);
+    next->segments.clear();
+
+    // Документы источника, удаленные за время слияния: по сравнению его копии в снимке с копией,
+    // которую сливали. Источник, выбывший из снимка, удален целиком
+    std::vector<uint32_t> removed;
+    auto removeFromMerged = [&](const IndexSegment& source, uint32_t document) {
+        uint32_t mergedDocument;
+        if (merged->findDocument(source.getDocumentName(document), mergedDocument)) {
+            removed.push_back(mergedDocument);
+        }
+    };
 
-    // Создаем карту частот для запроса
-    auto queryFreq = createWordFrequencyMap(normalizeText(query));
+    size_t position = SIZE_MAX;
+    bool persistent = merged->isPersistent();
+    std::vector<bool> present(sources.size(), false);
 
-    // Проходим по всем документам и чанкам
-    for (const auto& [docName, doc] : documents) {
-        for (size_t i = 0; i < doc->chunks.size(); ++i) {
-            const auto& chunk = doc->chunks[i];
+    for (const auto& segment : current->segments) {
+        auto source = std::find_if(sources.begin(), sources.end(),
+            [&](const std::shared_ptr<const IndexSegment>& s) { return s->sameData(*segment); });
+        if (source == sources.end()) {
+            next->segments.push_back(segment);
+            continue;
+        }
 
-            // Вычисляем релевантность
-            float relevance = calculateRelevance(query, chunk);
+        present[source - sources.begin()] = true;
+        persistent = persistent || segment->isPersistent();
+        for (uint32_t document : segment->getRemovedDocuments()) {
+            if (!(*source)->isDocumentRemoved(document)) {
+                removeFromMerged(**source, document);
+            }
+        }
 
-            if (relevance > 0.01f) { // Фильтруем совсем нерелевантные чанки
-                RankedChunk rankedChunk;
-                rankedChunk.content = chunk;
-                rankedChunk.source = docName;
-                rankedChunk.relevanceScore = relevance;
-                rankedChunk.chunkIndex = i;
+        // Результат встает на место самого старого источника
+        if (position == SIZE_MAX) {
+            position = next->segments.size();
+        }
+    }
 
-                rankedChunks.push_back(rankedChunk);
+    for (size_t i = 0; i < sources.size(); ++i) {
+        if (!present[i]) {
+            persistent = persistent || sources[i]->isPersistent();
+            for (uint32_t document = 0; document < sources[i]->getDocumentCount(); ++document) {
+                if (!sources[i]->isDocumentRemoved(document)) {
+                    removeFromMerged(*sources[i], document);
+                }
             }
         }
     }
 
-    // Сортируем по релевантности
-    std::sort(rankedChunks.begin(), rankedChunks.end(), std::greater<RankedChunk>());
+    if (!removed.empty()) {
+        merged = merged->withRemoved(removed, analyzer);
+    }
 
-    std::cout << "Ranked " << rankedChunks.size() << " relevant chunks" << std::endl;
+    // Если все документы удалены за время слияния, источники просто выбывают
+    const std::string path = merged->getPath();
+    const bool empty = isEmpty(*merged);
+    if (!empty) {
+        next->segments.insert(next->segments.begin() + std::min(position, next->segments.size()), merged);
+    }
+    publish(next);
 
-    return rankedChunks;
+    // Файлы источников удаляются после сохранения манифеста
+    if (persistent) {
+        saveIndex();
+    }
+    if (empty && !path.empty()) {
+        merged.reset();
+        std::error_code ec;
+        std::filesystem::remove(path, ec);
+    }
+    scheduleMerge();
 }
 
-float ContextManager::calculateRelevance(const std::string& query, const std::string& chunk) {
-    // Нормализуем тексты
-    std::string normalizedQuery = normalizeText(query);
-    std::string normalizedChunk = normalizeText(chunk);
-
-    // Создаем карты частот
-    auto queryFreq = createWordFrequencyMap(normalizedQuery);
-    auto chunkFreq = createWordFrequencyMap(normalizedChunk);
+void ContextManager::scheduleRechunk() {
+    if (stopping || !maintenanceWorker || rechunkQueued) {
+        return;
+    }
 
-    // Вычисляем косинусное сходство
-    float similarity = cosineSimilarity(queryFreq, chunkFreq);
+    for (const auto& [name, doc] : documents) {
+        if (doc->complete && (doc->chunkSize != maxChunkSize || doc->chunkOverlap != chunkOverlap)) {
+            rechunkQueued = true;
+            maintenanceWorker->submit([this]() { rechunkDocument(); });
+            return;
+        }
+    }
+}
 
-    // Дополнительные факторы релевантности
+void ContextManager::rechunkDocument() {
+    auto start = std::chrono::steady_clock::now();
+
+    std::shared_ptr<Document> doc;
+    std::shared_ptr<const IndexSnapshot> current;
+    IndexSegment::DocumentInfo info;
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        rechunkQueued = false;
+        if (stopping) {
+            return;
+        }
 
-    // 1. Прямое вхождение фраз из запроса
-    float directMatch = 0.0f;
-    auto keywords = extractKeywords(normalizedQuery);
-    for (const auto& keyword : keywords) {
-        if (normalizedChunk.find(keyword) != std::string::npos) {
-            directMatch += 0.2f; // Бонус за каждое найденное ключевое слово
+        for (const auto& [name, candidate] : documents) {
+            if (candidate->complete && (candidate->chunkSize != maxChunkSize || candidate->chunkOverlap != chunkOverlap)) {
+                doc = candidate;
+                break;
+            }
         }
+        if (!doc) {
+            return;
+        }
+
+        current = snapshot.load();
+        info = describePart(*doc, true);
+        info.chunkSize = static_cast<uint32_t>(maxChunkSize.load());
+        info.chunkOverlap = static_cast<uint32_t>(chunkOverlap.load());
     }
 
-    // 2. Учитываем длину чанка (предпочитаем средние по размеру чанки)
-    float lengthFactor = 1.0f;
-    if (chunk.length() < 100) {
-        lengthFactor = 0.5f; // Штраф за слишком короткие чанки
+    // Части документа из всех сегментов по порядку в тексте: их смещения восстанавливают текст
+    // документа (без исходного файла), перекрытия чанков пропускаются
+    struct Piece {
+        ChunkList::Source source;
+        std::string_view text;
+    };
+    std::vector<Piece> pieces;
+    for (const auto& segment : current->segments) {
+        uint32_t document;
+        if (!segment->findDocument(doc->name, document)) {
+            continue;
+        }
+        const IndexSegment::DocumentInfo part = segment->getDocument(document);
+        for (uint32_t chunk = part.firstChunk; chunk < part.firstChunk + part.chunkCount; ++chunk) {
+            pieces.push_back({ segment->getChunkSource(chunk), segment->getChunk(chunk) });
+        }
     }
-    else if (chunk.length() > 2000) {
-        lengthFactor = 0.8f; // Небольшой штраф за очень длинные чанки
+    std::stable_sort(pieces.begin(), pieces.end(), [](const Piece& a, const Piece& b) {
+        return a.source.offset < b.source.offset;
+    });
+
+    // Чанки без смещений (добавлены готовыми) идут подряд отдельными абзацами
+    TextChunker chunker = createChunker(info.chunkSize, info.chunkOverlap);
+    TextChunker::State state;
+    ChunkList chunks;
+    uint64_t end = 0;
+    for (size_t i = 0; i < pieces.size(); ++i) {
+        const Piece& piece = pieces[i];
+        uint64_t offset = piece.source.offset;
+        if (i > 0 && offset <= pieces[i - 1].source.offset) {
+            offset = end + 2;
+        }
+        chunker.appendAt(offset, piece.source.firstPage, piece.text, state, chunks);
+        end = std::max(end, offset + piece.text.size());
     }
+    chunker.flush(state, chunks);
 
-    // Итоговая релевантность
-    return (similarity * 0.7f + directMatch * 0.3f) * lengthFactor;
-}
+    auto segment = buildSegment(info, chunks);
 
-std::map<std::string, float> ContextManager::createWordFrequencyMap(const std::string& text) {
-    std::map<std::string, float> freq;
-    std::istringstream stream(text);
-    std::string word;
-    int totalWords = 0;
+    std::lock_guard<std::mutex> lock(mtx);
+    if (stopping) {
+        return;
+    }
 
-    while (stream >> word) {
-        if (word.length() > 2) { // Игнорируем слишком короткие слова
-            freq[word]++;
-            totalWords++;
+    // Документ удалили или загрузили заново, пока он разбивался: заменять нечего
+    auto it = documents.find(doc->name);
+    if (!segment && it != documents.end() && it->second == doc) {
+        // Не разбивается заново, пока параметры снова не изменятся
+        doc->chunkSize = info.chunkSize;
+        doc->chunkOverlap = info.chunkOverlap;
+    } else if (it != documents.end() && it->second == doc) {
+        const size_t oldChunks = doc->chunkCount;
+        size_t duplicateChunks = 0;
+        if (unindexDocument(doc->name, segment, &duplicateChunks)) {
+            saveIndex();
         }
+
+        doc->chunkSize = info.chunkSize;
+        doc->chunkOverlap = info.chunkOverlap;
+        doc->chunkCount = segment->getChunkCount();
+        doc->duplicateChunks = duplicateChunks;
+        enqueueEmbeddings(*snapshot.load(), segment);
+        scheduleFlush();
+
+        std::cout << "✓ Re-chunked '" << doc->name << "': " << oldChunks << " -> " << doc->chunkCount
+            << " chunks (" << info.chunkSize << " chars, overlap " << info.chunkOverlap << " tokens) in "
+            << std::fixed << std::setprecision(0) << elapsedMs(start) << " ms" << std::endl;
     }
+    scheduleRechunk();
+}
 
-    // Нормализуем частоты
-    for (auto& [w, f] : freq) {
-        f /= totalWords;
+void ContextManager::dropSegment(const IndexSegment& damaged) {
+    std::shared_ptr<const IndexSnapshot> current = snapshot.load();
+    auto found = std::find_if(current->segments.begin(), current->segments.end(),
+        [&](const std::shared_ptr<const IndexSegment>& segment) { return segment->sameData(damaged); });
+    if (found == current->segments.end()) {
+        return;
     }
 
-    return freq;
-}
+    const std::shared_ptr<const IndexSegment> segment = *found;
+    const std::string path = segment->getPath();
+
+    // Документ уходит целиком, вместе с частями в других сегментах
+    size_t dropped = 0;
+    for (uint32_t document = 0; document < segment->getDocumentCount(); ++document) {
+        if (segment->isDocumentRemoved(document)) {
+            continue;
+        }
+        const std::string name(segment->getDocumentName(document));
+        documents.erase(name);
+        unindexDocument(name);
+        dropped++;
+    }
 
-float ContextManager::cosineSimilarity(const std::map<std::string, float>& vec1,
-    const std::map<std::string, float>& vec2) {
-    if (vec1.empty() || vec2.empty()) {
-        return 0.0f;
+    // Сегмент без документов уже выбыл из снимка при удалении последнего из них
+    current = snapshot.load();
+    auto next = std::make_shared<IndexSnapshot>(*current);
+    next->segments.erase(std::remove_if(next->segments.begin(), next->segments.end(),
+        [&](const std::shared_ptr<const IndexSegment>& s) { return s->sameData(damaged); }), next->segments.end());
+    if (next->segments.size() != current->segments.size()) {
+        publish(next);
     }
+    saveIndex();
 
-    float dotProduct = 0.0f;
-    float norm1 = 0.0f;
-    float norm2 = 0.0f;
+    std::cout << "✗ Index segment dropped: " << path << ", " << dropped
+        << " document(s) will be indexed again on next start" << std::endl;
+}
 
-    // Вычисляем dot product только для общих слов
-    for (const auto& [word, freq1] : vec1) {
-        auto it = vec2.find(word);
-        if (it != vec2.end()) {
-            dotProduct += freq1 * it->second;
+std::string ContextManager::verifyIndex() {
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        if (!store) {
+            return "Persistent index is not open";
         }
-        norm1 += freq1 * freq1;
     }
 
-    for (const auto& [word, freq2] : vec2) {
-        norm2 += freq2 * freq2;
+    std::vector<std::shared_ptr<const IndexSegment>> toVerify;
+    for (const auto& segment : snapshot.load()->segments) {
+        if (segment->isPersistent()) {
+            toVerify.push_back(segment);
+        }
     }
 
-    if (norm1 == 0.0f || norm2 == 0.0f) {
-        return 0.0f;
+    // Проверка читает все сегменты целиком, поэтому идет без блокировки
+    auto start = std::chrono::steady_clock::now();
+    uint64_t bytes = 0;
+    size_t damaged = 0;
+    for (const auto& segment : toVerify) {
+        std::string error;
+        bytes += segment->getFileSize();
+        if (!segment->verify(error)) {
+            std::lock_guard<std::mutex> lock(mtx);
+            std::cout << "✗ " << error << std::endl;
+            dropSegment(*segment);
+            damaged++;
+        }
     }
 
-    return dotProduct / (std::sqrt(norm1) * std::sqrt(norm2));
+    std::stringstream ss;
+    ss << "Verified " << toVerify.size() << " segment(s), " << std::fixed << std::setprecision(1)
+        << (bytes / 1048576.0) << " MB in " << std::setprecision(0) << elapsedMs(start) << " ms: "
+        << (damaged == 0 ? "all checksums match" : std::to_string(damaged) + " damaged segment(s) dropped");
+    return ss.str();
 }
 
-size_t ContextManager::estimateTokenCount(const std::string& text) {
-    // Простая оценка: примерно 1 токен на 4 символа для английского/русского текста
-    return text.length() / 4;
-}
+void ContextManager::saveIndex() {
+    if (!store) {
+        return;
+    }
 
-// Альтернативный вариант с более безопасной проверкой:
-std::string ContextManager::normalizeText(const std::string& text) {
-    std::string normalized;
-    normalized.reserve(text.length());
+    IndexStore::State state;
+    state.nextChunkId = nextChunkId;
+    for (const auto& segment : snapshot.load()->segments) {
+        if (segment->isPersistent()) {
+            state.segments.push_back(segment);
+        }
+    }
 
-    for (char ch : text) {
-        unsigned char c = static_cast<unsigned char>(ch);  // Безопасное приведение
+    std::string error;
+    if (!store->save(state, error)) {
+        std::cout << "✗ " << error << std::endl;
+    }
+}
 
-        if (std::isalnum(c) || std::isspace(c)) {
-            normalized += static_cast<char>(std::tolower(c));
-        }
-        else if (c < 128) {  // Только ASCII символы
-            normalized += ' '; // Заменяем знаки препинания пробелами
+size_t ContextManager::countTokens(std::string_view text) const {
+    if (tokenizer.count) {
+        return tokenizer.count(text);
+    }
+
+    // Оценка: латиница и цифры - около 4 символов на токен, кириллица и другие символы вне ASCII -
+    // около 2.5 (считаются символы, а не байты UTF-8)
+    size_t ascii = 0;
+    size_t other = 0;
+    for (unsigned char c : text) {
+        if (c < 0x80) {
+            ascii++;
+        } else if ((c & 0xC0) != 0x80) {
+            other++;
         }
-        // Пропускаем не-ASCII символы (UTF-8 части)
     }
+    return ascii / 4 + other * 2 / 5;
+}
 
-    return normalized;
+size_t ContextManager::countChunkTokens(const IndexSegment& segment, uint32_t chunk) const {
+    if (tokenizer.tag != 0 && segment.getTokenizer() == tokenizer.tag) {
+        return segment.getTokenCount(chunk);
+    }
+    return countTokens(segment.getChunk(chunk));
 }
 
 std::vector<std::string> ContextManager::extractKeywords(const std::string& query) {
-    // Стоп-слова для русского и английского языков
-    static const std::unordered_set<std::string> stopWords = {
-        "в", "на", "и", "с", "по", "для", "от", "до", "из", "к", "о", "что", "как", "где", "когда",
-        "the", "a", "an", "and", "or", "but", "in", "on", "at", "to", "for", "of", "with", "by",
-        "is", "are", "was", "were", "be", "been", "have", "has", "had", "do", "does", "did",
-        "this", "that", "these", "those", "what", "where", "when", "how", "why"
-    };
+    // Термины запроса разбираются так же, как текст при индексации (служебные слова отброшены)
+    std::string buffer;
+    std::vector<std::string_view> terms;
+    analyzer.analyze(query, buffer, terms);
 
     std::vector<std::string> keywords;
-    std::istringstream stream(query);
-    std::string word;
-
-    while (stream >> word) {
-        // Очищаем слово от знаков препинания
-        std::string cleanWord;
-        for (char ch : word) {
-            unsigned char c = static_cast<unsigned char>(ch);
-            if (std::isalnum(c)) {
-                cleanWord += static_cast<char>(std::tolower(c));
-            }
-        }
-
-        if (cleanWord.length() > 2 && stopWords.find(cleanWord) == stopWords.end()) {
-            keywords.push_back(cleanWord);
+    for (std::string_view term : terms) {
+        if (std::find(keywords.begin(), keywords.end(), term) == keywords.end()) {
+            keywords.emplace_back(term);
         }
     }
 
@@ -1,4 +1,4 @@
-// ContextManager.h
+﻿// ContextManager.h
 #pragma once
 
 #include <string>
@@ -8,22 +8,67 @@
 #include <mutex>
 #include <algorithm>
 #include <numeric>
+#include <atomic>
+#include <functional>
+#include "InvertedIndex.h"
+#include "TextAnalyzer.h"
+#include "ChunkList.h"
+#include "TextChunker.h"
+#include "HNSWIndex.h"
+#include "IndexStore.h"
+#include "NearDuplicateIndex.h"
+#include "ContextCompressor.h"
+#include "QueryCache.h"
 
-//    
+class EmbeddingModel;
+class ThreadPool;
+
+// Настройки векторного поиска
+struct VectorSearchConfig {
+    VectorStorage storage = VectorStorage::Float;   // Float - граф HNSW, Int8/Binary - квантованные коды
+    HNSWConfig hnsw;                                // параметры графа (для Float)
+    size_t rerankCandidates = 100;                  // кандидатов на уточнение по float32 (для Int8/Binary)
+    std::string vectorDirectory;                    // каталог файла float32 (для Int8/Binary)
+};
+
+// Структура для хранения документа (описание; текст и термины чанков лежат в сегментах индекса)
 struct Document {
-    std::string name;                    //  
-    std::string content;                 //  
-    std::vector<std::string> chunks;     //    
-    size_t originalSize;                 //   
-    std::time_t addedTime;               //  
+    std::string name;                    // Имя файла
+    size_t originalSize;                 // Размер оригинального файла
+    std::string ocrProfile;              // Профиль OCR, которым извлекался текст
+    std::time_t addedTime;               // Время добавления
+    TextChunker::State chunkState;       // Незавершенный чанк при потоковой индексации
+    bool complete;                       // Индексация документа завершена
+    uint64_t sourceStamp = 0;            // Отпечаток исходного файла (0 - документ не из файла)
+    size_t chunkCount = 0;               // Чанков в индексе
+    size_t duplicateChunks = 0;          // Из них почти повторяют уже загруженные чанки
+    size_t chunkSize = 0;                // Параметры, с которыми документ разбит на чанки
+    size_t chunkOverlap = 0;
+};
+
+// Согласованный снимок индекса: сегменты (в памяти и на диске) с удалениями на момент снимка
+// и векторный поиск. Снимок не меняется: запрос берет текущий снимок и ранжирует по нему
+// без блокировок, а запись собирает новый снимок и публикует его целиком
+struct IndexSnapshot {
+    uint64_t generation = 0;                                    // номер публикации
+    std::vector<std::shared_ptr<const IndexSegment>> segments;  // от старых к новым
+    std::shared_ptr<EmbeddingModel> embeddingModel;
+    std::shared_ptr<VectorIndex> vectorIndex;
+};
+
+// Запрос, разобранный один раз на весь поиск: термины, общая статистика коллекции и номера
+// терминов с весами idf в каждом сегменте снимка. Все части параллельного поиска ранжируют по нему
+struct CompiledQuery {
+    std::vector<std::string> keywords;
+    InvertedIndex::CollectionStats collection;
+    std::vector<std::shared_ptr<const IndexSegment>> segments;  // сегменты с терминами запроса
+    std::vector<InvertedIndex::SparseVector> queries;           // запрос каждого из них
 };
 
-//    
+// Структура для ранжированного чанка (текст не копируется, чанк берется из индекса по идентификатору)
 struct RankedChunk {
-    std::string content;
-    std::string source;
+    InvertedIndex::ChunkId chunkId;
     float relevanceScore;
-    size_t chunkIndex;
 
     bool operator>(const RankedChunk& other) const {
         return relevanceScore > other.relevanceScore;
@@ -32,64 +77,283 @@ struct RankedChunk {
 
 class ContextManager {
 public:
-    //    
+    // Конструктор с настраиваемыми параметрами
     explicit ContextManager(size_t maxContextTokens = 3000, size_t maxChunkSize = 800);
+    ~ContextManager();
+
+    // Векторный поиск: чанки векторизуются моделью эмбеддингов в фоне (threads потоков,
+    // 0 - по числу контекстов модели) и добавляются в векторный индекс; уже загруженные чанки тоже
+    void setEmbeddingModel(std::shared_ptr<EmbeddingModel> model,
+        const VectorSearchConfig& config = VectorSearchConfig(), size_t threads = 0);
+
+    // Общий пул потоков (с загрузкой документов): большие запросы ранжируются по частям
+    // коллекции интерактивными задачами пула. Задается до начала работы; без пула - в потоке запроса
+    void setThreadPool(std::shared_ptr<ThreadPool> pool);
+
+    // Токенизатор модели генерации (modelInfo - ее описание): число токенов чанка считается
+    // при загрузке и хранится в сегменте, контекст собирается по точному числу токенов.
+    // Задается до открытия индекса; без токенизатора число токенов оценивается по длине текста
+    void setTokenizer(const std::string& modelInfo, std::function<size_t(std::string_view)> count);
+
+    // Сжатие контекста после упаковки: остается доля ratio токенов выбранных чанков - предложения,
+    // лучшие по терминам запроса (и по эмбеддингам, если есть модель), с соседями. 1 - без сжатия
+    void setCompressionRatio(double ratio);
+    double getCompressionRatio() const;
+
+    // Скорость prefill модели генерации (токенов в секунду) для оценки сэкономленного сжатием времени
+    void setPrefillRate(std::function<double()> tokensPerSecond);
+
+    // Ширина векторного поиска: efSearch графа или число уточняемых кандидатов
+    void setVectorSearchWidth(size_t width);
+
+    // Полнота векторного поиска относительно точного перебора float32 (recall@k)
+    std::string measureVectorRecall(size_t queries = 100, size_t k = 10);
+
+    // Микротест лексического поиска на queries запросах из текста чанков: разбор запроса
+    // (термины и их номера в сегментах) и ранжирование BM25 измеряются отдельно
+    std::string benchmarkSearch(size_t queries = 100);
 
-    //    
-    void addDocument(const std::string& docName, const std::string& content);
+    // Добавление документа в контекст
+    void addDocument(const std::string& docName, const std::string& content,
+        const std::string& ocrProfile = "");
 
-    //    
+    // Потоковая индексация: документ доступен для поиска сразу после beginDocument,
+    // чанки каждой страницы добавляются по мере извлечения (каждая порция - сегмент в памяти)
+    // sourceStamp - отпечаток исходного файла, по которому неизмененный файл не индексируется повторно
+    void beginDocument(const std::string& docName, const std::string& ocrProfile = "", uint64_t sourceStamp = 0);
+    bool appendToDocument(const std::string& docName, int pageNumber, const std::string& pageText);
+    void finishDocument(const std::string& docName);
+
+    // Добавление уже разбитых на чанки страниц (этап индексации конвейера загрузки)
+    bool appendChunks(const std::string& docName, const ChunkList& chunks, size_t textSize);
+
+    // Постоянный индекс в каталоге: документы прошлых запусков сразу доступны для поиска
+    // (сегменты отображаются в память), сегменты в памяти записываются на диск в фоне
+    void openIndex(const std::string& directory);
+
+    // Запись сегментов из памяти в новый сегмент постоянного индекса; wait - дождаться записи
+    void flushIndex(bool wait = false);
+
+    // Проверка контрольных сумм сегментов; поврежденные сегменты удаляются вместе с документами
+    std::string verifyIndex();
+
+    // Отпечаток исходного файла проиндексированного документа (0 - документа нет или он не из файла)
+    uint64_t getSourceStamp(const std::string& docName) const;
+
+    // Получение контекста для запроса (без блокировок: запросы идут параллельно друг другу и загрузке).
+    // Повторный вопрос с теми же терминами по тому же снимку индекса берется из кэша
     std::string getContextForQuery(const std::string& query);
 
-    //    
+    // Емкость кэша контекста в байтах (0 - без кэша)
+    void setQueryCacheSize(size_t bytes);
+
+    // Получение списка имен документов
     std::vector<std::string> getDocumentNames() const;
 
-    //   
+    // Получение статистики документов
     std::string getDocumentStats() const;
 
-    //   
+    // Очистка всех документов
     void clearDocuments();
 
-    //   
+    // Удаление конкретного документа
     bool removeDocument(const std::string& docName);
 
-    //  
+    // Настройка параметров. Документы, разбитые с другим размером чанка или перекрытием,
+    // разбиваются заново в фоне (по одному, поиск идет по старым чанкам до замены)
     void setMaxContextTokens(size_t tokens);
     void setMaxChunkSize(size_t size);
+    size_t getMaxChunkSize() const;
+
+    // Перекрытие соседних чанков в токенах: последние предложения чанка повторяются в следующем
+    void setChunkOverlap(size_t tokens);
+    size_t getChunkOverlap() const;
+
+    // Разбиение на чанки с текущими параметрами (этап разбиения конвейера загрузки)
+    TextChunker createChunker() const;
 
 private:
-    // 
-    size_t maxContextTokens;
-    size_t maxChunkSize;
+    // Параметры
+    std::atomic<size_t> maxContextTokens;
+    std::atomic<size_t> maxChunkSize;
+    std::atomic<size_t> chunkOverlap;
 
-    //  
+    // Разбор текста на термины, общий для сегментов и запросов
+    TextAnalyzer analyzer;
+
+    // Описания документов (под блокировкой записи)
     std::map<std::string, std::shared_ptr<Document>> documents;
 
-    //   
+    // Текущий снимок индекса
+    std::atomic<std::shared_ptr<const IndexSnapshot>> snapshot;
+
+    // Идентификаторы чанков выдаются по порядку и не меняются при слиянии сегментов:
+    // по ним чанки лежат в векторном индексе
+    std::atomic<InvertedIndex::ChunkId> nextChunkId;
+
+    // Группы почти одинаковых чанков по всем документам: в контекст группа попадает один раз
+    NearDuplicateIndex duplicates;
+
+    // Токенизатор модели генерации для счета токенов чанков
+    IndexSegment::Tokenizer tokenizer;
+
+    // Сжатие контекста: доля оставляемых токенов и скорость prefill модели
+    std::atomic<double> compressionRatio;
+    std::function<double()> prefillRate;
+
+    // Готовый контекст повторяющихся вопросов
+    QueryCache queryCache;
+
+    // Постоянный индекс: каталог сегментов на диске
+    std::unique_ptr<IndexStore> store;
+    bool flushQueued;
+    bool mergeQueued;
+    bool rechunkQueued;
+    uint64_t embeddingModelTag;          // хеш модели эмбеддингов (сохраненные векторы другой модели не берутся)
+
+    // Векторный поиск: настройки и фоновая векторизация чанков
+    VectorSearchConfig vectorConfig;
+    std::atomic<size_t> pendingEmbeddings;
+    std::atomic<bool> stopping;
+
+    // Статистика поиска (запросы идут параллельно, поэтому под своим мьютексом)
+    size_t queryCount;
+    double totalQueryMs;
+    double lastQueryMs;
+    uint64_t postingsTotal;
+    uint64_t postingsScored;
+    double totalVectorMs;
+    double totalCompileMs;
+    size_t parallelQueries;
+    size_t compressedQueries;
+    uint64_t tokensBeforeCompression;
+    uint64_t tokensAfterCompression;
+    double totalPrefillMsSaved;
+    size_t cacheLookups;
+    size_t cacheHits;
+    double totalCacheMsSaved;
+    mutable std::mutex statsMtx;
+
+    // Общий пул потоков для параллельного ранжирования
+    std::shared_ptr<ThreadPool> searchWorkers;
+
+    // Потоки векторизации и поток записи и слияния сегментов (объявлены последними:
+    // останавливаются первыми)
+    std::unique_ptr<ThreadPool> embeddingWorkers;
+    std::unique_ptr<ThreadPool> maintenanceWorker;
+
+    // Мьютекс записи: изменение документов и публикация снимков (запросы его не берут)
     mutable std::mutex mtx;
 
-    //    
-    std::vector<std::string> chunkContent(const std::string& content);
+    // Упаковка ранжированных чанков в контекст под maxContextTokens: из почти дубликатов берется
+    // лучший, набор чанков с наибольшей суммарной релевантностью выбирается как задача о рюкзаке
+    // (вес - токены чанка с заголовком), соседние чанки одного документа идут под одним заголовком
+    std::string packContext(const IndexSnapshot& current, const std::vector<RankedChunk>& rankedChunks,
+        const std::vector<std::string>& keywords, const std::vector<float>& queryVector);
+
+    // Извлекающее сжатие текстов блоков контекста до compressionRatio токенов; результат -
+    // сэкономлено токенов (0 - тексты не изменены)
+    size_t compressContext(const IndexSnapshot& current, const std::vector<std::string>& keywords,
+        const std::vector<float>& queryVector, std::vector<std::string>& texts);
+
+    // Оценка предложений: сумма idf терминов запроса в предложении, с моделью эмбеддингов -
+    // доля от лучшей лексической оценки плюс косинусная близость к вопросу
+    void scoreSentences(const IndexSnapshot& current, const std::vector<std::string>& keywords,
+        const std::vector<float>& queryVector, std::vector<ContextCompressor::Sentence>& sentences);
+
+    // Лучшие по релевантности чанки, которых хватает на заполнение контекста
+    // Лексические и векторные результаты объединяются по рангам (Reciprocal Rank Fusion)
+    std::vector<RankedChunk> rankChunksByRelevance(const IndexSnapshot& current, const std::string& query,
+        const std::vector<float>& queryVector);
+
+    // Разбор запроса по снимку: термины, их idf по всей коллекции и номера в каждом сегменте
+    // (один проход по словарю сегмента на все термины)
+    std::shared_ptr<const CompiledQuery> compileQuery(const IndexSnapshot& current, const std::string& query);
+
+    // BM25 по всей коллекции: сегменты - ее части с общей статистикой.
+    // Большая коллекция делится на диапазоны чанков, которые ранжируют поток запроса и задачи
+    // общего пула, у каждого потока свои лучшие чанки. Результат - идентификаторы чанков
+    std::vector<InvertedIndex::Hit> searchLexical(std::shared_ptr<const CompiledQuery> query, size_t topK,
+        InvertedIndex::SearchStats& stats) const;
+
+    // Сегмент и номер чанка в нем по идентификатору; false - чанка нет или он удален
+    static bool findChunk(const IndexSnapshot& current, InvertedIndex::ChunkId chunkId,
+        const IndexSegment*& segment, uint32_t& chunk);
+
+    // Сколько лучших чанков запрашивать у индекса
+    size_t getTopK() const;
+
+    // Публикация нового снимка (под блокировкой записи)
+    void publish(std::shared_ptr<IndexSnapshot> next);
+
+    // Сегмент в памяти из части документа info с чанками chunks (строится без блокировки)
+    std::shared_ptr<const IndexSegment> buildSegment(const IndexSegment::DocumentInfo& info, const ChunkList& chunks);
+
+    // Публикация сегмента документа, если документ не удален и не заменен, пока сегмент строился
+    bool publishSegment(const std::shared_ptr<Document>& doc, std::shared_ptr<const IndexSegment> segment);
+
+    // Отпечатки неудаленных чанков сегмента в индекс почти дубликатов; результат - сколько
+    // чанков оказались почти дубликатами уже добавленных
+    size_t indexDuplicates(const IndexSegment& segment);
+
+    // Удаление документа из индекса: его части отмечаются удаленными во всех сегментах новым
+    // снимком, затем векторы уходят из векторного индекса. replacement - сегмент с новой версией
+    // документа, публикуется тем же снимком; его отпечатки добавляются до публикации, число почти
+    // дубликатов среди них - в replacementDuplicates. true - изменен сегмент на диске
+    bool unindexDocument(const std::string& docName,
+        std::shared_ptr<const IndexSegment> replacement = nullptr, size_t* replacementDuplicates = nullptr);
+
+    // Запись сегментов из памяти на диск и слияние сегментов (в потоке обслуживания)
+    void writeSegment();
+    void mergeSegments();
+
+    // Сегменты для слияния: больше MAX_SEGMENTS сегментов одного уровня (в памяти или на диске) -
+    // MERGE_FACTOR самых маленьких из них, а также сегменты, где удалено больше половины чанков
+    std::vector<std::shared_ptr<const IndexSegment>> selectMergeSources(const IndexSnapshot& current) const;
+
+    // Замена источников слияния его результатом; документы, удаленные из источников за время
+    // слияния (в том числе вместе с выбывшим источником), удаляются и из результата
+    void installMerged(const std::vector<std::shared_ptr<const IndexSegment>>& sources,
+        std::shared_ptr<const IndexSegment> merged);
+
+    // Запись в фоне, если сегментов в памяти накопилось на сегмент на диске
+    void scheduleFlush();
+
+    // Слияние в фоне, если сегментов слишком много или в сегменте много удаленного
+    void scheduleMerge();
+
+    // Повторное разбиение в фоне, если есть документ, разбитый с другими параметрами
+    void scheduleRechunk();
+
+    // Повторное разбиение одного такого документа (в потоке обслуживания): текст собирается
+    // из его чанков по их смещениям, новый сегмент заменяет старые части одним снимком
+    void rechunkDocument();
+
+    // Разбиение с заданными параметрами; токены перекрытия считает countTokens
+    TextChunker createChunker(size_t chunkSize, size_t overlap) const;
+
+    // Удаление сегмента вместе с его документами (сегмент поврежден)
+    void dropSegment(const IndexSegment& segment);
 
-    //    
-    std::vector<RankedChunk> rankChunksByRelevance(const std::string& query);
+    // Сохранение манифеста постоянного индекса
+    void saveIndex();
 
-    //     
-    float calculateRelevance(const std::string& query, const std::string& chunk);
+    // Пустой векторный индекс по настройкам
+    std::shared_ptr<VectorIndex> createVectorIndex(size_t dimension) const;
 
-    //     (TF-IDF )
-    std::map<std::string, float> createWordFrequencyMap(const std::string& text);
+    // Векторы неудаленных чанков сегмента в фоне: сохраненные в сегменте эмбеддинги той же
+    // модели вставляются без модели, остальные чанки векторизуются
+    void enqueueEmbeddings(const IndexSnapshot& current, const std::shared_ptr<const IndexSegment>& segment);
 
-    //   
-    float cosineSimilarity(const std::map<std::string, float>& vec1,
-        const std::map<std::string, float>& vec2);
+    // Чанк еще в индексе и векторный индекс не заменен (после вставки вектора)
+    bool isChunkLive(const std::shared_ptr<VectorIndex>& index, InvertedIndex::ChunkId chunkId) const;
 
-    //    ()
-    size_t estimateTokenCount(const std::string& text);
+    // Число токенов текста: токенизатором модели, без него - оценка по длине текста
+    size_t countTokens(std::string_view text) const;
 
-    //    
-    std::string normalizeText(const std::string& text);
+    // Число токенов чанка: сохраненное в сегменте при том же токенизаторе, иначе countTokens
+    size_t countChunkTokens(const IndexSegment& segment, uint32_t chunk) const;
 
-    //     
+    // Извлечение терминов запроса (без стоп-слов и повторов)
     std::vector<std::string> extractKeywords(const std::string& query);
 };
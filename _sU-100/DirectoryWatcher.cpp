@@ -0,0 +1,261 @@
+﻿// DirectoryWatcher.cpp
+#include "DirectoryWatcher.h"
+#include <iostream>
+#include <vector>
+
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <poll.h>
+#include <unistd.h>
+#endif
+
+namespace fs = std::filesystem;
+
+namespace {
+    // Пауза после события перед сканированием: дает записи файла завершиться
+    constexpr std::chrono::milliseconds SETTLE_DELAY(500);
+
+    // Интервал опроса по умолчанию
+    constexpr std::chrono::milliseconds DEFAULT_POLL_INTERVAL(2000);
+
+    // Наибольшее время ожидания inotify, чтобы вовремя заметить остановку
+    constexpr std::chrono::milliseconds NOTIFY_WAIT_SLICE(250);
+}
+
+DirectoryWatcher::DirectoryWatcher(const std::string& directory, const std::string& extension)
+    : directory(directory),
+    extension(extension),
+    running(false),
+    pollInterval(DEFAULT_POLL_INTERVAL),
+    notifyFd(-1) {
+}
+
+DirectoryWatcher::~DirectoryWatcher() {
+    stop();
+}
+
+void DirectoryWatcher::setPollInterval(std::chrono::milliseconds interval) {
+    pollInterval = interval;
+}
+
+bool DirectoryWatcher::isUsingNotifications() const {
+    return notifyFd >= 0;
+}
+
+std::map<std::string, DirectoryWatcher::FileState> DirectoryWatcher::listFiles() const {
+    std::map<std::string, FileState> files;
+
+    std::error_code ec;
+    fs::recursive_directory_iterator it(directory, fs::directory_options::skip_permission_denied, ec);
+
+    // Файлы могут исчезать прямо во время обхода: ошибки отдельных записей пропускаем
+    for (; !ec && it != fs::recursive_directory_iterator(); it.increment(ec)) {
+        std::error_code entryEc;
+        if (!it->is_regular_file(entryEc) || it->path().extension() != extension) {
+            continue;
+        }
+
+        FileState state;
+        state.size = it->file_size(entryEc);
+        if (entryEc) {
+            continue;
+        }
+        state.modified = it->last_write_time(entryEc);
+        if (entryEc) {
+            continue;
+        }
+
+        files[it->path().string()] = state;
+    }
+
+    return files;
+}
+
+void DirectoryWatcher::snapshot() {
+    known = listFiles();
+    unsettled.clear();
+}
+
+bool DirectoryWatcher::start(ChangeCallback onChange) {
+    if (running) {
+        return false;
+    }
+
+    if (!fs::is_directory(directory)) {
+        std::cerr << "Warning: Cannot watch missing directory: " << directory << std::endl;
+        return false;
+    }
+
+    callback = std::move(onChange);
+
+#ifdef __linux__
+    notifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (notifyFd >= 0) {
+        addWatches();
+    }
+    else {
+        std::cerr << "Warning: inotify is unavailable, falling back to polling" << std::endl;
+    }
+#endif
+
+    running = true;
+    worker = std::thread(&DirectoryWatcher::run, this);
+    return true;
+}
+
+void DirectoryWatcher::stop() {
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        running = false;
+    }
+    cv.notify_all();
+
+    if (worker.joinable()) {
+        worker.join();
+    }
+
+#ifdef __linux__
+    if (notifyFd >= 0) {
+        close(notifyFd);
+        notifyFd = -1;
+    }
+#endif
+}
+
+void DirectoryWatcher::addWatches() {
+#ifdef __linux__
+    const uint32_t mask = IN_CREATE | IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM | IN_DELETE | IN_DELETE_SELF;
+
+    // Повторная подписка на уже отслеживаемый каталог безвредна
+    inotify_add_watch(notifyFd, directory.c_str(), mask);
+
+    std::error_code ec;
+    fs::recursive_directory_iterator it(directory, fs::directory_options::skip_permission_denied, ec);
+    for (; !ec && it != fs::recursive_directory_iterator(); it.increment(ec)) {
+        std::error_code entryEc;
+        if (it->is_directory(entryEc)) {
+            inotify_add_watch(notifyFd, it->path().string().c_str(), mask);
+        }
+    }
+#endif
+}
+
+bool DirectoryWatcher::waitForNotification(std::chrono::milliseconds timeout) {
+#ifdef __linux__
+    pollfd pfd{ notifyFd, POLLIN, 0 };
+    if (poll(&pfd, 1, static_cast<int>(timeout.count())) <= 0) {
+        return false;
+    }
+
+    alignas(inotify_event) char buffer[4096];
+    bool changed = false;
+    bool newDirectory = false;
+
+    ssize_t length;
+    while ((length = read(notifyFd, buffer, sizeof(buffer))) > 0) {
+        for (char* ptr = buffer; ptr < buffer + length;) {
+            const inotify_event* event = reinterpret_cast<const inotify_event*>(ptr);
+
+            // В новых подкаталогах тоже нужно отслеживать изменения
+            if ((event->mask & IN_ISDIR) && (event->mask & (IN_CREATE | IN_MOVED_TO))) {
+                newDirectory = true;
+            }
+            changed = true;
+
+            ptr += sizeof(inotify_event) + event->len;
+        }
+    }
+
+    if (newDirectory) {
+        addWatches();
+    }
+
+    return changed;
+#else
+    (void)timeout;
+    return false;
+#endif
+}
+
+bool DirectoryWatcher::scan() {
+    std::map<std::string, FileState> current = listFiles();
+    std::vector<FileChange> changes;
+    bool pending = false;
+
+    for (const auto& [path, state] : current) {
+        auto knownIt = known.find(path);
+        if (knownIt != known.end() && knownIt->second == state) {
+            unsettled.erase(path);
+            continue;
+        }
+
+        // Файл не менялся с прошлого сканирования - запись завершена
+        auto unsettledIt = unsettled.find(path);
+        if (unsettledIt != unsettled.end() && unsettledIt->second == state) {
+            changes.push_back({ knownIt == known.end() ? FileChange::Added : FileChange::Modified, path });
+            known[path] = state;
+            unsettled.erase(unsettledIt);
+            continue;
+        }
+
+        unsettled[path] = state;
+        pending = true;
+    }
+
+    for (auto it = known.begin(); it != known.end();) {
+        if (current.find(it->first) == current.end()) {
+            changes.push_back({ FileChange::Removed, it->first });
+            it = known.erase(it);
+        }
+        else {
+            ++it;
+        }
+    }
+
+    for (auto it = unsettled.begin(); it != unsettled.end();) {
+        it = current.find(it->first) == current.end() ? unsettled.erase(it) : std::next(it);
+    }
+
+    for (const auto& change : changes) {
+        if (callback) {
+            callback(change);
+        }
+    }
+
+    return pending;
+}
+
+void DirectoryWatcher::run() {
+    // Первое сканирование ловит изменения между snapshot() и start()
+    bool dirty = true;
+    auto scanDue = std::chrono::steady_clock::now();
+
+    while (running) {
+        auto now = std::chrono::steady_clock::now();
+
+        if (dirty && now >= scanDue) {
+            // Незавершенные файлы проверяются повторно после паузы
+            dirty = scan();
+            scanDue = now + (isUsingNotifications() ? SETTLE_DELAY : pollInterval);
+            continue;
+        }
+
+        if (isUsingNotifications()) {
+            auto timeout = NOTIFY_WAIT_SLICE;
+            if (dirty) {
+                timeout = std::min(timeout, std::chrono::duration_cast<std::chrono::milliseconds>(scanDue - now));
+            }
+
+            if (waitForNotification(timeout)) {
+                // Откладываем сканирование, пока поток событий не утихнет
+                dirty = true;
+                scanDue = std::chrono::steady_clock::now() + SETTLE_DELAY;
+            }
+        }
+        else {
+            std::unique_lock<std::mutex> lock(mtx);
+            cv.wait_until(lock, scanDue, [this]() { return !running; });
+            dirty = true;
+        }
+    }
+}
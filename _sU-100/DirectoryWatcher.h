@@ -0,0 +1,99 @@
+﻿// DirectoryWatcher.h
+#pragma once
+
+#include <string>
+#include <map>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+
+// Изменение файла в отслеживаемом каталоге
+struct FileChange {
+    enum Type { Added, Modified, Removed };
+
+    Type type;
+    std::string path;
+};
+
+// Отслеживание каталога документов (включая подкаталоги).
+// В Linux о изменениях сообщает inotify, в остальных системах каталог периодически
+// пересканируется. Файл считается готовым, когда его размер и время изменения
+// совпали в двух сканированиях подряд, поэтому копируемые файлы не обрабатываются наполовину
+class DirectoryWatcher {
+public:
+    using ChangeCallback = std::function<void(const FileChange& change)>;
+
+    DirectoryWatcher(const std::string& directory, const std::string& extension = ".pdf");
+    ~DirectoryWatcher();
+
+    DirectoryWatcher(const DirectoryWatcher&) = delete;
+    DirectoryWatcher& operator=(const DirectoryWatcher&) = delete;
+
+    // Запоминание текущего состояния каталога без уведомлений
+    // (вызывается до начальной загрузки, чтобы не пропустить файлы, появившиеся во время нее)
+    void snapshot();
+
+    // Запуск фонового потока; обработчик вызывается из этого потока
+    bool start(ChangeCallback callback);
+
+    // Остановка отслеживания
+    void stop();
+
+    // Используются ли уведомления системы (иначе - опрос)
+    bool isUsingNotifications() const;
+
+    // Интервал опроса каталога без уведомлений
+    void setPollInterval(std::chrono::milliseconds interval);
+
+private:
+    // Состояние файла при сканировании
+    struct FileState {
+        uintmax_t size;
+        std::filesystem::file_time_type modified;
+
+        bool operator==(const FileState& other) const {
+            return size == other.size && modified == other.modified;
+        }
+    };
+
+    std::string directory;
+    std::string extension;
+
+    // Файлы, о которых уже сообщено
+    std::map<std::string, FileState> known;
+
+    // Новые или измененные файлы, ожидающие завершения записи
+    std::map<std::string, FileState> unsettled;
+
+    ChangeCallback callback;
+    std::thread worker;
+    std::atomic<bool> running;
+
+    // Пробуждение потока при остановке
+    std::mutex mtx;
+    std::condition_variable cv;
+
+    std::chrono::milliseconds pollInterval;
+
+    // Дескриптор inotify (-1 - уведомления недоступны)
+    int notifyFd;
+
+    // Цикл фонового потока
+    void run();
+
+    // Сканирование каталога и рассылка изменений; true, если есть незавершенные файлы
+    bool scan();
+
+    // Текущее состояние подходящих файлов каталога
+    std::map<std::string, FileState> listFiles() const;
+
+    // Ожидание событий inotify; true, если в каталоге что-то изменилось
+    bool waitForNotification(std::chrono::milliseconds timeout);
+
+    // Подписка на все подкаталоги
+    void addWatches();
+};
@@ -0,0 +1,568 @@
+﻿// DocumentSource.cpp
+#include "DocumentSource.h"
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <cstring>
+#include <cstdint>
+#include <algorithm>
+
+#include <zlib.h>
+
+#ifdef _WIN32
+#include <io.h>
+#include <fcntl.h>
+#endif
+
+namespace {
+    // Размер буфера чтения потока
+    constexpr size_t READ_BUFFER_SIZE = 256 * 1024;
+
+    // Poppler принимает длину документа как int
+    constexpr uint64_t MAX_DOCUMENT_SIZE = 0x7FFFFFFF;
+
+    // Длинное имя и записи pax в tar не бывают больше MAX_TAR_NAME_RECORD байт:
+    // больший размер - поврежденный заголовок
+    constexpr uint64_t MAX_TAR_NAME_RECORD = 64 * 1024;
+
+    bool hasPdfExtension(const std::string& name) {
+        if (name.size() < 4) {
+            return false;
+        }
+        std::string ext = name.substr(name.size() - 4);
+        std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+        return ext == ".pdf";
+    }
+
+    uint16_t readLE16(const unsigned char* p) {
+        return static_cast<uint16_t>(p[0] | (p[1] << 8));
+    }
+
+    uint32_t readLE32(const unsigned char* p) {
+        return static_cast<uint32_t>(p[0]) | (static_cast<uint32_t>(p[1]) << 8)
+            | (static_cast<uint32_t>(p[2]) << 16) | (static_cast<uint32_t>(p[3]) << 24);
+    }
+
+    uint64_t readLE64(const unsigned char* p) {
+        return static_cast<uint64_t>(readLE32(p)) | (static_cast<uint64_t>(readLE32(p + 4)) << 32);
+    }
+
+    // Буферизованное чтение потока с возможностью заглянуть вперед.
+    // prefix - уже прочитанное из потока начало (при определении формата)
+    class ByteStream {
+    public:
+        ByteStream(std::istream& in, const std::string& prefix)
+            : in(in), buffer(std::max(READ_BUFFER_SIZE, prefix.size())), pos(0), end(prefix.size()) {
+            std::memcpy(buffer.data(), prefix.data(), prefix.size());
+        }
+
+        // Непрочитанные байты в буфере (подкачиваются, если буфер пуст); 0 - конец потока
+        size_t available() {
+            if (pos == end) {
+                fill(1);
+            }
+            return end - pos;
+        }
+
+        const char* current() const {
+            return buffer.data() + pos;
+        }
+
+        void consume(size_t count) {
+            pos += count;
+        }
+
+        // Гарантирует, что в буфере подряд лежат count байт (если поток не закончился)
+        size_t peek(size_t count) {
+            if (end - pos < count) {
+                fill(count);
+            }
+            return std::min(count, end - pos);
+        }
+
+        // Чтение ровно size байт
+        bool read(char* dst, size_t size) {
+            while (size > 0) {
+                size_t chunk = std::min(size, available());
+                if (chunk == 0) {
+                    return false;
+                }
+                std::memcpy(dst, current(), chunk);
+                consume(chunk);
+                dst += chunk;
+                size -= chunk;
+            }
+            return true;
+        }
+
+        // Пропуск size байт
+        bool skip(uint64_t size) {
+            while (size > 0) {
+                size_t chunk = static_cast<size_t>(std::min<uint64_t>(size, available()));
+                if (chunk == 0) {
+                    return false;
+                }
+                consume(chunk);
+                size -= chunk;
+            }
+            return true;
+        }
+
+    private:
+        std::istream& in;
+        std::vector<char> buffer;
+        size_t pos;
+        size_t end;
+
+        void fill(size_t minimum) {
+            // Сдвигаем непрочитанный остаток в начало буфера
+            if (pos > 0) {
+                std::memmove(buffer.data(), buffer.data() + pos, end - pos);
+                end -= pos;
+                pos = 0;
+            }
+            if (buffer.size() < minimum) {
+                buffer.resize(minimum);
+            }
+
+            while (end < minimum && in) {
+                in.read(buffer.data() + end, static_cast<std::streamsize>(buffer.size() - end));
+                std::streamsize got = in.gcount();
+                if (got <= 0) {
+                    break;
+                }
+                end += static_cast<size_t>(got);
+            }
+        }
+    };
+
+    // Одиночный PDF (отображенный файл или прочитанный поток)
+    class SingleSource : public DocumentSource {
+    public:
+        SingleSource(const std::string& name, std::shared_ptr<MemoryBuffer> buffer)
+            : name(name), buffer(std::move(buffer)) {
+        }
+
+        bool next(std::string& outName, std::shared_ptr<MemoryBuffer>& outBuffer) override {
+            if (!buffer) {
+                return false;
+            }
+            outName = name;
+            outBuffer = std::move(buffer);
+            return true;
+        }
+
+    private:
+        std::string name;
+        std::shared_ptr<MemoryBuffer> buffer;
+    };
+
+    // Последовательное чтение tar (ustar, GNU long names, pax path)
+    class TarSource : public DocumentSource {
+    public:
+        TarSource(std::unique_ptr<std::istream> owned, std::istream& in, const std::string& prefix,
+            const std::string& archiveName)
+            : owned(std::move(owned)), stream(in, prefix), archiveName(archiveName) {
+        }
+
+        bool next(std::string& name, std::shared_ptr<MemoryBuffer>& buffer) override {
+            std::string longName;
+
+            while (true) {
+                unsigned char header[512];
+                if (!stream.read(reinterpret_cast<char*>(header), sizeof(header))) {
+                    // Архив без завершающих нулевых блоков тоже считаем законченным
+                    return false;
+                }
+
+                // Нулевой блок - конец архива
+                if (std::all_of(header, header + sizeof(header), [](unsigned char c) { return c == 0; })) {
+                    return false;
+                }
+
+                uint64_t size = 0;
+                if (!parseSize(header + 124, size)) {
+                    error = "Error: Corrupt tar header in " + archiveName;
+                    return false;
+                }
+                uint64_t padded = (size + 511) & ~uint64_t(511);
+                char type = static_cast<char>(header[156]);
+
+                // Длинное имя следующей записи (GNU)
+                if (type == 'L' || type == 'x') {
+                    if (size > MAX_TAR_NAME_RECORD) {
+                        error = "Error: Corrupt tar header in " + archiveName;
+                        return false;
+                    }
+                    std::vector<char> data(static_cast<size_t>(size));
+                    if (!stream.read(data.data(), data.size()) || !stream.skip(padded - size)) {
+                        error = "Error: Unexpected end of tar archive " + archiveName;
+                        return false;
+                    }
+                    longName = type == 'L' ? std::string(data.data(), strnlen(data.data(), data.size()))
+                        : paxPath(std::string(data.begin(), data.end()));
+                    continue;
+                }
+
+                std::string entryName = longName.empty() ? headerName(header) : longName;
+                longName.clear();
+
+                bool regularFile = type == '0' || type == '\0';
+                if (!regularFile || !hasPdfExtension(entryName) || size > MAX_DOCUMENT_SIZE) {
+                    if (!stream.skip(padded)) {
+                        error = "Error: Unexpected end of tar archive " + archiveName;
+                        return false;
+                    }
+                    continue;
+                }
+
+                std::vector<char> data(static_cast<size_t>(size));
+                if (!stream.read(data.data(), data.size()) || !stream.skip(padded - size)) {
+                    error = "Error: Unexpected end of tar archive " + archiveName;
+                    return false;
+                }
+
+                name = archiveName + "/" + entryName;
+                buffer = MemoryBuffer::fromVector(std::move(data));
+                return true;
+            }
+        }
+
+    private:
+        std::unique_ptr<std::istream> owned;
+        ByteStream stream;
+        std::string archiveName;
+
+        static bool parseSize(const unsigned char* field, uint64_t& size) {
+            // Большие файлы: двоичное число в формате base-256
+            if (field[0] & 0x80) {
+                size = 0;
+                for (int i = 1; i < 12; ++i) {
+                    size = (size << 8) | field[i];
+                }
+                return true;
+            }
+
+            size = 0;
+            for (int i = 0; i < 12 && field[i] != 0 && field[i] != ' '; ++i) {
+                if (field[i] < '0' || field[i] > '7') {
+                    return false;
+                }
+                size = size * 8 + (field[i] - '0');
+            }
+            return true;
+        }
+
+        static std::string headerName(const unsigned char* header) {
+            const char* raw = reinterpret_cast<const char*>(header);
+            std::string name(raw, strnlen(raw, 100));
+
+            // ustar: имя может быть продолжено префиксом
+            if (std::memcmp(raw + 257, "ustar", 5) == 0 && raw[345] != 0) {
+                name = std::string(raw + 345, strnlen(raw + 345, 155)) + "/" + name;
+            }
+            return name;
+        }
+
+        static std::string paxPath(const std::string& records) {
+            // Записи вида "<длина> path=<имя>\n"
+            size_t pos = 0;
+            while (pos < records.size()) {
+                size_t space = records.find(' ', pos);
+                if (space == std::string::npos) {
+                    break;
+                }
+                size_t length = std::strtoul(records.c_str() + pos, nullptr, 10);
+                if (length == 0 || pos + length > records.size()) {
+                    break;
+                }
+
+                std::string record = records.substr(space + 1, pos + length - space - 2);
+                if (record.compare(0, 5, "path=") == 0) {
+                    return record.substr(5);
+                }
+                pos += length;
+            }
+            return "";
+        }
+    };
+
+    // Последовательное чтение zip по локальным заголовкам (stored и deflate, zip64).
+    // Центральный каталог не нужен, поэтому архив можно читать из канала
+    class ZipSource : public DocumentSource {
+    public:
+        ZipSource(std::unique_ptr<std::istream> owned, std::istream& in, const std::string& prefix,
+            const std::string& archiveName)
+            : owned(std::move(owned)), stream(in, prefix), archiveName(archiveName) {
+        }
+
+        bool next(std::string& name, std::shared_ptr<MemoryBuffer>& buffer) override {
+            while (true) {
+                if (stream.peek(4) < 4) {
+                    return false;
+                }
+
+                const unsigned char* sig = reinterpret_cast<const unsigned char*>(stream.current());
+                uint32_t signature = readLE32(sig);
+
+                // Центральный каталог - записи закончились
+                if (signature != LOCAL_HEADER_SIGNATURE) {
+                    return false;
+                }
+
+                unsigned char header[30];
+                if (!stream.read(reinterpret_cast<char*>(header), sizeof(header))) {
+                    return truncated();
+                }
+
+                uint16_t flags = readLE16(header + 6);
+                uint16_t method = readLE16(header + 8);
+                uint32_t crc = readLE32(header + 14);
+                uint64_t compressedSize = readLE32(header + 18);
+                uint64_t uncompressedSize = readLE32(header + 22);
+                uint16_t nameLength = readLE16(header + 26);
+                uint16_t extraLength = readLE16(header + 28);
+
+                std::string entryName(nameLength, '\0');
+                std::vector<unsigned char> extra(extraLength);
+                if (!stream.read(&entryName[0], nameLength)
+                    || !stream.read(reinterpret_cast<char*>(extra.data()), extraLength)) {
+                    return truncated();
+                }
+
+                bool zip64 = parseZip64(extra, compressedSize, uncompressedSize);
+                bool hasDescriptor = (flags & 0x08) != 0;
+                bool encrypted = (flags & 0x01) != 0;
+                bool wanted = hasPdfExtension(entryName) && !encrypted
+                    && (method == METHOD_STORED || method == METHOD_DEFLATE);
+
+                // Размер записи с дескриптором известен только после распаковки
+                if (hasDescriptor && method != METHOD_DEFLATE) {
+                    error = "Error: Unsupported zip entry (streamed without size): " + entryName;
+                    return false;
+                }
+
+                if (!hasDescriptor && !wanted) {
+                    if (!stream.skip(compressedSize)) {
+                        return truncated();
+                    }
+                    continue;
+                }
+
+                std::vector<char> data;
+                uint64_t consumed = 0;
+                if (method == METHOD_STORED) {
+                    if (compressedSize > MAX_DOCUMENT_SIZE) {
+                        error = "Error: Zip entry too large: " + entryName;
+                        return false;
+                    }
+                    data.resize(static_cast<size_t>(compressedSize));
+                    if (!stream.read(data.data(), data.size())) {
+                        return truncated();
+                    }
+                }
+                else if (!inflateEntry(data, consumed, hasDescriptor ? 0 : compressedSize)) {
+                    if (error.empty()) {
+                        error = "Error: Corrupt deflate data in " + archiveName + "/" + entryName;
+                    }
+                    return false;
+                }
+
+                if (hasDescriptor && !readDescriptor(zip64, crc)) {
+                    return truncated();
+                }
+
+                if (!wanted) {
+                    continue;
+                }
+
+                // Поврежденную запись пропускаем, остальные документы архива читаются дальше
+                uint32_t actualCrc = static_cast<uint32_t>(crc32(0L,
+                    reinterpret_cast<const Bytef*>(data.data()), static_cast<uInt>(data.size())));
+                if (actualCrc != crc) {
+                    std::cerr << "Warning: CRC mismatch, skipping " << archiveName << "/" << entryName << std::endl;
+                    continue;
+                }
+
+                name = archiveName + "/" + entryName;
+                buffer = MemoryBuffer::fromVector(std::move(data));
+                return true;
+            }
+        }
+
+    private:
+        static constexpr uint32_t LOCAL_HEADER_SIGNATURE = 0x04034b50;
+        static constexpr uint32_t DESCRIPTOR_SIGNATURE = 0x08074b50;
+        static constexpr uint16_t METHOD_STORED = 0;
+        static constexpr uint16_t METHOD_DEFLATE = 8;
+
+        std::unique_ptr<std::istream> owned;
+        ByteStream stream;
+        std::string archiveName;
+
+        bool truncated() {
+            error = "Error: Unexpected end of zip archive " + archiveName;
+            return false;
+        }
+
+        // Размеры zip64 из дополнительного поля 0x0001
+        static bool parseZip64(const std::vector<unsigned char>& extra, uint64_t& compressedSize,
+            uint64_t& uncompressedSize) {
+            size_t pos = 0;
+            while (pos + 4 <= extra.size()) {
+                uint16_t id = readLE16(&extra[pos]);
+                uint16_t length = readLE16(&extra[pos + 2]);
+                if (pos + 4 + length > extra.size()) {
+                    break;
+                }
+
+                if (id == 0x0001) {
+                    size_t field = pos + 4;
+                    if (uncompressedSize == 0xFFFFFFFF && field + 8 <= pos + 4 + length) {
+                        uncompressedSize = readLE64(&extra[field]);
+                        field += 8;
+                    }
+                    if (compressedSize == 0xFFFFFFFF && field + 8 <= pos + 4 + length) {
+                        compressedSize = readLE64(&extra[field]);
+                    }
+                    return true;
+                }
+                pos += 4 + length;
+            }
+            return false;
+        }
+
+        // Распаковка deflate прямо из буфера потока до конца сжатых данных
+        bool inflateEntry(std::vector<char>& data, uint64_t& consumed, uint64_t compressedSize) {
+            z_stream zs{};
+            if (inflateInit2(&zs, -MAX_WBITS) != Z_OK) {
+                return false;
+            }
+
+            std::vector<char> out(READ_BUFFER_SIZE);
+            int status = Z_OK;
+
+            while (status != Z_STREAM_END) {
+                size_t chunk = stream.available();
+                if (chunk == 0) {
+                    break;
+                }
+                if (compressedSize > 0) {
+                    chunk = static_cast<size_t>(std::min<uint64_t>(chunk, compressedSize - consumed));
+                }
+
+                zs.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(stream.current()));
+                zs.avail_in = static_cast<uInt>(chunk);
+
+                do {
+                    zs.next_out = reinterpret_cast<Bytef*>(out.data());
+                    zs.avail_out = static_cast<uInt>(out.size());
+
+                    status = inflate(&zs, Z_NO_FLUSH);
+                    if (status != Z_OK && status != Z_STREAM_END) {
+                        inflateEnd(&zs);
+                        return false;
+                    }
+
+                    data.insert(data.end(), out.data(), out.data() + (out.size() - zs.avail_out));
+                    if (data.size() > MAX_DOCUMENT_SIZE) {
+                        inflateEnd(&zs);
+                        error = "Error: Zip entry too large in " + archiveName;
+                        return false;
+                    }
+                } while (zs.avail_out == 0 && status != Z_STREAM_END);
+
+                // Байты после конца сжатых данных остаются в потоке
+                size_t used = chunk - zs.avail_in;
+                stream.consume(used);
+                consumed += used;
+            }
+
+            inflateEnd(&zs);
+            return status == Z_STREAM_END;
+        }
+
+        // Дескриптор данных после записи: [сигнатура] crc, сжатый и исходный размер
+        bool readDescriptor(bool zip64, uint32_t& crc) {
+            unsigned char word[4];
+            if (!stream.read(reinterpret_cast<char*>(word), 4)) {
+                return false;
+            }
+            if (readLE32(word) == DESCRIPTOR_SIGNATURE && !stream.read(reinterpret_cast<char*>(word), 4)) {
+                return false;
+            }
+            crc = readLE32(word);
+            return stream.skip(zip64 ? 16 : 8);
+        }
+    };
+
+    std::unique_ptr<DocumentSource> detectStream(std::unique_ptr<std::istream> owned, std::istream& in,
+        const std::string& name, std::string& error) {
+        // Заглядываем в начало потока, не теряя прочитанные байты
+        char head[512] = {};
+        in.read(head, sizeof(head));
+        size_t got = static_cast<size_t>(in.gcount());
+        std::string prefix(head, got);
+
+        bool isZip = got >= 4 && std::memcmp(head, "PK\x03\x04", 4) == 0;
+        bool isTar = got >= 262 && std::memcmp(head + 257, "ustar", 5) == 0;
+        bool isPdf = prefix.find("%PDF") != std::string::npos;
+
+        if (!isZip && !isTar && !isPdf) {
+            error = "Error: Unrecognized stream format: " + name;
+            return nullptr;
+        }
+
+        if (isZip) {
+            return std::make_unique<ZipSource>(std::move(owned), in, prefix, name);
+        }
+        if (isTar) {
+            return std::make_unique<TarSource>(std::move(owned), in, prefix, name);
+        }
+
+        // Одиночный PDF из потока читается целиком: разбор требует произвольного доступа
+        std::vector<char> data(prefix.begin(), prefix.end());
+        char block[64 * 1024];
+        while (in.read(block, sizeof(block)) || in.gcount() > 0) {
+            data.insert(data.end(), block, block + in.gcount());
+            if (data.size() > MAX_DOCUMENT_SIZE) {
+                error = "Error: PDF stream too large: " + name;
+                return nullptr;
+            }
+        }
+        return std::make_unique<SingleSource>(name, MemoryBuffer::fromVector(std::move(data)));
+    }
+}
+
+std::unique_ptr<DocumentSource> DocumentSource::open(const std::string& path, std::string& error) {
+    if (path == "-") {
+#ifdef _WIN32
+        // Двоичный режим, иначе CRLF в PDF будет искажен
+        _setmode(_fileno(stdin), _O_BINARY);
+#endif
+        return fromStream(std::cin, "stdin", error);
+    }
+
+    // Отдельный PDF отображается в память без копирования
+    if (hasPdfExtension(path)) {
+        auto buffer = MemoryBuffer::mapFile(path, error);
+        if (!buffer) {
+            return nullptr;
+        }
+        return std::make_unique<SingleSource>(path, buffer);
+    }
+
+    auto file = std::make_unique<std::ifstream>(path, std::ios::binary);
+    if (!*file) {
+        error = "Error: Failed to open file: " + path;
+        return nullptr;
+    }
+
+    std::istream& in = *file;
+    return detectStream(std::move(file), in, path, error);
+}
+
+std::unique_ptr<DocumentSource> DocumentSource::fromStream(std::istream& in, const std::string& name,
+    std::string& error) {
+    return detectStream(nullptr, in, name, error);
+}
@@ -0,0 +1,31 @@
+﻿// DocumentSource.h
+#pragma once
+
+#include <string>
+#include <memory>
+#include <istream>
+
+#include "MemoryBuffer.h"
+
+// Источник PDF документов в памяти: архив zip/tar, поток (stdin) или отдельный файл.
+// Архивы читаются последовательно, содержимое во временные файлы не распаковывается
+class DocumentSource {
+public:
+    virtual ~DocumentSource() = default;
+
+    // Следующий PDF документ; false, если документы закончились или произошла ошибка (см. getError)
+    virtual bool next(std::string& name, std::shared_ptr<MemoryBuffer>& buffer) = 0;
+
+    // Ошибка чтения (пустая строка, если источник просто закончился)
+    const std::string& getError() const { return error; }
+
+    // Источник по пути: *.zip, *.tar, *.pdf; "-" - стандартный ввод
+    static std::unique_ptr<DocumentSource> open(const std::string& path, std::string& error);
+
+    // Источник из потока: формат (zip, tar или одиночный PDF) определяется по первым байтам
+    static std::unique_ptr<DocumentSource> fromStream(std::istream& in, const std::string& name,
+        std::string& error);
+
+protected:
+    std::string error;
+};
@@ -0,0 +1,195 @@
+﻿// EmbeddingModel.cpp
+#include "EmbeddingModel.h"
+#include <iostream>
+#include <stdexcept>
+#include <algorithm>
+#include <thread>
+#include <cmath>
+
+namespace {
+    // Окно модели эмбеддингов: чанк в 800 символов укладывается с запасом
+    constexpr uint32_t EMBEDDING_CONTEXT_TOKENS = 512;
+}
+
+EmbeddingModel::EmbeddingModel(const std::string& modelPath, size_t contextCount)
+    : model(nullptr), dimension(0), maxTokens(EMBEDDING_CONTEXT_TOKENS) {
+    try {
+        llama_backend_init();
+
+        std::cout << "Loading embedding model: " << modelPath << std::endl;
+
+        llama_model_params modelParams = llama_model_default_params();
+        modelParams.n_gpu_layers = 0; // CPU-only
+
+        model = llama_model_load_from_file(modelPath.c_str(), modelParams);
+        if (!model) {
+            throw std::runtime_error("Failed to load embedding model from: " + modelPath);
+        }
+
+        dimension = static_cast<size_t>(llama_model_n_embd(model));
+
+        if (contextCount == 0) {
+            contextCount = std::min<size_t>(4, std::max(1u, std::thread::hardware_concurrency()));
+        }
+
+        // Каждый контекст векторизует один текст целиком за один проход
+        llama_context_params ctxParams = llama_context_default_params();
+        ctxParams.n_ctx = EMBEDDING_CONTEXT_TOKENS;
+        ctxParams.n_batch = EMBEDDING_CONTEXT_TOKENS;
+        ctxParams.n_ubatch = EMBEDDING_CONTEXT_TOKENS;
+        ctxParams.n_threads = std::max(1u, std::thread::hardware_concurrency() / static_cast<unsigned>(contextCount));
+        ctxParams.n_threads_batch = ctxParams.n_threads;
+        ctxParams.embeddings = true;
+        ctxParams.pooling_type = LLAMA_POOLING_TYPE_MEAN;
+
+        for (size_t i = 0; i < contextCount; ++i) {
+            llama_context* ctx = llama_init_from_model(model, ctxParams);
+            if (!ctx) {
+                throw std::runtime_error("Failed to create embedding context");
+            }
+            contexts.push_back(ctx);
+        }
+        idleContexts = contexts;
+
+        std::cout << "✓ Embedding model loaded: " << dimension << " dimensions, "
+            << contexts.size() << " context(s)" << std::endl;
+    }
+    catch (const std::exception& e) {
+        std::cerr << "✗ Error initializing embedding model: " << e.what() << std::endl;
+        cleanup();
+        throw;
+    }
+}
+
+EmbeddingModel::~EmbeddingModel() {
+    cleanup();
+}
+
+void EmbeddingModel::cleanup() {
+    for (llama_context* ctx : contexts) {
+        llama_free(ctx);
+    }
+    contexts.clear();
+    idleContexts.clear();
+
+    if (model) {
+        llama_model_free(model);
+        model = nullptr;
+    }
+}
+
+size_t EmbeddingModel::getDimension() const {
+    return dimension;
+}
+
+size_t EmbeddingModel::getContextCount() const {
+    return contexts.size();
+}
+
+std::string EmbeddingModel::getModelInfo() const {
+    char buf[256] = {};
+    if (model) {
+        llama_model_desc(model, buf, sizeof(buf));
+    }
+    return std::string(buf) + ", " + std::to_string(dimension) + " dimensions";
+}
+
+std::vector<llama_token> EmbeddingModel::tokenize(const std::string& text) const {
+    std::vector<llama_token> tokens(text.size() + 16);
+    const llama_vocab* vocab = llama_model_get_vocab(model);
+
+    // Специальные токены ([CLS]/[SEP] или BOS) нужны модели эмбеддингов
+    int n = llama_tokenize(vocab, text.c_str(), static_cast<int32_t>(text.size()),
+        tokens.data(), static_cast<int32_t>(tokens.size()), true, false);
+
+    if (n < 0) {
+        tokens.resize(-n);
+        n = llama_tokenize(vocab, text.c_str(), static_cast<int32_t>(text.size()),
+            tokens.data(), static_cast<int32_t>(tokens.size()), true, false);
+    }
+
+    tokens.resize(std::max(n, 0));
+    return tokens;
+}
+
+bool EmbeddingModel::embed(const std::string& text, std::vector<float>& embedding) {
+    if (!model || contexts.empty() || text.empty()) {
+        return false;
+    }
+
+    std::vector<llama_token> tokens = tokenize(text);
+    if (tokens.empty()) {
+        return false;
+    }
+    if (tokens.size() > maxTokens) {
+        tokens.resize(maxTokens);
+    }
+
+    // Берем свободный контекст
+    llama_context* ctx = nullptr;
+    {
+        std::unique_lock<std::mutex> lock(mtx);
+        cv.wait(lock, [this]() { return !idleContexts.empty(); });
+        ctx = idleContexts.back();
+        idleContexts.pop_back();
+    }
+
+    llama_kv_cache_clear(ctx);
+
+    // Весь текст одной последовательностью
+    const int32_t n = static_cast<int32_t>(tokens.size());
+    llama_batch batch = llama_batch_init(n, 0, 1);
+    for (int32_t i = 0; i < n; ++i) {
+        batch.token[i] = tokens[i];
+        batch.pos[i] = i;
+        batch.n_seq_id[i] = 1;
+        batch.seq_id[i][0] = 0;
+        batch.logits[i] = 1;
+    }
+    batch.n_tokens = n;
+
+    // Модели-кодировщики (BERT) обрабатываются encode, декодеры - decode
+    int result = llama_model_has_encoder(model) && !llama_model_has_decoder(model)
+        ? llama_encode(ctx, batch)
+        : llama_decode(ctx, batch);
+
+    bool ok = false;
+    if (result == 0) {
+        const float* data = llama_get_embeddings_seq(ctx, 0);
+        if (!data) {
+            // Модель без пулинга: берем эмбеддинг последнего токена
+            data = llama_get_embeddings_ith(ctx, n - 1);
+        }
+
+        if (data) {
+            embedding.assign(data, data + dimension);
+
+            // Нормализация: косинусная близость становится скалярным произведением
+            double norm = 0.0;
+            for (float value : embedding) {
+                norm += static_cast<double>(value) * value;
+            }
+            if (norm > 0.0) {
+                float scale = static_cast<float>(1.0 / std::sqrt(norm));
+                for (float& value : embedding) {
+                    value *= scale;
+                }
+            }
+            ok = true;
+        }
+    }
+
+    llama_batch_free(batch);
+
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        idleContexts.push_back(ctx);
+    }
+    cv.notify_one();
+
+    if (!ok) {
+        std::cerr << "Error: Failed to compute embedding" << std::endl;
+    }
+
+    return ok;
+}
@@ -0,0 +1,53 @@
+﻿// EmbeddingModel.h
+#pragma once
+
+#include <string>
+#include <vector>
+#include <mutex>
+#include <condition_variable>
+
+// Включаем API llama.cpp
+#include <llama.h>
+
+// Модель эмбеддингов (GGUF, например bge-small или multilingual-e5) для векторного поиска.
+// Держит несколько контекстов llama.cpp, поэтому тексты можно векторизовать параллельно
+class EmbeddingModel {
+public:
+    // Загрузка модели; contextCount - число одновременно векторизуемых текстов (0 - по числу ядер, не больше 4)
+    explicit EmbeddingModel(const std::string& modelPath, size_t contextCount = 0);
+    ~EmbeddingModel();
+
+    EmbeddingModel(const EmbeddingModel&) = delete;
+    EmbeddingModel& operator=(const EmbeddingModel&) = delete;
+
+    // Нормализованный эмбеддинг текста; длинный текст обрезается до размера окна модели
+    bool embed(const std::string& text, std::vector<float>& embedding);
+
+    // Размерность эмбеддингов
+    size_t getDimension() const;
+
+    // Число контекстов (параллельных векторизаций)
+    size_t getContextCount() const;
+
+    // Описание модели
+    std::string getModelInfo() const;
+
+private:
+    llama_model* model;
+
+    // Контексты llama.cpp и свободные из них
+    std::vector<llama_context*> contexts;
+    std::vector<llama_context*> idleContexts;
+    std::mutex mtx;
+    std::condition_variable cv;
+
+    // Размерность и максимальная длина текста в токенах
+    size_t dimension;
+    size_t maxTokens;
+
+    // Токенизация текста
+    std::vector<llama_token> tokenize(const std::string& text) const;
+
+    // Освобождение ресурсов
+    void cleanup();
+};
@@ -0,0 +1,183 @@
+﻿// ExtractionCache.cpp
+#include "ExtractionCache.h"
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <filesystem>
+#include <thread>
+#include <algorithm>
+
+namespace fs = std::filesystem;
+
+namespace {
+    // Версия формата записей кэша
+    constexpr const char* CACHE_FORMAT = "ucache 1";
+
+    constexpr uint64_t FNV_PRIME = 1099511628211ull;
+}
+
+ExtractionCache::ExtractionCache(const std::string& directory)
+    : directory(directory) {
+    std::error_code ec;
+    fs::create_directories(fs::path(directory) / "pages", ec);
+    fs::create_directories(fs::path(directory) / "docs", ec);
+
+    if (ec) {
+        std::cerr << "Warning: Failed to create extraction cache directory: " << directory << std::endl;
+    }
+}
+
+uint64_t ExtractionCache::hashBytes(const void* data, size_t size, uint64_t seed) {
+    const unsigned char* bytes = static_cast<const unsigned char*>(data);
+    uint64_t hash = seed;
+
+    for (size_t i = 0; i < size; ++i) {
+        hash ^= bytes[i];
+        hash *= FNV_PRIME;
+    }
+
+    return hash;
+}
+
+uint64_t ExtractionCache::hashContent(const void* data, size_t size) {
+    return hashContent(data, size, size, nullptr);
+}
+
+uint64_t ExtractionCache::hashContent(const void* data, size_t size, size_t sliceSize,
+    const std::function<void(size_t offset, size_t length)>& afterSlice) {
+    const char* bytes = static_cast<const char*>(data);
+    uint64_t hash = hashBytes(nullptr, 0);
+
+    // FNV-1a последовательный: хэш частей с переданным состоянием равен хэшу целого
+    for (size_t offset = 0; offset < size;) {
+        size_t length = std::min(sliceSize > 0 ? sliceSize : size, size - offset);
+        hash = hashBytes(bytes + offset, length, hash);
+        if (afterSlice) {
+            afterSlice(offset, length);
+        }
+        offset += length;
+    }
+
+    // Размер файла дополнительно снижает вероятность коллизий
+    uint64_t totalSize = size;
+    return hashBytes(&totalSize, sizeof(totalSize), hash);
+}
+
+std::string ExtractionCache::toHex(uint64_t value) {
+    static const char digits[] = "0123456789abcdef";
+    std::string hex(16, '0');
+
+    for (int i = 15; i >= 0; --i) {
+        hex[i] = digits[value & 0xF];
+        value >>= 4;
+    }
+
+    return hex;
+}
+
+std::string ExtractionCache::pagePath(uint64_t fingerprint) const {
+    // Раскладываем страницы по подкаталогам, чтобы не держать сотни тысяч файлов в одном
+    std::string hex = toHex(fingerprint);
+    return (fs::path(directory) / "pages" / hex.substr(0, 2) / (hex + ".txt")).string();
+}
+
+std::string ExtractionCache::documentPath(const std::string& documentKey) const {
+    return (fs::path(directory) / "docs" / (documentKey + ".idx")).string();
+}
+
+bool ExtractionCache::loadDocument(const std::string& documentKey, std::vector<std::string>& pages) {
+    std::ifstream file(documentPath(documentKey));
+    if (!file) {
+        return false;
+    }
+
+    std::string format;
+    size_t pageCount = 0;
+    if (!std::getline(file, format) || format != CACHE_FORMAT || !(file >> pageCount)) {
+        return false;
+    }
+
+    std::vector<std::string> loaded;
+    loaded.reserve(pageCount);
+
+    for (size_t i = 0; i < pageCount; ++i) {
+        std::string hex;
+        if (!(file >> hex)) {
+            return false;
+        }
+
+        uint64_t fingerprint = 0;
+        try {
+            fingerprint = std::stoull(hex, nullptr, 16);
+        }
+        catch (const std::exception&) {
+            return false;
+        }
+
+        std::string text;
+        if (!loadPage(fingerprint, text)) {
+            return false;
+        }
+        loaded.push_back(std::move(text));
+    }
+
+    pages = std::move(loaded);
+    return true;
+}
+
+void ExtractionCache::storeDocument(const std::string& documentKey, const std::vector<uint64_t>& pageFingerprints) {
+    std::stringstream ss;
+    ss << CACHE_FORMAT << "\n" << pageFingerprints.size() << "\n";
+    for (uint64_t fingerprint : pageFingerprints) {
+        ss << toHex(fingerprint) << "\n";
+    }
+
+    writeFile(documentPath(documentKey), ss.str());
+}
+
+bool ExtractionCache::loadPage(uint64_t fingerprint, std::string& text) {
+    std::ifstream file(pagePath(fingerprint), std::ios::binary);
+    if (!file) {
+        return false;
+    }
+
+    std::stringstream ss;
+    ss << file.rdbuf();
+    text = ss.str();
+    return true;
+}
+
+void ExtractionCache::storePage(uint64_t fingerprint, const std::string& text) {
+    std::string path = pagePath(fingerprint);
+
+    std::error_code ec;
+    fs::create_directories(fs::path(path).parent_path(), ec);
+
+    writeFile(path, text);
+}
+
+bool ExtractionCache::writeFile(const std::string& filePath, const std::string& data) {
+    // Временное имя уникально для потока, чтобы параллельные записи не пересекались
+    std::stringstream tmpName;
+    tmpName << filePath << ".tmp" << std::hash<std::thread::id>()(std::this_thread::get_id());
+
+    {
+        std::ofstream file(tmpName.str(), std::ios::binary | std::ios::trunc);
+        if (!file) {
+            return false;
+        }
+        file.write(data.data(), data.size());
+        if (!file) {
+            return false;
+        }
+    }
+
+    std::error_code ec;
+    fs::rename(tmpName.str(), filePath, ec);
+    if (ec) {
+        fs::remove(tmpName.str(), ec);
+        return false;
+    }
+
+    return true;
+}
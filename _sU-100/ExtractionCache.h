@@ -0,0 +1,56 @@
+﻿// ExtractionCache.h
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <functional>
+
+// Постоянный кэш извлеченного текста.
+// Документ ищется по хэшу содержимого файла и настроек извлечения,
+// текст хранится постранично по отпечатку страницы, поэтому в измененном PDF
+// заново обрабатываются только изменившиеся страницы
+class ExtractionCache {
+public:
+    // Конструктор с каталогом кэша (создается при необходимости)
+    explicit ExtractionCache(const std::string& directory);
+
+    // Хэш содержимого файла, уже прочитанного в память
+    static uint64_t hashContent(const void* data, size_t size);
+
+    // То же по частям: после каждой части вызывается обработчик (смещение, длина),
+    // например, чтобы выгрузить прочитанную часть отображенного файла
+    static uint64_t hashContent(const void* data, size_t size, size_t sliceSize,
+        const std::function<void(size_t offset, size_t length)>& afterSlice);
+
+    // Хэш произвольных данных (FNV-1a)
+    static uint64_t hashBytes(const void* data, size_t size, uint64_t seed = 14695981039346656037ull);
+
+    // Шестнадцатеричное представление хэша
+    static std::string toHex(uint64_t value);
+
+    // Загрузка всех страниц документа; false, если документа или хотя бы одной страницы нет
+    bool loadDocument(const std::string& documentKey, std::vector<std::string>& pages);
+
+    // Сохранение списка отпечатков страниц документа
+    void storeDocument(const std::string& documentKey, const std::vector<uint64_t>& pageFingerprints);
+
+    // Загрузка текста страницы по отпечатку
+    bool loadPage(uint64_t fingerprint, std::string& text);
+
+    // Сохранение текста страницы
+    void storePage(uint64_t fingerprint, const std::string& text);
+
+private:
+    // Корневой каталог кэша
+    std::string directory;
+
+    // Путь к файлу страницы
+    std::string pagePath(uint64_t fingerprint) const;
+
+    // Путь к записи документа
+    std::string documentPath(const std::string& documentKey) const;
+
+    // Атомарная запись файла (через временный файл и переименование)
+    bool writeFile(const std::string& filePath, const std::string& data);
+};
@@ -0,0 +1,476 @@
+﻿// HNSWIndex.cpp
+#include "HNSWIndex.h"
+#include "VectorKernels.h"
+#include <algorithm>
+#include <queue>
+#include <chrono>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+
+HNSWIndex::HNSWIndex(size_t dimension, const HNSWConfig& config)
+    : dimension(dimension), config(config), efSearch(config.efSearch),
+    levelMultiplier(1.0 / std::log(static_cast<double>(std::max<size_t>(2, config.M)))),
+    blocks(new std::unique_ptr<Node[]>[MAX_BLOCKS]), nodeCount(0),
+    rng(std::random_device{}()), entryPoint(0), maxLevel(-1), deletedCount(0) {
+}
+
+HNSWIndex::Node& HNSWIndex::node(uint32_t id) const {
+    return blocks[id >> BLOCK_BITS][id & (BLOCK_SIZE - 1)];
+}
+
+float HNSWIndex::distance(const float* a, const float* b) const {
+    return 1.0f - VectorKernels::dotFloat(a, b, dimension);
+}
+
+uint32_t HNSWIndex::allocateNode(Label label, std::vector<float>&& vector, int level) {
+    std::lock_guard<std::mutex> lock(allocMtx);
+
+    uint32_t id = nodeCount.load();
+    if ((id >> BLOCK_BITS) >= MAX_BLOCKS) {
+        throw std::runtime_error("HNSW index is full");
+    }
+
+    if (!blocks[id >> BLOCK_BITS]) {
+        blocks[id >> BLOCK_BITS].reset(new Node[BLOCK_SIZE]);
+    }
+
+    Node& n = node(id);
+    n.label = label;
+    n.level = level;
+    n.vector = std::move(vector);
+    n.links.resize(level + 1);
+    for (int l = 0; l <= level; ++l) {
+        n.links[l].reserve(l == 0 ? 2 * config.M : config.M);
+    }
+
+    // Прежний вектор той же метки заменяется
+    auto it = labels.find(label);
+    if (it != labels.end()) {
+        node(it->second).deleted = true;
+        deletedCount++;
+    }
+    labels[label] = id;
+
+    // Узел опубликован только после полной инициализации
+    nodeCount.store(id + 1);
+    return id;
+}
+
+void HNSWIndex::insert(Label label, const std::vector<float>& vector) {
+    if (vector.size() != dimension) {
+        return;
+    }
+
+    std::vector<float> normalized = vector;
+    normalize(normalized);
+
+    int level = 0;
+    {
+        std::lock_guard<std::mutex> lock(allocMtx);
+        double u = std::uniform_real_distribution<double>(std::numeric_limits<double>::min(), 1.0)(rng);
+        level = static_cast<int>(-std::log(u) * levelMultiplier);
+    }
+
+    uint32_t id = allocateNode(label, std::move(normalized), level);
+    const float* query = node(id).vector.data();
+
+    // Узел выше текущей вершины графа вставляется под блокировкой точки входа
+    std::unique_lock<std::mutex> entryLock(entryMtx);
+    int topLevel = maxLevel;
+    uint32_t entry = entryPoint;
+
+    if (topLevel < 0) {
+        entryPoint = id;
+        maxLevel = level;
+        return;
+    }
+    if (level <= topLevel) {
+        entryLock.unlock();
+    }
+
+    entry = descend(entry, query, topLevel, level + 1);
+
+    for (int l = std::min(level, topLevel); l >= 0; --l) {
+        std::vector<Candidate> candidates = searchLayer(entry, query, config.efConstruction, l, false);
+        std::vector<uint32_t> neighbors = selectNeighbors(candidates, config.M);
+
+        {
+            std::lock_guard<std::mutex> lock(node(id).mtx);
+            node(id).links[l] = neighbors;
+        }
+
+        for (uint32_t neighbor : neighbors) {
+            connect(neighbor, id, l);
+        }
+
+        // Ближайший кандидат - вход на следующий уровень
+        entry = std::min_element(candidates.begin(), candidates.end())->node;
+    }
+
+    if (level > topLevel) {
+        entryPoint = id;
+        maxLevel = level;
+    }
+}
+
+void HNSWIndex::connect(uint32_t neighbor, uint32_t newNode, int level) {
+    Node& n = node(neighbor);
+    std::lock_guard<std::mutex> lock(n.mtx);
+
+    auto& links = n.links[level];
+    if (std::find(links.begin(), links.end(), newNode) != links.end()) {
+        return;
+    }
+
+    size_t maxLinks = level == 0 ? 2 * config.M : config.M;
+    if (links.size() < maxLinks) {
+        links.push_back(newNode);
+        return;
+    }
+
+    // Список переполнен: оставляем лучших по той же эвристике
+    std::vector<Candidate> candidates;
+    candidates.reserve(links.size() + 1);
+    candidates.push_back({ distance(n.vector.data(), node(newNode).vector.data()), newNode });
+    for (uint32_t link : links) {
+        candidates.push_back({ distance(n.vector.data(), node(link).vector.data()), link });
+    }
+
+    links = selectNeighbors(std::move(candidates), maxLinks);
+}
+
+std::vector<uint32_t> HNSWIndex::selectNeighbors(std::vector<Candidate> candidates, size_t maxCount) const {
+    std::sort(candidates.begin(), candidates.end());
+
+    std::vector<uint32_t> selected;
+    selected.reserve(std::min(maxCount, candidates.size()));
+
+    for (const Candidate& candidate : candidates) {
+        if (selected.size() >= maxCount) {
+            break;
+        }
+
+        // Кандидат, который ближе к уже выбранному соседу, чем к узлу, достижим через него
+        const float* vector = node(candidate.node).vector.data();
+        bool diverse = std::none_of(selected.begin(), selected.end(), [&](uint32_t chosen) {
+            return distance(vector, node(chosen).vector.data()) < candidate.distance;
+        });
+
+        if (diverse) {
+            selected.push_back(candidate.node);
+        }
+    }
+
+    return selected;
+}
+
+uint32_t HNSWIndex::descend(uint32_t entry, const float* query, int fromLevel, int toLevel) const {
+    float best = distance(query, node(entry).vector.data());
+
+    for (int level = fromLevel; level >= toLevel; --level) {
+        bool changed = true;
+        while (changed) {
+            changed = false;
+
+            std::vector<uint32_t> links;
+            {
+                std::lock_guard<std::mutex> lock(node(entry).mtx);
+                links = node(entry).links[level];
+            }
+
+            for (uint32_t link : links) {
+                float d = distance(query, node(link).vector.data());
+                if (d < best) {
+                    best = d;
+                    entry = link;
+                    changed = true;
+                }
+            }
+        }
+    }
+
+    return entry;
+}
+
+std::vector<HNSWIndex::Candidate> HNSWIndex::searchLayer(uint32_t entry, const float* query, size_t ef,
+    int level, bool skipDeleted) const {
+    std::unique_ptr<VisitedList> visited = acquireVisited();
+    auto visit = [&visited](uint32_t id) {
+        if (id >= visited->marks.size()) {
+            visited->marks.resize(id + BLOCK_SIZE, 0);
+        }
+        if (visited->marks[id] == visited->tag) {
+            return false;
+        }
+        visited->marks[id] = visited->tag;
+        return true;
+    };
+
+    // found - лучшие ef (дальний сверху), frontier - очередь обхода (ближний сверху)
+    std::priority_queue<Candidate> found;
+    std::priority_queue<Candidate, std::vector<Candidate>, std::greater<Candidate>> frontier;
+
+    float d = distance(query, node(entry).vector.data());
+    visit(entry);
+    frontier.push({ d, entry });
+    if (!skipDeleted || !node(entry).deleted) {
+        found.push({ d, entry });
+    }
+
+    std::vector<uint32_t> links;
+    while (!frontier.empty()) {
+        Candidate current = frontier.top();
+        if (found.size() >= ef && current.distance > found.top().distance) {
+            break;
+        }
+        frontier.pop();
+
+        {
+            std::lock_guard<std::mutex> lock(node(current.node).mtx);
+            links = node(current.node).links[level];
+        }
+
+        for (uint32_t link : links) {
+            if (!visit(link)) {
+                continue;
+            }
+
+            float linkDistance = distance(query, node(link).vector.data());
+            if (found.size() < ef || linkDistance < found.top().distance) {
+                frontier.push({ linkDistance, link });
+
+                if (!skipDeleted || !node(link).deleted) {
+                    found.push({ linkDistance, link });
+                    if (found.size() > ef) {
+                        found.pop();
+                    }
+                }
+            }
+        }
+    }
+
+    releaseVisited(std::move(visited));
+
+    std::vector<Candidate> result;
+    result.reserve(found.size());
+    while (!found.empty()) {
+        result.push_back(found.top());
+        found.pop();
+    }
+    return result;
+}
+
+std::vector<HNSWIndex::Neighbor> HNSWIndex::search(const std::vector<float>& query, size_t k) const {
+    std::vector<Neighbor> result;
+    if (query.size() != dimension || k == 0) {
+        return result;
+    }
+
+    uint32_t entry = 0;
+    int topLevel = -1;
+    {
+        std::lock_guard<std::mutex> lock(entryMtx);
+        entry = entryPoint;
+        topLevel = maxLevel;
+    }
+    if (topLevel < 0) {
+        return result;
+    }
+
+    std::vector<float> normalized = query;
+    normalize(normalized);
+
+    entry = descend(entry, normalized.data(), topLevel, 1);
+    std::vector<Candidate> candidates = searchLayer(entry, normalized.data(),
+        std::max(efSearch.load(), k), 0, true);
+
+    std::sort(candidates.begin(), candidates.end());
+    for (const Candidate& candidate : candidates) {
+        if (result.size() >= k) {
+            break;
+        }
+        result.push_back({ node(candidate.node).label, 1.0f - candidate.distance });
+    }
+
+    return result;
+}
+
+std::vector<HNSWIndex::Neighbor> HNSWIndex::exactSearch(const std::vector<float>& query, size_t k) const {
+    std::vector<Neighbor> result;
+    if (query.size() != dimension || k == 0) {
+        return result;
+    }
+
+    std::vector<float> normalized = query;
+    normalize(normalized);
+
+    std::priority_queue<Candidate> best;
+    uint32_t count = nodeCount.load();
+
+    for (uint32_t id = 0; id < count; ++id) {
+        if (node(id).deleted) {
+            continue;
+        }
+
+        float d = distance(normalized.data(), node(id).vector.data());
+        if (best.size() < k) {
+            best.push({ d, id });
+        }
+        else if (d < best.top().distance) {
+            best.pop();
+            best.push({ d, id });
+        }
+    }
+
+    result.resize(best.size());
+    for (size_t i = result.size(); i-- > 0;) {
+        result[i] = { node(best.top().node).label, 1.0f - best.top().distance };
+        best.pop();
+    }
+    return result;
+}
+
+RecallStats HNSWIndex::measureRecall(size_t queryCount, size_t k) const {
+    RecallStats stats;
+    uint32_t count = nodeCount.load();
+    if (count == 0 || size() == 0) {
+        return stats;
+    }
+
+    // Запросы - случайные сохраненные векторы
+    std::mt19937 sampler(12345);
+    std::uniform_int_distribution<uint32_t> pick(0, count - 1);
+
+    size_t found = 0;
+    size_t expected = 0;
+    double searchMs = 0.0;
+    double exactMs = 0.0;
+
+    for (size_t attempt = 0; stats.queries < queryCount && attempt < queryCount * 10; ++attempt) {
+        uint32_t id = pick(sampler);
+        if (node(id).deleted) {
+            continue;
+        }
+        const std::vector<float>& query = node(id).vector;
+
+        auto start = std::chrono::steady_clock::now();
+        auto approximate = search(query, k);
+        auto middle = std::chrono::steady_clock::now();
+        auto exact = exactSearch(query, k);
+        auto end = std::chrono::steady_clock::now();
+
+        searchMs += std::chrono::duration<double, std::milli>(middle - start).count();
+        exactMs += std::chrono::duration<double, std::milli>(end - middle).count();
+
+        for (const Neighbor& neighbor : exact) {
+            bool hit = std::any_of(approximate.begin(), approximate.end(),
+                [&neighbor](const Neighbor& candidate) { return candidate.label == neighbor.label; });
+            found += hit ? 1 : 0;
+        }
+        expected += exact.size();
+        stats.queries++;
+    }
+
+    if (stats.queries > 0) {
+        stats.recall = expected > 0 ? static_cast<double>(found) / expected : 0.0;
+        stats.searchMs = searchMs / stats.queries;
+        stats.exactMs = exactMs / stats.queries;
+    }
+    return stats;
+}
+
+void HNSWIndex::remove(Label label) {
+    std::lock_guard<std::mutex> lock(allocMtx);
+
+    auto it = labels.find(label);
+    if (it == labels.end()) {
+        return;
+    }
+
+    node(it->second).deleted = true;
+    deletedCount++;
+    labels.erase(it);
+}
+
+bool HNSWIndex::getVector(Label label, std::vector<float>& vector) const {
+    std::lock_guard<std::mutex> lock(allocMtx);
+
+    auto it = labels.find(label);
+    if (it == labels.end()) {
+        return false;
+    }
+
+    // Вектор узла не меняется после публикации
+    vector = node(it->second).vector;
+    return true;
+}
+
+std::unique_ptr<HNSWIndex::VisitedList> HNSWIndex::acquireVisited() const {
+    std::unique_ptr<VisitedList> visited;
+    {
+        std::lock_guard<std::mutex> lock(visitedMtx);
+        if (!visitedPool.empty()) {
+            visited = std::move(visitedPool.back());
+            visitedPool.pop_back();
+        }
+    }
+
+    if (!visited) {
+        visited = std::make_unique<VisitedList>();
+    }
+
+    size_t count = nodeCount.load();
+    if (visited->marks.size() < count) {
+        visited->marks.resize(count + BLOCK_SIZE, 0);
+    }
+
+    // Новый номер обхода; при переполнении отметки сбрасываются
+    if (++visited->tag == 0) {
+        std::fill(visited->marks.begin(), visited->marks.end(), 0);
+        visited->tag = 1;
+    }
+
+    return visited;
+}
+
+void HNSWIndex::releaseVisited(std::unique_ptr<VisitedList> visited) const {
+    std::lock_guard<std::mutex> lock(visitedMtx);
+    visitedPool.push_back(std::move(visited));
+}
+
+void HNSWIndex::setSearchWidth(size_t ef) {
+    efSearch = std::max<size_t>(1, ef);
+}
+
+size_t HNSWIndex::getSearchWidth() const {
+    return efSearch;
+}
+
+const HNSWConfig& HNSWIndex::getConfig() const {
+    return config;
+}
+
+size_t HNSWIndex::getDimension() const {
+    return dimension;
+}
+
+size_t HNSWIndex::size() const {
+    std::lock_guard<std::mutex> lock(allocMtx);
+    return labels.size();
+}
+
+size_t HNSWIndex::getDeletedCount() const {
+    return deletedCount;
+}
+
+size_t HNSWIndex::getMemoryUsage() const {
+    // Оценка: узел, вектор и в среднем полный список связей нулевого уровня
+    size_t perNode = sizeof(Node) + dimension * sizeof(float)
+        + sizeof(std::vector<uint32_t>) + 2 * config.M * sizeof(uint32_t);
+    return nodeCount.load() * perNode;
+}
+
+std::string HNSWIndex::describe() const {
+    return "HNSW float32, M=" + std::to_string(config.M) + ", efConstruction=" + std::to_string(config.efConstruction);
+}
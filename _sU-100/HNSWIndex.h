@@ -0,0 +1,130 @@
+﻿// HNSWIndex.h
+#pragma once
+
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <random>
+#include <unordered_map>
+#include <cstdint>
+#include "VectorIndex.h"
+
+// Параметры графа HNSW
+struct HNSWConfig {
+    size_t M = 16;                 // связей узла на уровне (на нулевом уровне - вдвое больше)
+    size_t efConstruction = 200;   // ширина поиска при вставке: качество графа против скорости построения
+    size_t efSearch = 64;          // ширина поиска при запросе: полнота против задержки
+};
+
+// Приближенный поиск ближайших векторов (Hierarchical Navigable Small World).
+// Векторы float32 хранятся в узлах графа. Вставки и поиски выполняются параллельно;
+// удаленный узел остается в графе для навигации, но в результаты не попадает
+class HNSWIndex : public VectorIndex {
+public:
+    HNSWIndex(size_t dimension, const HNSWConfig& config = HNSWConfig());
+
+    HNSWIndex(const HNSWIndex&) = delete;
+    HNSWIndex& operator=(const HNSWIndex&) = delete;
+
+    void insert(Label label, const std::vector<float>& vector) override;
+    void remove(Label label) override;
+    bool getVector(Label label, std::vector<float>& vector) const override;
+    std::vector<Neighbor> search(const std::vector<float>& query, size_t k) const override;
+
+    // Точный перебор всех векторов (для проверки полноты)
+    std::vector<Neighbor> exactSearch(const std::vector<float>& query, size_t k) const;
+
+    // Полнота search относительно exactSearch
+    RecallStats measureRecall(size_t queryCount, size_t k) const override;
+
+    // Ширина поиска при запросе (efSearch)
+    void setSearchWidth(size_t ef) override;
+    size_t getSearchWidth() const override;
+
+    const HNSWConfig& getConfig() const;
+    size_t getDimension() const override;
+
+    size_t size() const override;
+    size_t getDeletedCount() const override;
+    size_t getMemoryUsage() const override;
+    std::string describe() const override;
+
+private:
+    // Узел графа
+    struct Node {
+        Label label = 0;
+        int level = 0;
+        std::vector<float> vector;
+        std::vector<std::vector<uint32_t>> links;   // соседи по уровням
+        std::atomic<bool> deleted{ false };
+        mutable std::mutex mtx;                      // защищает links
+    };
+
+    // Узлы хранятся блоками: адреса не меняются при росте, поиск идет без общей блокировки
+    static constexpr size_t BLOCK_BITS = 14;
+    static constexpr size_t BLOCK_SIZE = size_t(1) << BLOCK_BITS;
+    static constexpr size_t MAX_BLOCKS = size_t(1) << 14;
+
+    // Кандидат поиска: расстояние (1 - близость) и узел
+    struct Candidate {
+        float distance;
+        uint32_t node;
+        bool operator<(const Candidate& other) const { return distance < other.distance; }
+        bool operator>(const Candidate& other) const { return distance > other.distance; }
+    };
+
+    // Отметки посещенных узлов: номер обхода вместо очистки массива
+    struct VisitedList {
+        std::vector<uint16_t> marks;
+        uint16_t tag = 0;
+    };
+
+    size_t dimension;
+    HNSWConfig config;
+    std::atomic<size_t> efSearch;
+    double levelMultiplier;
+
+    std::unique_ptr<std::unique_ptr<Node[]>[]> blocks;
+    std::atomic<uint32_t> nodeCount;
+
+    // Выделение узлов и словарь меток
+    mutable std::mutex allocMtx;
+    std::unordered_map<Label, uint32_t> labels;
+    std::mt19937 rng;
+
+    // Точка входа и верхний уровень графа
+    mutable std::mutex entryMtx;
+    uint32_t entryPoint;
+    int maxLevel;
+
+    std::atomic<size_t> deletedCount;
+
+    // Переиспользуемые отметки посещений
+    mutable std::mutex visitedMtx;
+    mutable std::vector<std::unique_ptr<VisitedList>> visitedPool;
+
+    Node& node(uint32_t id) const;
+
+    // Новый узел с меткой и вектором; возвращает его номер
+    uint32_t allocateNode(Label label, std::vector<float>&& vector, int level);
+
+    // Расстояние между нормализованными векторами
+    float distance(const float* a, const float* b) const;
+
+    // Жадный поиск на уровне: до ef ближайших, удаленные узлы (если skipDeleted) только для навигации
+    std::vector<Candidate> searchLayer(uint32_t entry, const float* query, size_t ef, int level,
+        bool skipDeleted) const;
+
+    // Спуск по верхним уровням к ближайшему узлу
+    uint32_t descend(uint32_t entry, const float* query, int fromLevel, int toLevel) const;
+
+    // Эвристика выбора соседей: кандидат берется, если он ближе к узлу, чем к уже выбранным
+    std::vector<uint32_t> selectNeighbors(std::vector<Candidate> candidates, size_t maxCount) const;
+
+    // Связь соседа с новым узлом с прореживанием переполненного списка
+    void connect(uint32_t neighbor, uint32_t newNode, int level);
+
+    std::unique_ptr<VisitedList> acquireVisited() const;
+    void releaseVisited(std::unique_ptr<VisitedList> visited) const;
+};
@@ -0,0 +1,1076 @@
+﻿// IndexSegment.cpp
+#include "IndexSegment.h"
+#include "TermDictionary.h"
+#include "ExtractionCache.h"
+#include "NearDuplicateIndex.h"
+#include <fstream>
+#include <filesystem>
+#include <algorithm>
+#include <numeric>
+#include <cstring>
+
+namespace fs = std::filesystem;
+
+namespace {
+    // Сигнатура файла сегмента
+    constexpr char MAGIC[8] = { 's', 'U', '1', '0', '0', 'S', 'E', 'G' };
+
+    // Разделы в порядке следования в файле
+    enum SectionId : uint32_t {
+        DOCUMENTS,       // DocumentRecord на документ
+        STRINGS,         // имена документов и профилей OCR
+        CHUNK_SPANS,     // ChunkSpan на чанк: одинаковый текст чанков хранится один раз
+        CHUNK_LENGTHS,   // uint32: длина чанка в терминах
+        CHUNK_TOKENS,    // uint32: длина чанка в токенах модели генерации (0 - не считалась)
+        CHUNK_SOURCES,   // ChunkList::Source на чанк: место чанка в тексте документа
+        CHUNK_IDS,       // uint32: идентификатор чанка в контексте
+        CHUNK_LOOKUP,    // ChunkLookup по возрастанию идентификатора
+        FINGERPRINTS,    // uint64: отпечаток SimHash чанка для поиска почти дубликатов
+        TERM_OFFSETS,    // uint64: начало строки термина, последний элемент - конец строк
+        TERMS,           // TermRecord на термин, термины по возрастанию
+        POSTINGS,        // InvertedIndex::Posting: списки терминов подряд
+        TERM_TEXT,       // строки терминов
+        CHUNK_TEXT,      // текст чанков
+        EMBEDDINGS,      // float[dimension] на чанк; нулевой вектор - эмбеддинга нет
+        SECTION_COUNT
+    };
+
+    // Заголовок файла; за ним - таблица разделов (SectionEntry на раздел)
+    struct FileHeader {
+        char magic[8];
+        uint32_t version;
+        uint32_t sectionCount;
+        uint64_t fileSize;
+        uint32_t documentCount;
+        uint32_t chunkCount;
+        uint32_t termCount;
+        uint32_t dimension;
+        uint64_t postingCount;
+        uint64_t totalLength;      // сумма длин чанков в терминах
+        uint64_t embeddingModel;   // хеш описания модели эмбеддингов
+        uint64_t textLength;       // сумма длин текста чанков (до объединения одинаковых)
+        uint64_t tokenizer;        // хеш описания модели, чьим токенизатором считались токены
+        uint64_t checksum;         // заголовка и таблицы разделов (при подсчете поле нулевое)
+    };
+
+    struct SectionEntry {
+        uint64_t offset;
+        uint64_t size;
+        uint64_t checksum;
+    };
+
+    struct DocumentRecord {
+        uint64_t originalSize;
+        int64_t addedTime;
+        uint64_t sourceStamp;
+        uint32_t firstChunk;
+        uint32_t chunkCount;
+        uint32_t nameOffset;
+        uint32_t nameLength;
+        uint32_t profileOffset;
+        uint32_t profileLength;
+        uint32_t chunkSize;        // параметры разбиения на чанки
+        uint32_t chunkOverlap;
+    };
+
+    // Участок раздела текста, занятый чанком
+    struct ChunkSpan {
+        uint64_t offset;
+        uint32_t length;
+        uint32_t reserved;
+    };
+
+    struct ChunkLookup {
+        uint32_t chunkId;
+        uint32_t chunk;
+    };
+
+    struct TermRecord {
+        uint64_t firstPosting;
+        uint32_t postingCount;
+        uint32_t maxTermFrequency;
+        uint32_t minChunkLength;
+        uint32_t reserved;
+    };
+
+    // Структуры читаются прямо из отображения: без выравнивающих пропусков,
+    // порядок байтов - платформы (little-endian)
+    static_assert(sizeof(FileHeader) == 88, "FileHeader layout");
+    static_assert(sizeof(SectionEntry) == 24, "SectionEntry layout");
+    static_assert(sizeof(DocumentRecord) == 56, "DocumentRecord layout");
+    static_assert(sizeof(ChunkList::Source) == 16, "ChunkList::Source layout");
+    static_assert(sizeof(ChunkSpan) == 16, "ChunkSpan layout");
+    static_assert(sizeof(ChunkLookup) == 8, "ChunkLookup layout");
+    static_assert(sizeof(TermRecord) == 24, "TermRecord layout");
+    static_assert(sizeof(InvertedIndex::Posting) == 8, "Posting layout");
+
+    // Разделы выравниваются, чтобы элементы читались без копирования
+    constexpr uint64_t SECTION_ALIGNMENT = 64;
+
+    // Проверка контрольных сумм идет частями, прочитанные страницы выгружаются
+    constexpr size_t VERIFY_SLICE_BYTES = 64 * 1024 * 1024;
+
+    // Контрольная сумма заголовка и таблицы разделов
+    uint64_t headerChecksum(const FileHeader& header, const SectionEntry* entries) {
+        FileHeader copy = header;
+        copy.checksum = 0;
+        uint64_t hash = ExtractionCache::hashBytes(&copy, sizeof(copy));
+        return ExtractionCache::hashBytes(entries, SECTION_COUNT * sizeof(SectionEntry), hash);
+    }
+
+    // Словарь и списки терминов строящегося сегмента
+    struct TermTable {
+        TermDictionary dictionary;
+        std::vector<std::vector<InvertedIndex::Posting>> postings;
+
+        std::vector<InvertedIndex::Posting>& listFor(std::string_view term) {
+            TermDictionary::TermId id = dictionary.intern(term);
+            if (id >= postings.size()) {
+                postings.resize(id + 1);
+            }
+            return postings[id];
+        }
+    };
+
+    // Последовательная запись разделов с подсчетом контрольных сумм в файл (file)
+    // или в буфер сегмента в памяти (memory)
+    class SectionWriter {
+    public:
+        SectionWriter(std::ofstream* file, std::vector<char>* memory)
+            : file(file), memory(memory), position(0), checksum(0), entries() {
+        }
+
+        void begin(SectionId id) {
+            static const char padding[SECTION_ALIGNMENT] = {};
+            write(padding, static_cast<size_t>((SECTION_ALIGNMENT - position % SECTION_ALIGNMENT) % SECTION_ALIGNMENT));
+
+            entries[id].offset = position;
+            checksum = ExtractionCache::hashBytes(nullptr, 0);
+        }
+
+        void write(const void* data, size_t size) {
+            if (file) {
+                file->write(static_cast<const char*>(data), static_cast<std::streamsize>(size));
+            }
+            else {
+                const char* bytes = static_cast<const char*>(data);
+                memory->insert(memory->end(), bytes, bytes + size);
+            }
+            checksum = ExtractionCache::hashBytes(data, size, checksum);
+            position += size;
+        }
+
+        template <typename T>
+        void write(const std::vector<T>& items) {
+            write(items.data(), items.size() * sizeof(T));
+        }
+
+        void end(SectionId id) {
+            entries[id].size = position - entries[id].offset;
+            entries[id].checksum = checksum;
+        }
+
+        uint64_t getPosition() const {
+            return position;
+        }
+
+        const SectionEntry* getEntries() const {
+            return entries;
+        }
+
+        // Заголовок и таблица разделов - на место, оставленное в начале
+        void writeHeader(const FileHeader& header) {
+            if (file) {
+                file->seekp(0);
+                file->write(reinterpret_cast<const char*>(&header), sizeof(header));
+                file->write(reinterpret_cast<const char*>(entries), SECTION_COUNT * sizeof(SectionEntry));
+            }
+            else {
+                std::memcpy(memory->data(), &header, sizeof(header));
+                std::memcpy(memory->data() + sizeof(header), entries, SECTION_COUNT * sizeof(SectionEntry));
+            }
+        }
+
+    private:
+        std::ofstream* file;
+        std::vector<char>* memory;
+        uint64_t position;
+        uint64_t checksum;
+        SectionEntry entries[SECTION_COUNT];
+    };
+
+    // Запись сегмента по готовым длинам, отпечаткам, числу токенов чанков и спискам терминов:
+    // в файл path или в буфер memory (пустой path). tokenizer = 0 - токены не считались
+    bool writeSegmentData(const std::string& path, std::vector<char>& memory, const std::vector<IndexSegment::DocumentData>& documents,
+        const std::vector<uint32_t>& chunkLengths, const std::vector<uint64_t>& fingerprints,
+        const std::vector<uint32_t>& chunkTokens, uint64_t tokenizer, const TermTable& terms, size_t dimension,
+        uint64_t embeddingModel, const IndexSegment::EmbeddingSource& embeddings, std::string& error) {
+        // Документы, участки текста и идентификаторы чанков. Одинаковый текст (колонтитулы,
+        // неизменные пункты редакций договора) пишется один раз, чанки ссылаются на один участок
+        std::vector<DocumentRecord> records;
+        std::string strings;
+        std::vector<ChunkSpan> chunkSpans;
+        std::vector<uint32_t> chunkIds;
+        std::vector<ChunkList::Source> chunkSources;
+        std::vector<std::string_view> storedText;                               // текст без повторов
+        std::vector<ChunkSpan> storedSpans;
+        std::unordered_map<uint64_t, std::vector<uint32_t>> storedByHash;       // хеш - номера в storedText
+        uint64_t storedSize = 0;
+        uint64_t textLength = 0;
+
+        for (const auto& document : documents) {
+            DocumentRecord record = {};
+            record.originalSize = document.info.originalSize;
+            record.addedTime = document.info.addedTime;
+            record.sourceStamp = document.info.sourceStamp;
+            record.firstChunk = static_cast<uint32_t>(chunkIds.size());
+            record.chunkCount = static_cast<uint32_t>(document.chunks.size());
+            record.nameOffset = static_cast<uint32_t>(strings.size());
+            record.nameLength = static_cast<uint32_t>(document.info.name.size());
+            strings += document.info.name;
+            record.profileOffset = static_cast<uint32_t>(strings.size());
+            record.profileLength = static_cast<uint32_t>(document.info.ocrProfile.size());
+            strings += document.info.ocrProfile;
+            record.chunkSize = document.info.chunkSize;
+            record.chunkOverlap = document.info.chunkOverlap;
+            records.push_back(record);
+
+            for (size_t i = 0; i < document.chunks.size(); ++i) {
+                std::string_view text = document.chunks[i];
+                textLength += text.size();
+                chunkIds.push_back(document.chunkIds[i]);
+                chunkSources.push_back(i < document.sources.size() ? document.sources[i] : ChunkList::Source());
+
+                // Текст с тем же хешем сравнивается целиком
+                auto& sameHash = storedByHash[ExtractionCache::hashBytes(text.data(), text.size())];
+                auto stored = std::find_if(sameHash.begin(), sameHash.end(),
+                    [&](uint32_t index) { return storedText[index] == text; });
+                if (stored != sameHash.end()) {
+                    chunkSpans.push_back(storedSpans[*stored]);
+                    continue;
+                }
+
+                sameHash.push_back(static_cast<uint32_t>(storedText.size()));
+                storedText.push_back(text);
+                storedSpans.push_back({ storedSize, static_cast<uint32_t>(text.size()), 0 });
+                chunkSpans.push_back(storedSpans.back());
+                storedSize += text.size();
+            }
+        }
+
+        std::vector<ChunkLookup> lookup(chunkIds.size());
+        for (uint32_t chunk = 0; chunk < chunkIds.size(); ++chunk) {
+            lookup[chunk] = { chunkIds[chunk], chunk };
+        }
+        std::sort(lookup.begin(), lookup.end(),
+            [](const ChunkLookup& a, const ChunkLookup& b) { return a.chunkId < b.chunkId; });
+
+        // Термины по возрастанию строки: поиск термина - двоичный поиск прямо в файле
+        const uint32_t termCount = static_cast<uint32_t>(terms.dictionary.size());
+        std::vector<uint32_t> order(termCount);
+        std::iota(order.begin(), order.end(), 0);
+        std::sort(order.begin(), order.end(), [&terms](uint32_t a, uint32_t b) {
+            return terms.dictionary.getTerm(a) < terms.dictionary.getTerm(b);
+        });
+
+        std::vector<uint64_t> termOffsets(1, 0);
+        std::vector<TermRecord> termRecords;
+        termRecords.reserve(termCount);
+        uint64_t postingCount = 0;
+
+        for (uint32_t id : order) {
+            const auto& postings = terms.postings[id];
+
+            TermRecord record = {};
+            record.firstPosting = postingCount;
+            record.postingCount = static_cast<uint32_t>(postings.size());
+            record.minChunkLength = UINT32_MAX;
+            for (const auto& posting : postings) {
+                record.maxTermFrequency = std::max(record.maxTermFrequency, posting.termFrequency);
+                record.minChunkLength = std::min(record.minChunkLength, chunkLengths[posting.chunkId]);
+            }
+            termRecords.push_back(record);
+
+            postingCount += postings.size();
+            termOffsets.push_back(termOffsets.back() + terms.dictionary.getTerm(id).size());
+        }
+
+        FileHeader header = {};
+        std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+        header.version = IndexSegment::FORMAT_VERSION;
+        header.sectionCount = SECTION_COUNT;
+        header.documentCount = static_cast<uint32_t>(records.size());
+        header.chunkCount = static_cast<uint32_t>(chunkIds.size());
+        header.termCount = termCount;
+        header.dimension = static_cast<uint32_t>(dimension);
+        header.postingCount = postingCount;
+        header.totalLength = std::accumulate(chunkLengths.begin(), chunkLengths.end(), uint64_t(0));
+        header.embeddingModel = dimension > 0 ? embeddingModel : 0;
+        header.textLength = textLength;
+        header.tokenizer = tokenizer;
+
+        // Пишем рядом и переименовываем: недописанный файл не примут за сегмент
+        const std::string tempPath = path.empty() ? std::string() : path + ".tmp";
+        std::ofstream out;
+        if (!path.empty()) {
+            out.open(tempPath, std::ios::binary | std::ios::trunc);
+            if (!out) {
+                error = "Error: Failed to create index segment: " + tempPath;
+                return false;
+            }
+        }
+
+        SectionWriter writer(path.empty() ? nullptr : &out, &memory);
+
+        // Место под заголовок и таблицу разделов: они дописываются последними
+        std::vector<char> placeholder(sizeof(FileHeader) + SECTION_COUNT * sizeof(SectionEntry), 0);
+        writer.write(placeholder);
+
+        writer.begin(DOCUMENTS);
+        writer.write(records);
+        writer.end(DOCUMENTS);
+
+        writer.begin(STRINGS);
+        writer.write(strings.data(), strings.size());
+        writer.end(STRINGS);
+
+        writer.begin(CHUNK_SPANS);
+        writer.write(chunkSpans);
+        writer.end(CHUNK_SPANS);
+
+        writer.begin(CHUNK_LENGTHS);
+        writer.write(chunkLengths);
+        writer.end(CHUNK_LENGTHS);
+
+        writer.begin(CHUNK_TOKENS);
+        writer.write(chunkTokens);
+        writer.end(CHUNK_TOKENS);
+
+        writer.begin(CHUNK_SOURCES);
+        writer.write(chunkSources);
+        writer.end(CHUNK_SOURCES);
+
+        writer.begin(CHUNK_IDS);
+        writer.write(chunkIds);
+        writer.end(CHUNK_IDS);
+
+        writer.begin(CHUNK_LOOKUP);
+        writer.write(lookup);
+        writer.end(CHUNK_LOOKUP);
+
+        writer.begin(FINGERPRINTS);
+        writer.write(fingerprints);
+        writer.end(FINGERPRINTS);
+
+        writer.begin(TERM_OFFSETS);
+        writer.write(termOffsets);
+        writer.end(TERM_OFFSETS);
+
+        writer.begin(TERMS);
+        writer.write(termRecords);
+        writer.end(TERMS);
+
+        writer.begin(POSTINGS);
+        for (uint32_t id : order) {
+            writer.write(terms.postings[id]);
+        }
+        writer.end(POSTINGS);
+
+        writer.begin(TERM_TEXT);
+        for (uint32_t id : order) {
+            std::string_view term = terms.dictionary.getTerm(id);
+            writer.write(term.data(), term.size());
+        }
+        writer.end(TERM_TEXT);
+
+        writer.begin(CHUNK_TEXT);
+        for (std::string_view text : storedText) {
+            writer.write(text.data(), text.size());
+        }
+        writer.end(CHUNK_TEXT);
+
+        // Векторы идут прямо в файл: все эмбеддинги сегмента в памяти не собираются
+        writer.begin(EMBEDDINGS);
+        if (dimension > 0) {
+            const std::vector<float> missing(dimension, 0.0f);
+            std::vector<float> embedding;
+
+            for (size_t document = 0; document < documents.size(); ++document) {
+                for (size_t chunk = 0; chunk < documents[document].chunks.size(); ++chunk) {
+                    bool found = embeddings && embeddings(document, chunk, embedding) && embedding.size() == dimension;
+                    writer.write(found ? embedding : missing);
+                }
+            }
+        }
+        writer.end(EMBEDDINGS);
+
+        header.fileSize = writer.getPosition();
+        header.checksum = headerChecksum(header, writer.getEntries());
+
+        writer.writeHeader(header);
+        if (path.empty()) {
+            return true;
+        }
+        out.close();
+
+        std::error_code ec;
+        if (!out) {
+            fs::remove(tempPath, ec);
+            error = "Error: Failed to write index segment: " + tempPath;
+            return false;
+        }
+
+        fs::rename(tempPath, path, ec);
+        if (ec) {
+            fs::remove(tempPath, ec);
+            error = "Error: Failed to rename index segment: " + path;
+            return false;
+        }
+        return true;
+    }
+}
+
+template <typename T>
+const T* IndexSegment::items(size_t section) const {
+    return reinterpret_cast<const T*>(sections[section].data);
+}
+
+std::shared_ptr<IndexSegment> IndexSegment::write(const std::string& path, const std::vector<DocumentData>& documents,
+    const TextAnalyzer& analyzer, size_t dimension, uint64_t embeddingModel,
+    const EmbeddingSource& embeddings, const Tokenizer& tokenizer, std::string& error) {
+    std::vector<uint32_t> chunkLengths;
+    std::vector<uint64_t> fingerprints;
+    std::vector<uint32_t> chunkTokens;
+    TermTable terms;
+    const bool countTokens = tokenizer.tag != 0 && tokenizer.count;
+
+    std::string buffer;
+    std::vector<std::string_view> tokens;
+    uint32_t chunk = 0;
+
+    for (const auto& document : documents) {
+        for (std::string_view text : document.chunks) {
+            analyzer.analyze(text, buffer, tokens);
+            chunkLengths.push_back(static_cast<uint32_t>(tokens.size()));
+            fingerprints.push_back(NearDuplicateIndex::fingerprint(tokens));
+            chunkTokens.push_back(countTokens ? tokenizer.count(text) : 0);
+
+            // После сортировки повторы одного термина стоят подряд
+            std::sort(tokens.begin(), tokens.end());
+            for (size_t i = 0; i < tokens.size();) {
+                size_t next = i + 1;
+                while (next < tokens.size() && tokens[next] == tokens[i]) {
+                    ++next;
+                }
+                terms.listFor(tokens[i]).push_back({ chunk, static_cast<uint32_t>(next - i) });
+                i = next;
+            }
+            chunk++;
+        }
+    }
+
+    std::vector<char> memory;
+    if (!writeSegmentData(path, memory, documents, chunkLengths, fingerprints, chunkTokens,
+        countTokens ? tokenizer.tag : 0, terms, dimension, embeddingModel, embeddings, error)) {
+        return nullptr;
+    }
+    return path.empty() ? load(MemoryBuffer::fromVector(std::move(memory)), path, error) : open(path, error);
+}
+
+std::shared_ptr<IndexSegment> IndexSegment::merge(const std::string& path,
+    const std::vector<std::shared_ptr<const IndexSegment>>& sources, size_t dimension,
+    uint64_t embeddingModel, const EmbeddingLookup& lookup, const Tokenizer& tokenizer, std::string& error) {
+    // Части документа: сегмент-источник и номер документа в нем
+    struct Part {
+        size_t source;
+        uint32_t document;
+    };
+
+    // Документы результата в порядке первого появления; части одного документа (по имени)
+    // объединяются в порядке сегментов
+    std::vector<std::vector<Part>> parts;
+    std::unordered_map<std::string_view, size_t> byName;
+
+    for (size_t i = 0; i < sources.size(); ++i) {
+        for (uint32_t document = 0; document < sources[i]->documentCount; ++document) {
+            if (sources[i]->isDocumentRemoved(document)) {
+                continue;
+            }
+
+            auto inserted = byName.emplace(sources[i]->getDocumentName(document), parts.size());
+            if (inserted.second) {
+                parts.emplace_back();
+            }
+            parts[inserted.first->second].push_back({ i, document });
+        }
+    }
+
+    // Без заданной модели эмбеддинги берутся у самого нового сегмента, где они есть;
+    // векторы других моделей не переносятся
+    if (dimension == 0) {
+        for (const auto& source : sources) {
+            if (source->getDimension() > 0) {
+                dimension = source->getDimension();
+                embeddingModel = source->getEmbeddingModel();
+            }
+        }
+    }
+
+    // Число токенов чанков: без токенизатора переносится, только если все сегменты считали
+    // его одним токенизатором; с токенизатором чанки других сегментов считаются заново
+    const bool countTokens = tokenizer.tag != 0 && tokenizer.count;
+    uint64_t tokenizerTag = countTokens ? tokenizer.tag : sources.empty() ? 0 : sources.front()->tokenizer;
+    for (const auto& source : sources) {
+        if (!countTokens && source->tokenizer != tokenizerTag) {
+            tokenizerTag = 0;
+        }
+    }
+
+    std::vector<DocumentData> documents;
+    std::vector<uint32_t> chunkLengths;
+    std::vector<uint64_t> fingerprints;
+    std::vector<uint32_t> chunkTokens;
+    TermTable terms;
+
+    // Новые номера чанков по сегментам (UINT32_MAX - чанк удален) и откуда взят каждый чанк
+    std::vector<std::vector<uint32_t>> renumber(sources.size());
+    for (size_t i = 0; i < sources.size(); ++i) {
+        renumber[i].assign(sources[i]->chunkCount, UINT32_MAX);
+    }
+    std::vector<std::pair<const IndexSegment*, uint32_t>> origins;
+    std::vector<size_t> firstChunks;
+
+    for (const auto& documentParts : parts) {
+        DocumentData data;
+        firstChunks.push_back(chunkLengths.size());
+
+        for (const Part& part : documentParts) {
+            const IndexSegment* source = sources[part.source].get();
+            const DocumentInfo info = source->getDocument(part.document);
+            const uint32_t* lengths = source->items<uint32_t>(CHUNK_LENGTHS);
+
+            // Описание - у последней части (размер растет с каждой частью), время добавления -
+            // у первой, отпечаток файла есть только у завершающей
+            DocumentInfo merged = info;
+            if (&part != &documentParts.front()) {
+                merged.addedTime = data.info.addedTime;
+                merged.originalSize = std::max(merged.originalSize, data.info.originalSize);
+                if (merged.sourceStamp == 0) {
+                    merged.sourceStamp = data.info.sourceStamp;
+                }
+            }
+            data.info = merged;
+
+            for (uint32_t chunk = info.firstChunk; chunk < info.firstChunk + info.chunkCount; ++chunk) {
+                renumber[part.source][chunk] = static_cast<uint32_t>(chunkLengths.size());
+                chunkLengths.push_back(lengths[chunk]);
+                fingerprints.push_back(source->getFingerprint(chunk));
+                if (tokenizerTag == 0) {
+                    chunkTokens.push_back(0);
+                } else if (source->tokenizer == tokenizerTag) {
+                    chunkTokens.push_back(source->getTokenCount(chunk));
+                } else {
+                    chunkTokens.push_back(tokenizer.count(source->getChunk(chunk)));
+                }
+                data.chunks.push_back(source->getChunk(chunk));
+                data.chunkIds.push_back(source->getChunkId(chunk));
+                data.sources.push_back(source->getChunkSource(chunk));
+                origins.push_back({ source, chunk });
+            }
+        }
+
+        documents.push_back(std::move(data));
+    }
+
+    for (size_t i = 0; i < sources.size(); ++i) {
+        const auto& source = sources[i];
+        const TermRecord* records = source->items<TermRecord>(TERMS);
+        const InvertedIndex::Posting* postings = source->items<InvertedIndex::Posting>(POSTINGS);
+
+        for (uint32_t term = 0; term < source->termCount; ++term) {
+            const TermRecord& record = records[term];
+            if (record.firstPosting + record.postingCount > source->postingCount) {
+                continue;
+            }
+
+            std::vector<InvertedIndex::Posting>* list = nullptr;
+            for (uint64_t p = record.firstPosting; p < record.firstPosting + record.postingCount; ++p) {
+                const auto& posting = postings[p];
+                if (posting.chunkId >= source->chunkCount || renumber[i][posting.chunkId] == UINT32_MAX) {
+                    continue;
+                }
+                if (!list) {
+                    list = &terms.listFor(source->getTerm(term));
+                }
+                list->push_back({ renumber[i][posting.chunkId], posting.termFrequency });
+            }
+        }
+    }
+
+    // Части документа из более новых сегментов получают номера внутри документа, поэтому
+    // списки терминов после объединения частей могут нарушить порядок
+    for (auto& list : terms.postings) {
+        auto byChunk = [](const InvertedIndex::Posting& a, const InvertedIndex::Posting& b) { return a.chunkId < b.chunkId; };
+        if (!std::is_sorted(list.begin(), list.end(), byChunk)) {
+            std::sort(list.begin(), list.end(), byChunk);
+        }
+    }
+
+    EmbeddingSource embeddings = [&](size_t document, size_t chunk, std::vector<float>& embedding) {
+        const auto& origin = origins[firstChunks[document] + chunk];
+        const IndexSegment* source = origin.first;
+
+        const float* vector = source->getDimension() == dimension && source->getEmbeddingModel() == embeddingModel
+            ? source->getEmbedding(origin.second) : nullptr;
+        if (vector) {
+            embedding.assign(vector, vector + dimension);
+            return true;
+        }
+        return lookup && lookup(source->getChunkId(origin.second), embedding);
+    };
+
+    std::vector<char> memory;
+    if (!writeSegmentData(path, memory, documents, chunkLengths, fingerprints, chunkTokens, tokenizerTag, terms,
+        dimension, embeddingModel, embeddings, error)) {
+        return nullptr;
+    }
+    return path.empty() ? load(MemoryBuffer::fromVector(std::move(memory)), path, error) : open(path, error);
+}
+
+std::shared_ptr<IndexSegment> IndexSegment::open(const std::string& path, std::string& error) {
+    std::shared_ptr<MemoryBuffer> file = MemoryBuffer::mapFile(path, error);
+    if (!file) {
+        return nullptr;
+    }
+    return load(file, path, error);
+}
+
+std::shared_ptr<IndexSegment> IndexSegment::load(std::shared_ptr<MemoryBuffer> file, const std::string& path,
+    std::string& error) {
+    const size_t tableEnd = sizeof(FileHeader) + SECTION_COUNT * sizeof(SectionEntry);
+    if (file->size() < tableEnd) {
+        error = "Error: Index segment is truncated: " + path;
+        return nullptr;
+    }
+
+    FileHeader header;
+    std::memcpy(&header, file->data(), sizeof(header));
+    if (std::memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0) {
+        error = "Error: Not an index segment: " + path;
+        return nullptr;
+    }
+
+    if (header.version != FORMAT_VERSION) {
+        error = "Error: Unsupported index segment version " + std::to_string(header.version)
+            + " (expected " + std::to_string(FORMAT_VERSION) + "): " + path;
+        return nullptr;
+    }
+
+    std::vector<SectionEntry> entries(SECTION_COUNT);
+    std::memcpy(entries.data(), file->data() + sizeof(FileHeader), SECTION_COUNT * sizeof(SectionEntry));
+
+    if (header.sectionCount != SECTION_COUNT || header.fileSize != file->size()
+        || header.checksum != headerChecksum(header, entries.data())) {
+        error = "Error: Index segment header is damaged: " + path;
+        return nullptr;
+    }
+
+    // Ожидаемые размеры разделов с массивами фиксированных элементов
+    const uint64_t chunks = header.chunkCount;
+    const uint64_t expected[SECTION_COUNT] = {
+        header.documentCount * sizeof(DocumentRecord), UINT64_MAX,
+        chunks * sizeof(ChunkSpan), chunks * sizeof(uint32_t), chunks * sizeof(uint32_t),
+        chunks * sizeof(ChunkList::Source), chunks * sizeof(uint32_t), chunks * sizeof(ChunkLookup), chunks * sizeof(uint64_t), (uint64_t(header.termCount) + 1) * sizeof(uint64_t),
+        header.termCount * sizeof(TermRecord), header.postingCount * sizeof(InvertedIndex::Posting),
+        UINT64_MAX, UINT64_MAX, chunks * header.dimension * sizeof(float)
+    };
+
+    std::shared_ptr<IndexSegment> segment(new IndexSegment());
+    segment->sections.resize(SECTION_COUNT);
+
+    for (size_t i = 0; i < SECTION_COUNT; ++i) {
+        const SectionEntry& entry = entries[i];
+        bool valid = entry.offset % SECTION_ALIGNMENT == 0 && entry.offset >= tableEnd
+            && entry.offset <= file->size() && entry.size <= file->size() - entry.offset
+            && (expected[i] == UINT64_MAX || entry.size == expected[i]);
+
+        if (!valid) {
+            error = "Error: Index segment section table is damaged: " + path;
+            return nullptr;
+        }
+
+        segment->sections[i] = { file->data() + entry.offset, entry.size, entry.checksum };
+    }
+
+    // Таблица документов маленькая и читается при открытии целиком: ее проверяем сразу
+    for (SectionId id : { DOCUMENTS, STRINGS }) {
+        const Section& section = segment->sections[id];
+        if (ExtractionCache::hashBytes(section.data, section.size) != section.checksum) {
+            error = "Error: Index segment document table is damaged: " + path;
+            return nullptr;
+        }
+    }
+
+    segment->path = path;
+    segment->file = file;
+    segment->documentCount = header.documentCount;
+    segment->chunkCount = header.chunkCount;
+    segment->termCount = header.termCount;
+    segment->dimension = header.dimension;
+    segment->postingCount = header.postingCount;
+    segment->totalLength = header.totalLength;
+    segment->embeddingModel = header.embeddingModel;
+    segment->textLength = header.textLength;
+    segment->tokenizer = header.tokenizer;
+    segment->removedDocuments.assign(header.documentCount, false);
+    segment->removedChunks.assign(header.chunkCount, false);
+
+    auto names = std::make_shared<std::unordered_map<std::string_view, uint32_t>>();
+    names->reserve(header.documentCount);
+    for (uint32_t document = 0; document < header.documentCount; ++document) {
+        (*names)[segment->getDocumentName(document)] = document;
+    }
+    segment->documentNames = std::move(names);
+
+    return segment;
+}
+
+std::shared_ptr<IndexSegment> IndexSegment::withRemoved(const std::vector<uint32_t>& documents,
+    const TextAnalyzer& analyzer) const {
+    std::shared_ptr<IndexSegment> copy(new IndexSegment(*this));
+    for (uint32_t document : documents) {
+        copy->removeDocument(document, analyzer);
+    }
+    return copy;
+}
+
+bool IndexSegment::sameData(const IndexSegment& other) const {
+    return file == other.file;
+}
+
+bool IndexSegment::verify(std::string& error) const {
+    for (size_t i = 0; i < sections.size(); ++i) {
+        const Section& section = sections[i];
+        const size_t fileOffset = static_cast<size_t>(section.data - file->data());
+
+        uint64_t hash = ExtractionCache::hashBytes(nullptr, 0);
+        for (uint64_t offset = 0; offset < section.size; offset += VERIFY_SLICE_BYTES) {
+            size_t length = static_cast<size_t>(std::min<uint64_t>(VERIFY_SLICE_BYTES, section.size - offset));
+            hash = ExtractionCache::hashBytes(section.data + offset, length, hash);
+
+            // Проверка не должна вытеснять из памяти рабочие страницы поиска
+            file->evict(fileOffset + static_cast<size_t>(offset), length);
+        }
+
+        if (hash != section.checksum) {
+            error = "Error: Index segment section " + std::to_string(i) + " checksum mismatch: " + path;
+            return false;
+        }
+    }
+    return true;
+}
+
+const std::string& IndexSegment::getPath() const {
+    return path;
+}
+
+bool IndexSegment::isPersistent() const {
+    return !path.empty();
+}
+
+uint64_t IndexSegment::getFileSize() const {
+    return file->size();
+}
+
+size_t IndexSegment::getDocumentCount() const {
+    return documentCount;
+}
+
+std::string_view IndexSegment::getString(uint32_t offset, uint32_t length) const {
+    const Section& section = sections[STRINGS];
+    uint64_t begin = std::min<uint64_t>(offset, section.size);
+    uint64_t end = std::min<uint64_t>(begin + length, section.size);
+    return std::string_view(section.data + begin, static_cast<size_t>(end - begin));
+}
+
+IndexSegment::DocumentInfo IndexSegment::getDocument(uint32_t document) const {
+    const DocumentRecord& record = items<DocumentRecord>(DOCUMENTS)[document];
+
+    DocumentInfo info;
+    info.name = getString(record.nameOffset, record.nameLength);
+    info.ocrProfile = getString(record.profileOffset, record.profileLength);
+    info.originalSize = record.originalSize;
+    info.addedTime = record.addedTime;
+    info.sourceStamp = record.sourceStamp;
+    info.chunkSize = record.chunkSize;
+    info.chunkOverlap = record.chunkOverlap;
+    info.firstChunk = std::min(record.firstChunk, chunkCount);
+    info.chunkCount = std::min(record.chunkCount, chunkCount - info.firstChunk);
+    return info;
+}
+
+std::string_view IndexSegment::getDocumentName(uint32_t document) const {
+    const DocumentRecord& record = items<DocumentRecord>(DOCUMENTS)[document];
+    return getString(record.nameOffset, record.nameLength);
+}
+
+bool IndexSegment::findDocument(std::string_view name, uint32_t& document) const {
+    auto it = documentNames->find(name);
+    if (it == documentNames->end() || isDocumentRemoved(it->second)) {
+        return false;
+    }
+    document = it->second;
+    return true;
+}
+
+bool IndexSegment::isDocumentRemoved(uint32_t document) const {
+    return document >= documentCount || removedDocuments[document];
+}
+
+std::vector<uint32_t> IndexSegment::getRemovedDocuments() const {
+    std::vector<uint32_t> removed;
+    for (uint32_t document = 0; document < documentCount; ++document) {
+        if (removedDocuments[document]) {
+            removed.push_back(document);
+        }
+    }
+    return removed;
+}
+
+void IndexSegment::removeDocument(uint32_t document, const TextAnalyzer& analyzer) {
+    if (isDocumentRemoved(document)) {
+        return;
+    }
+    removedDocuments[document] = true;
+
+    const DocumentInfo info = getDocument(document);
+    const uint32_t* lengths = items<uint32_t>(CHUNK_LENGTHS);
+
+    std::string buffer;
+    std::vector<std::string_view> tokens;
+
+    for (uint32_t chunk = info.firstChunk; chunk < info.firstChunk + info.chunkCount; ++chunk) {
+        if (removedChunks[chunk]) {
+            continue;
+        }
+        removedChunks[chunk] = true;
+        removedChunkCount++;
+        removedLength += lengths[chunk];
+
+        // Частоты терминов чанка перестают учитываться в idf
+        analyzer.analyze(getChunk(chunk), buffer, tokens);
+        std::sort(tokens.begin(), tokens.end());
+        tokens.erase(std::unique(tokens.begin(), tokens.end()), tokens.end());
+
+        for (std::string_view token : tokens) {
+            uint32_t term = findTerm(token);
+            if (term != INVALID_TERM) {
+                removedFrequency[term]++;
+            }
+        }
+    }
+}
+
+size_t IndexSegment::getChunkCount() const {
+    return chunkCount;
+}
+
+bool IndexSegment::isChunkRemoved(uint32_t chunk) const {
+    return chunk >= chunkCount || removedChunks[chunk];
+}
+
+size_t IndexSegment::getRemovedChunkCount() const {
+    return removedChunkCount;
+}
+
+std::string_view IndexSegment::getChunk(uint32_t chunk) const {
+    const ChunkSpan& span = items<ChunkSpan>(CHUNK_SPANS)[chunk];
+    const Section& text = sections[CHUNK_TEXT];
+
+    // Участок ограничивается разделом: поврежденный файл не выводит чтение за отображение
+    uint64_t begin = std::min(span.offset, text.size);
+    uint64_t end = std::min(begin + span.length, text.size);
+    return std::string_view(text.data + begin, static_cast<size_t>(end - begin));
+}
+
+uint64_t IndexSegment::getFingerprint(uint32_t chunk) const {
+    return items<uint64_t>(FINGERPRINTS)[chunk];
+}
+
+uint64_t IndexSegment::getTokenizer() const {
+    return tokenizer;
+}
+
+uint32_t IndexSegment::getTokenCount(uint32_t chunk) const {
+    return items<uint32_t>(CHUNK_TOKENS)[chunk];
+}
+
+ChunkList::Source IndexSegment::getChunkSource(uint32_t chunk) const {
+    return items<ChunkList::Source>(CHUNK_SOURCES)[chunk];
+}
+
+uint64_t IndexSegment::getTextLength() const {
+    return textLength;
+}
+
+uint64_t IndexSegment::getStoredTextSize() const {
+    return sections[CHUNK_TEXT].size;
+}
+
+IndexSegment::ChunkId IndexSegment::getChunkId(uint32_t chunk) const {
+    return items<uint32_t>(CHUNK_IDS)[chunk];
+}
+
+bool IndexSegment::findChunk(ChunkId chunkId, uint32_t& chunk) const {
+    const ChunkLookup* lookup = items<ChunkLookup>(CHUNK_LOOKUP);
+    const ChunkLookup* found = std::lower_bound(lookup, lookup + chunkCount, chunkId,
+        [](const ChunkLookup& entry, ChunkId id) { return entry.chunkId < id; });
+
+    if (found == lookup + chunkCount || found->chunkId != chunkId || found->chunk >= chunkCount
+        || removedChunks[found->chunk]) {
+        return false;
+    }
+
+    chunk = found->chunk;
+    return true;
+}
+
+uint32_t IndexSegment::getChunkDocument(uint32_t chunk) const {
+    const DocumentRecord* records = items<DocumentRecord>(DOCUMENTS);
+    const DocumentRecord* next = std::upper_bound(records, records + documentCount, chunk,
+        [](uint32_t value, const DocumentRecord& record) { return value < record.firstChunk; });
+    return next == records ? 0 : static_cast<uint32_t>(next - records - 1);
+}
+
+size_t IndexSegment::getDimension() const {
+    return dimension;
+}
+
+uint64_t IndexSegment::getEmbeddingModel() const {
+    return embeddingModel;
+}
+
+const float* IndexSegment::getEmbedding(uint32_t chunk) const {
+    if (dimension == 0 || chunk >= chunkCount) {
+        return nullptr;
+    }
+
+    // Нормализованный эмбеддинг не бывает нулевым: нулевой вектор означает, что его не было
+    const float* vector = items<float>(EMBEDDINGS) + size_t(chunk) * dimension;
+    bool present = std::any_of(vector, vector + dimension, [](float value) { return value != 0.0f; });
+    return present ? vector : nullptr;
+}
+
+std::string_view IndexSegment::getTerm(uint32_t term) const {
+    const uint64_t* offsets = items<uint64_t>(TERM_OFFSETS);
+    const Section& text = sections[TERM_TEXT];
+
+    uint64_t begin = std::min(offsets[term], text.size);
+    uint64_t end = std::min(std::max(offsets[term + 1], begin), text.size);
+    return std::string_view(text.data + begin, static_cast<size_t>(end - begin));
+}
+
+uint32_t IndexSegment::findTerm(std::string_view term) const {
+    uint32_t low = 0;
+    uint32_t high = termCount;
+
+    while (low < high) {
+        uint32_t middle = low + (high - low) / 2;
+        if (getTerm(middle) < term) {
+            low = middle + 1;
+        }
+        else {
+            high = middle;
+        }
+    }
+
+    return low < termCount && getTerm(low) == term ? low : INVALID_TERM;
+}
+
+void IndexSegment::findTerms(const std::vector<std::string_view>& sortedTerms, std::vector<uint32_t>& terms) const {
+    terms.assign(sortedTerms.size(), INVALID_TERM);
+    uint32_t low = 0;
+
+    for (size_t i = 0; i < sortedTerms.size() && low < termCount; ++i) {
+        uint32_t high = termCount;
+        while (low < high) {
+            uint32_t middle = low + (high - low) / 2;
+            if (getTerm(middle) < sortedTerms[i]) {
+                low = middle + 1;
+            }
+            else {
+                high = middle;
+            }
+        }
+
+        if (low < termCount && getTerm(low) == sortedTerms[i]) {
+            terms[i] = low;
+        }
+    }
+}
+
+uint32_t IndexSegment::getDocumentFrequency(uint32_t term) const {
+    if (term >= termCount) {
+        return 0;
+    }
+
+    uint32_t frequency = items<TermRecord>(TERMS)[term].postingCount;
+    auto removed = removedFrequency.find(term);
+    if (removed != removedFrequency.end()) {
+        frequency -= std::min(frequency, removed->second);
+    }
+    return frequency;
+}
+
+InvertedIndex::CollectionStats IndexSegment::getCollectionStats() const {
+    return { chunkCount - removedChunkCount, totalLength - removedLength };
+}
+
+std::vector<InvertedIndex::Hit> IndexSegment::search(const InvertedIndex::SparseVector& weightedQuery,
+    const InvertedIndex::CollectionStats& collection, size_t topK, InvertedIndex::SearchStats* stats,
+    uint32_t firstChunk, uint32_t endChunk) const {
+    if (stats) {
+        *stats = InvertedIndex::SearchStats();
+    }
+    endChunk = std::min(endChunk, chunkCount);
+    if (removedChunkCount == chunkCount || collection.chunkCount == 0 || topK == 0 || firstChunk >= endChunk) {
+        return {};
+    }
+    const bool wholeSegment = firstChunk == 0 && endChunk == chunkCount;
+
+    const TermRecord* records = items<TermRecord>(TERMS);
+    const InvertedIndex::Posting* postings = items<InvertedIndex::Posting>(POSTINGS);
+
+    std::vector<InvertedIndex::PostingList> lists;
+    for (const auto& term : weightedQuery) {
+        if (getDocumentFrequency(term.termId) == 0) {
+            continue;
+        }
+
+        const TermRecord& record = records[term.termId];
+        if (record.firstPosting + record.postingCount > postingCount) {
+            continue;
+        }
+
+        const InvertedIndex::Posting* begin = postings + record.firstPosting;
+        const InvertedIndex::Posting* end = begin + record.postingCount;
+        if (!wholeSegment) {
+            // Списки упорядочены по номеру чанка; верхние оценки списка годятся и для его части
+            auto byChunk = [](const InvertedIndex::Posting& posting, uint32_t chunk) {
+                return posting.chunkId < chunk;
+            };
+            begin = std::lower_bound(begin, end, firstChunk, byChunk);
+            end = std::lower_bound(begin, end, endChunk, byChunk);
+            if (begin == end) {
+                continue;
+            }
+        }
+
+        lists.push_back({ begin, end, term.weight, record.maxTermFrequency, record.minChunkLength });
+    }
+
+    const float averageLength = std::max(1.0f,
+        static_cast<float>(collection.totalLength) / static_cast<float>(collection.chunkCount));
+    return InvertedIndex::searchLists(lists, items<uint32_t>(CHUNK_LENGTHS), removedChunks, averageLength,
+        topK, stats);
+}
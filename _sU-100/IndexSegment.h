@@ -0,0 +1,216 @@
+﻿// IndexSegment.h
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <memory>
+#include <functional>
+#include <unordered_map>
+#include <cstdint>
+#include "InvertedIndex.h"
+#include "TextAnalyzer.h"
+#include "MemoryBuffer.h"
+#include "ChunkList.h"
+
+// Неизменяемый сегмент индекса: документы, текст чанков, словарь, списки терминов
+// и эмбеддинги в одном файле. Файл отображается в память и читается на месте, без разбора,
+// поэтому открытие не зависит от размера сегмента, а в памяти остаются только страницы,
+// к которым обращался поиск (ими распоряжается кэш страниц системы). Тот же формат
+// без файла - сегмент в памяти для только что загруженных документов.
+// Формат версионирован, каждый раздел снабжен контрольной суммой. Объект сегмента не
+// меняется после создания, поэтому его читают из любых потоков без блокировок: удаление
+// документа дает новую копию с отметкой (данные общие), а сами данные убираются при слиянии
+class IndexSegment {
+public:
+    using ChunkId = InvertedIndex::ChunkId;
+
+    // Версия формата файла
+    static constexpr uint32_t FORMAT_VERSION = 4;
+
+    // Нет такого термина в сегменте
+    static constexpr uint32_t INVALID_TERM = UINT32_MAX;
+
+    // Документ сегмента. Документ, загружавшийся частями, может лежать в нескольких сегментах
+    // (по части в каждом); при слиянии части объединяются
+    struct DocumentInfo {
+        std::string name;
+        std::string ocrProfile;
+        uint64_t originalSize = 0;
+        int64_t addedTime = 0;
+        uint64_t sourceStamp = 0;       // отпечаток исходного файла (0 - документ не из файла)
+        uint32_t chunkSize = 0;         // размер чанка в символах, которым разбит документ
+        uint32_t chunkOverlap = 0;      // перекрытие чанков в токенах
+        uint32_t firstChunk = 0;        // номер первого чанка документа в сегменте
+        uint32_t chunkCount = 0;
+    };
+
+    // Документ для записи: чанки подряд, их идентификаторы в контексте и места в документе
+    struct DocumentData {
+        DocumentInfo info;              // firstChunk и chunkCount заполняются при записи
+        std::vector<std::string_view> chunks;
+        std::vector<ChunkId> chunkIds;
+        std::vector<ChunkList::Source> sources;
+    };
+
+    // Эмбеддинг чанка документа при записи; false - эмбеддинга нет
+    using EmbeddingSource = std::function<bool(size_t document, size_t chunk, std::vector<float>& embedding)>;
+
+    // Эмбеддинг чанка по идентификатору при слиянии (векторы, которых нет в сегментах)
+    using EmbeddingLookup = std::function<bool(ChunkId chunkId, std::vector<float>& embedding)>;
+
+    // Токенизатор модели генерации: число токенов чанка считается при записи и хранится
+    // в сегменте. tag - хеш описания модели (0 - токенизатора нет, число токенов не хранится)
+    struct Tokenizer {
+        uint64_t tag = 0;
+        std::function<uint32_t(std::string_view text)> count;
+    };
+
+    // Запись сегмента: термины чанков разбирает analyzer; dimension = 0 - без эмбеддингов.
+    // Пустой path - сегмент в памяти. Файл пишется рядом и переименовывается, поэтому
+    // недописанный сегмент не виден. nullptr и текст ошибки при неудаче
+    static std::shared_ptr<IndexSegment> write(const std::string& path, const std::vector<DocumentData>& documents,
+        const TextAnalyzer& analyzer, size_t dimension, uint64_t embeddingModel,
+        const EmbeddingSource& embeddings, const Tokenizer& tokenizer, std::string& error);
+
+    // Слияние сегментов (от старых к новым) в один без удаленных документов; части одного
+    // документа объединяются. Списки терминов переносятся без повторного разбора текста.
+    // Эмбеддинги: dimension = 0 - из самого нового сегмента, где они есть; иначе векторы модели
+    // embeddingModel из сегментов, а недостающие - из lookup. Число токенов чанков переносится
+    // из сегментов того же токенизатора, остальные чанки считаются заново.
+    // Пустой path - результат в памяти
+    static std::shared_ptr<IndexSegment> merge(const std::string& path,
+        const std::vector<std::shared_ptr<const IndexSegment>>& sources, size_t dimension,
+        uint64_t embeddingModel, const EmbeddingLookup& lookup, const Tokenizer& tokenizer, std::string& error);
+
+    // Открытие сегмента: проверяются версия, заголовок, таблица разделов и таблица документов
+    // (остальные разделы - в verify); nullptr и текст ошибки при неудаче
+    static std::shared_ptr<IndexSegment> open(const std::string& path, std::string& error);
+
+    // Копия с удаленными документами: они исчезают из поиска и статистики BM25 (термины
+    // их чанков разбирает analyzer). Данные сегмента у копий общие
+    std::shared_ptr<IndexSegment> withRemoved(const std::vector<uint32_t>& documents,
+        const TextAnalyzer& analyzer) const;
+
+    // Копии одного сегмента (с разными удалениями)
+    bool sameData(const IndexSegment& other) const;
+
+    // Проверка контрольных сумм всех разделов (читает весь файл)
+    bool verify(std::string& error) const;
+
+    // Путь к файлу; пустой у сегмента в памяти
+    const std::string& getPath() const;
+    bool isPersistent() const;
+    uint64_t getFileSize() const;
+
+    // Документы
+    size_t getDocumentCount() const;
+    DocumentInfo getDocument(uint32_t document) const;
+    std::string_view getDocumentName(uint32_t document) const;
+    bool isDocumentRemoved(uint32_t document) const;
+    std::vector<uint32_t> getRemovedDocuments() const;
+
+    // Неудаленный документ по имени; false, если его нет
+    bool findDocument(std::string_view name, uint32_t& document) const;
+
+    // Чанки (по номеру в сегменте)
+    size_t getChunkCount() const;
+    size_t getRemovedChunkCount() const;
+    bool isChunkRemoved(uint32_t chunk) const;
+    std::string_view getChunk(uint32_t chunk) const;
+    ChunkId getChunkId(uint32_t chunk) const;
+
+    // Отпечаток SimHash чанка (NearDuplicateIndex::NO_FINGERPRINT - чанк слишком короткий)
+    uint64_t getFingerprint(uint32_t chunk) const;
+
+    // Токенизатор, которым считались токены чанков (0 - не считались), и число токенов чанка
+    uint64_t getTokenizer() const;
+    uint32_t getTokenCount(uint32_t chunk) const;
+
+    // Место чанка в тексте документа: смещение и страницы
+    ChunkList::Source getChunkSource(uint32_t chunk) const;
+
+    // Объем текста чанков и сколько из него записано: одинаковый текст хранится один раз
+    uint64_t getTextLength() const;
+    uint64_t getStoredTextSize() const;
+
+    // Номер неудаленного чанка по идентификатору; false, если чанка в сегменте нет
+    bool findChunk(ChunkId chunkId, uint32_t& chunk) const;
+
+    // Документ, которому принадлежит чанк
+    uint32_t getChunkDocument(uint32_t chunk) const;
+
+    // Эмбеддинги: размерность (0 - нет), хеш модели и вектор чанка (nullptr - нет)
+    size_t getDimension() const;
+    uint64_t getEmbeddingModel() const;
+    const float* getEmbedding(uint32_t chunk) const;
+
+    // Номер термина (INVALID_TERM, если его нет) и число неудаленных чанков с ним
+    uint32_t findTerm(std::string_view term) const;
+
+    // Номера сразу нескольких терминов, упорядоченных по возрастанию: один проход по словарю,
+    // каждый следующий поиск начинается с места предыдущего
+    void findTerms(const std::vector<std::string_view>& sortedTerms, std::vector<uint32_t>& terms) const;
+    uint32_t getDocumentFrequency(uint32_t term) const;
+
+    // Статистика BM25 неудаленных чанков
+    InvertedIndex::CollectionStats getCollectionStats() const;
+
+    // Поиск в сегменте как части коллекции: вес термина в запросе уже включает idf по всей
+    // коллекции, средняя длина чанка берется из collection. Запрос - номера терминов сегмента,
+    // результат - номера чанков в сегменте. [firstChunk, endChunk) - часть чанков сегмента
+    // для параллельного поиска: списки терминов сужаются до нее двоичным поиском
+    std::vector<InvertedIndex::Hit> search(const InvertedIndex::SparseVector& weightedQuery,
+        const InvertedIndex::CollectionStats& collection, size_t topK,
+        InvertedIndex::SearchStats* stats = nullptr, uint32_t firstChunk = 0,
+        uint32_t endChunk = UINT32_MAX) const;
+
+private:
+    // Положение раздела в файле
+    struct Section {
+        const char* data = nullptr;
+        uint64_t size = 0;
+        uint64_t checksum = 0;
+    };
+
+    IndexSegment() = default;
+    IndexSegment(const IndexSegment&) = default;
+
+    std::string path;
+    std::shared_ptr<MemoryBuffer> file;
+    std::vector<Section> sections;
+
+    uint32_t documentCount = 0;
+    uint32_t chunkCount = 0;
+    uint32_t termCount = 0;
+    uint32_t dimension = 0;
+    uint64_t postingCount = 0;
+    uint64_t totalLength = 0;
+    uint64_t embeddingModel = 0;
+    uint64_t textLength = 0;
+    uint64_t tokenizer = 0;
+
+    // Документы по имени (имена - в данных сегмента)
+    std::shared_ptr<const std::unordered_map<std::string_view, uint32_t>> documentNames;
+
+    // Удаленные документы и чанки; removedFrequency - удаленных чанков с термином
+    std::vector<bool> removedDocuments;
+    std::vector<bool> removedChunks;
+    std::unordered_map<uint32_t, uint32_t> removedFrequency;
+    size_t removedChunkCount = 0;
+    uint64_t removedLength = 0;
+
+    // Разбор заголовка и таблицы разделов данных сегмента (файла или буфера в памяти)
+    static std::shared_ptr<IndexSegment> load(std::shared_ptr<MemoryBuffer> file, const std::string& path,
+        std::string& error);
+
+    // Отметка удаленного документа (только в еще не опубликованной копии)
+    void removeDocument(uint32_t document, const TextAnalyzer& analyzer);
+
+    // Элемент раздела по номеру
+    template <typename T>
+    const T* items(size_t section) const;
+
+    std::string_view getString(uint32_t offset, uint32_t length) const;
+    std::string_view getTerm(uint32_t term) const;
+};
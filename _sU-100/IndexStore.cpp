@@ -0,0 +1,202 @@
+﻿// IndexStore.cpp
+#include "IndexStore.h"
+#include "ExtractionCache.h"
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <filesystem>
+#include <algorithm>
+#include <cstdio>
+
+namespace fs = std::filesystem;
+
+namespace {
+    // Версия формата манифеста
+    constexpr const char* MANIFEST_FORMAT = "sU-100 index 1";
+
+    constexpr const char* MANIFEST_NAME = "manifest";
+    constexpr const char* SEGMENT_PREFIX = "segment-";
+    constexpr const char* SEGMENT_EXTENSION = ".seg";
+
+    // Номер сегмента по имени файла; 0 - не файл сегмента
+    uint32_t segmentNumber(const std::string& fileName) {
+        const size_t prefix = std::char_traits<char>::length(SEGMENT_PREFIX);
+        const size_t extension = std::char_traits<char>::length(SEGMENT_EXTENSION);
+        if (fileName.size() <= prefix + extension ||
+            fileName.compare(0, prefix, SEGMENT_PREFIX) != 0 ||
+            fileName.compare(fileName.size() - extension, extension, SEGMENT_EXTENSION) != 0) {
+            return 0;
+        }
+
+        uint32_t number = 0;
+        for (size_t i = prefix; i < fileName.size() - extension; ++i) {
+            if (fileName[i] < '0' || fileName[i] > '9') {
+                return 0;
+            }
+            number = number * 10 + static_cast<uint32_t>(fileName[i] - '0');
+        }
+        return number;
+    }
+}
+
+IndexStore::IndexStore(const std::string& directory)
+    : directory(directory), nextSegmentNumber(1) {
+    std::error_code ec;
+    fs::create_directories(directory, ec);
+
+    if (ec) {
+        std::cerr << "Warning: Failed to create index directory: " << directory << std::endl;
+    }
+}
+
+const std::string& IndexStore::getDirectory() const {
+    return directory;
+}
+
+std::string IndexStore::manifestPath() const {
+    return (fs::path(directory) / MANIFEST_NAME).string();
+}
+
+bool IndexStore::load(const TextAnalyzer& analyzer, State& state, std::string& error) {
+    std::lock_guard<std::mutex> lock(mtx);
+    state = State();
+    savedFiles.clear();
+
+    // Номера новых сегментов продолжают номера всех файлов каталога
+    std::error_code ec;
+    for (const auto& entry : fs::directory_iterator(directory, ec)) {
+        nextSegmentNumber = std::max(nextSegmentNumber, segmentNumber(entry.path().filename().string()) + 1);
+    }
+
+    std::ifstream file(manifestPath(), std::ios::binary);
+    if (!file) {
+        // Индекса еще нет: файлы сегментов без манифеста остались от прерванной первой записи
+        for (const auto& entry : fs::directory_iterator(directory, ec)) {
+            if (segmentNumber(entry.path().filename().string()) != 0 || entry.path().extension() == ".tmp") {
+                fs::remove(entry.path(), ec);
+            }
+        }
+        return true;
+    }
+
+    std::stringstream buffer;
+    buffer << file.rdbuf();
+    const std::string text = buffer.str();
+
+    // Последняя строка - контрольная сумма всего, что перед ней
+    const size_t checksumLine = text.rfind("checksum ");
+    if (checksumLine == std::string::npos ||
+        text.compare(checksumLine + 9, 16, ExtractionCache::toHex(ExtractionCache::hashBytes(text.data(), checksumLine))) != 0) {
+        error = "Error: Index manifest is damaged: " + manifestPath();
+        return false;
+    }
+
+    std::istringstream lines(text.substr(0, checksumLine));
+    std::string line;
+    if (!std::getline(lines, line) || line != MANIFEST_FORMAT) {
+        error = "Error: Unsupported index manifest format: " + manifestPath();
+        return false;
+    }
+
+    while (std::getline(lines, line)) {
+        std::istringstream fields(line);
+        std::string key;
+        fields >> key;
+
+        if (key == "next-chunk") {
+            fields >> state.nextChunkId;
+        }
+        else if (key == "segment") {
+            std::string fileName;
+            fields >> fileName;
+            savedFiles.insert(fileName);
+
+            std::string segmentError;
+            auto segment = IndexSegment::open((fs::path(directory) / fileName).string(), segmentError);
+            if (!segment) {
+                std::cerr << "Warning: " << segmentError << std::endl;
+                continue;
+            }
+
+            // Удаленные документы сегмента
+            std::vector<uint32_t> removed;
+            uint32_t document;
+            while (fields >> document) {
+                removed.push_back(document);
+            }
+
+            state.segments.push_back(removed.empty() ? segment : segment->withRemoved(removed, analyzer));
+        }
+    }
+
+    // Файлы сегментов вне манифеста: недописанные или уже слитые
+    for (const auto& entry : fs::directory_iterator(directory, ec)) {
+        const std::string fileName = entry.path().filename().string();
+        if ((segmentNumber(fileName) != 0 && savedFiles.count(fileName) == 0) || entry.path().extension() == ".tmp") {
+            fs::remove(entry.path(), ec);
+        }
+    }
+
+    return true;
+}
+
+std::string IndexStore::createSegmentPath() {
+    std::lock_guard<std::mutex> lock(mtx);
+
+    char fileName[32];
+    std::snprintf(fileName, sizeof(fileName), "%s%06u%s", SEGMENT_PREFIX, nextSegmentNumber++, SEGMENT_EXTENSION);
+    return (fs::path(directory) / fileName).string();
+}
+
+bool IndexStore::save(const State& state, std::string& error) {
+    std::lock_guard<std::mutex> lock(mtx);
+
+    std::ostringstream ss;
+    ss << MANIFEST_FORMAT << "\n";
+    ss << "next-chunk " << state.nextChunkId << "\n";
+
+    std::set<std::string> files;
+    for (const auto& segment : state.segments) {
+        const std::string fileName = fs::path(segment->getPath()).filename().string();
+        files.insert(fileName);
+
+        ss << "segment " << fileName;
+        for (uint32_t document : segment->getRemovedDocuments()) {
+            ss << " " << document;
+        }
+        ss << "\n";
+    }
+
+    std::string text = ss.str();
+    text += "checksum " + ExtractionCache::toHex(ExtractionCache::hashBytes(text.data(), text.size())) + "\n";
+
+    // Атомарная замена: временный файл и переименование
+    const std::string path = manifestPath();
+    const std::string tmpPath = path + ".tmp";
+    {
+        std::ofstream file(tmpPath, std::ios::binary | std::ios::trunc);
+        file.write(text.data(), text.size());
+        if (!file) {
+            error = "Error: Failed to write index manifest: " + tmpPath;
+            return false;
+        }
+    }
+
+    std::error_code ec;
+    fs::rename(tmpPath, path, ec);
+    if (ec) {
+        fs::remove(tmpPath, ec);
+        error = "Error: Failed to replace index manifest: " + path;
+        return false;
+    }
+
+    // Выбывшие сегменты (слитые или удаленные целиком) больше не нужны
+    for (const auto& fileName : savedFiles) {
+        if (files.count(fileName) == 0) {
+            fs::remove(fs::path(directory) / fileName, ec);
+        }
+    }
+    savedFiles = std::move(files);
+
+    return true;
+}
@@ -0,0 +1,50 @@
+﻿// IndexStore.h
+#pragma once
+
+#include <string>
+#include <vector>
+#include <set>
+#include <memory>
+#include <mutex>
+#include <cstdint>
+#include "IndexSegment.h"
+
+// Каталог постоянного индекса: файлы сегментов и манифест - список действующих сегментов
+// с номерами удаленных из них документов. Сегменты не изменяются, манифест заменяется
+// атомарно, поэтому после сбоя индекс открывается в последнем сохраненном состоянии,
+// а недописанные и уже слитые сегменты удаляются при открытии
+class IndexStore {
+public:
+    // Состояние индекса в манифесте
+    struct State {
+        std::vector<std::shared_ptr<const IndexSegment>> segments;
+        InvertedIndex::ChunkId nextChunkId = 0;     // первый свободный идентификатор чанка
+    };
+
+    // Конструктор с каталогом индекса (создается при необходимости)
+    explicit IndexStore(const std::string& directory);
+
+    const std::string& getDirectory() const;
+
+    // Открытие сегментов манифеста с отметкой удаленных документов (их термины разбирает analyzer).
+    // Сегмент, который не открылся (поврежден или другой версии), пропускается с предупреждением.
+    // false - манифест поврежден, state пуст
+    bool load(const TextAnalyzer& analyzer, State& state, std::string& error);
+
+    // Путь к файлу нового сегмента
+    std::string createSegmentPath();
+
+    // Сохранение манифеста; файлы сегментов, выбывших из прежнего манифеста, удаляются
+    bool save(const State& state, std::string& error);
+
+private:
+    std::string directory;
+    uint32_t nextSegmentNumber;
+
+    // Файлы сегментов последнего сохраненного манифеста
+    std::set<std::string> savedFiles;
+
+    std::mutex mtx;
+
+    std::string manifestPath() const;
+};
@@ -0,0 +1,877 @@
+﻿// IngestionPipeline.cpp
+#include "IngestionPipeline.h"
+#include "ContextManager.h"
+#include "TextChunker.h"
+#include "MemoryBuffer.h"
+#include "SpillFile.h"
+#include "ExtractionCache.h"
+#include "ThreadPool.h"
+#include <iostream>
+#include <sstream>
+#include <iomanip>
+#include <map>
+#include <chrono>
+#include <algorithm>
+#include <filesystem>
+
+namespace {
+    const char* const STAGE_NAMES[] = { "load", "render", "ocr", "chunk", "index" };
+
+    // Доли бюджета памяти: PDF в памяти, страницы в обработке, ожидающий текст
+    constexpr double DOCUMENT_BUDGET_SHARE = 0.25;
+    constexpr double PAGE_BUDGET_SHARE = 0.60;
+    constexpr double TEXT_BUDGET_SHARE = 0.15;
+
+    size_t budgetShare(size_t budget, double share) {
+        return budget > 0 ? std::max<size_t>(1, static_cast<size_t>(budget * share)) : 0;
+    }
+
+    long long nowNs() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    // Отпечаток файла: размер, время изменения и профиль OCR (0 - файл недоступен)
+    uint64_t sourceStamp(const std::string& path, const std::string& ocrProfile) {
+        std::error_code ec;
+        const uint64_t size = std::filesystem::file_size(path, ec);
+        if (ec) {
+            return 0;
+        }
+        const int64_t modified = std::filesystem::last_write_time(path, ec).time_since_epoch().count();
+        if (ec) {
+            return 0;
+        }
+
+        uint64_t stamp = ExtractionCache::hashBytes(&size, sizeof(size));
+        stamp = ExtractionCache::hashBytes(&modified, sizeof(modified), stamp);
+        stamp = ExtractionCache::hashBytes(ocrProfile.data(), ocrProfile.size(), stamp);
+        return stamp != 0 ? stamp : 1;
+    }
+}
+
+// Страница, ожидающая рендеринга
+struct IngestionPipeline::PageTask {
+    std::shared_ptr<Job> job;
+    int pageIndex = 0;
+};
+
+// Отрендеренная или распознанная страница
+struct IngestionPipeline::PageResult {
+    std::shared_ptr<Job> job;
+    PDFProcessor::RenderedPage page;
+    size_t reservedBytes = 0;    // резерв бюджета страниц до окончания OCR
+};
+
+// Страница, ожидающая предыдущих перед разбиением
+struct IngestionPipeline::WaitingPage {
+    PDFProcessor::RenderedPage page;
+    size_t reservedBytes = 0;    // резерв бюджета текста
+    bool spilled = false;        // текст во временном файле
+    SpillFile::Segment segment;
+};
+
+// Готовые чанки очередных страниц документа
+struct IngestionPipeline::ChunkBatch {
+    std::shared_ptr<Job> job;
+    int seq = 0;
+    ChunkList chunks;
+    size_t textSize = 0;
+    bool last = false;
+};
+
+// Файл в обработке
+struct IngestionPipeline::Job {
+    std::string path;
+    std::string docName;
+    std::string ocrProfile;
+    uint64_t sourceStamp = 0;     // отпечаток файла (0 - PDF из памяти)
+    long long submittedNs = 0;
+
+    // Содержимое PDF, переданное из памяти (до открытия документа)
+    std::shared_ptr<MemoryBuffer> data;
+    size_t reservedDocumentBytes = 0;
+
+    std::shared_ptr<PDFProcessor::DocumentHandle> handle;
+    int pageCount = 0;
+    bool fromCache = false;
+    bool fromIndex = false;
+
+    // Файл удален или поставлен в очередь заново: оставшиеся страницы пропускаются
+    std::atomic<bool> cancelled{ false };
+
+    // Этап разбиения: страницы приходят в произвольном порядке и ждут предыдущих
+    std::mutex chunkMtx;
+    std::map<int, WaitingPage> readyPages;
+    std::unique_ptr<SpillFile> spill;
+    int nextPage = 1;
+    std::unique_ptr<TextChunker> chunker;   // с параметрами на момент начала документа
+    TextChunker::State chunkState;
+    int nextBatch = 0;
+
+    // Этап индексации: пачки применяются строго по порядку
+    std::mutex indexMtx;
+    std::map<int, ChunkBatch> readyBatches;
+    int nextIndexBatch = 0;
+    size_t characters = 0;
+    long long firstPageMs = -1;
+};
+
+IngestionPipeline::IngestionPipeline(std::shared_ptr<PDFProcessor> pdfProcessor,
+    std::shared_ptr<ContextManager> contextManager, const IngestionConfig& config)
+    : pdfProcessor(pdfProcessor),
+    contextManager(contextManager),
+    config(config),
+    loadQueue(config.documentQueueCapacity),
+    renderQueue(config.pageQueueCapacity),
+    ocrQueue(config.imageQueueCapacity),
+    chunkQueue(config.pageQueueCapacity),
+    indexQueue(config.batchQueueCapacity),
+    documentBudget(budgetShare(config.memoryBudget, DOCUMENT_BUDGET_SHARE)),
+    pageBudget(budgetShare(config.memoryBudget, PAGE_BUDGET_SHARE)),
+    textBudget(budgetShare(config.memoryBudget, TEXT_BUDGET_SHARE)),
+    spilledBytes(0),
+    statsStartNs(nowNs()),
+    stopping(false) {
+
+    // Огромные PDF в бюджете памяти требуют экономного режима извлечения
+    if (config.memoryBudget > 0) {
+        pdfProcessor->setLowMemoryMode(true);
+    }
+
+    size_t ocrThreads = config.ocrThreads;
+    if (ocrThreads == 0) {
+        ocrThreads = std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    const size_t threadCounts[STAGE_COUNT] = {
+        std::max<size_t>(1, config.loadThreads),
+        std::max<size_t>(1, config.renderThreads),
+        ocrThreads,
+        std::max<size_t>(1, config.chunkThreads),
+        std::max<size_t>(1, config.indexThreads)
+    };
+    void (IngestionPipeline::* const loops[STAGE_COUNT])() = {
+        &IngestionPipeline::loadLoop,
+        &IngestionPipeline::renderLoop,
+        &IngestionPipeline::ocrLoop,
+        &IngestionPipeline::chunkLoop,
+        &IngestionPipeline::indexLoop
+    };
+    void (IngestionPipeline::* const dispatchers[STAGE_COUNT])() = {
+        nullptr,
+        &IngestionPipeline::renderDispatchLoop,
+        &IngestionPipeline::ocrDispatchLoop,
+        nullptr,
+        nullptr
+    };
+
+    // Рендеринг и OCR страниц - фоновые задачи общего пула. Задача рендеринга ждет места
+    // в очереди OCR, поэтому занимает не больше size() - 1 потоков пула: иначе распознаванию
+    // не достанется ни одного. В пуле из одного потока рендеринг остается в своих потоках
+    if (config.workers) {
+        slots[RENDER].limit = std::min(threadCounts[RENDER], config.workers->size() - 1);
+        slots[OCR].limit = std::min(threadCounts[OCR], config.workers->size());
+    }
+
+    for (int stage = 0; stage < STAGE_COUNT; ++stage) {
+        counters[stage].name = STAGE_NAMES[stage];
+        counters[stage].threads = threadCounts[stage];
+
+        if (slots[stage].limit > 0) {
+            counters[stage].threads = slots[stage].limit;
+            workers.emplace_back(dispatchers[stage], this);
+            continue;
+        }
+
+        for (size_t i = 0; i < threadCounts[stage]; ++i) {
+            workers.emplace_back(loops[stage], this);
+        }
+    }
+}
+
+IngestionPipeline::~IngestionPipeline() {
+    stop();
+}
+
+void IngestionPipeline::setDoneCallback(DoneCallback callback) {
+    std::lock_guard<std::mutex> lock(jobsMtx);
+    doneCallback = std::move(callback);
+}
+
+bool IngestionPipeline::submit(const std::string& pdfPath, const std::string& docName) {
+    if (stopping) {
+        return false;
+    }
+
+    auto job = std::make_shared<Job>();
+    job->path = pdfPath;
+    job->docName = docName;
+    job->ocrProfile = pdfProcessor->resolveProfileName(pdfPath);
+    job->sourceStamp = sourceStamp(pdfPath, job->ocrProfile);
+    job->submittedNs = nowNs();
+
+    return enqueue(std::move(job));
+}
+
+bool IngestionPipeline::submit(std::shared_ptr<MemoryBuffer> data, const std::string& docName) {
+    if (stopping) {
+        return false;
+    }
+
+    auto job = std::make_shared<Job>();
+    job->path = docName;
+    job->docName = docName;
+    job->ocrProfile = pdfProcessor->resolveProfileName(docName);
+    job->submittedNs = nowNs();
+
+    // PDF в памяти учитываются по размеру: архив не читается дальше, пока бюджет занят
+    job->reservedDocumentBytes = documentBudget.getLimit() > 0 ? data->size() : 0;
+    documentBudget.acquire(job->reservedDocumentBytes);
+    job->data = std::move(data);
+
+    return enqueue(std::move(job));
+}
+
+bool IngestionPipeline::enqueue(std::shared_ptr<Job> job) {
+    const std::string docName = job->docName;
+
+    {
+        std::lock_guard<std::mutex> lock(jobsMtx);
+        activeJobs.insert(job);
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(ownersMtx);
+        auto& owner = owners[docName];
+        if (owner) {
+            owner->cancelled = true;
+        }
+        owner = job;
+    }
+
+    if (!loadQueue.push(std::move(job))) {
+        {
+            std::lock_guard<std::mutex> lock(ownersMtx);
+            auto it = owners.find(docName);
+            if (it != owners.end() && it->second == job) {
+                owners.erase(it);
+            }
+        }
+
+        std::lock_guard<std::mutex> lock(jobsMtx);
+        activeJobs.erase(job);
+        idleCv.notify_all();
+        return false;
+    }
+
+    return true;
+}
+
+void IngestionPipeline::cancel(const std::string& docName) {
+    std::lock_guard<std::mutex> lock(ownersMtx);
+
+    auto it = owners.find(docName);
+    if (it != owners.end()) {
+        it->second->cancelled = true;
+        owners.erase(it);
+    }
+
+    // Под той же блокировкой, чтобы отмененная обработка не успела вернуть документ
+    contextManager->removeDocument(docName);
+}
+
+void IngestionPipeline::waitIdle() {
+    std::unique_lock<std::mutex> lock(jobsMtx);
+    idleCv.wait(lock, [this]() { return activeJobs.empty(); });
+}
+
+size_t IngestionPipeline::getPendingCount() const {
+    std::lock_guard<std::mutex> lock(jobsMtx);
+    return activeJobs.size();
+}
+
+template <typename T>
+bool IngestionPipeline::take(BoundedQueue<T>& queue, T& item, Stage stage, size_t idleThreads) {
+    long long start = nowNs();
+    bool ok = queue.pop(item);
+    counters[stage].starvedNs += (nowNs() - start) * static_cast<long long>(idleThreads);
+
+    if (ok) {
+        counters[stage].items++;
+    }
+    return ok;
+}
+
+template <typename F>
+bool IngestionPipeline::updateIfOwner(const std::shared_ptr<Job>& job, F update) {
+    std::lock_guard<std::mutex> lock(ownersMtx);
+
+    auto it = owners.find(job->docName);
+    if (job->cancelled || it == owners.end() || it->second != job) {
+        return false;
+    }
+
+    update();
+    return true;
+}
+
+template <typename T>
+bool IngestionPipeline::forward(BoundedQueue<T>& queue, T& item, Stage stage) {
+    long long start = nowNs();
+    bool ok = queue.push(std::move(item));
+    counters[stage].blockedNs += nowNs() - start;
+    return ok;
+}
+
+void IngestionPipeline::loadLoop() {
+    std::shared_ptr<Job> job;
+
+    while (take(loadQueue, job, LOAD)) {
+        // Файл не изменился с прошлой индексации: документ уже в постоянном индексе
+        if (job->sourceStamp != 0 && contextManager->getSourceStamp(job->docName) == job->sourceStamp) {
+            job->fromIndex = true;
+            finishJob(job, true, "");
+            continue;
+        }
+
+        std::string error;
+        job->handle = job->data
+            ? pdfProcessor->openDocument(std::move(job->data), job->path, job->ocrProfile, error)
+            : pdfProcessor->openDocument(job->path, job->ocrProfile, error);
+
+        if (!job->handle) {
+            finishJob(job, false, error);
+            continue;
+        }
+
+        job->pageCount = PDFProcessor::getPageCount(*job->handle);
+        if (job->pageCount <= 0) {
+            pdfProcessor->closeDocument(*job->handle);
+            finishJob(job, false, "Error: Document has no pages");
+            continue;
+        }
+
+        // Документ доступен для поиска с первой проиндексированной страницы
+        bool owner = updateIfOwner(job, [&]() {
+            contextManager->beginDocument(job->docName, job->ocrProfile, job->sourceStamp);
+            job->chunker = std::make_unique<TextChunker>(contextManager->createChunker());
+        });
+
+        if (!owner) {
+            finishJob(job, false, "cancelled");
+            continue;
+        }
+
+        // Неизмененный файл целиком взят из кэша: рендеринг и OCR не нужны
+        std::vector<std::string> cachedPages = PDFProcessor::takeCachedPages(*job->handle);
+        if (!cachedPages.empty()) {
+            job->fromCache = true;
+
+            for (int i = 0; i < job->pageCount; ++i) {
+                PageResult result;
+                result.job = job;
+                result.page.pageNumber = i + 1;
+                result.page.text = std::move(cachedPages[i]);
+
+                if (!forward(chunkQueue, result, LOAD)) {
+                    break;
+                }
+            }
+            continue;
+        }
+
+        // Страницы расходятся по потокам рендеринга вперемешку со страницами других файлов
+        for (int i = 0; i < job->pageCount; ++i) {
+            PageTask task{ job, i };
+            if (!forward(renderQueue, task, LOAD)) {
+                break;
+            }
+        }
+    }
+}
+
+void IngestionPipeline::renderLoop() {
+    PageTask task;
+
+    while (take(renderQueue, task, RENDER)) {
+        renderPage(task, reservePage(task));
+    }
+}
+
+void IngestionPipeline::ocrLoop() {
+    PageResult result;
+
+    while (take(ocrQueue, result, OCR)) {
+        recognizePage(result);
+    }
+}
+
+void IngestionPipeline::renderDispatchLoop() {
+    dispatchLoop(renderQueue, RENDER, [this](PageTask& task) {
+        // Бюджет памяти ждет раздающий поток, а не поток пула
+        const size_t reservedBytes = reservePage(task);
+        return [this, task, reservedBytes]() { renderPage(task, reservedBytes); };
+    });
+}
+
+void IngestionPipeline::ocrDispatchLoop() {
+    dispatchLoop(ocrQueue, OCR, [this](PageResult& result) {
+        return [this, result = std::move(result)]() mutable { recognizePage(result); };
+    });
+}
+
+template <typename T, typename F>
+void IngestionPipeline::dispatchLoop(BoundedQueue<T>& queue, Stage stage, F prepare) {
+    PoolSlots& stageSlots = slots[stage];
+    T item;
+
+    while (true) {
+        // Страница берется из очереди, только когда у этапа есть свободное место в пуле:
+        // очереди между этапами по-прежнему сдерживают предыдущий этап
+        size_t idleSlots = 0;
+        {
+            std::unique_lock<std::mutex> lock(stageSlots.mtx);
+            stageSlots.cv.wait(lock, [&stageSlots]() { return stageSlots.running < stageSlots.limit; });
+            idleSlots = stageSlots.limit - stageSlots.running;
+        }
+
+        if (!take(queue, item, stage, idleSlots)) {
+            break;
+        }
+
+        auto work = prepare(item);
+        {
+            std::lock_guard<std::mutex> lock(stageSlots.mtx);
+            stageSlots.running++;
+        }
+
+        config.workers->submit([work = std::move(work), &stageSlots]() mutable {
+            work();
+
+            std::lock_guard<std::mutex> lock(stageSlots.mtx);
+            stageSlots.running--;
+            stageSlots.cv.notify_all();
+        }, TaskPriority::Background);
+    }
+
+    // Задачи обращаются к конвейеру: остановка ждет их завершения
+    std::unique_lock<std::mutex> lock(stageSlots.mtx);
+    stageSlots.cv.wait(lock, [&stageSlots]() { return stageSlots.running == 0; });
+}
+
+size_t IngestionPipeline::reservePage(const PageTask& task) {
+    // Страницы в обработке ограничены объемом памяти, а не количеством
+    if (pageBudget.getLimit() == 0 || task.job->cancelled) {
+        return 0;
+    }
+
+    const size_t reservedBytes = pdfProcessor->estimatePageMemory(*task.job->handle, task.pageIndex);
+
+    long long start = nowNs();
+    pageBudget.acquire(reservedBytes);
+    counters[RENDER].blockedNs += nowNs() - start;
+    return reservedBytes;
+}
+
+void IngestionPipeline::renderPage(const PageTask& task, size_t reservedBytes) {
+    PageResult result;
+    result.job = task.job;
+    result.reservedBytes = reservedBytes;
+
+    try {
+        if (task.job->cancelled) {
+            result.page.pageNumber = task.pageIndex + 1;
+            result.page.failed = true;
+        }
+        else {
+            result.page = pdfProcessor->renderPage(*task.job->handle, task.pageIndex);
+        }
+    }
+    catch (const std::exception& e) {
+        std::cerr << "Error rendering page " << (task.pageIndex + 1) << " of "
+            << task.job->docName << ": " << e.what() << std::endl;
+        result.page.pageNumber = task.pageIndex + 1;
+        result.page.failed = true;
+    }
+
+    // Текстовой странице резерв больше не нужен
+    if (!result.page.image) {
+        pageBudget.release(result.reservedBytes);
+        result.reservedBytes = 0;
+    }
+
+    // Сканы уходят на OCR, текстовые страницы - сразу на разбиение
+    bool delivered = result.page.image
+        ? forward(ocrQueue, result, RENDER)
+        : forward(chunkQueue, result, RENDER);
+
+    if (!delivered) {
+        PDFProcessor::releasePage(result.page);
+        pageBudget.release(result.reservedBytes);
+    }
+}
+
+void IngestionPipeline::recognizePage(PageResult& result) {
+    try {
+        if (result.job->cancelled) {
+            PDFProcessor::releasePage(result.page);
+            result.page.failed = true;
+        }
+        else {
+            pdfProcessor->recognizePage(*result.job->handle, result.page);
+        }
+    }
+    catch (const std::exception& e) {
+        result.page.text = "Error: OCR failed: " + std::string(e.what());
+    }
+
+    // Изображение и память движка освобождены
+    pageBudget.release(result.reservedBytes);
+    result.reservedBytes = 0;
+
+    forward(chunkQueue, result, OCR);
+}
+
+void IngestionPipeline::chunkLoop() {
+    PageResult result;
+
+    while (take(chunkQueue, result, CHUNK)) {
+        std::shared_ptr<Job> job = std::move(result.job);
+
+        ChunkBatch batch;
+        batch.job = job;
+
+        {
+            std::lock_guard<std::mutex> lock(job->chunkMtx);
+
+            // Страница пришла раньше предыдущих - ждет своей очереди
+            if (result.page.pageNumber != job->nextPage) {
+                parkPage(*job, std::move(result.page));
+                continue;
+            }
+
+            // Разбиваем все страницы, идущие подряд от последней обработанной
+            const TextChunker& chunker = *job->chunker;
+            PDFProcessor::RenderedPage page = std::move(result.page);
+
+            while (true) {
+                if (page.failed) {
+                    // Страницы отмененной обработки пропускаются молча
+                    if (!job->cancelled) {
+                        std::cerr << "Error: Failed to load page " << page.pageNumber
+                            << " of " << job->docName << std::endl;
+                    }
+                }
+                else {
+                    chunker.appendPage(page.pageNumber, page.text, job->chunkState, batch.chunks);
+                    batch.textSize += page.text.size();
+                }
+
+                auto it = job->readyPages.find(++job->nextPage);
+                if (it == job->readyPages.end()) {
+                    break;
+                }
+
+                page = unparkPage(*job, it->second);
+                job->readyPages.erase(it);
+            }
+
+            if (job->nextPage > job->pageCount) {
+                chunker.flush(job->chunkState, batch.chunks);
+                batch.last = true;
+            }
+
+            if (batch.chunks.empty() && batch.textSize == 0 && !batch.last) {
+                continue;
+            }
+
+            batch.seq = job->nextBatch++;
+        }
+
+        // Все страницы получены: документ записывается в кэш и закрывается
+        if (batch.last && !job->cancelled) {
+            pdfProcessor->closeDocument(*job->handle);
+        }
+
+        forward(indexQueue, batch, CHUNK);
+    }
+}
+
+void IngestionPipeline::parkPage(Job& job, PDFProcessor::RenderedPage&& page) {
+    int pageNumber = page.pageNumber;
+    WaitingPage waiting;
+    waiting.page = std::move(page);
+
+    size_t textSize = waiting.page.text.size();
+    if (textBudget.getLimit() == 0 || textBudget.tryAcquire(textSize)) {
+        waiting.reservedBytes = textBudget.getLimit() > 0 ? textSize : 0;
+    }
+    else {
+        if (!job.spill) {
+            job.spill = std::make_unique<SpillFile>(config.spillDirectory);
+        }
+
+        // При ошибке записи текст остается в памяти: потерять страницу хуже, чем превысить бюджет
+        if (job.spill->write(waiting.page.text, waiting.segment)) {
+            waiting.spilled = true;
+            spilledBytes += textSize;
+            std::string().swap(waiting.page.text);
+        }
+    }
+
+    job.readyPages.emplace(pageNumber, std::move(waiting));
+}
+
+PDFProcessor::RenderedPage IngestionPipeline::unparkPage(Job& job, WaitingPage& waiting) {
+    if (waiting.spilled) {
+        if (!job.spill->read(waiting.segment, waiting.page.text)) {
+            waiting.page.failed = true;
+        }
+    }
+    else {
+        textBudget.release(waiting.reservedBytes);
+    }
+
+    return std::move(waiting.page);
+}
+
+void IngestionPipeline::indexLoop() {
+    ChunkBatch batch;
+
+    while (take(indexQueue, batch, INDEX)) {
+        std::shared_ptr<Job> job = std::move(batch.job);
+        std::lock_guard<std::mutex> lock(job->indexMtx);
+
+        int seq = batch.seq;
+        job->readyBatches.emplace(seq, std::move(batch));
+
+        // Пачки разных потоков разбиения применяются в порядке страниц
+        auto it = job->readyBatches.find(job->nextIndexBatch);
+        while (it != job->readyBatches.end()) {
+            ChunkBatch& ready = it->second;
+            bool last = ready.last;
+
+            if (!ready.chunks.empty() || ready.textSize > 0) {
+                bool hasChunks = !ready.chunks.empty();
+                job->characters += ready.textSize;
+
+                bool indexed = updateIfOwner(job, [&]() {
+                    contextManager->appendChunks(job->docName, ready.chunks, ready.textSize);
+                });
+
+                if (indexed && hasChunks && job->firstPageMs < 0) {
+                    job->firstPageMs = (nowNs() - job->submittedNs) / 1000000;
+                }
+            }
+
+            job->readyBatches.erase(it);
+            it = job->readyBatches.find(++job->nextIndexBatch);
+
+            if (last) {
+                if (job->cancelled) {
+                    finishJob(job, false, "cancelled");
+                }
+                else {
+                    bool success = job->characters > 0;
+                    finishJob(job, success, success ? "" : "no text found");
+                }
+            }
+        }
+    }
+}
+
+void IngestionPipeline::finishJob(const std::shared_ptr<Job>& job, bool success, const std::string& error) {
+    {
+        // Отмененная обработка документ не трогает: его уже удалили или обрабатывает новая версия
+        std::lock_guard<std::mutex> lock(ownersMtx);
+
+        auto it = owners.find(job->docName);
+        if (it != owners.end() && it->second == job) {
+            if (success) {
+                contextManager->finishDocument(job->docName);
+            }
+            else {
+                contextManager->removeDocument(job->docName);
+            }
+            owners.erase(it);
+        }
+        else {
+            success = false;
+        }
+    }
+
+    IngestionResult result;
+    result.path = job->path;
+    result.docName = job->docName;
+    result.ocrProfile = job->ocrProfile;
+    result.success = success;
+    result.cancelled = job->cancelled;
+    result.error = error;
+    result.pageCount = job->pageCount;
+    result.characters = job->characters;
+    result.fromCache = job->fromCache;
+    result.fromIndex = job->fromIndex;
+    result.totalMs = (nowNs() - job->submittedNs) / 1000000;
+    result.firstPageMs = job->firstPageMs >= 0 ? job->firstPageMs : result.totalMs;
+
+    job->handle.reset();
+    job->spill.reset();
+
+    documentBudget.release(job->reservedDocumentBytes);
+    job->reservedDocumentBytes = 0;
+
+    DoneCallback callback;
+    {
+        std::lock_guard<std::mutex> lock(jobsMtx);
+        callback = doneCallback;
+    }
+
+    if (callback) {
+        callback(result);
+    }
+
+    std::lock_guard<std::mutex> lock(jobsMtx);
+    activeJobs.erase(job);
+    idleCv.notify_all();
+}
+
+std::vector<StageStats> IngestionPipeline::getStats() const {
+    const size_t queueDepths[STAGE_COUNT] = {
+        loadQueue.size(), renderQueue.size(), ocrQueue.size(), chunkQueue.size(), indexQueue.size()
+    };
+    const size_t queueCapacities[STAGE_COUNT] = {
+        loadQueue.capacity(), renderQueue.capacity(), ocrQueue.capacity(), chunkQueue.capacity(), indexQueue.capacity()
+    };
+
+    double elapsedNs = static_cast<double>(std::max(1LL, nowNs() - statsStartNs.load()));
+
+    std::vector<StageStats> stats;
+    for (int stage = 0; stage < STAGE_COUNT; ++stage) {
+        const StageCounters& c = counters[stage];
+        double total = elapsedNs * c.threads;
+
+        StageStats s;
+        s.name = c.name;
+        s.threads = c.threads;
+        s.items = c.items;
+        s.starvedPercent = std::clamp(100.0 * c.starvedNs / total, 0.0, 100.0);
+        s.blockedPercent = std::clamp(100.0 * c.blockedNs / total, 0.0, 100.0 - s.starvedPercent);
+        // Поток этапа либо ждет очередь, либо работает
+        s.busyPercent = 100.0 - s.starvedPercent - s.blockedPercent;
+        s.queueDepth = queueDepths[stage];
+        s.queueCapacity = queueCapacities[stage];
+        stats.push_back(s);
+    }
+
+    return stats;
+}
+
+void IngestionPipeline::resetStats() {
+    for (auto& c : counters) {
+        c.items = 0;
+        c.starvedNs = 0;
+        c.blockedNs = 0;
+    }
+    statsStartNs = nowNs();
+}
+
+MemoryStats IngestionPipeline::getMemoryStats() const {
+    MemoryStats stats;
+    stats.limit = config.memoryBudget;
+    stats.documentPeak = documentBudget.getPeak();
+    stats.pagePeak = pageBudget.getPeak();
+    stats.textPeak = textBudget.getPeak();
+    stats.spilledBytes = spilledBytes;
+    return stats;
+}
+
+std::string IngestionPipeline::formatStats() const {
+    std::vector<StageStats> stats = getStats();
+
+    std::stringstream ss;
+    ss << std::fixed << std::setprecision(1);
+    ss << "Stage    Threads   Items    Busy%  Starved%  Blocked%   Queue\n";
+
+    const StageStats* bottleneck = nullptr;
+    for (const auto& s : stats) {
+        ss << std::left << std::setw(9) << s.name << std::right
+            << std::setw(7) << s.threads
+            << std::setw(8) << s.items
+            << std::setw(9) << s.busyPercent
+            << std::setw(10) << s.starvedPercent
+            << std::setw(10) << s.blockedPercent
+            << std::setw(5) << s.queueDepth << "/" << s.queueCapacity << "\n";
+
+        if (!bottleneck || s.busyPercent > bottleneck->busyPercent) {
+            bottleneck = &s;
+        }
+    }
+
+    // Самый загруженный этап ограничивает пропускную способность всего конвейера
+    if (bottleneck && bottleneck->items > 0) {
+        ss << "Bottleneck: " << bottleneck->name << " (" << bottleneck->busyPercent << "% busy)\n";
+    }
+
+    if (config.memoryBudget > 0) {
+        MemoryStats memory = getMemoryStats();
+        const double mb = 1024.0 * 1024.0;
+
+        ss << "Memory budget: " << (memory.limit / mb) << " MB, peak: pages " << (memory.pagePeak / mb)
+            << " MB, documents " << (memory.documentPeak / mb) << " MB, waiting text "
+            << (memory.textPeak / mb) << " MB, spilled to disk " << (memory.spilledBytes / mb) << " MB\n";
+    }
+
+    return ss.str();
+}
+
+void IngestionPipeline::stop() {
+    if (stopping.exchange(true)) {
+        return;
+    }
+
+    // Потоки, ждущие бюджет памяти, тоже должны проснуться
+    documentBudget.cancel();
+    pageBudget.cancel();
+    textBudget.cancel();
+
+    loadQueue.close();
+    renderQueue.close();
+    ocrQueue.close();
+    chunkQueue.close();
+    indexQueue.close();
+
+    for (auto& worker : workers) {
+        if (worker.joinable()) {
+            worker.join();
+        }
+    }
+    workers.clear();
+
+    // Изображения, не дошедшие до OCR
+    for (auto& result : ocrQueue.drain()) {
+        PDFProcessor::releasePage(result.page);
+    }
+    loadQueue.drain();
+    renderQueue.drain();
+    chunkQueue.drain();
+    indexQueue.drain();
+
+    // Недоиндексированные документы не должны оставаться в контексте
+    std::set<std::shared_ptr<Job>> unfinished;
+    {
+        std::lock_guard<std::mutex> lock(jobsMtx);
+        unfinished.swap(activeJobs);
+    }
+
+    std::lock_guard<std::mutex> lock(ownersMtx);
+    owners.clear();
+
+    for (const auto& job : unfinished) {
+        contextManager->removeDocument(job->docName);
+        job->handle.reset();
+        job->readyBatches.clear();
+    }
+
+    idleCv.notify_all();
+}
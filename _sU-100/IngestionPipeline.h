@@ -0,0 +1,242 @@
+﻿// IngestionPipeline.h
+#pragma once
+
+#include <string>
+#include <vector>
+#include <set>
+#include <map>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <atomic>
+
+#include "BoundedQueue.h"
+#include "MemoryBudget.h"
+#include "PDFProcessor.h"
+
+class ContextManager;
+class ThreadPool;
+
+// Параметры конвейера загрузки
+struct IngestionConfig {
+    // Потоков на этап (0 для OCR - по числу ядер)
+    size_t loadThreads = 2;
+    size_t renderThreads = 2;
+    size_t ocrThreads = 0;
+    size_t chunkThreads = 2;
+    size_t indexThreads = 1;
+
+    // Общий пул потоков (nullptr - свои потоки всех этапов). Рендеринг и OCR страниц выполняются
+    // в нем фоновыми задачами, поэтому запросы пользователя получают потоки пула раньше загрузки;
+    // потоки этих этапов тогда только раздают страницы, не больше renderThreads и ocrThreads сразу
+    std::shared_ptr<ThreadPool> workers;
+
+    // Емкость очередей между этапами
+    size_t documentQueueCapacity = 16;   // файлы, ожидающие загрузки
+    size_t pageQueueCapacity = 64;       // страницы, ожидающие рендеринга, и готовый текст страниц
+    size_t imageQueueCapacity = 8;       // изображения для OCR (~25 МБ каждое при 300 DPI)
+    size_t batchQueueCapacity = 64;      // пачки чанков для индексации
+
+    // Бюджет памяти на загрузку в байтах (0 - без ограничения). Делится между PDF в памяти
+    // (записи архивов), страницами в рендеринге и OCR (учитываются по байтам, а не штукам)
+    // и текстом страниц, ожидающих предыдущих; сверх бюджета текст вытесняется во временный файл.
+    // Включает экономный режим PDFProcessor. Сам индекс в бюджет не входит
+    size_t memoryBudget = 0;
+
+    // Каталог временных файлов вытесненного текста (пустая строка - системный временный каталог)
+    std::string spillDirectory;
+};
+
+// Загрузка каждого этапа
+struct StageStats {
+    std::string name;
+    size_t threads;
+    size_t items;            // обработано элементов
+    double busyPercent;      // работа
+    double starvedPercent;   // ожидание входной очереди (этап простаивает)
+    double blockedPercent;   // ожидание места в выходной очереди (тормозит следующий этап)
+    size_t queueDepth;       // текущая длина входной очереди
+    size_t queueCapacity;
+};
+
+// Использование бюджета памяти
+struct MemoryStats {
+    size_t limit;            // 0 - без ограничения
+    size_t documentPeak;     // PDF в памяти
+    size_t pagePeak;         // страницы в рендеринге и OCR
+    size_t textPeak;         // текст, ожидающий предыдущих страниц
+    uint64_t spilledBytes;   // текст, вытесненный во временные файлы
+};
+
+// Итог обработки одного файла
+struct IngestionResult {
+    std::string path;
+    std::string docName;
+    std::string ocrProfile;
+    bool success = false;
+    bool cancelled = false;       // файл удален или заменен более новой версией
+    std::string error;
+    int pageCount = 0;
+    size_t characters = 0;
+    bool fromCache = false;
+    bool fromIndex = false;       // файл не изменился с прошлой индексации, документ взят из постоянного индекса
+    long long firstPageMs = -1;   // от постановки в очередь до первой доступной для поиска страницы
+    long long totalMs = 0;        // от постановки в очередь до завершения индексации
+};
+
+// Конвейер загрузки документов: загрузка -> рендеринг -> OCR -> разбиение на чанки -> индексация.
+// Этапы связаны очередями ограниченной емкости и работают одновременно, а единица работы
+// рендеринга и OCR - страница, поэтому страницы большого PDF разбираются всеми потоками
+// этапа вперемешку со страницами других файлов
+class IngestionPipeline {
+public:
+    using DoneCallback = std::function<void(const IngestionResult& result)>;
+
+    IngestionPipeline(std::shared_ptr<PDFProcessor> pdfProcessor,
+        std::shared_ptr<ContextManager> contextManager,
+        const IngestionConfig& config = IngestionConfig());
+    ~IngestionPipeline();
+
+    IngestionPipeline(const IngestionPipeline&) = delete;
+    IngestionPipeline& operator=(const IngestionPipeline&) = delete;
+
+    // Обработчик завершения файла (вызывается из потоков конвейера)
+    void setDoneCallback(DoneCallback callback);
+
+    // Постановка файла в очередь (блокируется, если очередь загрузки заполнена).
+    // Незавершенная обработка прежней версии того же документа отменяется
+    bool submit(const std::string& pdfPath, const std::string& docName);
+
+    // Постановка в очередь PDF, уже находящегося в памяти (запись архива, поток)
+    bool submit(std::shared_ptr<MemoryBuffer> data, const std::string& docName);
+
+    // Отмена обработки и удаление документа из контекста (файл удален)
+    void cancel(const std::string& docName);
+
+    // Ожидание обработки всех поставленных файлов
+    void waitIdle();
+
+    // Количество файлов в обработке (включая ожидающие загрузки)
+    size_t getPendingCount() const;
+
+    // Загрузка этапов с момента запуска или последнего сброса
+    std::vector<StageStats> getStats() const;
+    void resetStats();
+
+    // Пиковое использование бюджета памяти
+    MemoryStats getMemoryStats() const;
+
+    // Текстовый отчет о загрузке этапов
+    std::string formatStats() const;
+
+    // Остановка конвейера: незавершенные документы удаляются из контекста
+    void stop();
+
+private:
+    struct Job;
+    struct PageTask;
+    struct PageResult;
+    struct ChunkBatch;
+    struct WaitingPage;
+
+    // Счетчики этапа (наносекунды); остальное время потоков этапа - работа
+    struct StageCounters {
+        std::string name;
+        size_t threads = 0;
+        std::atomic<size_t> items{ 0 };
+        std::atomic<long long> starvedNs{ 0 };
+        std::atomic<long long> blockedNs{ 0 };
+    };
+
+    enum Stage { LOAD, RENDER, OCR, CHUNK, INDEX, STAGE_COUNT };
+
+    // Страницы этапа, выполняемые задачами общего пула
+    struct PoolSlots {
+        size_t limit = 0;      // 0 - этап работает в своих потоках
+        size_t running = 0;    // поставлены в пул и не завершены
+        std::mutex mtx;
+        std::condition_variable cv;
+    };
+
+    std::shared_ptr<PDFProcessor> pdfProcessor;
+    std::shared_ptr<ContextManager> contextManager;
+    IngestionConfig config;
+
+    // Очереди между этапами
+    BoundedQueue<std::shared_ptr<Job>> loadQueue;
+    BoundedQueue<PageTask> renderQueue;
+    BoundedQueue<PageResult> ocrQueue;
+    BoundedQueue<PageResult> chunkQueue;
+    BoundedQueue<ChunkBatch> indexQueue;
+
+    // Части бюджета памяти: раздельные, чтобы ожидание одной не блокировало освобождение другой
+    MemoryBudget documentBudget;
+    MemoryBudget pageBudget;
+    MemoryBudget textBudget;
+    std::atomic<uint64_t> spilledBytes;
+
+    std::vector<std::thread> workers;
+    StageCounters counters[STAGE_COUNT];
+    PoolSlots slots[STAGE_COUNT];
+    std::atomic<long long> statsStartNs;
+
+    // Файлы в обработке
+    std::set<std::shared_ptr<Job>> activeJobs;
+    mutable std::mutex jobsMtx;
+    std::condition_variable idleCv;
+
+    // Актуальная обработка каждого документа: только она изменяет документ в контексте
+    std::map<std::string, std::shared_ptr<Job>> owners;
+    std::mutex ownersMtx;
+
+    DoneCallback doneCallback;
+    std::atomic<bool> stopping;
+
+    // Циклы этапов
+    void loadLoop();
+    void renderLoop();
+    void ocrLoop();
+    void chunkLoop();
+    void indexLoop();
+
+    // Раздача страниц этапа задачам общего пула
+    void renderDispatchLoop();
+    void ocrDispatchLoop();
+    template <typename T, typename F>
+    void dispatchLoop(BoundedQueue<T>& queue, Stage stage, F prepare);
+
+    // Резерв бюджета памяти под страницу перед рендерингом
+    size_t reservePage(const PageTask& task);
+
+    // Рендеринг одной страницы и передача на OCR или разбиение
+    void renderPage(const PageTask& task, size_t reservedBytes);
+
+    // Распознавание одной страницы и передача на разбиение
+    void recognizePage(PageResult& result);
+
+    // Извлечение из очереди и передача дальше с учетом времени ожидания
+    // (idleThreads - сколько потоков или мест в пуле этапа простаивает, пока очередь пуста)
+    template <typename T>
+    bool take(BoundedQueue<T>& queue, T& item, Stage stage, size_t idleThreads = 1);
+    template <typename T>
+    bool forward(BoundedQueue<T>& queue, T& item, Stage stage);
+
+    // Страница, пришедшая раньше предыдущих: текст остается в памяти, пока позволяет бюджет,
+    // иначе вытесняется во временный файл документа
+    void parkPage(Job& job, PDFProcessor::RenderedPage&& page);
+
+    // Возврат отложенной страницы для разбиения
+    PDFProcessor::RenderedPage unparkPage(Job& job, WaitingPage& waiting);
+
+    // Регистрация файла и постановка в очередь загрузки
+    bool enqueue(std::shared_ptr<Job> job);
+
+    // Изменение документа в контексте, если обработка не отменена и не заменена более новой
+    template <typename F>
+    bool updateIfOwner(const std::shared_ptr<Job>& job, F update);
+
+    // Завершение файла: итог, уведомление, снятие с учета
+    void finishJob(const std::shared_ptr<Job>& job, bool success, const std::string& error);
+};
@@ -0,0 +1,155 @@
+﻿// InvertedIndex.cpp
+#include "InvertedIndex.h"
+#include <algorithm>
+#include <queue>
+#include <cmath>
+
+float InvertedIndex::termScore(float idf, uint32_t termFrequency, uint32_t chunkLength, float averageLength) {
+    const float tf = static_cast<float>(termFrequency);
+    const float lengthNorm = 1.0f - B + B * chunkLength / averageLength;
+    return idf * tf * (K1 + 1.0f) / (tf + K1 * lengthNorm);
+}
+
+std::vector<InvertedIndex::Hit> InvertedIndex::searchLists(const std::vector<PostingList>& lists,
+    const uint32_t* chunkLengths, const std::vector<bool>& removed, float averageLength, size_t topK,
+    SearchStats* stats) {
+    std::vector<Hit> hits;
+    if (topK == 0) {
+        return hits;
+    }
+
+    // Позиция в списке термина запроса
+    struct Cursor {
+        const Posting* position;
+        const Posting* end;
+        float idf;                  // умножен на вес термина в запросе
+        float upperBound;
+    };
+
+    std::vector<Cursor> cursors;
+    SearchStats localStats;
+
+    for (const PostingList& list : lists) {
+        if (list.begin == list.end) {
+            continue;
+        }
+
+        cursors.push_back({ list.begin, list.end, list.weight,
+            termScore(list.weight, list.maxTermFrequency, list.minChunkLength, averageLength) });
+        localStats.postingsTotal += list.end - list.begin;
+    }
+
+    // Термины по возрастанию верхней оценки; boundSums[i] - сумма оценок терминов 0..i
+    std::sort(cursors.begin(), cursors.end(),
+        [](const Cursor& a, const Cursor& b) { return a.upperBound < b.upperBound; });
+
+    std::vector<float> boundSums(cursors.size());
+    float boundSum = 0.0f;
+    for (size_t i = 0; i < cursors.size(); ++i) {
+        boundSum += cursors[i].upperBound;
+        boundSums[i] = boundSum;
+    }
+
+    // Мин-куча лучших k чанков: в вершине - порог входа в результат
+    auto worse = [](const Hit& a, const Hit& b) {
+        return a.score != b.score ? a.score > b.score : a.chunkId < b.chunkId;
+    };
+    std::priority_queue<Hit, std::vector<Hit>, decltype(worse)> heap(worse);
+
+    float threshold = 0.0f;
+
+    // Термины до firstEssential вместе не дотягивают до порога: чанк, содержащий только их,
+    // в результат не попадет, поэтому кандидаты берутся лишь из списков остальных терминов
+    size_t firstEssential = 0;
+
+    while (firstEssential < cursors.size()) {
+        ChunkId candidate = UINT32_MAX;
+        for (size_t i = firstEssential; i < cursors.size(); ++i) {
+            const Cursor& cursor = cursors[i];
+            if (cursor.position != cursor.end) {
+                candidate = std::min(candidate, cursor.position->chunkId);
+            }
+        }
+
+        if (candidate == UINT32_MAX) {
+            break;
+        }
+
+        // Существенные списки, стоящие на кандидате, оцениваются и сдвигаются;
+        // номер вне диапазона (поврежденный сегмент на диске) пропускается как удаленный
+        bool live = candidate < removed.size() && !removed[candidate];
+        float score = 0.0f;
+
+        for (size_t i = firstEssential; i < cursors.size(); ++i) {
+            Cursor& cursor = cursors[i];
+            if (cursor.position != cursor.end && cursor.position->chunkId == candidate) {
+                if (live) {
+                    score += termScore(cursor.idf, cursor.position->termFrequency, chunkLengths[candidate],
+                        averageLength);
+                    localStats.postingsScored++;
+                }
+                cursor.position++;
+            }
+        }
+
+        if (!live) {
+            continue;
+        }
+        localStats.candidates++;
+
+        // Несущественные списки - от самого весомого, пока чанк еще может пройти порог
+        for (size_t i = firstEssential; i-- > 0;) {
+            if (score + boundSums[i] <= threshold) {
+                break;
+            }
+
+            Cursor& cursor = cursors[i];
+            cursor.position = std::lower_bound(cursor.position, cursor.end, candidate,
+                [](const Posting& posting, ChunkId chunkId) { return posting.chunkId < chunkId; });
+
+            if (cursor.position != cursor.end && cursor.position->chunkId == candidate) {
+                score += termScore(cursor.idf, cursor.position->termFrequency, chunkLengths[candidate],
+                    averageLength);
+                localStats.postingsScored++;
+                cursor.position++;
+            }
+        }
+
+        if (heap.size() < topK) {
+            heap.push({ candidate, score });
+        }
+        else if (score > heap.top().score) {
+            heap.pop();
+            heap.push({ candidate, score });
+        }
+        else {
+            continue;
+        }
+
+        // Порог вырос: термины, не способные вместе его превысить, становятся несущественными
+        if (heap.size() == topK) {
+            threshold = heap.top().score;
+            while (firstEssential < cursors.size() && boundSums[firstEssential] <= threshold) {
+                firstEssential++;
+            }
+        }
+    }
+
+    hits.resize(heap.size());
+    for (size_t i = hits.size(); i-- > 0;) {
+        hits[i] = heap.top();
+        heap.pop();
+    }
+
+    if (stats) {
+        *stats = localStats;
+    }
+
+    return hits;
+}
+
+float InvertedIndex::idf(const CollectionStats& collection, uint64_t documentFrequency) {
+    const float chunkCount = static_cast<float>(collection.chunkCount);
+    const float df = static_cast<float>(documentFrequency);
+    return std::log(1.0f + (chunkCount - df + 0.5f) / (df + 0.5f));
+}
@@ -0,0 +1,83 @@
+﻿// InvertedIndex.h
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <cstdint>
+#include "TermDictionary.h"
+
+// Ранжирование BM25 по инвертированному индексу чанков: типы и общий поиск для сегментов.
+// Для каждого термина хранится список чанков с частотой термина в чанке,
+// поэтому запрос обходит только списки своих терминов, а не весь корпус.
+// Лучшие k чанков отбираются алгоритмом MaxScore: по верхним оценкам терминов
+// пропускаются чанки, которые заведомо не попадут в результат.
+// Термины хранятся как 32-битные идентификаторы словаря, запрос - разреженный вектор
+// (идентификатор, вес), отсортированный по идентификатору.
+// Сами списки лежат в неизменяемых сегментах (IndexSegment) - частях коллекции: idf и средняя
+// длина чанка считаются по всей коллекции, а лучшие чанки частей объединяются
+class InvertedIndex {
+public:
+    using ChunkId = uint32_t;
+    using TermId = TermDictionary::TermId;
+
+    // Элемент разреженного вектора: термин и вес
+    struct TermWeight {
+        TermId termId;
+        float weight;
+    };
+
+    // Разреженный вектор по возрастанию идентификатора термина
+    using SparseVector = std::vector<TermWeight>;
+
+    // Вхождение термина в чанк
+    struct Posting {
+        ChunkId chunkId;
+        uint32_t termFrequency;
+    };
+
+    // Статистика коллекции для BM25 (суммируется по частям коллекции)
+    struct CollectionStats {
+        uint64_t chunkCount = 0;
+        uint64_t totalLength = 0;   // сумма длин чанков в терминах
+    };
+
+    // Список вхождений термина запроса по возрастанию идентификатора чанка
+    struct PostingList {
+        const Posting* begin;
+        const Posting* end;
+        float weight;                  // idf, умноженный на вес термина в запросе
+        uint32_t maxTermFrequency;     // для верхней оценки вклада термина
+        uint32_t minChunkLength;
+    };
+
+    // Найденный чанк
+    struct Hit {
+        ChunkId chunkId;
+        float score;
+    };
+
+    // Статистика одного поиска
+    struct SearchStats {
+        size_t postingsTotal = 0;    // вхождений в списках терминов запроса
+        size_t postingsScored = 0;   // из них прочитано и оценено, остальные пропущены
+        size_t candidates = 0;       // рассмотрено чанков
+        size_t threads = 0;          // потоков, ранжировавших части коллекции
+    };
+
+    // Параметры BM25: насыщение частоты термина и нормализация по длине чанка
+    static constexpr float K1 = 1.2f;
+    static constexpr float B = 0.75f;
+
+    // idf термина, встречающегося в documentFrequency чанках коллекции
+    static float idf(const CollectionStats& collection, uint64_t documentFrequency);
+
+    // Лучшие topK чанков по спискам терминов (MaxScore). chunkLengths и removed - по идентификатору
+    // чанка в списках; удаленные чанки пропускаются
+    static std::vector<Hit> searchLists(const std::vector<PostingList>& lists, const uint32_t* chunkLengths,
+        const std::vector<bool>& removed, float averageLength, size_t topK, SearchStats* stats);
+
+private:
+    // Вклад термина в оценку чанка
+    static float termScore(float idf, uint32_t termFrequency, uint32_t chunkLength, float averageLength);
+};
@@ -5,9 +5,10 @@
 #include <iomanip>
 #include <algorithm>
 #include <random>
+#include <chrono>
 
 LLMInterface::LLMInterface(const std::string& modelPath)
-    : model(nullptr), ctx(nullptr), sampler(nullptr), stopRequested(false), loaded(false) {
+    : model(nullptr), ctx(nullptr), sampler(nullptr), stopRequested(false), loaded(false), prefillRate(0.0) {
     try {
         initializeModel(modelPath);
         initializeSampler();
@@ -146,6 +147,7 @@ std::string LLMInterface::generateResponse(
 
         // Очищаем контекст
         llama_kv_cache_clear(ctx);
+        auto prefillStart = std::chrono::steady_clock::now();
 
         // УПРОЩЕННАЯ обработка промпта - по одному токену
         for (size_t i = 0; i < tokens.size(); ++i) {
@@ -177,6 +179,14 @@ std::string LLMInterface::generateResponse(
             }
         }
 
+        // Скорость prefill: по ней оценивается, сколько времени экономит более короткий контекст
+        double prefillSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - prefillStart).count();
+        if (prefillSeconds > 0.0) {
+            double rate = tokens.size() / prefillSeconds;
+            double previous = prefillRate;
+            prefillRate = previous > 0.0 ? 0.7 * previous + 0.3 * rate : rate;
+        }
+
         std::cout << "Prompt processed, generating response..." << std::endl;
 
         // Генерация ответа
@@ -410,6 +420,28 @@ bool LLMInterface::isLoaded() const {
     return loaded && model && ctx;
 }
 
+double LLMInterface::getPrefillRate() const {
+    return prefillRate;
+}
+
+size_t LLMInterface::countTokens(std::string_view text) const {
+    if (!loaded || !model || text.empty()) {
+        return 0;
+    }
+
+    // Без буфера llama_tokenize возвращает число токенов со знаком минус
+    int n = llama_tokenize(
+        llama_model_get_vocab(model),
+        text.data(),
+        static_cast<int32_t>(text.length()),
+        nullptr,
+        0,
+        false,
+        false
+    );
+    return static_cast<size_t>(n < 0 ? -static_cast<int64_t>(n) : n);
+}
+
 std::vector<llama_token> LLMInterface::tokenize(const std::string& text, bool addBos) {
     if (!model) {
         return {};
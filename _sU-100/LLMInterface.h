@@ -1,79 +1,90 @@
-// LLMInterface.h
+﻿// LLMInterface.h
 #pragma once
 
 #include <string>
+#include <string_view>
 #include <vector>
 #include <functional>
 #include <mutex>
 #include <atomic>
 
-//  API llama.cpp
+// Включаем API llama.cpp
 #include <llama.h>
 
 class LLMInterface {
 public:
-    //     
+    // Конструктор принимает путь к модели
     LLMInterface(const std::string& modelPath);
     ~LLMInterface();
 
-    //    
+    // Установка контекста для запросов
     void setContext(const std::string& context);
 
-    //    
+    // Генерация ответа на запрос
     std::string generateResponse(
         const std::string& prompt,
         bool streamOutput = false,
         std::function<void(const std::string&)> streamCallback = nullptr
     );
 
-    //  
+    // Остановка генерации
     void stopGeneration();
 
-    //  
+    // Сброс контекста
     void resetContext();
 
-    //   
+    // Информация о модели
     std::string getModelInfo() const;
 
-    // ,   
+    // Проверка, загружена ли модель
     bool isLoaded() const;
 
+    // Число токенов текста по словарю модели (без BOS); 0 - модель не загружена.
+    // Словарь не меняется после загрузки, поэтому вызывается из любых потоков без блокировки
+    size_t countTokens(std::string_view text) const;
+
+    // Скорость обработки промпта (prefill), токенов в секунду по последним ответам; 0 - еще не измерялась
+    double getPrefillRate() const;
+
 private:
-    //  llama.cpp
+    // Компоненты llama.cpp
     llama_model* model;
     llama_context* ctx;
     llama_sampler* sampler;
 
-    //   (  API)
+    // Параметры контекста (для старого API)
     llama_context_params ctxParams;
 
-    //  
+    // Контекстные данные
     std::string contextData;
 
-    //    
+    // Мьютекс для синхронизации доступа
     mutable std::mutex mtx;
 
-    //    
+    // Флаг для остановки генерации
     std::atomic<bool> stopRequested;
 
-    //   
+    // Флаг успешной загрузки
     std::atomic<bool> loaded;
 
-    //  
+    // Скорость prefill (скользящее среднее)
+    std::atomic<double> prefillRate;
+
+    // Инициализация модели
     void initializeModel(const std::string& modelPath);
 
-    //  
+    // Инициализация самплера
     void initializeSampler();
 
-    //  
+    // Токенизация текста
     std::vector<llama_token> tokenize(const std::string& text, bool addBos = false);
 
-    //  
+    // Детокенизация токенов
     std::string detokenize(const std::vector<llama_token>& tokens);
 
-    //   
+    // Простое семплирование токенов
     llama_token sampleToken(const float* logits, int n_vocab);
 
-    //  
+    // Очистка ресурсов
     void cleanup();
 };
\ No newline at end of file
@@ -0,0 +1,60 @@
+﻿// MemoryBudget.cpp
+#include "MemoryBudget.h"
+#include <algorithm>
+
+MemoryBudget::MemoryBudget(size_t limitBytes)
+    : limit(limitBytes), used(0), peak(0), cancelled(false) {
+}
+
+bool MemoryBudget::fits(size_t bytes) const {
+    return limit == 0 || used == 0 || used + bytes <= limit;
+}
+
+void MemoryBudget::acquire(size_t bytes) {
+    std::unique_lock<std::mutex> lock(mtx);
+    cv.wait(lock, [this, bytes]() { return cancelled || fits(bytes); });
+
+    used += bytes;
+    peak = std::max(peak, used);
+}
+
+bool MemoryBudget::tryAcquire(size_t bytes) {
+    std::lock_guard<std::mutex> lock(mtx);
+    if (!fits(bytes)) {
+        return false;
+    }
+
+    used += bytes;
+    peak = std::max(peak, used);
+    return true;
+}
+
+void MemoryBudget::release(size_t bytes) {
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        used -= std::min(bytes, used);
+    }
+    cv.notify_all();
+}
+
+void MemoryBudget::cancel() {
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        cancelled = true;
+    }
+    cv.notify_all();
+}
+
+size_t MemoryBudget::getLimit() const {
+    return limit;
+}
+
+size_t MemoryBudget::getUsed() const {
+    std::lock_guard<std::mutex> lock(mtx);
+    return used;
+}
+
+size_t MemoryBudget::getPeak() const {
+    std::lock_guard<std::mutex> lock(mtx);
+    return peak;
+}
@@ -0,0 +1,43 @@
+﻿// MemoryBudget.h
+#pragma once
+
+#include <mutex>
+#include <condition_variable>
+
+// Ограничение памяти в байтах: потоки резервируют объем перед выделением
+// и ждут, пока другие не освободят свою часть
+class MemoryBudget {
+public:
+    // 0 - без ограничения
+    explicit MemoryBudget(size_t limitBytes = 0);
+
+    MemoryBudget(const MemoryBudget&) = delete;
+    MemoryBudget& operator=(const MemoryBudget&) = delete;
+
+    // Резервирование (блокируется при нехватке). Запрос больше всего бюджета
+    // выполняется, когда зарезервированного не осталось, чтобы не зависнуть навсегда
+    void acquire(size_t bytes);
+
+    // Резервирование без ожидания
+    bool tryAcquire(size_t bytes);
+
+    void release(size_t bytes);
+
+    // Прерывание ожидания (при остановке): acquire сразу возвращает управление
+    void cancel();
+
+    size_t getLimit() const;
+    size_t getUsed() const;
+    size_t getPeak() const;
+
+private:
+    size_t limit;
+    size_t used;
+    size_t peak;
+    bool cancelled;
+
+    mutable std::mutex mtx;
+    std::condition_variable cv;
+
+    bool fits(size_t bytes) const;
+};
@@ -0,0 +1,148 @@
+﻿// MemoryBuffer.cpp
+#include "MemoryBuffer.h"
+#include <algorithm>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+MemoryBuffer::MemoryBuffer()
+    : mapped(nullptr),
+    mappedSize(0)
+#ifdef _WIN32
+    , fileHandle(nullptr),
+    mappingHandle(nullptr)
+#endif
+{
+}
+
+MemoryBuffer::~MemoryBuffer() {
+#ifdef _WIN32
+    if (mapped) {
+        UnmapViewOfFile(mapped);
+    }
+    if (mappingHandle) {
+        CloseHandle(mappingHandle);
+    }
+    if (fileHandle) {
+        CloseHandle(fileHandle);
+    }
+#else
+    if (mapped) {
+        munmap(const_cast<char*>(mapped), mappedSize);
+    }
+#endif
+}
+
+std::shared_ptr<MemoryBuffer> MemoryBuffer::fromVector(std::vector<char>&& data) {
+    std::shared_ptr<MemoryBuffer> buffer(new MemoryBuffer());
+    buffer->owned = std::move(data);
+    return buffer;
+}
+
+std::shared_ptr<MemoryBuffer> MemoryBuffer::mapFile(const std::string& path, std::string& error) {
+    std::shared_ptr<MemoryBuffer> buffer(new MemoryBuffer());
+
+#ifdef _WIN32
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, nullptr,
+        OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (file == INVALID_HANDLE_VALUE) {
+        error = "Error: Failed to open file: " + path;
+        return nullptr;
+    }
+    buffer->fileHandle = file;
+
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(file, &fileSize)) {
+        error = "Error: Failed to get file size: " + path;
+        return nullptr;
+    }
+
+    // Отобразить пустой файл нельзя
+    if (fileSize.QuadPart == 0) {
+        return buffer;
+    }
+
+    buffer->mappingHandle = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (!buffer->mappingHandle) {
+        error = "Error: Failed to map file: " + path;
+        return nullptr;
+    }
+
+    buffer->mapped = static_cast<const char*>(MapViewOfFile(buffer->mappingHandle, FILE_MAP_READ, 0, 0, 0));
+    if (!buffer->mapped) {
+        error = "Error: Failed to map file: " + path;
+        return nullptr;
+    }
+    buffer->mappedSize = static_cast<size_t>(fileSize.QuadPart);
+#else
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        error = "Error: Failed to open file: " + path;
+        return nullptr;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        error = "Error: Failed to get file size: " + path;
+        return nullptr;
+    }
+
+    if (st.st_size > 0) {
+        void* address = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+        if (address == MAP_FAILED) {
+            close(fd);
+            error = "Error: Failed to map file: " + path;
+            return nullptr;
+        }
+        buffer->mapped = static_cast<const char*>(address);
+        buffer->mappedSize = static_cast<size_t>(st.st_size);
+    }
+
+    // Отображение остается действительным и после закрытия дескриптора
+    close(fd);
+#endif
+
+    return buffer;
+}
+
+const char* MemoryBuffer::data() const {
+    return mapped ? mapped : owned.data();
+}
+
+size_t MemoryBuffer::size() const {
+    return mapped ? mappedSize : owned.size();
+}
+
+bool MemoryBuffer::isMapped() const {
+    return mapped != nullptr;
+}
+
+void MemoryBuffer::evict(size_t offset, size_t length) const {
+    if (!mapped || offset >= mappedSize) {
+        return;
+    }
+    length = std::min(length, mappedSize - offset);
+
+#ifdef _WIN32
+    // Разблокировка незаблокированных страниц удаляет их из рабочего набора процесса
+    VirtualUnlock(const_cast<char*>(mapped) + offset, length);
+#else
+    // Границы выравниваются по страницам: частичные страницы остаются в памяти
+    size_t pageSize = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    size_t begin = (offset + pageSize - 1) / pageSize * pageSize;
+    size_t end = (offset + length) / pageSize * pageSize;
+    if (offset + length == mappedSize) {
+        end = mappedSize;
+    }
+    if (begin < end) {
+        madvise(const_cast<char*>(mapped) + begin, end - begin, MADV_DONTNEED);
+    }
+#endif
+}
@@ -0,0 +1,46 @@
+﻿// MemoryBuffer.h
+#pragma once
+
+#include <string>
+#include <vector>
+#include <memory>
+
+// Неизменяемый блок данных PDF в памяти: отображенный файл либо собственный буфер.
+// Poppler разбирает документ прямо из этого блока, без копирования
+class MemoryBuffer {
+public:
+    ~MemoryBuffer();
+
+    MemoryBuffer(const MemoryBuffer&) = delete;
+    MemoryBuffer& operator=(const MemoryBuffer&) = delete;
+
+    // Буфер, владеющий переданными данными (без копирования)
+    static std::shared_ptr<MemoryBuffer> fromVector(std::vector<char>&& data);
+
+    // Отображение файла в память (nullptr и текст ошибки при неудаче)
+    static std::shared_ptr<MemoryBuffer> mapFile(const std::string& path, std::string& error);
+
+    const char* data() const;
+    size_t size() const;
+
+    // Отображен ли буфер из файла
+    bool isMapped() const;
+
+    // Выгрузка прочитанных страниц отображения из памяти процесса: данные не теряются,
+    // при следующем обращении система снова прочитает их из файла
+    void evict(size_t offset, size_t length) const;
+
+private:
+    MemoryBuffer();
+
+    // Собственные данные (если буфер не отображен из файла)
+    std::vector<char> owned;
+
+    // Отображение файла
+    const char* mapped;
+    size_t mappedSize;
+#ifdef _WIN32
+    void* fileHandle;
+    void* mappingHandle;
+#endif
+};
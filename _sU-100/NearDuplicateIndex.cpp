@@ -0,0 +1,149 @@
+﻿// NearDuplicateIndex.cpp
+#include "NearDuplicateIndex.h"
+#include "ExtractionCache.h"
+#include <algorithm>
+#include <bitset>
+#include <mutex>
+
+namespace {
+    // Чанк короче MIN_TERMS терминов не сравнивается: у коротких текстов отпечатки случайно близки
+    constexpr size_t MIN_TERMS = 8;
+
+    // Перемешивание бит хеша термина (splitmix64): каждый бит отпечатка зависит от всей строки
+    uint64_t mix(uint64_t value) {
+        value ^= value >> 30;
+        value *= 0xbf58476d1ce4e5b9ull;
+        value ^= value >> 27;
+        value *= 0x94d049bb133111ebull;
+        value ^= value >> 31;
+        return value;
+    }
+}
+
+uint64_t NearDuplicateIndex::fingerprint(const std::vector<std::string_view>& terms) {
+    if (terms.size() < MIN_TERMS) {
+        return NO_FINGERPRINT;
+    }
+
+    // Голос каждого вхождения термина за биты его хеша
+    int64_t votes[64] = {};
+    for (std::string_view term : terms) {
+        uint64_t hash = mix(ExtractionCache::hashBytes(term.data(), term.size()));
+        for (int bit = 0; bit < 64; ++bit) {
+            votes[bit] += (hash >> bit) & 1 ? 1 : -1;
+        }
+    }
+
+    uint64_t result = 0;
+    for (int bit = 0; bit < 64; ++bit) {
+        if (votes[bit] > 0) {
+            result |= uint64_t(1) << bit;
+        }
+    }
+    return result == NO_FINGERPRINT ? 1 : result;
+}
+
+uint16_t NearDuplicateIndex::band(uint64_t fingerprint, int index) {
+    return static_cast<uint16_t>(fingerprint >> (index * BAND_BITS));
+}
+
+bool NearDuplicateIndex::add(ChunkId chunkId, uint64_t fingerprint) {
+    if (fingerprint == NO_FINGERPRINT) {
+        return false;
+    }
+
+    std::unique_lock<std::shared_mutex> lock(mtx);
+    if (chunks.count(chunkId)) {
+        return false;
+    }
+
+    // Группа первого найденного кандидата, отличающегося не больше чем в MAX_DISTANCE битах
+    ChunkId group = chunkId;
+    for (int i = 0; i < BANDS && group == chunkId; ++i) {
+        auto bucket = buckets[i].find(band(fingerprint, i));
+        if (bucket == buckets[i].end()) {
+            continue;
+        }
+
+        for (ChunkId candidate : bucket->second) {
+            const Entry& entry = chunks.at(candidate);
+            if (std::bitset<64>(entry.fingerprint ^ fingerprint).count() <= MAX_DISTANCE) {
+                group = entry.group;
+                break;
+            }
+        }
+    }
+
+    chunks[chunkId] = { fingerprint, group };
+    groups[group].push_back(chunkId);
+    for (int i = 0; i < BANDS; ++i) {
+        buckets[i][band(fingerprint, i)].push_back(chunkId);
+    }
+    return group != chunkId;
+}
+
+void NearDuplicateIndex::remove(ChunkId chunkId) {
+    std::unique_lock<std::shared_mutex> lock(mtx);
+    auto found = chunks.find(chunkId);
+    if (found == chunks.end()) {
+        return;
+    }
+
+    const Entry entry = found->second;
+    chunks.erase(found);
+
+    auto erase = [chunkId](std::vector<ChunkId>& list) {
+        auto position = std::find(list.begin(), list.end(), chunkId);
+        if (position != list.end()) {
+            *position = list.back();
+            list.pop_back();
+        }
+    };
+
+    // Группа остается под прежним идентификатором, пока в ней есть чанки
+    auto group = groups.find(entry.group);
+    if (group != groups.end()) {
+        erase(group->second);
+        if (group->second.empty()) {
+            groups.erase(group);
+        }
+    }
+
+    for (int i = 0; i < BANDS; ++i) {
+        auto bucket = buckets[i].find(band(entry.fingerprint, i));
+        if (bucket != buckets[i].end()) {
+            erase(bucket->second);
+            if (bucket->second.empty()) {
+                buckets[i].erase(bucket);
+            }
+        }
+    }
+}
+
+void NearDuplicateIndex::clear() {
+    std::unique_lock<std::shared_mutex> lock(mtx);
+    chunks.clear();
+    groups.clear();
+    for (auto& bands : buckets) {
+        bands.clear();
+    }
+}
+
+std::vector<NearDuplicateIndex::ChunkId> NearDuplicateIndex::getGroup(ChunkId chunkId) const {
+    std::shared_lock<std::shared_mutex> lock(mtx);
+    auto found = chunks.find(chunkId);
+    if (found == chunks.end()) {
+        return {};
+    }
+    return groups.at(found->second.group);
+}
+
+size_t NearDuplicateIndex::size() const {
+    std::shared_lock<std::shared_mutex> lock(mtx);
+    return chunks.size();
+}
+
+size_t NearDuplicateIndex::getGroupCount() const {
+    std::shared_lock<std::shared_mutex> lock(mtx);
+    return groups.size();
+}
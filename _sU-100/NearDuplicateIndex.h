@@ -0,0 +1,62 @@
+﻿// NearDuplicateIndex.h
+#pragma once
+
+#include <string_view>
+#include <vector>
+#include <unordered_map>
+#include <shared_mutex>
+#include <cstdint>
+#include "InvertedIndex.h"
+
+// Поиск почти одинаковых чанков (редакции одного договора, колонтитулы на каждой странице).
+// Отпечаток чанка - SimHash по его терминам: у похожих текстов отпечатки отличаются в немногих
+// битах. Отпечаток делится на BANDS полос по 16 бит (LSH): отпечатки, отличающиеся не больше
+// чем в MAX_DISTANCE битах, совпадают хотя бы в одной полосе, поэтому кандидаты берутся
+// из корзин полос, а не перебором всех чанков. Похожие чанки объединяются в группы
+class NearDuplicateIndex {
+public:
+    using ChunkId = InvertedIndex::ChunkId;
+
+    // Наибольшее число различающихся бит у почти дубликатов
+    static constexpr int MAX_DISTANCE = 3;
+
+    // Нет отпечатка (в чанке слишком мало терминов для сравнения)
+    static constexpr uint64_t NO_FINGERPRINT = 0;
+
+    // SimHash терминов чанка (в любом порядке, с повторами)
+    static uint64_t fingerprint(const std::vector<std::string_view>& terms);
+
+    // Добавление чанка; true - нашелся почти дубликат из уже добавленных
+    bool add(ChunkId chunkId, uint64_t fingerprint);
+
+    // Удаление чанка из индекса и из его группы
+    void remove(ChunkId chunkId);
+    void clear();
+
+    // Группа почти дубликатов чанка, включая сам чанк (пусто - чанка нет в индексе)
+    std::vector<ChunkId> getGroup(ChunkId chunkId) const;
+
+    // Число чанков в индексе и число групп
+    size_t size() const;
+    size_t getGroupCount() const;
+
+private:
+    static constexpr int BANDS = 4;
+    static constexpr int BAND_BITS = 16;
+
+    struct Entry {
+        uint64_t fingerprint;
+        ChunkId group;              // идентификатор первого чанка группы
+    };
+
+    std::unordered_map<ChunkId, Entry> chunks;
+    std::unordered_map<ChunkId, std::vector<ChunkId>> groups;
+
+    // Корзины полос: значение полосы - чанки с ним
+    std::unordered_map<uint16_t, std::vector<ChunkId>> buckets[BANDS];
+
+    // Запросы читают группы параллельно с загрузкой
+    mutable std::shared_mutex mtx;
+
+    static uint16_t band(uint64_t fingerprint, int index);
+};
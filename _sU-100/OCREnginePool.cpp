@@ -0,0 +1,195 @@
+﻿// OCREnginePool.cpp
+#include "OCREnginePool.h"
+#include <iostream>
+#include <algorithm>
+#include <filesystem>
+
+#include <tesseract/baseapi.h>
+
+OCREnginePool::Lease::Lease()
+    : pool(nullptr) {
+}
+
+OCREnginePool::Lease::Lease(OCREnginePool* pool, std::unique_ptr<tesseract::TessBaseAPI> engine,
+    const std::string& key)
+    : pool(pool), engine(std::move(engine)), key(key) {
+}
+
+OCREnginePool::Lease::Lease(Lease&& other) noexcept
+    : pool(other.pool), engine(std::move(other.engine)), key(std::move(other.key)) {
+    other.pool = nullptr;
+}
+
+OCREnginePool::Lease& OCREnginePool::Lease::operator=(Lease&& other) noexcept {
+    if (this != &other) {
+        release();
+        pool = other.pool;
+        engine = std::move(other.engine);
+        key = std::move(other.key);
+        other.pool = nullptr;
+    }
+    return *this;
+}
+
+OCREnginePool::Lease::~Lease() {
+    release();
+}
+
+void OCREnginePool::Lease::release() {
+    if (pool && engine) {
+        pool->release(std::move(engine), key);
+    }
+    pool = nullptr;
+}
+
+tesseract::TessBaseAPI* OCREnginePool::Lease::operator->() const {
+    return engine.get();
+}
+
+tesseract::TessBaseAPI* OCREnginePool::Lease::get() const {
+    return engine.get();
+}
+
+OCREnginePool::Lease::operator bool() const {
+    return engine != nullptr;
+}
+
+OCREnginePool::OCREnginePool(size_t maxEngines)
+    : maxEngines(std::max<size_t>(1, maxEngines)), created(0), idleCount(0), releaseCounter(0) {
+}
+
+OCREnginePool::~OCREnginePool() {
+    std::lock_guard<std::mutex> lock(mtx);
+    for (auto& [key, engines] : idle) {
+        for (auto& entry : engines) {
+            entry.engine->End();
+        }
+    }
+    idle.clear();
+    idleCount = 0;
+}
+
+size_t OCREnginePool::capacity() const {
+    return maxEngines;
+}
+
+OCREnginePool::Lease OCREnginePool::acquire(const OCRProfile& profile, const std::string& languages) {
+    const std::string key = profile.signature() + "|" + languages;
+
+    std::unique_lock<std::mutex> lock(mtx);
+
+    // Ждем свободный движок с нужным ключом, возможность создать новый
+    // или свободный движок с другим ключом, который можно освободить
+    cv.wait(lock, [this, &key]() {
+        auto it = idle.find(key);
+        return (it != idle.end() && !it->second.empty()) || created < maxEngines || idleCount > 0;
+    });
+
+    auto it = idle.find(key);
+    if (it != idle.end() && !it->second.empty()) {
+        auto engine = std::move(it->second.back().engine);
+        it->second.pop_back();
+        idleCount--;
+        return Lease(this, std::move(engine), key);
+    }
+
+    if (created >= maxEngines) {
+        evictIdleEngine();
+    }
+
+    // Инициализация движка занимает заметное время, поэтому выполняем ее без блокировки
+    created++;
+    lock.unlock();
+
+    auto engine = createEngine(profile, languages);
+    if (!engine) {
+        lock.lock();
+        created--;
+        lock.unlock();
+        cv.notify_one();
+        return Lease();
+    }
+
+    return Lease(this, std::move(engine), key);
+}
+
+void OCREnginePool::evictIdleEngine() {
+    // Самый давний возврат - первый в своем наборе; движки часто нужных языков
+    // возвращаются постоянно и поэтому не вытесняются (модели LSTM не загружаются заново)
+    std::vector<IdleEngine>* oldest = nullptr;
+    for (auto& [key, engines] : idle) {
+        if (!engines.empty() && (!oldest || engines.front().releasedAt < oldest->front().releasedAt)) {
+            oldest = &engines;
+        }
+    }
+    if (!oldest) {
+        return;
+    }
+
+    auto engine = std::move(oldest->front().engine);
+    oldest->erase(oldest->begin());
+    idleCount--;
+    created--;
+
+    engine->End();
+}
+
+std::unique_ptr<tesseract::TessBaseAPI> OCREnginePool::createEngine(const OCRProfile& profile,
+    const std::string& languages) {
+    try {
+        auto engine = std::make_unique<tesseract::TessBaseAPI>();
+
+        // Каталог с вариантом языковых данных; при его отсутствии используем стандартный
+        std::string dataPath = profile.tessdataPath();
+        if (!dataPath.empty() && !std::filesystem::exists(dataPath)) {
+            std::cerr << "Tessdata directory '" << dataPath << "' not found, profile '"
+                << profile.name << "' falls back to default tessdata" << std::endl;
+            dataPath.clear();
+        }
+
+        tesseract::OcrEngineMode oem = tesseract::OEM_DEFAULT;
+        if (profile.engineMode == OCREngineMode::LSTMOnly) {
+            oem = tesseract::OEM_LSTM_ONLY;
+        }
+        else if (profile.engineMode == OCREngineMode::Legacy) {
+            oem = tesseract::OEM_TESSERACT_ONLY;
+        }
+
+        // Словари загружаются только при инициализации
+        std::vector<std::string> varNames = { "load_system_dawg", "load_freq_dawg" };
+        std::vector<std::string> varValues = {
+            profile.useSystemDictionary ? "1" : "0",
+            profile.useFrequentWords ? "1" : "0"
+        };
+
+        if (engine->Init(dataPath.empty() ? nullptr : dataPath.c_str(), languages.c_str(), oem,
+            nullptr, 0, &varNames, &varValues, false)) {
+            std::cerr << "Could not initialize Tesseract OCR engine (" << languages
+                << ", profile '" << profile.name << "')" << std::endl;
+            return nullptr;
+        }
+
+        if (!profile.charWhitelist.empty()) {
+            engine->SetVariable("tessedit_char_whitelist", profile.charWhitelist.c_str());
+        }
+
+        engine->SetPageSegMode(static_cast<tesseract::PageSegMode>(profile.pageSegMode));
+        return engine;
+    }
+    catch (const std::exception& e) {
+        std::cerr << "Error initializing OCR: " << e.what() << std::endl;
+        return nullptr;
+    }
+}
+
+void OCREnginePool::release(std::unique_ptr<tesseract::TessBaseAPI> engine, const std::string& key) {
+    // Сбрасываем изображение и результаты предыдущего распознавания
+    engine->Clear();
+
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        idle[key].push_back({ std::move(engine), ++releaseCounter });
+        idleCount++;
+    }
+    cv.notify_all();
+}
@@ -0,0 +1,93 @@
+﻿// OCREnginePool.h
+#pragma once
+
+#include <string>
+#include <vector>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <cstdint>
+
+#include "OCRProfile.h"
+
+// Предварительное объявление для Tesseract
+namespace tesseract {
+    class TessBaseAPI;
+}
+
+// Пул движков Tesseract: один движок не потокобезопасен,
+// поэтому каждый поток получает собственный экземпляр во временное пользование.
+// Движки разделяются по профилю и набору языков ("rus", "eng", "rus+eng", "osd").
+// Когда лимит исчерпан, освобождается движок, дольше всех простаивавший без дела
+class OCREnginePool {
+public:
+    // Движок, выданный из пула; возвращается обратно при разрушении
+    class Lease {
+    public:
+        Lease();
+        Lease(OCREnginePool* pool, std::unique_ptr<tesseract::TessBaseAPI> engine,
+            const std::string& key);
+        Lease(Lease&& other) noexcept;
+        Lease& operator=(Lease&& other) noexcept;
+        ~Lease();
+
+        tesseract::TessBaseAPI* operator->() const;
+        tesseract::TessBaseAPI* get() const;
+        explicit operator bool() const;
+
+    private:
+        OCREnginePool* pool;
+        std::unique_ptr<tesseract::TessBaseAPI> engine;
+        std::string key;
+
+        // Возврат движка в пул
+        void release();
+    };
+
+    // Конструктор с максимальным числом движков (суммарно по всем языкам)
+    explicit OCREnginePool(size_t maxEngines);
+    ~OCREnginePool();
+
+    // Получение движка для профиля и набора языков (ждет, если все движки заняты);
+    // пустая аренда при ошибке инициализации
+    Lease acquire(const OCRProfile& profile, const std::string& languages);
+
+    // Максимальное количество одновременно работающих движков
+    size_t capacity() const;
+
+private:
+    // Ограничение на число движков
+    size_t maxEngines;
+
+    // Количество созданных движков
+    size_t created;
+
+    // Свободный движок и номер его возврата в пул
+    struct IdleEngine {
+        std::unique_ptr<tesseract::TessBaseAPI> engine;
+        uint64_t releasedAt;
+    };
+
+    // Свободные движки по ключу "профиль|языки" в порядке возврата (последний - самый свежий)
+    std::map<std::string, std::vector<IdleEngine>> idle;
+
+    // Количество свободных движков во всех наборах
+    size_t idleCount;
+
+    // Счетчик возвратов движков в пул
+    uint64_t releaseCounter;
+
+    // Синхронизация
+    mutable std::mutex mtx;
+    std::condition_variable cv;
+
+    // Создание и инициализация нового движка
+    std::unique_ptr<tesseract::TessBaseAPI> createEngine(const OCRProfile& profile, const std::string& languages);
+
+    // Возврат движка в пул
+    void release(std::unique_ptr<tesseract::TessBaseAPI> engine, const std::string& key);
+
+    // Освобождение свободного движка, дольше всех не использовавшегося, чтобы уложиться в лимит
+    void evictIdleEngine();
+};
@@ -0,0 +1,49 @@
+﻿// OCRProfile.cpp
+#include "OCRProfile.h"
+#include <sstream>
+
+std::string OCRProfile::tessdataPath() const {
+    switch (tessdata) {
+    case TessdataVariant::Fast:
+        return "tessdata_fast";
+    case TessdataVariant::Best:
+        return "tessdata_best";
+    default:
+        return "";
+    }
+}
+
+std::string OCRProfile::signature() const {
+    std::stringstream ss;
+    ss << name
+        << ";oem=" << static_cast<int>(engineMode)
+        << ";data=" << static_cast<int>(tessdata)
+        << ";psm=" << pageSegMode
+        << ";wl=" << charWhitelist
+        << ";dict=" << useSystemDictionary << useFrequentWords;
+    return ss.str();
+}
+
+OCRProfile OCRProfile::fast() {
+    OCRProfile profile;
+    profile.name = "fast";
+    profile.engineMode = OCREngineMode::LSTMOnly;
+    profile.tessdata = TessdataVariant::Fast;
+    profile.useSystemDictionary = false;
+    profile.useFrequentWords = false;
+    return profile;
+}
+
+OCRProfile OCRProfile::standard() {
+    OCRProfile profile;
+    profile.name = "standard";
+    return profile;
+}
+
+OCRProfile OCRProfile::best() {
+    OCRProfile profile;
+    profile.name = "best";
+    profile.engineMode = OCREngineMode::LSTMOnly;
+    profile.tessdata = TessdataVariant::Best;
+    return profile;
+}
@@ -0,0 +1,40 @@
+﻿// OCRProfile.h
+#pragma once
+
+#include <string>
+
+// Режим движка Tesseract
+enum class OCREngineMode {
+    Default,    // как собраны языковые данные
+    LSTMOnly,   // только нейросетевой движок
+    Legacy      // только классический движок (нужны стандартные tessdata)
+};
+
+// Вариант языковых данных
+enum class TessdataVariant {
+    Standard,   // TESSDATA_PREFIX / tessdata
+    Fast,       // tessdata_fast - быстрые целочисленные модели
+    Best        // tessdata_best - самые точные модели
+};
+
+// Профиль OCR: баланс между скоростью и качеством распознавания
+struct OCRProfile {
+    std::string name;
+    OCREngineMode engineMode = OCREngineMode::Default;
+    TessdataVariant tessdata = TessdataVariant::Standard;
+    int pageSegMode = 3;                 // tesseract::PageSegMode (3 = PSM_AUTO)
+    std::string charWhitelist;           // пустая строка - без ограничений
+    bool useSystemDictionary = true;     // load_system_dawg
+    bool useFrequentWords = true;        // load_freq_dawg
+
+    // Каталог языковых данных для Tesseract (пустая строка - путь по умолчанию)
+    std::string tessdataPath() const;
+
+    // Строка, однозначно описывающая настройки профиля
+    std::string signature() const;
+
+    // Встроенные профили
+    static OCRProfile fast();       // массовая загрузка архивов
+    static OCRProfile standard();   // поведение по умолчанию
+    static OCRProfile best();       // юридические документы
+};
@@ -1,29 +1,160 @@
-// PDFProcessor.cpp
+﻿// PDFProcessor.cpp
 #include "PDFProcessor.h"
+#include "OCREnginePool.h"
+#include "ThreadPool.h"
+#include "ExtractionCache.h"
+#include "MemoryBuffer.h"
 #include <iostream>
 #include <fstream>
 #include <filesystem>
-
-//   Poppler
+#include <future>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <algorithm>
+#include <limits>
+
+// Включаем заголовки Poppler
 #include <poppler/cpp/poppler-document.h>
 #include <poppler/cpp/poppler-page.h>
 #include <poppler/cpp/poppler-page-renderer.h>
 #include <poppler/cpp/poppler-global.h>
 
-//   Tesseract  Leptonica
+// Включаем заголовки Tesseract и Leptonica
 #include <tesseract/baseapi.h>
 #include <leptonica/allheaders.h>
 
 namespace fs = std::filesystem;
 
-PDFProcessor::PDFProcessor() {
+namespace {
+    // Минимальная уверенность OSD, при которой доверяем результату
+    constexpr float MIN_ORIENTATION_CONFIDENCE = 2.0f;
+    constexpr float MIN_SCRIPT_CONFIDENCE = 1.0f;
+
+    // Масштаб изображения для OSD (300 DPI -> 150 DPI)
+    constexpr float OSD_SCALE = 0.5f;
+
+    // Версия алгоритма извлечения: меняется при любом изменении, влияющем на текст
+    constexpr int EXTRACTOR_VERSION = 1;
+
+    // Разрешение миниатюры, по которой вычисляется отпечаток отсканированной страницы
+    constexpr int FINGERPRINT_DPI = 36;
+
+    // Память на пиксель страницы при OCR: изображение Poppler и его копия для Leptonica (по 4 байта),
+    // копия и бинаризация внутри Tesseract
+    constexpr size_t OCR_BYTES_PER_PIXEL = 12;
+
+    // Экономный режим: через сколько страниц документ Poppler открывается заново
+    constexpr int DOCUMENT_RELOAD_PAGES = 32;
+
+    // Экономный режим: часть файла, после хэширования которой прочитанное выгружается
+    constexpr size_t HASH_SLICE_BYTES = 64 * 1024 * 1024;
+
+    // Сообщения об ошибках не должны попадать в кэш
+    bool isErrorText(const std::string& text) {
+        return text.rfind("Error", 0) == 0 || text.rfind("OCR Error", 0) == 0 ||
+            text == "OCR not initialized";
+    }
+
+    // Распознавание блоков большой страницы потоком страницы и задачами пула. Задачи держат
+    // состояние через shared_ptr: задача, начатая после разбора всех блоков, сразу завершается
+    struct BlockRecognition {
+        OCREnginePool* engines = nullptr;
+        OCRProfile profile;
+        std::string languages;
+        std::vector<Pix*> images;
+        std::vector<std::string> texts;
+        std::atomic<size_t> nextBlock{ 0 };
+
+        std::mutex mtx;
+        std::condition_variable finished;
+        size_t finishedBlocks = 0;
+    };
+
+    // Распознавание свободных блоков, пока они есть
+    void recognizeBlocks(BlockRecognition& work) {
+        size_t done = 0;
+        for (size_t i = work.nextBlock++; i < work.images.size(); i = work.nextBlock++) {
+            ++done;
+            if (!work.images[i]) {
+                continue;
+            }
+
+            try {
+                auto engine = work.engines->acquire(work.profile, work.languages);
+                if (!engine) {
+                    continue;
+                }
+
+                engine->SetPageSegMode(tesseract::PSM_SINGLE_BLOCK);
+                engine->SetImage(work.images[i]);
+
+                char* ocrText = engine->GetUTF8Text();
+                if (ocrText) {
+                    work.texts[i] = ocrText;
+                    delete[] ocrText;
+                }
+            }
+            catch (const std::exception& e) {
+                std::cerr << "Block OCR error: " << e.what() << std::endl;
+            }
+        }
+
+        if (done == 0) {
+            return;
+        }
+        std::lock_guard<std::mutex> lock(work.mtx);
+        work.finishedBlocks += done;
+        if (work.finishedBlocks == work.images.size()) {
+            work.finished.notify_all();
+        }
+    }
+}
+
+// Открытый документ: исходные данные, разобранный PDF и состояние кэша
+struct PDFProcessor::DocumentHandle {
+    std::string path;
+    OCRProfile profile;
+
+    // Содержимое файла должно пережить документ Poppler, поэтому объявлено раньше
+    std::shared_ptr<MemoryBuffer> data;
+    std::unique_ptr<poppler::document> document;
+
+    // Доступ к документу Poppler и полям ниже
+    std::mutex mtx;
+
+    int pageCount = 0;
+
+    // Страниц отрендерено с последнего открытия документа Poppler (экономный режим)
+    int pagesSinceReload = 0;
+
+    // Документ целиком найден в кэше
+    bool fromCache = false;
+    std::vector<std::string> cachedPages;
+
+    // Состояние для записи в кэш
+    uint64_t settingsHash = 0;
+    std::string documentKey;
+    std::vector<uint64_t> pageFingerprints;
+    bool cacheable = false;
+    int reusedPages = 0;
+};
+
+PDFProcessor::PDFProcessor()
+    : largePageThreshold(DEFAULT_LARGE_PAGE_PIXELS), scriptDetection(true), lowMemoryMode(false),
+    defaultProfile("standard") {
+    addProfile(OCRProfile::fast());
+    addProfile(OCRProfile::standard());
+    addProfile(OCRProfile::best());
+
     initOCR();
 }
 
 PDFProcessor::~PDFProcessor() {
-    if (tessApi) {
-        tessApi->End();
-    }
+    // Сначала дожидаемся рабочих потоков, затем освобождаем движки
+    ocrWorkers.reset();
+    ocrPool.reset();
+    osdPool.reset();
 }
 
 bool PDFProcessor::fileExists(const std::string& filePath) {
@@ -32,74 +163,258 @@ bool PDFProcessor::fileExists(const std::string& filePath) {
 
 void PDFProcessor::initOCR() {
     try {
-        tessApi = std::make_unique<tesseract::TessBaseAPI>();
+        size_t threads = std::max(1u, std::thread::hardware_concurrency());
+
+        // По одному движку на поток: каждый движок держит свою копию LSTM моделей
+        ocrPool = std::make_unique<OCREnginePool>(threads);
 
-        //  OCR      
-        if (tessApi->Init(nullptr, "rus+eng")) {
+        // Проверяем, что движок инициализируется (заодно прогреваем первый экземпляр)
+        if (!ocrPool->acquire(profiles[defaultProfile], DEFAULT_OCR_LANGUAGES)) {
             std::cerr << "Could not initialize Tesseract OCR engine" << std::endl;
-            tessApi.reset();
+            ocrPool.reset();
+            return;
         }
 
-        //      
-        if (tessApi) {
-            tessApi->SetPageSegMode(tesseract::PSM_AUTO);
+        // Для OSD нужен osd.traineddata; без него распознаем всеми языками
+        if (scriptDetection) {
+            osdPool = std::make_unique<OCREnginePool>(threads);
+            if (!osdPool->acquire(OCRProfile::standard(), "osd")) {
+                std::cerr << "OSD data not found, script detection disabled" << std::endl;
+                scriptDetection = false;
+                osdPool.reset();
+            }
         }
+
+        ocrWorkers = std::make_shared<ThreadPool>(threads);
     }
     catch (const std::exception& e) {
         std::cerr << "Error initializing OCR: " << e.what() << std::endl;
-        tessApi.reset();
+        ocrPool.reset();
+        osdPool.reset();
     }
 }
 
-std::string PDFProcessor::extractText(const std::string& pdfPath) {
-    if (!fileExists(pdfPath)) {
-        return "Error: File not found: " + pdfPath;
+void PDFProcessor::setThreadPool(std::shared_ptr<ThreadPool> pool) {
+    // Без OCR распознавать нечего: свой пул не создавался, общий не нужен
+    if (ocrPool && pool) {
+        ocrWorkers = std::move(pool);
     }
+}
 
-    try {
-        //  
-        std::unique_ptr<poppler::document> doc(poppler::document::load_from_file(pdfPath));
+void PDFProcessor::setLargePageThreshold(size_t pixels) {
+    largePageThreshold = pixels;
+}
+
+size_t PDFProcessor::getLargePageThreshold() const {
+    return largePageThreshold;
+}
+
+void PDFProcessor::setScriptDetection(bool enabled) {
+    scriptDetection = enabled;
+}
+
+bool PDFProcessor::isScriptDetectionEnabled() const {
+    return scriptDetection;
+}
+
+void PDFProcessor::setLowMemoryMode(bool enabled) {
+    lowMemoryMode = enabled;
+}
+
+bool PDFProcessor::isLowMemoryMode() const {
+    return lowMemoryMode;
+}
+
+void PDFProcessor::addProfile(const OCRProfile& profile) {
+    profiles[profile.name] = profile;
+}
+
+bool PDFProcessor::setDefaultProfile(const std::string& profileName) {
+    if (profiles.find(profileName) == profiles.end()) {
+        std::cerr << "Unknown OCR profile: " << profileName << std::endl;
+        return false;
+    }
+
+    defaultProfile = profileName;
+    return true;
+}
+
+bool PDFProcessor::addDirectoryRule(const std::string& directory, const std::string& profileName) {
+    if (profiles.find(profileName) == profiles.end()) {
+        std::cerr << "Unknown OCR profile: " << profileName << std::endl;
+        return false;
+    }
+
+    directoryRules.emplace_back(fs::path(directory).lexically_normal().generic_string(), profileName);
+
+    // Более глубокие каталоги проверяются первыми
+    std::stable_sort(directoryRules.begin(), directoryRules.end(),
+        [](const auto& a, const auto& b) { return a.first.size() > b.first.size(); });
+    return true;
+}
 
-        if (!doc) {
-            return "Error: Failed to open PDF file: " + pdfPath;
+void PDFProcessor::setCacheDirectory(const std::string& directory) {
+    if (directory.empty()) {
+        cache.reset();
+        return;
+    }
+
+    cache = std::make_unique<ExtractionCache>(directory);
+}
+
+std::string PDFProcessor::extractionSignature(const OCRProfile& profile) const {
+    std::stringstream ss;
+    ss << "extractor=" << EXTRACTOR_VERSION
+        << ";osd=" << scriptDetection
+        << ";large=" << largePageThreshold
+        << ";" << profile.signature();
+    return ss.str();
+}
+
+uint64_t PDFProcessor::scannedPageFingerprint(poppler::page* page, uint64_t seed) {
+    // Миниатюра рендерится на порядки быстрее, чем выполняется OCR
+    poppler::page_renderer renderer;
+    poppler::image img = renderer.render_page(page, FINGERPRINT_DPI, FINGERPRINT_DPI);
+
+    if (!img.is_valid()) {
+        return 0;
+    }
+
+    uint64_t hash = ExtractionCache::hashBytes(img.const_data(),
+        static_cast<size_t>(img.bytes_per_row()) * img.height(), seed);
+
+    int size[2] = { img.width(), img.height() };
+    return ExtractionCache::hashBytes(size, sizeof(size), hash);
+}
+
+std::string PDFProcessor::resolveProfileName(const std::string& pdfPath) const {
+    std::string path = fs::path(pdfPath).lexically_normal().generic_string();
+
+    for (const auto& [directory, profileName] : directoryRules) {
+        // Совпадение только по целым компонентам пути
+        if (path.size() > directory.size() && path.compare(0, directory.size(), directory) == 0 &&
+            (directory.back() == '/' || path[directory.size()] == '/')) {
+            return profileName;
         }
+    }
+
+    return defaultProfile;
+}
 
-        int pageCount = doc->pages();
-        std::cout << "PDF loaded successfully. Total pages: " << pageCount << std::endl;
+std::string PDFProcessor::extractText(const std::string& pdfPath, const std::string& profileName) {
+    std::string error;
+    auto doc = openDocument(pdfPath, profileName, error);
+    if (!doc) {
+        return error;
+    }
+
+    return extractDocumentText(doc);
+}
+
+std::string PDFProcessor::extractText(std::shared_ptr<MemoryBuffer> data, const std::string& name,
+    const std::string& profileName) {
+    std::string error;
+    auto doc = openDocument(std::move(data), name, profileName, error);
+    if (!doc) {
+        return error;
+    }
+
+    return extractDocumentText(doc);
+}
+
+std::string PDFProcessor::extractPages(const std::string& pdfPath, const PageCallback& onPage,
+    const std::string& profileName) {
+    std::string error;
+    auto doc = openDocument(pdfPath, profileName, error);
+    if (!doc) {
+        return error;
+    }
+
+    return extractDocumentPages(doc, onPage);
+}
+
+std::string PDFProcessor::extractPages(std::shared_ptr<MemoryBuffer> data, const std::string& name,
+    const PageCallback& onPage, const std::string& profileName) {
+    std::string error;
+    auto doc = openDocument(std::move(data), name, profileName, error);
+    if (!doc) {
+        return error;
+    }
+
+    return extractDocumentPages(doc, onPage);
+}
 
-        std::stringstream result;
-        result << "Extracted text from: " << pdfPath << "\n\n";
+std::string PDFProcessor::extractDocumentText(const std::shared_ptr<DocumentHandle>& doc) {
+    std::stringstream result;
+    result << "Extracted text from: " << doc->path << "\n\n";
 
-        //   
+    std::string error = extractDocumentPages(doc,
+        [&result](int pageNumber, int /*pageCount*/, const std::string& pageText) {
+            result << "=== Page " << pageNumber << " ===\n";
+            result << pageText << "\n\n";
+            return true;
+        });
+
+    if (!error.empty()) {
+        return error;
+    }
+
+    return result.str();
+}
+
+std::string PDFProcessor::extractDocumentPages(const std::shared_ptr<DocumentHandle>& doc,
+    const PageCallback& onPage) {
+    int pageCount = doc->pageCount;
+
+    // Неизмененный файл целиком взят из кэша
+    if (doc->fromCache) {
+        std::cout << "Loaded from extraction cache: " << pageCount << " pages" << std::endl;
+
+        for (int i = 0; i < pageCount; ++i) {
+            if (!onPage(i + 1, pageCount, doc->cachedPages[i])) {
+                return "Error: Extraction cancelled";
+            }
+            // Страница передана потребителю - освобождаем память сразу
+            std::string().swap(doc->cachedPages[i]);
+        }
+        return "";
+    }
+
+    std::cout << "PDF loaded successfully. Total pages: " << pageCount << std::endl;
+
+    try {
+        // Обрабатываем каждую страницу
         for (int i = 0; i < pageCount; ++i) {
             std::cout << "Processing page " << (i + 1) << " of " << pageCount << "\r";
             std::cout.flush();
 
-            //  
-            std::unique_ptr<poppler::page> page(doc->create_page(i));
+            RenderedPage page = renderPage(*doc, i);
 
-            if (!page) {
+            if (page.failed) {
                 std::cerr << "\nError: Failed to load page " << (i + 1) << std::endl;
                 continue;
             }
 
-            //   
-            result << "=== Page " << (i + 1) << " ===\n";
-
-            //  
-            std::string pageText;
-            if (isScannedPage(page.get())) {
-                pageText = extractTextWithOCR(page.get());
-            }
-            else {
-                pageText = extractTextFromPage(page.get());
+            if (page.image) {
+                recognizePage(*doc, page);
             }
 
-            result << pageText << "\n\n";
+            // Отдаем страницу потребителю, не накапливая текст всего документа
+            if (!onPage(page.pageNumber, pageCount, page.text)) {
+                std::cout << std::endl;
+                return "Error: Extraction cancelled";
+            }
         }
 
-        std::cout << "\nText extraction completed." << std::endl;
-        return result.str();
+        int reusedPages = doc->reusedPages;
+        closeDocument(*doc);
+
+        std::cout << "\nText extraction completed";
+        if (reusedPages > 0) {
+            std::cout << " (" << reusedPages << " OCR pages reused from cache)";
+        }
+        std::cout << "." << std::endl;
+        return "";
     }
     catch (const std::exception& e) {
         std::cerr << "Error processing PDF: " << e.what() << std::endl;
@@ -107,13 +422,242 @@ std::string PDFProcessor::extractText(const std::string& pdfPath) {
     }
 }
 
+std::shared_ptr<PDFProcessor::DocumentHandle> PDFProcessor::openDocument(const std::string& pdfPath,
+    const std::string& profileName, std::string& error) {
+    if (!fileExists(pdfPath)) {
+        error = "Error: File not found: " + pdfPath;
+        return nullptr;
+    }
+
+    // Файл отображается в память: Poppler читает его напрямую, без промежуточной копии
+    auto data = MemoryBuffer::mapFile(pdfPath, error);
+    if (!data) {
+        return nullptr;
+    }
+
+    return openDocument(std::move(data), pdfPath, profileName, error);
+}
+
+std::shared_ptr<PDFProcessor::DocumentHandle> PDFProcessor::openDocument(std::shared_ptr<MemoryBuffer> data,
+    const std::string& name, const std::string& profileName, std::string& error) {
+    if (!data || data->size() == 0) {
+        error = "Error: Empty PDF data: " + name;
+        return nullptr;
+    }
+
+    // Poppler принимает длину документа как int
+    if (data->size() > static_cast<size_t>(std::numeric_limits<int>::max())) {
+        error = "Error: PDF is too large: " + name;
+        return nullptr;
+    }
+
+    // Выбираем профиль OCR: явно заданный или по правилам каталогов
+    std::string selectedProfile = profileName.empty() ? resolveProfileName(name) : profileName;
+    auto profileIt = profiles.find(selectedProfile);
+    if (profileIt == profiles.end()) {
+        error = "Error: Unknown OCR profile: " + selectedProfile;
+        return nullptr;
+    }
+
+    auto doc = std::make_shared<DocumentHandle>();
+    doc->path = name;
+    doc->profile = profileIt->second;
+    doc->data = std::move(data);
+
+    try {
+        // Ключ кэша: содержимое файла плюс настройки извлечения и OCR.
+        // Хэширование заодно читает весь файл на этапе загрузки
+        if (cache) {
+            std::string signature = extractionSignature(doc->profile);
+            doc->settingsHash = ExtractionCache::hashBytes(signature.data(), signature.size());
+
+            // В экономном режиме прочитанные при хэшировании части файла сразу выгружаются
+            const MemoryBuffer& buffer = *doc->data;
+            uint64_t contentHash = lowMemoryMode && buffer.isMapped()
+                ? ExtractionCache::hashContent(buffer.data(), buffer.size(), HASH_SLICE_BYTES,
+                    [&buffer](size_t offset, size_t length) { buffer.evict(offset, length); })
+                : ExtractionCache::hashContent(buffer.data(), buffer.size());
+            doc->documentKey = ExtractionCache::toHex(contentHash) + "-" + ExtractionCache::toHex(doc->settingsHash);
+
+            // Неизмененный файл не разбираем вовсе
+            if (cache->loadDocument(doc->documentKey, doc->cachedPages)) {
+                doc->fromCache = true;
+                doc->pageCount = static_cast<int>(doc->cachedPages.size());
+                doc->data.reset();
+                return doc;
+            }
+        }
+
+        // Загружаем документ прямо из буфера (Poppler не копирует данные)
+        doc->document.reset(poppler::document::load_from_raw_data(doc->data->data(),
+            static_cast<int>(doc->data->size())));
+
+        if (!doc->document) {
+            error = "Error: Failed to open PDF file: " + name;
+            return nullptr;
+        }
+
+        doc->pageCount = doc->document->pages();
+        doc->pageFingerprints.assign(doc->pageCount, 0);
+        doc->cacheable = cache != nullptr;
+        return doc;
+    }
+    catch (const std::exception& e) {
+        error = "Error: Failed to open PDF file: " + std::string(e.what());
+        return nullptr;
+    }
+}
+
+int PDFProcessor::getPageCount(const DocumentHandle& doc) {
+    return doc.pageCount;
+}
+
+std::vector<std::string> PDFProcessor::takeCachedPages(DocumentHandle& doc) {
+    return std::move(doc.cachedPages);
+}
+
+PDFProcessor::RenderedPage PDFProcessor::renderPage(DocumentHandle& doc, int pageIndex) {
+    RenderedPage result;
+    result.pageNumber = pageIndex + 1;
+
+    // Документ Poppler не потокобезопасен: страницы одного файла рендерятся по очереди,
+    // а распознавание (самая долгая часть) идет параллельно
+    std::lock_guard<std::mutex> lock(doc.mtx);
+
+    if (!doc.document) {
+        result.failed = true;
+        return result;
+    }
+
+    // Poppler держит разобранные объекты всех открытых страниц до закрытия документа:
+    // в экономном режиме документ периодически открывается заново из того же буфера
+    if (lowMemoryMode && ++doc.pagesSinceReload > DOCUMENT_RELOAD_PAGES) {
+        doc.pagesSinceReload = 1;
+        doc.document.reset();
+        doc.data->evict(0, doc.data->size());
+        doc.document.reset(poppler::document::load_from_raw_data(doc.data->data(),
+            static_cast<int>(doc.data->size())));
+
+        if (!doc.document) {
+            result.failed = true;
+            doc.cacheable = false;
+            return result;
+        }
+    }
+
+    std::unique_ptr<poppler::page> page(doc.document->create_page(pageIndex));
+    if (!page) {
+        result.failed = true;
+        doc.cacheable = false;
+        return result;
+    }
+
+    if (isScannedPage(page.get())) {
+        // Повторно распознаем только страницы, отпечаток которых изменился
+        if (cache) {
+            result.fingerprint = scannedPageFingerprint(page.get(), doc.settingsHash);
+        }
+
+        if (result.fingerprint != 0 && cache->loadPage(result.fingerprint, result.text)) {
+            doc.reusedPages++;
+        }
+        else if (!ocrPool) {
+            result.text = "OCR not initialized";
+        }
+        else {
+            // Получаем изображение страницы
+            result.image = renderPageToImage(page.get());
+            if (!result.image) {
+                result.text = "Error: Failed to render page for OCR";
+            }
+        }
+    }
+    else {
+        result.text = extractTextFromPage(page.get());
+        if (cache) {
+            result.fingerprint = ExtractionCache::hashBytes(result.text.data(), result.text.size(), doc.settingsHash);
+            cache->storePage(result.fingerprint, result.text);
+        }
+    }
+
+    if (!result.image) {
+        recordPageFingerprint(doc, result);
+    }
+
+    return result;
+}
+
+void PDFProcessor::recognizePage(DocumentHandle& doc, RenderedPage& page) {
+    if (!page.image) {
+        return;
+    }
+
+    page.text = extractTextWithOCR(page.image, doc.profile);
+    page.image = nullptr;
+
+    if (cache && page.fingerprint != 0 && !isErrorText(page.text)) {
+        cache->storePage(page.fingerprint, page.text);
+    }
+
+    std::lock_guard<std::mutex> lock(doc.mtx);
+    recordPageFingerprint(doc, page);
+}
+
+void PDFProcessor::releasePage(RenderedPage& page) {
+    if (page.image) {
+        pixDestroy(&page.image);
+    }
+}
+
+size_t PDFProcessor::estimatePageMemory(DocumentHandle& doc, int pageIndex) {
+    std::lock_guard<std::mutex> lock(doc.mtx);
+
+    if (!doc.document) {
+        return 0;
+    }
+
+    std::unique_ptr<poppler::page> page(doc.document->create_page(pageIndex));
+    if (!page) {
+        return 0;
+    }
+
+    // Размер страницы в пунктах (1/72 дюйма) -> пиксели при рендеринге для OCR
+    poppler::rectf rect = page->page_rect();
+    double scale = OCR_DPI / 72.0;
+    double pixels = rect.width() * scale * rect.height() * scale;
+
+    return static_cast<size_t>(pixels) * OCR_BYTES_PER_PIXEL;
+}
+
+void PDFProcessor::recordPageFingerprint(DocumentHandle& doc, const RenderedPage& page) {
+    if (page.fingerprint == 0 || isErrorText(page.text)) {
+        doc.cacheable = false;
+        return;
+    }
+
+    doc.pageFingerprints[page.pageNumber - 1] = page.fingerprint;
+}
+
+void PDFProcessor::closeDocument(DocumentHandle& doc) {
+    std::lock_guard<std::mutex> lock(doc.mtx);
+
+    if (doc.cacheable && !doc.documentKey.empty()) {
+        cache->storeDocument(doc.documentKey, doc.pageFingerprints);
+    }
+    doc.cacheable = false;
+
+    // Документ и исходные данные больше не нужны
+    doc.document.reset();
+    doc.data.reset();
+}
+
 std::string PDFProcessor::extractTextFromPage(poppler::page* page) {
     if (!page) {
         return "";
     }
 
     try {
-        //       
+        // Получаем весь текст страницы с физической компоновкой
         poppler::ustring utext = page->text(poppler::rectf(), poppler::page::physical_layout);
         return ustringToString(utext);
     }
@@ -124,14 +668,14 @@ std::string PDFProcessor::extractTextFromPage(poppler::page* page) {
 }
 
 std::string PDFProcessor::ustringToString(const poppler::ustring& ustr) {
-    // to_utf8()  std::vector<char>,      c_str()
+    // to_utf8() возвращает std::vector<char>, а не строку с методом c_str()
     std::vector<char> utf8Data = ustr.to_utf8();
 
     if (utf8Data.empty()) {
         return "";
     }
 
-    //     
+    // Создаем строку из данных вектора
     return std::string(utf8Data.data(), utf8Data.size());
 }
 
@@ -140,62 +684,207 @@ bool PDFProcessor::isScannedPage(poppler::page* page) {
         return false;
     }
 
-    //   
+    // Получаем текст страницы
     std::string text = extractTextFromPage(page);
 
-    //  :      ,   
+    // Простая эвристика: если текста мало или его нет, вероятно это скан
     return text.length() < 100;
 }
 
-std::string PDFProcessor::extractTextWithOCR(poppler::page* page) {
-    if (!tessApi) {
+std::string PDFProcessor::extractTextWithOCR(Pix* pixImage, const OCRProfile& profile) {
+    if (!ocrPool) {
+        pixDestroy(&pixImage);
         return "OCR not initialized";
     }
 
-    //   
-    Pix* pixImage = renderPageToImage(page);
-    if (!pixImage) {
-        return "Error: Failed to render page for OCR";
+    // Определяем письменность и ориентацию, чтобы не гонять обе LSTM модели
+    // и не тратить полный проход OCR на перевернутый скан
+    std::string languages = DEFAULT_OCR_LANGUAGES;
+    if (scriptDetection && osdPool) {
+        PageScript script = detectPageScript(pixImage);
+        languages = script.languages;
+
+        if (script.rotation != 0) {
+            // pixRotateOrth поворачивает по часовой стрелке, компенсируем поворот скана
+            Pix* rotated = pixRotateOrth(pixImage, (360 - script.rotation) / 90);
+            if (rotated) {
+                pixDestroy(&pixImage);
+                pixImage = rotated;
+            }
+        }
+    }
+
+    std::string result;
+    size_t pixels = static_cast<size_t>(pixGetWidth(pixImage)) * pixGetHeight(pixImage);
+
+    // Большие страницы (чертежи A0, газетные полосы) распознаем по блокам параллельно
+    if (pixels >= largePageThreshold && ocrPool->capacity() > 1) {
+        std::cout << "\nLarge page (" << (pixels / 1000000) << " MP), using parallel block OCR" << std::endl;
+        result = recognizeLargeImage(pixImage, profile, languages);
+    }
+    else {
+        result = recognizeImage(pixImage, profile, languages);
+    }
+
+    pixDestroy(&pixImage);
+    return result;
+}
+
+PDFProcessor::PageScript PDFProcessor::detectPageScript(Pix* pixImage) {
+    PageScript script{ DEFAULT_OCR_LANGUAGES, 0 };
+
+    Pix* smallImage = pixScale(pixImage, OSD_SCALE, OSD_SCALE);
+    if (!smallImage) {
+        return script;
+    }
+
+    auto engine = osdPool->acquire(OCRProfile::standard(), "osd");
+    if (engine) {
+        int orientation = 0;
+        float orientationConfidence = 0.0f;
+        const char* scriptName = nullptr;
+        float scriptConfidence = 0.0f;
+
+        engine->SetPageSegMode(tesseract::PSM_OSD_ONLY);
+        engine->SetImage(smallImage);
+
+        if (engine->DetectOrientationScript(&orientation, &orientationConfidence,
+            &scriptName, &scriptConfidence)) {
+            if (orientationConfidence >= MIN_ORIENTATION_CONFIDENCE) {
+                script.rotation = ((orientation % 360) + 360) % 360;
+            }
+
+            if (scriptName && scriptConfidence >= MIN_SCRIPT_CONFIDENCE) {
+                std::string name(scriptName);
+                if (name == "Cyrillic") {
+                    script.languages = "rus";
+                }
+                else if (name == "Latin") {
+                    script.languages = "eng";
+                }
+            }
+        }
+    }
+
+    pixDestroy(&smallImage);
+    return script;
+}
+
+std::string PDFProcessor::recognizeImage(Pix* pixImage, const OCRProfile& profile, const std::string& languages) {
+    auto engine = ocrPool->acquire(profile, languages);
+    if (!engine) {
+        return "Error: OCR engine is not available";
     }
 
     try {
-        //    OCR
-        tessApi->SetImage(pixImage);
+        // Устанавливаем изображение для OCR
+        engine->SetPageSegMode(static_cast<tesseract::PageSegMode>(profile.pageSegMode));
+        engine->SetImage(pixImage);
 
-        //  OCR
-        char* ocrText = tessApi->GetUTF8Text();
+        // Выполняем OCR
+        char* ocrText = engine->GetUTF8Text();
         if (!ocrText) {
-            pixDestroy(&pixImage);
             return "Error: OCR failed to extract text";
         }
 
-        //  
+        // Копируем результат
         std::string result(ocrText);
 
-        //  
+        // Освобождаем ресурсы
         delete[] ocrText;
-        pixDestroy(&pixImage);
 
         return result;
     }
     catch (const std::exception& e) {
-        pixDestroy(&pixImage);
         return "OCR Error: " + std::string(e.what());
     }
 }
 
+std::string PDFProcessor::recognizeLargeImage(Pix*& pixImage, const OCRProfile& profile,
+    const std::string& languages) {
+    // Анализ разметки выполняем один раз на всю страницу
+    Boxa* blocks = nullptr;
+    {
+        auto engine = ocrPool->acquire(profile, languages);
+        if (!engine) {
+            return "Error: OCR engine is not available";
+        }
+
+        engine->SetPageSegMode(tesseract::PSM_AUTO);
+        engine->SetImage(pixImage);
+        blocks = engine->GetComponentImages(tesseract::RIL_BLOCK, true, nullptr, nullptr);
+    }
+
+    int blockCount = blocks ? boxaGetCount(blocks) : 0;
+    if (blockCount <= 1) {
+        // Делить нечего - распознаем страницу целиком
+        if (blocks) {
+            boxaDestroy(&blocks);
+        }
+        return recognizeImage(pixImage, profile, languages);
+    }
+
+    // Вырезаем блоки заранее: изображение страницы не должно использоваться из нескольких потоков
+    auto work = std::make_shared<BlockRecognition>();
+    work->engines = ocrPool.get();
+    work->profile = profile;
+    work->languages = languages;
+    work->images.resize(blockCount, nullptr);
+    work->texts.resize(blockCount);
+    for (int i = 0; i < blockCount; ++i) {
+        l_int32 x = 0, y = 0, w = 0, h = 0;
+        boxaGetBoxGeometry(blocks, i, &x, &y, &w, &h);
+
+        Box* box = boxCreate(x, y, w, h);
+        work->images[i] = pixClipRectangle(pixImage, box, nullptr);
+        boxDestroy(&box);
+    }
+    boxaDestroy(&blocks);
+
+    // Страница целиком больше не нужна: блоки распознаются из своих копий
+    pixDestroy(&pixImage);
+
+    // Поток страницы распознает блоки наравне с задачами пула и ждет только уже начатые ими:
+    // страница сама может выполняться задачей того же пула, и занятый пул ее не останавливает
+    std::shared_ptr<ThreadPool> pool = ocrWorkers;
+    if (pool) {
+        const size_t helpers = std::min(pool->size(), work->images.size() - 1);
+        for (size_t i = 0; i < helpers; ++i) {
+            pool->submit([work]() { recognizeBlocks(*work); }, TaskPriority::Background);
+        }
+    }
+    recognizeBlocks(*work);
+
+    {
+        std::unique_lock<std::mutex> lock(work->mtx);
+        work->finished.wait(lock, [&work]() { return work->finishedBlocks == work->images.size(); });
+    }
+
+    // Собираем текст в порядке разметки
+    std::string result;
+    for (size_t i = 0; i < work->images.size(); ++i) {
+        if (!work->texts[i].empty()) {
+            result += work->texts[i];
+            result += "\n";
+        }
+        pixDestroy(&work->images[i]);
+    }
+
+    return result;
+}
+
 Pix* PDFProcessor::renderPageToImage(poppler::page* page, int dpi) {
     if (!page) {
         return nullptr;
     }
 
     try {
-        //  
+        // Создаем рендерер
         poppler::page_renderer renderer;
         renderer.set_render_hint(poppler::page_renderer::antialiasing);
         renderer.set_render_hint(poppler::page_renderer::text_antialiasing);
 
-        //    
+        // Рендерим страницу в изображение
         poppler::image img = renderer.render_page(page, dpi, dpi);
 
         if (!img.is_valid()) {
@@ -203,29 +892,29 @@ Pix* PDFProcessor::renderPageToImage(poppler::page* page, int dpi) {
             return nullptr;
         }
 
-        //  PIX   Tesseract
+        // Создаем PIX изображение для Tesseract
         Pix* pixImage = pixCreate(img.width(), img.height(), 32);
         if (!pixImage) {
             std::cerr << "Failed to create PIX image" << std::endl;
             return nullptr;
         }
 
-        //  PIX   
+        // Заполняем PIX данными из изображения
         uint32_t* pixData = pixGetData(pixImage);
         int wpl = pixGetWpl(pixImage);
 
         for (int y = 0; y < img.height(); ++y) {
             uint32_t* line = pixData + y * wpl;
             for (int x = 0; x < img.width(); ++x) {
-                //      Poppler
+                // Получаем данные пикселя из изображения Poppler
                 int idx = y * img.width() * 4 + x * 4;
                 uint8_t r = img.data()[idx];
                 uint8_t g = img.data()[idx + 1];
                 uint8_t b = img.data()[idx + 2];
                 uint8_t a = img.data()[idx + 3];
 
-                //  32-   PIX
-                // PIX   RGBA,  R    
+                // Создаем 32-битный пиксель для PIX
+                // PIX использует формат RGBA, где R находится в старших битах
                 line[x] = (r << 24) | (g << 16) | (b << 8) | a;
             }
         }
@@ -1,55 +1,226 @@
-// PDFProcessor.h
+﻿// PDFProcessor.h
 #pragma once
 
 #include <string>
 #include <vector>
+#include <map>
 #include <memory>
+#include <functional>
+#include <cstdint>
 
-//    Tesseract
+#include "OCRProfile.h"
+
+// Предварительное объявление для Tesseract
 namespace tesseract {
     class TessBaseAPI;
 }
 
-//     Poppler
+// Используем предварительные объявления для Poppler
 namespace poppler {
     class document;
     class page;
     class ustring;
 }
 
-//    Leptonica
+// Предварительное объявление для Leptonica
 struct Pix;
 
+class OCREnginePool;
+class MemoryBuffer;
+class ThreadPool;
+class ExtractionCache;
+
 class PDFProcessor {
 public:
     PDFProcessor();
     ~PDFProcessor();
 
-    //    PDF 
-    std::string extractText(const std::string& pdfPath);
+    // Обработчик очередной страницы: номер (с 1), всего страниц, текст.
+    // Возврат false прерывает извлечение
+    using PageCallback = std::function<bool(int pageNumber, int pageCount, const std::string& pageText)>;
+
+    // Извлечение текста из PDF документа (пустое имя профиля - выбор по правилам каталогов)
+    std::string extractText(const std::string& pdfPath, const std::string& profileName = "");
+
+    // Потоковое извлечение: страницы передаются обработчику по мере готовности,
+    // текст документа целиком не накапливается. Пустая строка - успех, иначе сообщение об ошибке
+    std::string extractPages(const std::string& pdfPath, const PageCallback& onPage,
+        const std::string& profileName = "");
+
+    // Извлечение из PDF в памяти (содержимое архива, поток, отображенный файл).
+    // Данные не копируются; name используется в сообщениях и для выбора профиля
+    std::string extractText(std::shared_ptr<MemoryBuffer> data, const std::string& name,
+        const std::string& profileName = "");
+    std::string extractPages(std::shared_ptr<MemoryBuffer> data, const std::string& name,
+        const PageCallback& onPage, const std::string& profileName = "");
+
+    // Постраничный API для конвейера загрузки: страницы одного документа
+    // можно рендерить и распознавать из разных потоков
+
+    // Открытый документ
+    struct DocumentHandle;
+
+    // Страница после рендеринга: готовый текст либо изображение, которое нужно распознать
+    struct RenderedPage {
+        int pageNumber = 0;          // номер страницы (с 1)
+        std::string text;            // текстовый слой или текст из кэша
+        Pix* image = nullptr;        // изображение для OCR (освобождается в recognizePage)
+        uint64_t fingerprint = 0;    // отпечаток страницы для кэша
+        bool failed = false;         // страницу не удалось загрузить
+    };
+
+    // Открытие документа: чтение файла, поиск в кэше, разбор PDF (nullptr и текст ошибки при неудаче)
+    std::shared_ptr<DocumentHandle> openDocument(const std::string& pdfPath, const std::string& profileName,
+        std::string& error);
+
+    // Открытие документа из буфера в памяти (буфер удерживается до закрытия документа)
+    std::shared_ptr<DocumentHandle> openDocument(std::shared_ptr<MemoryBuffer> data, const std::string& name,
+        const std::string& profileName, std::string& error);
+
+    // Количество страниц документа
+    static int getPageCount(const DocumentHandle& doc);
+
+    // Страницы документа, целиком найденного в кэше (пусто, если документа в кэше нет)
+    static std::vector<std::string> takeCachedPages(DocumentHandle& doc);
+
+    // Рендеринг страницы (индекс с 0): текстовые страницы сразу получают текст
+    RenderedPage renderPage(DocumentHandle& doc, int pageIndex);
+
+    // Распознавание отрендеренной страницы
+    void recognizePage(DocumentHandle& doc, RenderedPage& page);
+
+    // Освобождение изображения страницы, которую не будут распознавать
+    static void releasePage(RenderedPage& page);
+
+    // Оценка памяти, которая понадобится на рендеринг и OCR страницы (индекс с 0)
+    size_t estimatePageMemory(DocumentHandle& doc, int pageIndex);
+
+    // Завершение документа: запись в кэш и освобождение ресурсов
+    void closeDocument(DocumentHandle& doc);
+
+    // Регистрация профиля OCR (встроенные: fast, standard, best)
+    void addProfile(const OCRProfile& profile);
+
+    // Профиль для файлов, не подпавших ни под одно правило
+    bool setDefaultProfile(const std::string& profileName);
+
+    // Правило: все файлы внутри каталога распознаются указанным профилем
+    bool addDirectoryRule(const std::string& directory, const std::string& profileName);
+
+    // Имя профиля, который будет применен к файлу
+    std::string resolveProfileName(const std::string& pdfPath) const;
+
+    // Постоянный кэш извлеченного текста (пустой путь - отключить)
+    void setCacheDirectory(const std::string& directory);
+
+    // Общий пул потоков (с поиском): блоки больших страниц распознаются в нем фоновыми
+    // задачами и уступают очередь запросам. Без общего пула - свои потоки
+    void setThreadPool(std::shared_ptr<ThreadPool> pool);
+
+    // Порог площади страницы (в пикселях при рендеринге), начиная с которого
+    // блоки страницы распознаются параллельно несколькими движками
+    void setLargePageThreshold(size_t pixels);
+    size_t getLargePageThreshold() const;
+
+    // Порог по умолчанию: ~24 мегапикселя (газетная полоса при 300 DPI)
+    static constexpr size_t DEFAULT_LARGE_PAGE_PIXELS = 24000000;
+
+    // Предварительное определение письменности и ориентации страницы (Tesseract OSD).
+    // Позволяет распознавать одноязычные страницы одной моделью и разворачивать сканы
+    void setScriptDetection(bool enabled);
+    bool isScriptDetectionEnabled() const;
+
+    // Языки, если письменность определить не удалось
+    static constexpr const char* DEFAULT_OCR_LANGUAGES = "rus+eng";
+
+    // Экономный режим для огромных PDF: документ Poppler периодически открывается заново
+    // (сбрасываются его внутренние кэши), прочитанные части отображенного файла выгружаются
+    void setLowMemoryMode(bool enabled);
+    bool isLowMemoryMode() const;
+
+    // Разрешение рендеринга страниц для OCR
+    static constexpr int OCR_DPI = 300;
 
 private:
-    //   
+    // Проверка существования файла
     bool fileExists(const std::string& filePath);
 
-    //  OCR 
+    // Инициализация OCR движка
     void initOCR();
 
-    //     PDF
+    // Извлечение из открытого документа: текст целиком и постранично
+    std::string extractDocumentText(const std::shared_ptr<DocumentHandle>& doc);
+    std::string extractDocumentPages(const std::shared_ptr<DocumentHandle>& doc, const PageCallback& onPage);
+
+    // Извлечение текста из страницы PDF
     std::string extractTextFromPage(poppler::page* page);
 
-    // ,    
+    // Строка настроек, от которых зависит извлеченный текст (часть ключа кэша)
+    std::string extractionSignature(const OCRProfile& profile) const;
+
+    // Отпечаток отсканированной страницы по миниатюре (0 при ошибке)
+    uint64_t scannedPageFingerprint(poppler::page* page, uint64_t seed);
+
+    // Проверка, является ли страница сканом
     bool isScannedPage(poppler::page* page);
 
-    //       OCR
-    std::string extractTextWithOCR(poppler::page* page);
+    // Извлечение текста из скана с помощью OCR (изображение освобождается)
+    std::string extractTextWithOCR(Pix* pixImage, const OCRProfile& profile);
+
+    // Запоминание отпечатка обработанной страницы для записи документа в кэш
+    void recordPageFingerprint(DocumentHandle& doc, const RenderedPage& page);
+
+    // Результат предварительного анализа страницы
+    struct PageScript {
+        std::string languages;  // минимальный набор языков для OCR
+        int rotation;           // поворот скана по часовой стрелке (0, 90, 180, 270)
+    };
+
+    // Определение письменности и ориентации по уменьшенному изображению
+    PageScript detectPageScript(Pix* pixImage);
 
-    //   PDF    OCR
-    Pix* renderPageToImage(poppler::page* page, int dpi = 300);
+    // Распознавание всего изображения одним движком
+    std::string recognizeImage(Pix* pixImage, const OCRProfile& profile, const std::string& languages);
 
-    //  poppler::ustring  std::string
+    // Параллельное распознавание блоков большой страницы:
+    // анализ разметки выполняется один раз, блоки распознаются в пуле движков.
+    // Изображение страницы освобождается сразу после вырезания блоков
+    std::string recognizeLargeImage(Pix*& pixImage, const OCRProfile& profile, const std::string& languages);
+
+    // Рендеринг страницы PDF в изображение для OCR
+    Pix* renderPageToImage(poppler::page* page, int dpi = OCR_DPI);
+
+    // Преобразование poppler::ustring в std::string
     std::string ustringToString(const poppler::ustring& ustr);
 
-    // OCR 
-    std::unique_ptr<tesseract::TessBaseAPI> tessApi;
+    // Пул OCR движков
+    std::unique_ptr<OCREnginePool> ocrPool;
+
+    // Пул движков OSD - отдельный: определение письменности на каждой странице
+    // не должно вытеснять из лимита ocrPool движки языков с загруженными моделями LSTM
+    std::unique_ptr<OCREnginePool> osdPool;
+
+    // Потоки для параллельного распознавания блоков
+    std::shared_ptr<ThreadPool> ocrWorkers;
+
+    // Порог включения параллельного режима
+    size_t largePageThreshold;
+
+    // Включено ли определение письменности
+    bool scriptDetection;
+
+    // Экономный режим
+    bool lowMemoryMode;
+
+    // Зарегистрированные профили OCR
+    std::map<std::string, OCRProfile> profiles;
+
+    // Профиль по умолчанию
+    std::string defaultProfile;
+
+    // Правила выбора профиля: каталог -> имя профиля
+    std::vector<std::pair<std::string, std::string>> directoryRules;
+
+    // Кэш извлеченного текста
+    std::unique_ptr<ExtractionCache> cache;
 };
\ No newline at end of file
@@ -0,0 +1,366 @@
+﻿// QuantizedIndex.cpp
+#include "QuantizedIndex.h"
+#include "VectorKernels.h"
+#include <algorithm>
+#include <queue>
+#include <random>
+#include <chrono>
+#include <cstring>
+#include <cmath>
+
+namespace {
+    // Квантование в int8: множитель по максимальной компоненте, коды в [-127, 127]
+    float quantize(const std::vector<float>& vector, int8_t* code) {
+        float maxAbs = 0.0f;
+        for (float value : vector) {
+            maxAbs = std::max(maxAbs, std::fabs(value));
+        }
+
+        float scale = maxAbs > 0.0f ? maxAbs / 127.0f : 1.0f;
+        for (size_t i = 0; i < vector.size(); ++i) {
+            long rounded = std::lround(vector[i] / scale);
+            code[i] = static_cast<int8_t>(std::clamp(rounded, -127L, 127L));
+        }
+        return scale;
+    }
+
+    // Двоичный код: бит на знак компоненты
+    void binarize(const std::vector<float>& vector, uint64_t* code, size_t words) {
+        std::fill(code, code + words, 0);
+        for (size_t i = 0; i < vector.size(); ++i) {
+            if (vector[i] > 0.0f) {
+                code[i / 64] |= uint64_t(1) << (i % 64);
+            }
+        }
+    }
+}
+
+QuantizedIndex::QuantizedIndex(size_t dimension, VectorStorage storage, const std::string& directory,
+    size_t rerankCandidates)
+    : dimension(dimension), storage(storage), words((dimension + 63) / 64),
+    rerankCandidates(std::max<size_t>(1, rerankCandidates)),
+    vectorFile(std::make_unique<SpillFile>(directory)) {
+}
+
+void QuantizedIndex::encode(const std::vector<float>& vector, uint32_t slot) {
+    if (storage == VectorStorage::Binary) {
+        binarize(vector, binaryCodes.data() + static_cast<size_t>(slot) * words, words);
+        return;
+    }
+
+    int8_t* code = int8Codes.data() + static_cast<size_t>(slot) * dimension;
+    scales[slot] = quantize(vector, code);
+
+    int32_t sum = 0;
+    for (size_t i = 0; i < dimension; ++i) {
+        sum += code[i];
+    }
+    codeSums[slot] = sum;
+}
+
+void QuantizedIndex::insert(Label label, const std::vector<float>& vector) {
+    if (vector.size() != dimension) {
+        return;
+    }
+
+    std::vector<float> normalized = vector;
+    normalize(normalized);
+
+    // Полный вектор - в файл, до монопольной блокировки
+    std::string bytes(reinterpret_cast<const char*>(normalized.data()), normalized.size() * sizeof(float));
+    SpillFile::Segment segment;
+    if (!vectorFile->write(bytes, segment)) {
+        return;
+    }
+
+    std::unique_lock<std::shared_mutex> lock(mtx);
+
+    auto it = labels.find(label);
+    if (it != labels.end()) {
+        releaseSlot(it->second);
+        labels.erase(it);
+    }
+
+    uint32_t slot = 0;
+    if (!freeSlots.empty()) {
+        slot = freeSlots.back();
+        freeSlots.pop_back();
+    }
+    else {
+        slot = static_cast<uint32_t>(slotLabels.size());
+        slotLabels.push_back(0);
+        slotLive.push_back(0);
+        fullVectors.emplace_back();
+
+        if (storage == VectorStorage::Binary) {
+            binaryCodes.resize(binaryCodes.size() + words);
+        }
+        else {
+            int8Codes.resize(int8Codes.size() + dimension);
+            scales.push_back(0.0f);
+            codeSums.push_back(0);
+        }
+    }
+
+    encode(normalized, slot);
+    slotLabels[slot] = label;
+    slotLive[slot] = 1;
+    fullVectors[slot] = segment;
+    labels[label] = slot;
+}
+
+void QuantizedIndex::releaseSlot(uint32_t slot) {
+    slotLive[slot] = 0;
+    freeSlots.push_back(slot);
+}
+
+void QuantizedIndex::remove(Label label) {
+    std::unique_lock<std::shared_mutex> lock(mtx);
+
+    auto it = labels.find(label);
+    if (it == labels.end()) {
+        return;
+    }
+
+    releaseSlot(it->second);
+    labels.erase(it);
+}
+
+bool QuantizedIndex::getVector(Label label, std::vector<float>& vector) const {
+    std::shared_lock<std::shared_mutex> lock(mtx);
+
+    auto it = labels.find(label);
+    return it != labels.end() && loadVector(it->second, vector);
+}
+
+std::vector<QuantizedIndex::Candidate> QuantizedIndex::scanCodes(const std::vector<float>& query, size_t count) const {
+    // Мин-куча лучших: в вершине - порог входа
+    std::priority_queue<Candidate, std::vector<Candidate>, std::greater<Candidate>> best;
+    auto offer = [&best, count](float score, uint32_t slot) {
+        if (best.size() < count) {
+            best.push({ score, slot });
+        }
+        else if (score > best.top().score) {
+            best.pop();
+            best.push({ score, slot });
+        }
+    };
+
+    const uint32_t slotCount = static_cast<uint32_t>(slotLabels.size());
+
+    if (storage == VectorStorage::Binary) {
+        std::vector<uint64_t> queryCode(words);
+        binarize(query, queryCode.data(), words);
+
+        // Доля совпавших знаков переводится в оценку близости из [-1, 1]
+        const float scale = 2.0f / static_cast<float>(dimension);
+        for (uint32_t slot = 0; slot < slotCount; ++slot) {
+            if (slotLive[slot]) {
+                uint32_t distance = VectorKernels::hamming(queryCode.data(), binaryCodes.data() + static_cast<size_t>(slot) * words, words);
+                offer(1.0f - scale * distance, slot);
+            }
+        }
+    }
+    else {
+        std::vector<int8_t> queryCode(dimension);
+        const float queryScale = quantize(query, queryCode.data());
+
+        if (VectorKernels::preferUnsignedDot()) {
+            // VNNI умножает беззнаковое на знаковое: запрос смещается на 128,
+            // смещение вычитается через сумму кода записи
+            std::vector<uint8_t> shifted(dimension);
+            for (size_t i = 0; i < dimension; ++i) {
+                shifted[i] = static_cast<uint8_t>(queryCode[i] + 128);
+            }
+
+            for (uint32_t slot = 0; slot < slotCount; ++slot) {
+                if (slotLive[slot]) {
+                    int32_t dot = VectorKernels::dotUint8Int8(shifted.data(), int8Codes.data() + static_cast<size_t>(slot) * dimension, dimension)
+                        - 128 * codeSums[slot];
+                    offer(queryScale * scales[slot] * dot, slot);
+                }
+            }
+        }
+        else {
+            for (uint32_t slot = 0; slot < slotCount; ++slot) {
+                if (slotLive[slot]) {
+                    int32_t dot = VectorKernels::dotInt8(queryCode.data(), int8Codes.data() + static_cast<size_t>(slot) * dimension, dimension);
+                    offer(queryScale * scales[slot] * dot, slot);
+                }
+            }
+        }
+    }
+
+    std::vector<Candidate> result(best.size());
+    for (size_t i = result.size(); i-- > 0;) {
+        result[i] = best.top();
+        best.pop();
+    }
+    return result;
+}
+
+bool QuantizedIndex::loadVector(uint32_t slot, std::vector<float>& vector) const {
+    std::string bytes;
+    if (!vectorFile->read(fullVectors[slot], bytes) || bytes.size() != dimension * sizeof(float)) {
+        return false;
+    }
+
+    vector.resize(dimension);
+    std::memcpy(vector.data(), bytes.data(), bytes.size());
+    return true;
+}
+
+std::vector<QuantizedIndex::Neighbor> QuantizedIndex::search(const std::vector<float>& query, size_t k) const {
+    std::vector<Neighbor> result;
+    if (query.size() != dimension || k == 0) {
+        return result;
+    }
+
+    std::vector<float> normalized = query;
+    normalize(normalized);
+
+    std::shared_lock<std::shared_mutex> lock(mtx);
+
+    // Первый проход по кодам, второй - точная близость лучших кандидатов
+    std::vector<Candidate> candidates = scanCodes(normalized, std::max(k, rerankCandidates.load()));
+
+    std::vector<float> vector;
+    for (const Candidate& candidate : candidates) {
+        float similarity = candidate.score;
+        if (loadVector(candidate.slot, vector)) {
+            similarity = VectorKernels::dotFloat(normalized.data(), vector.data(), dimension);
+        }
+        result.push_back({ slotLabels[candidate.slot], similarity });
+    }
+
+    std::sort(result.begin(), result.end(), [](const Neighbor& a, const Neighbor& b) {
+        return a.similarity > b.similarity;
+    });
+    if (result.size() > k) {
+        result.resize(k);
+    }
+    return result;
+}
+
+RecallStats QuantizedIndex::measureRecall(size_t queryCount, size_t k) const {
+    RecallStats stats;
+
+    // Запросы - случайные сохраненные векторы
+    std::vector<std::vector<float>> queries;
+    {
+        std::shared_lock<std::shared_mutex> lock(mtx);
+        if (labels.empty()) {
+            return stats;
+        }
+
+        std::mt19937 sampler(12345);
+        std::uniform_int_distribution<uint32_t> pick(0, static_cast<uint32_t>(slotLabels.size() - 1));
+        std::vector<float> vector;
+
+        for (size_t attempt = 0; queries.size() < queryCount && attempt < queryCount * 10; ++attempt) {
+            uint32_t slot = pick(sampler);
+            if (slotLive[slot] && loadVector(slot, vector)) {
+                queries.push_back(vector);
+            }
+        }
+    }
+
+    if (queries.empty()) {
+        return stats;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::vector<Neighbor>> approximate;
+    for (const auto& query : queries) {
+        approximate.push_back(search(query, k));
+    }
+    auto middle = std::chrono::steady_clock::now();
+
+    // Точный перебор float32 всех записей за один проход по файлу для всех запросов
+    using Scored = std::pair<float, Label>;
+    std::vector<std::priority_queue<Scored, std::vector<Scored>, std::greater<Scored>>> exact(queries.size());
+    {
+        std::shared_lock<std::shared_mutex> lock(mtx);
+        std::vector<float> vector;
+
+        for (uint32_t slot = 0; slot < slotLabels.size(); ++slot) {
+            if (!slotLive[slot] || !loadVector(slot, vector)) {
+                continue;
+            }
+
+            for (size_t q = 0; q < queries.size(); ++q) {
+                float similarity = VectorKernels::dotFloat(queries[q].data(), vector.data(), dimension);
+                if (exact[q].size() < k) {
+                    exact[q].push({ similarity, slotLabels[slot] });
+                }
+                else if (similarity > exact[q].top().first) {
+                    exact[q].pop();
+                    exact[q].push({ similarity, slotLabels[slot] });
+                }
+            }
+        }
+    }
+    auto end = std::chrono::steady_clock::now();
+
+    size_t found = 0;
+    size_t expected = 0;
+    for (size_t q = 0; q < queries.size(); ++q) {
+        while (!exact[q].empty()) {
+            Label label = exact[q].top().second;
+            exact[q].pop();
+
+            bool hit = std::any_of(approximate[q].begin(), approximate[q].end(),
+                [label](const Neighbor& neighbor) { return neighbor.label == label; });
+            found += hit ? 1 : 0;
+            expected++;
+        }
+    }
+
+    stats.queries = queries.size();
+    stats.recall = expected > 0 ? static_cast<double>(found) / expected : 0.0;
+    stats.searchMs = std::chrono::duration<double, std::milli>(middle - start).count() / stats.queries;
+    stats.exactMs = std::chrono::duration<double, std::milli>(end - middle).count() / stats.queries;
+    return stats;
+}
+
+void QuantizedIndex::setSearchWidth(size_t candidates) {
+    rerankCandidates = std::max<size_t>(1, candidates);
+}
+
+size_t QuantizedIndex::getSearchWidth() const {
+    return rerankCandidates;
+}
+
+size_t QuantizedIndex::getDimension() const {
+    return dimension;
+}
+
+size_t QuantizedIndex::size() const {
+    std::shared_lock<std::shared_mutex> lock(mtx);
+    return labels.size();
+}
+
+size_t QuantizedIndex::getDeletedCount() const {
+    std::shared_lock<std::shared_mutex> lock(mtx);
+    return freeSlots.size();
+}
+
+size_t QuantizedIndex::getMemoryUsage() const {
+    std::shared_lock<std::shared_mutex> lock(mtx);
+
+    size_t codes = int8Codes.capacity() + scales.capacity() * sizeof(float) + codeSums.capacity() * sizeof(int32_t)
+        + binaryCodes.capacity() * sizeof(uint64_t);
+    size_t slots = slotLabels.capacity() * sizeof(Label) + slotLive.capacity()
+        + fullVectors.capacity() * sizeof(SpillFile::Segment) + freeSlots.capacity() * sizeof(uint32_t);
+
+    // Узел словаря меток: ключ, значение, связь и ячейка корзины
+    size_t labelMap = labels.size() * (sizeof(Label) + sizeof(uint32_t) + 2 * sizeof(void*))
+        + labels.bucket_count() * sizeof(void*);
+
+    return codes + slots + labelMap;
+}
+
+std::string QuantizedIndex::describe() const {
+    std::string codes = storage == VectorStorage::Binary ? "binary codes (Hamming)" : "int8 codes";
+    return codes + " + float32 rerank from disk, " + VectorKernels::getInstructionSet();
+}
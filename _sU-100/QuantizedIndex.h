@@ -0,0 +1,85 @@
+﻿// QuantizedIndex.h
+#pragma once
+
+#include <vector>
+#include <string>
+#include <memory>
+#include <atomic>
+#include <shared_mutex>
+#include <unordered_map>
+#include "VectorIndex.h"
+#include "SpillFile.h"
+
+// Индекс квантованных эмбеддингов: в памяти только компактные коды (int8 - байт на измерение,
+// двоичные - бит на измерение), векторы float32 лежат в файле. Поиск в два прохода:
+// перебор всех кодов ядрами SIMD и уточнение лучших кандидатов по float32
+class QuantizedIndex : public VectorIndex {
+public:
+    // storage - Int8 или Binary; directory - каталог файла векторов float32 (пустой - временный каталог)
+    QuantizedIndex(size_t dimension, VectorStorage storage, const std::string& directory = "",
+        size_t rerankCandidates = 100);
+
+    QuantizedIndex(const QuantizedIndex&) = delete;
+    QuantizedIndex& operator=(const QuantizedIndex&) = delete;
+
+    void insert(Label label, const std::vector<float>& vector) override;
+    void remove(Label label) override;
+    bool getVector(Label label, std::vector<float>& vector) const override;
+    std::vector<Neighbor> search(const std::vector<float>& query, size_t k) const override;
+
+    // Полнота относительно точного перебора float32
+    RecallStats measureRecall(size_t queryCount, size_t k) const override;
+
+    // Число кандидатов первого прохода, уточняемых по float32
+    void setSearchWidth(size_t candidates) override;
+    size_t getSearchWidth() const override;
+
+    size_t getDimension() const override;
+    size_t size() const override;
+    size_t getDeletedCount() const override;
+    size_t getMemoryUsage() const override;
+    std::string describe() const override;
+
+private:
+    // Кандидат первого прохода: приближенная оценка и запись
+    struct Candidate {
+        float score;
+        uint32_t slot;
+        bool operator>(const Candidate& other) const { return score > other.score; }
+    };
+
+    size_t dimension;
+    VectorStorage storage;
+    size_t words;                         // 64-битных слов в двоичном коде
+    std::atomic<size_t> rerankCandidates;
+
+    // Коды записей подряд
+    std::vector<int8_t> int8Codes;        // dimension байт на запись
+    std::vector<float> scales;            // множитель кода int8
+    std::vector<int32_t> codeSums;        // сумма кода int8 (поправка для VNNI)
+    std::vector<uint64_t> binaryCodes;    // words слов на запись
+
+    // Записи: метка, признак занятости и положение вектора float32 в файле
+    std::vector<Label> slotLabels;
+    std::vector<uint8_t> slotLive;
+    std::vector<SpillFile::Segment> fullVectors;
+    std::vector<uint32_t> freeSlots;
+    std::unordered_map<Label, uint32_t> labels;
+
+    std::unique_ptr<SpillFile> vectorFile;
+
+    // Поиски идут параллельно, вставки и удаления - монопольно
+    mutable std::shared_mutex mtx;
+
+    // Кодирование нормализованного вектора в запись slot
+    void encode(const std::vector<float>& vector, uint32_t slot);
+
+    // Приближенные оценки всех записей, лучшие count кандидатов по убыванию
+    std::vector<Candidate> scanCodes(const std::vector<float>& query, size_t count) const;
+
+    // Чтение вектора float32 записи
+    bool loadVector(uint32_t slot, std::vector<float>& vector) const;
+
+    // Освобождение записи (под монопольной блокировкой)
+    void releaseSlot(uint32_t slot);
+};
@@ -0,0 +1,115 @@
+﻿// QueryCache.cpp
+#include "QueryCache.h"
+#include <algorithm>
+
+namespace {
+    // Служебные данные записи: узел списка, элемент таблицы и копия ключа в ней
+    constexpr size_t ENTRY_OVERHEAD = 128;
+}
+
+QueryCache::QueryCache(size_t capacityBytes)
+    : capacity(capacityBytes), usedBytes(0), generation(0) {
+}
+
+std::string QueryCache::makeKey(std::vector<std::string> terms) {
+    std::sort(terms.begin(), terms.end());
+    terms.erase(std::unique(terms.begin(), terms.end()), terms.end());
+
+    // Термины не содержат пробелов: они и служат разделителем
+    std::string key;
+    for (const auto& term : terms) {
+        if (!key.empty()) {
+            key += ' ';
+        }
+        key += term;
+    }
+    return key;
+}
+
+size_t QueryCache::entryBytes(const Entry& entry) {
+    return 2 * entry.key.size() + entry.context.size() + ENTRY_OVERHEAD;
+}
+
+void QueryCache::advance(uint64_t newer) {
+    if (newer > generation) {
+        entries.clear();
+        index.clear();
+        usedBytes = 0;
+        generation = newer;
+    }
+}
+
+bool QueryCache::find(uint64_t snapshotGeneration, const std::string& key, std::string& context, double& buildMs) {
+    std::lock_guard<std::mutex> lock(mtx);
+    advance(snapshotGeneration);
+
+    auto it = index.find(key);
+    if (snapshotGeneration != generation || it == index.end()) {
+        return false;
+    }
+
+    // Запись становится самой недавней
+    entries.splice(entries.begin(), entries, it->second);
+    context = it->second->context;
+    buildMs = it->second->buildMs;
+    return true;
+}
+
+void QueryCache::insert(uint64_t snapshotGeneration, const std::string& key, const std::string& context,
+    double buildMs) {
+    std::lock_guard<std::mutex> lock(mtx);
+    advance(snapshotGeneration);
+
+    // Контекст устаревшего снимка и контекст больше всего кэша не сохраняются
+    if (snapshotGeneration != generation || capacity == 0 || index.count(key) > 0) {
+        return;
+    }
+
+    Entry entry{ key, context, buildMs };
+    const size_t bytes = entryBytes(entry);
+    if (bytes > capacity) {
+        return;
+    }
+
+    entries.push_front(std::move(entry));
+    index.emplace(key, entries.begin());
+    usedBytes += bytes;
+    evict();
+}
+
+void QueryCache::evict() {
+    while (usedBytes > capacity && !entries.empty()) {
+        const Entry& oldest = entries.back();
+        usedBytes -= entryBytes(oldest);
+        index.erase(oldest.key);
+        entries.pop_back();
+    }
+}
+
+void QueryCache::clear() {
+    std::lock_guard<std::mutex> lock(mtx);
+    entries.clear();
+    index.clear();
+    usedBytes = 0;
+}
+
+void QueryCache::setCapacity(size_t bytes) {
+    std::lock_guard<std::mutex> lock(mtx);
+    capacity = bytes;
+    evict();
+}
+
+size_t QueryCache::getCapacity() const {
+    std::lock_guard<std::mutex> lock(mtx);
+    return capacity;
+}
+
+size_t QueryCache::size() const {
+    std::lock_guard<std::mutex> lock(mtx);
+    return entries.size();
+}
+
+size_t QueryCache::getMemoryUsage() const {
+    std::lock_guard<std::mutex> lock(mtx);
+    return usedBytes;
+}
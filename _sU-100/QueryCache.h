@@ -0,0 +1,66 @@
+﻿// QueryCache.h
+#pragma once
+
+#include <string>
+#include <vector>
+#include <list>
+#include <unordered_map>
+#include <mutex>
+#include <cstdint>
+
+// Кэш готового контекста повторяющихся вопросов (LRU, ограничен по байтам). Ключ - набор
+// терминов запроса (без служебных слов, после стемминга, по порядку), поэтому "Сроки поставки?"
+// и "сроки поставки" - один вопрос. Результат действителен для своей публикации индекса:
+// новый снимок (добавление, удаление документа, слияние) делает все записи устаревшими,
+// и они выбрасываются при первом обращении с новым номером
+class QueryCache {
+public:
+    explicit QueryCache(size_t capacityBytes = 0);
+
+    // Ключ по терминам запроса: сортировка без повторов
+    static std::string makeKey(std::vector<std::string> terms);
+
+    // Контекст по ключу для снимка snapshotGeneration и время, за которое он был собран; false - нет
+    bool find(uint64_t snapshotGeneration, const std::string& key, std::string& context, double& buildMs);
+
+    // Запись контекста, собранного по снимку snapshotGeneration (результат устаревшего снимка не берется)
+    void insert(uint64_t snapshotGeneration, const std::string& key, const std::string& context, double buildMs);
+
+    // Удаление всех записей (изменились параметры сборки контекста)
+    void clear();
+
+    // Емкость в байтах (0 - кэш выключен)
+    void setCapacity(size_t bytes);
+    size_t getCapacity() const;
+
+    // Число записей и занятые байты
+    size_t size() const;
+    size_t getMemoryUsage() const;
+
+private:
+    struct Entry {
+        std::string key;
+        std::string context;
+        double buildMs;
+    };
+
+    // Записи от недавно использованных к давним
+    std::list<Entry> entries;
+    std::unordered_map<std::string, std::list<Entry>::iterator> index;
+
+    size_t capacity;
+    size_t usedBytes;
+    uint64_t generation;
+
+    // Запросы идут параллельно
+    mutable std::mutex mtx;
+
+    // Байты записи вместе с узлами списка и таблицы
+    static size_t entryBytes(const Entry& entry);
+
+    // Выбрасывание давних записей, пока занято больше емкости
+    void evict();
+
+    // Переход на снимок newer: записи прежних снимков выбрасываются
+    void advance(uint64_t newer);
+};
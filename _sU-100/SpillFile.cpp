@@ -0,0 +1,140 @@
+﻿// SpillFile.cpp
+#include "SpillFile.h"
+#include <iostream>
+#include <filesystem>
+#include <atomic>
+#include <chrono>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#endif
+
+namespace fs = std::filesystem;
+
+SpillFile::SpillFile(const std::string& directory)
+    : written(0) {
+    static std::atomic<unsigned> counter{ 0 };
+
+    std::error_code ec;
+    fs::path dir = directory.empty() ? fs::temp_directory_path(ec) : fs::path(directory);
+    fs::create_directories(dir, ec);
+
+    // Уникальное имя: время запуска и порядковый номер
+    auto stamp = std::chrono::steady_clock::now().time_since_epoch().count();
+    path = (dir / ("spill-" + std::to_string(stamp) + "-" + std::to_string(counter++) + ".seg")).string();
+
+#ifdef _WIN32
+    // Асинхронный дескриптор: операции с явным смещением не выстраиваются в очередь к позиции файла
+    HANDLE handle = CreateFileA(path.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_DELETE,
+        nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_TEMPORARY | FILE_FLAG_OVERLAPPED, nullptr);
+    file = handle == INVALID_HANDLE_VALUE ? nullptr : handle;
+#else
+    file = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0600);
+#endif
+    if (!isOpen()) {
+        std::cerr << "Warning: Failed to create spill file: " << path << std::endl;
+    }
+}
+
+SpillFile::~SpillFile() {
+    if (isOpen()) {
+#ifdef _WIN32
+        CloseHandle(file);
+#else
+        ::close(file);
+#endif
+    }
+
+    std::error_code ec;
+    fs::remove(path, ec);
+}
+
+bool SpillFile::isOpen() const {
+#ifdef _WIN32
+    return file != nullptr;
+#else
+    return file >= 0;
+#endif
+}
+
+namespace {
+#ifdef _WIN32
+    // Наибольшая часть одной операции ReadFile/WriteFile
+    constexpr size_t MAX_TRANSFER = 1u << 30;
+
+    // Чтение или запись length байт со смещения offset: ожидание своей операции по своему событию
+    bool transfer(void* file, bool writing, char* data, size_t length, uint64_t offset) {
+        HANDLE event = CreateEventA(nullptr, TRUE, FALSE, nullptr);
+        if (!event) {
+            return false;
+        }
+
+        bool ok = true;
+        while (ok && length > 0) {
+            OVERLAPPED overlapped = {};
+            overlapped.Offset = static_cast<DWORD>(offset);
+            overlapped.OffsetHigh = static_cast<DWORD>(offset >> 32);
+            overlapped.hEvent = event;
+
+            const DWORD part = static_cast<DWORD>(length > MAX_TRANSFER ? MAX_TRANSFER : length);
+            DWORD done = 0;
+            BOOL started = writing ? WriteFile(file, data, part, nullptr, &overlapped)
+                : ReadFile(file, data, part, nullptr, &overlapped);
+            ok = (started || GetLastError() == ERROR_IO_PENDING)
+                && GetOverlappedResult(file, &overlapped, &done, TRUE) && done > 0;
+
+            data += done;
+            length -= done;
+            offset += done;
+        }
+
+        CloseHandle(event);
+        return ok;
+    }
+#else
+    bool transfer(int file, bool writing, char* data, size_t length, uint64_t offset) {
+        while (length > 0) {
+            ssize_t done = writing ? ::pwrite(file, data, length, static_cast<off_t>(offset))
+                : ::pread(file, data, length, static_cast<off_t>(offset));
+            if (done < 0 && errno == EINTR) {
+                continue;
+            }
+            if (done <= 0) {
+                return false;
+            }
+
+            data += done;
+            length -= static_cast<size_t>(done);
+            offset += static_cast<uint64_t>(done);
+        }
+        return true;
+    }
+#endif
+}
+
+bool SpillFile::write(const std::string& text, Segment& segment) {
+    std::lock_guard<std::mutex> lock(mtx);
+
+    if (!isOpen() || !transfer(file, true, const_cast<char*>(text.data()), text.size(), written)) {
+        return false;
+    }
+
+    segment.offset = written;
+    segment.length = text.size();
+    written += text.size();
+    return true;
+}
+
+bool SpillFile::read(const Segment& segment, std::string& text) const {
+    text.resize(segment.length);
+    return isOpen() && transfer(file, false, &text[0], segment.length, segment.offset);
+}
+
+uint64_t SpillFile::size() const {
+    std::lock_guard<std::mutex> lock(mtx);
+    return written;
+}
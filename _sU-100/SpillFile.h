@@ -0,0 +1,49 @@
+﻿// SpillFile.h
+#pragma once
+
+#include <string>
+#include <mutex>
+#include <cstdint>
+
+// Временный файл-сегмент для данных, которые не помещаются в бюджет памяти (текст, векторы).
+// Записи дописываются в конец, читаются по смещению; файл удаляется в деструкторе.
+// Чтение позиционное (pread, ReadFile с OVERLAPPED) и без блокировки: потоки запросов
+// читают векторы для уточнения оценок параллельно
+class SpillFile {
+public:
+    // Положение записи в файле
+    struct Segment {
+        uint64_t offset = 0;
+        size_t length = 0;
+    };
+
+    // directory - каталог для временного файла (пустой - системный временный каталог)
+    explicit SpillFile(const std::string& directory = "");
+    ~SpillFile();
+
+    SpillFile(const SpillFile&) = delete;
+    SpillFile& operator=(const SpillFile&) = delete;
+
+    // Запись текста; false при ошибке ввода-вывода
+    bool write(const std::string& text, Segment& segment);
+
+    // Чтение ранее записанного текста; можно из нескольких потоков одновременно
+    bool read(const Segment& segment, std::string& text) const;
+
+    // Объем записанных данных
+    uint64_t size() const;
+
+private:
+    std::string path;
+#ifdef _WIN32
+    void* file;
+#else
+    int file;
+#endif
+    uint64_t written;
+
+    // Дописывание в конец по одной записи
+    mutable std::mutex mtx;
+
+    bool isOpen() const;
+};
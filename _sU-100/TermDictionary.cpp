@@ -0,0 +1,98 @@
+﻿// TermDictionary.cpp
+#include "TermDictionary.h"
+
+namespace {
+    // Начальный размер таблицы (степень двойки)
+    constexpr size_t INITIAL_SLOTS = 1024;
+}
+
+uint32_t TermDictionary::hash(std::string_view term) {
+    // FNV-1a
+    uint32_t value = 2166136261u;
+    for (char ch : term) {
+        value ^= static_cast<unsigned char>(ch);
+        value *= 16777619u;
+    }
+    return value;
+}
+
+size_t TermDictionary::findSlot(std::string_view term, uint32_t termHash) const {
+    const size_t mask = slots.size() - 1;
+    size_t slot = termHash & mask;
+
+    // Линейное пробирование: таблица заполнена не больше чем наполовину
+    while (slots[slot] != INVALID_TERM) {
+        TermId id = slots[slot];
+        if (hashes[id] == termHash && getTerm(id) == term) {
+            return slot;
+        }
+        slot = (slot + 1) & mask;
+    }
+    return slot;
+}
+
+TermDictionary::TermId TermDictionary::find(std::string_view term) const {
+    if (slots.empty()) {
+        return INVALID_TERM;
+    }
+    return slots[findSlot(term, hash(term))];
+}
+
+TermDictionary::TermId TermDictionary::intern(std::string_view term) {
+    if (slots.empty()) {
+        slots.assign(INITIAL_SLOTS, INVALID_TERM);
+        offsets.push_back(0);
+    }
+
+    uint32_t termHash = hash(term);
+    size_t slot = findSlot(term, termHash);
+    if (slots[slot] != INVALID_TERM) {
+        return slots[slot];
+    }
+
+    TermId id = static_cast<TermId>(hashes.size());
+    text.insert(text.end(), term.begin(), term.end());
+    offsets.push_back(static_cast<uint32_t>(text.size()));
+    hashes.push_back(termHash);
+    slots[slot] = id;
+
+    if (hashes.size() * 2 > slots.size()) {
+        grow();
+    }
+    return id;
+}
+
+void TermDictionary::grow() {
+    std::vector<TermId> larger(slots.size() * 2, INVALID_TERM);
+    const size_t mask = larger.size() - 1;
+
+    for (TermId id = 0; id < hashes.size(); ++id) {
+        size_t slot = hashes[id] & mask;
+        while (larger[slot] != INVALID_TERM) {
+            slot = (slot + 1) & mask;
+        }
+        larger[slot] = id;
+    }
+
+    slots.swap(larger);
+}
+
+std::string_view TermDictionary::getTerm(TermId id) const {
+    return std::string_view(text.data() + offsets[id], offsets[id + 1] - offsets[id]);
+}
+
+size_t TermDictionary::size() const {
+    return hashes.size();
+}
+
+size_t TermDictionary::getMemoryUsage() const {
+    return text.capacity() + offsets.capacity() * sizeof(uint32_t) + hashes.capacity() * sizeof(uint32_t)
+        + slots.capacity() * sizeof(TermId);
+}
+
+void TermDictionary::clear() {
+    text.clear();
+    offsets.clear();
+    hashes.clear();
+    slots.clear();
+}
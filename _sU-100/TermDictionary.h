@@ -0,0 +1,47 @@
+﻿// TermDictionary.h
+#pragma once
+
+#include <string_view>
+#include <vector>
+#include <cstdint>
+
+// Словарь терминов: каждому термину выдается 32-битный идентификатор.
+// Строки терминов лежат подряд в одном буфере, хеш-таблица с открытой адресацией
+// хранит только идентификаторы, поэтому термин не требует отдельного выделения памяти
+class TermDictionary {
+public:
+    using TermId = uint32_t;
+
+    static constexpr TermId INVALID_TERM = UINT32_MAX;
+
+    // Идентификатор термина; новый термин добавляется в словарь
+    TermId intern(std::string_view term);
+
+    // Идентификатор термина или INVALID_TERM, если его нет в словаре
+    TermId find(std::string_view term) const;
+
+    // Строка термина по идентификатору
+    std::string_view getTerm(TermId id) const;
+
+    // Количество терминов
+    size_t size() const;
+
+    // Занимаемая память в байтах
+    size_t getMemoryUsage() const;
+
+    void clear();
+
+private:
+    std::vector<char> text;          // строки терминов подряд
+    std::vector<uint32_t> offsets;   // начало строки термина; последний элемент - конец буфера
+    std::vector<uint32_t> hashes;    // хеш термина: быстрое сравнение и перестройка таблицы без строк
+    std::vector<TermId> slots;       // хеш-таблица: идентификатор или INVALID_TERM
+
+    static uint32_t hash(std::string_view term);
+
+    // Ячейка термина или первая свободная ячейка на пути поиска
+    size_t findSlot(std::string_view term, uint32_t termHash) const;
+
+    // Удвоение таблицы
+    void grow();
+};
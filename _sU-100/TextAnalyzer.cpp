@@ -0,0 +1,850 @@
+﻿// TextAnalyzer.cpp
+#include "TextAnalyzer.h"
+#include <unordered_set>
+#include <cstring>
+#include <cstdint>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define TEXT_ANALYZER_SSE2 1
+#include <emmintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#endif
+
+namespace {
+    // Символы, которые удаляются без разделения слова: мягкий перенос, пробелы нулевой ширины, BOM
+    constexpr uint16_t IGNORED = 0xFFFF;
+
+    // Слова длиннее не стеммируются
+    constexpr size_t MAX_STEM_LENGTH = 64;
+
+    // Приведение регистра латиницы (ASCII, Latin-1, Latin Extended-A) и кириллицы; ё -> е
+    uint32_t foldCase(uint32_t cp) {
+        if (cp >= 'A' && cp <= 'Z') {
+            return cp + 0x20;
+        }
+        if (cp >= 0xC0 && cp <= 0xDE && cp != 0xD7) {
+            return cp + 0x20;
+        }
+        if (cp >= 0x100 && cp <= 0x17F) {
+            if (cp == 0x178) {
+                return 0xFF;
+            }
+            if (cp == 0x130 || cp == 0x131 || cp == 0x138 || cp == 0x149 || cp == 0x17F) {
+                return cp;
+            }
+            // Пары "прописная - строчная": до U+0138 и после U+0149 прописная четная
+            bool evenUpper = cp < 0x138 || (cp > 0x149 && cp < 0x178);
+            bool upper = evenUpper ? (cp % 2 == 0) : (cp % 2 == 1);
+            return upper ? cp + 1 : cp;
+        }
+        if (cp >= 0x400 && cp <= 0x40F) {
+            cp += 0x50;
+        }
+        else if (cp >= 0x410 && cp <= 0x42F) {
+            cp += 0x20;
+        }
+        else if ((cp >= 0x460 && cp <= 0x481) || (cp >= 0x48A && cp <= 0x4BF) || (cp >= 0x4D0 && cp <= 0x4FF)) {
+            return cp % 2 == 0 ? cp + 1 : cp;
+        }
+        else if (cp >= 0x4C1 && cp <= 0x4CE) {
+            return cp % 2 == 1 ? cp + 1 : cp;
+        }
+        else if (cp == 0x4C0) {
+            return 0x4CF;
+        }
+        return cp == 0x451 ? 0x435 : cp;
+    }
+
+    // Входит ли символ в слово: буквы и цифры; знаки препинания, пробелы и символы - разделители
+    bool isWordChar(uint32_t cp) {
+        if (cp < 0x80) {
+            return (cp >= '0' && cp <= '9') || (cp >= 'a' && cp <= 'z') || (cp >= 'A' && cp <= 'Z');
+        }
+        if (cp < 0xC0) {
+            return cp == 0xAA || cp == 0xB5 || cp == 0xBA;
+        }
+        if (cp == 0xD7 || cp == 0xF7 || cp == 0x37E || cp == 0x387 || (cp >= 0x482 && cp <= 0x489)) {
+            return false;
+        }
+        if ((cp >= 0x2000 && cp <= 0x2BFF) || (cp >= 0x3000 && cp <= 0x303F) || (cp >= 0xFE10 && cp <= 0xFE6F)) {
+            return false;
+        }
+        if ((cp >= 0xFF00 && cp <= 0xFF0F) || (cp >= 0xFF1A && cp <= 0xFF20) || (cp >= 0xFF3B && cp <= 0xFF40)
+            || (cp >= 0xFF5B && cp <= 0xFF65) || (cp >= 0xFFF0 && cp <= 0xFFFF)) {
+            return false;
+        }
+        // Эмодзи и пиктограммы
+        return !(cp >= 0x1F000 && cp <= 0x1FAFF);
+    }
+
+    bool isIgnored(uint32_t cp) {
+        return cp == 0xAD || (cp >= 0x200B && cp <= 0x200D) || cp == 0x2060 || cp == 0xFEFF;
+    }
+
+    // Таблицы для однобайтовых и двухбайтовых символов
+    struct CharTables {
+        char ascii[128];              // символ в нижнем регистре или пробел
+        uint16_t twoByte[0x800];      // свернутый символ, 0 - разделитель, IGNORED - удаляется
+
+        CharTables() {
+            for (uint32_t c = 0; c < 128; ++c) {
+                ascii[c] = isWordChar(c) ? static_cast<char>(foldCase(c)) : ' ';
+            }
+            for (uint32_t cp = 0; cp < 0x800; ++cp) {
+                if (cp < 0x80) {
+                    twoByte[cp] = 0;
+                }
+                else if (isIgnored(cp)) {
+                    twoByte[cp] = IGNORED;
+                }
+                else {
+                    twoByte[cp] = isWordChar(cp) ? static_cast<uint16_t>(foldCase(cp)) : 0;
+                }
+            }
+        }
+    };
+
+    const CharTables& charTables() {
+        static const CharTables tables;
+        return tables;
+    }
+
+#ifdef TEXT_ANALYZER_SSE2
+    // 16 символов ASCII: буквы в нижний регистр, цифры как есть, остальное - пробелы
+    __m128i foldAsciiBlock(__m128i block) {
+        const __m128i upper = _mm_and_si128(_mm_cmpgt_epi8(block, _mm_set1_epi8('A' - 1)),
+            _mm_cmplt_epi8(block, _mm_set1_epi8('Z' + 1)));
+        const __m128i lowered = _mm_or_si128(block, _mm_and_si128(upper, _mm_set1_epi8(0x20)));
+
+        const __m128i letter = _mm_and_si128(_mm_cmpgt_epi8(lowered, _mm_set1_epi8('a' - 1)),
+            _mm_cmplt_epi8(lowered, _mm_set1_epi8('z' + 1)));
+        const __m128i digit = _mm_and_si128(_mm_cmpgt_epi8(block, _mm_set1_epi8('0' - 1)),
+            _mm_cmplt_epi8(block, _mm_set1_epi8('9' + 1)));
+        const __m128i word = _mm_or_si128(letter, digit);
+
+        return _mm_or_si128(_mm_and_si128(word, lowered), _mm_andnot_si128(word, _mm_set1_epi8(' ')));
+    }
+
+    // Номер младшего установленного бита
+    unsigned countTrailingZeros(unsigned mask) {
+#if defined(_MSC_VER)
+        unsigned long index;
+        _BitScanForward(&index, mask);
+        return static_cast<unsigned>(index);
+#else
+        return static_cast<unsigned>(__builtin_ctz(mask));
+#endif
+    }
+#endif
+
+    // Количество символов UTF-8 в слове
+    size_t characterCount(std::string_view word) {
+        size_t count = 0;
+        for (char ch : word) {
+            count += (static_cast<unsigned char>(ch) & 0xC0) != 0x80;
+        }
+        return count;
+    }
+
+    // ---------- Стеммер Snowball для русского ----------
+    // Слово переводится в однобайтовую форму: "а".."я" -> 0xE0..0xFF (как в cp1251)
+
+    char russianLetter(uint32_t cp) {
+        return static_cast<char>(0xE0 + (cp - 0x430));
+    }
+
+    // Однобайтовая форма слова из строчных русских букв; false, если в слове есть другие символы
+    bool toRussianBytes(const char* word, size_t length, char* out, size_t& count) {
+        if (length % 2 != 0 || length / 2 > MAX_STEM_LENGTH) {
+            return false;
+        }
+
+        count = 0;
+        for (size_t i = 0; i < length; i += 2) {
+            unsigned char lead = static_cast<unsigned char>(word[i]);
+            unsigned char tail = static_cast<unsigned char>(word[i + 1]);
+            uint32_t cp = ((lead & 0x1Fu) << 6) | (tail & 0x3Fu);
+            if ((lead != 0xD0 && lead != 0xD1) || (tail & 0xC0) != 0x80 || cp < 0x430 || cp > 0x44F) {
+                return false;
+            }
+            out[count++] = russianLetter(cp);
+        }
+        return true;
+    }
+
+    // Однобайтовая форма окончания; пустая строка, если в нем есть не строчные русские буквы.
+    // Окончания и служебные слова заданы кодами символов (U"..."): узкие литералы в кириллице
+    // зависят от кодировки исполнения компилятора, а текст всегда приходит в UTF-8
+    std::string russianSuffix(std::u32string_view letters) {
+        std::string text;
+        for (char32_t cp : letters) {
+            if (cp < 0x430 || cp > 0x44F) {
+                return {};
+            }
+            text.push_back(russianLetter(cp));
+        }
+        return text;
+    }
+
+    // Окончание; afterAYa - допустимо только после "а" или "я"
+    struct Ending {
+        std::string text;
+        bool afterAYa;
+    };
+
+    // Группа окончаний, разложенная по последней букве
+    struct EndingGroup {
+        std::vector<Ending> byLastLetter[32];
+
+        EndingGroup(std::initializer_list<const char32_t*> withAYa, std::initializer_list<const char32_t*> plain) {
+            for (const char32_t* ending : withAYa) {
+                add(ending, true);
+            }
+            for (const char32_t* ending : plain) {
+                add(ending, false);
+            }
+        }
+
+        // Пустое или не русское окончание пропускается: у него нет последней буквы для раскладки
+        void add(const char32_t* letters, bool afterAYa) {
+            std::string text = russianSuffix(letters);
+            if (text.empty()) {
+                return;
+            }
+            byLastLetter[static_cast<unsigned char>(text.back()) - 0xE0].push_back({ text, afterAYa });
+        }
+    };
+
+    struct RussianEndings {
+        EndingGroup perfectiveGerund{ { U"в", U"вши", U"вшись" }, { U"ив", U"ивши", U"ившись", U"ыв", U"ывши",
+            U"ывшись" } };
+        EndingGroup adjective{ {}, { U"ее", U"ие", U"ые", U"ое", U"ими", U"ыми", U"ей", U"ий", U"ый", U"ой", U"ем",
+            U"им", U"ым", U"ом", U"его", U"ого", U"ему", U"ому", U"их", U"ых", U"ую", U"юю", U"ая", U"яя", U"ою",
+            U"ею" } };
+        EndingGroup participle{ { U"ем", U"нн", U"вш", U"ющ", U"щ" }, { U"ивш", U"ывш", U"ующ" } };
+        EndingGroup reflexive{ {}, { U"ся", U"сь" } };
+        EndingGroup verb{ { U"ла", U"на", U"ете", U"йте", U"ли", U"й", U"л", U"ем", U"н", U"ло", U"но", U"ет", U"ют",
+            U"ны", U"ть", U"ешь", U"нно" }, { U"ила", U"ыла", U"ена", U"ейте", U"уйте", U"ите", U"или", U"ыли", U"ей",
+            U"уй", U"ил", U"ыл", U"им", U"ым", U"ен", U"ило", U"ыло", U"ено", U"ят", U"ует", U"уют", U"ит", U"ыт",
+            U"ены", U"ить", U"ыть", U"ишь", U"ую", U"ю" } };
+        EndingGroup noun{ {}, { U"а", U"ев", U"ов", U"ие", U"ье", U"е", U"иями", U"ями", U"ами", U"еи", U"ии", U"и",
+            U"ией", U"ей", U"ой", U"ий", U"й", U"иям", U"ям", U"ием", U"ем", U"ам", U"ом", U"о", U"у", U"ах", U"иях",
+            U"ях", U"ы", U"ь", U"ию", U"ью", U"ю", U"ия", U"ья", U"я" } };
+        EndingGroup derivational{ {}, { U"ост", U"ость" } };
+        EndingGroup superlative{ {}, { U"ейш", U"ейше" } };
+        bool vowels[32] = {};
+
+        RussianEndings() {
+            for (char letter : russianSuffix(U"аеиоуыэюя")) {
+                vowels[static_cast<unsigned char>(letter) - 0xE0] = true;
+            }
+        }
+    };
+
+    const RussianEndings& russianEndings() {
+        static const RussianEndings endings;
+        return endings;
+    }
+
+    struct RussianWord {
+        const RussianEndings& endings;
+        char* letters;
+        size_t length;
+        size_t rv;
+        size_t r2;
+
+        bool isVowel(char letter) const {
+            return endings.vowels[static_cast<unsigned char>(letter) - 0xE0];
+        }
+
+        bool endsWith(const std::string& suffix) const {
+            return length >= suffix.size()
+                && std::memcmp(letters + length - suffix.size(), suffix.data(), suffix.size()) == 0;
+        }
+
+        // Самое длинное окончание группы внутри RV; nullptr, если нет
+        const Ending* findLongest(const EndingGroup& group) const {
+            if (length <= rv) {
+                return nullptr;
+            }
+
+            const Ending* best = nullptr;
+            for (const Ending& ending : group.byLastLetter[static_cast<unsigned char>(letters[length - 1]) - 0xE0]) {
+                if (length - rv >= ending.text.size() && endsWith(ending.text)
+                    && (!best || ending.text.size() > best->text.size())) {
+                    best = &ending;
+                }
+            }
+            return best;
+        }
+
+        // Удаление самого длинного окончания группы (с проверкой предшествующих "а"/"я")
+        bool removeLongest(const EndingGroup& group) {
+            const Ending* ending = findLongest(group);
+            if (!ending) {
+                return false;
+            }
+
+            size_t start = length - ending->text.size();
+            if (ending->afterAYa) {
+                static const char a = russianLetter(0x430);
+                static const char ya = russianLetter(0x44F);
+                if (start <= rv || (letters[start - 1] != a && letters[start - 1] != ya)) {
+                    return false;
+                }
+            }
+
+            length = start;
+            return true;
+        }
+    };
+
+    size_t stemRussian(char* word, size_t length) {
+        char letters[MAX_STEM_LENGTH];
+        size_t count = 0;
+        if (!toRussianBytes(word, length, letters, count)) {
+            return length;
+        }
+
+        const RussianEndings& endings = russianEndings();
+        RussianWord w{ endings, letters, count, count, count };
+
+        // RV - после первой гласной; R2 - после второй пары "гласная, согласная" (R1 дважды)
+        size_t i = 0;
+        while (i < count && !w.isVowel(letters[i])) {
+            ++i;
+        }
+        if (i < count) {
+            w.rv = i + 1;
+            size_t p = w.rv;
+            for (int region = 0; region < 2; ++region) {
+                while (p < count && w.isVowel(letters[p])) {
+                    ++p;
+                }
+                if (p >= count) {
+                    p = count;
+                    break;
+                }
+                ++p;
+                if (region == 0) {
+                    while (p < count && !w.isVowel(letters[p])) {
+                        ++p;
+                    }
+                }
+            }
+            w.r2 = p;
+        }
+
+        // Шаг 1: деепричастие; иначе возвратная частица и прилагательное, глагол или существительное
+        if (!w.removeLongest(endings.perfectiveGerund)) {
+            w.removeLongest(endings.reflexive);
+
+            bool adjectival = w.removeLongest(endings.adjective);
+            if (adjectival) {
+                w.removeLongest(endings.participle);
+            }
+            else if (!w.removeLongest(endings.verb)) {
+                w.removeLongest(endings.noun);
+            }
+        }
+
+        // Шаг 2: конечное "и"
+        static const char letterI = russianLetter(0x438);
+        if (w.length > w.rv && letters[w.length - 1] == letterI) {
+            w.length--;
+        }
+
+        // Шаг 3: словообразовательное окончание в R2
+        if (const Ending* ending = w.findLongest(endings.derivational)) {
+            if (w.length - ending->text.size() >= w.r2) {
+                w.length -= ending->text.size();
+            }
+        }
+
+        // Шаг 4: превосходная степень, двойное "н", мягкий знак
+        static const char letterN = russianLetter(0x43D);
+        static const char softSign = russianLetter(0x44C);
+        auto undoubleN = [&]() {
+            if (w.length >= w.rv + 2 && letters[w.length - 1] == letterN && letters[w.length - 2] == letterN) {
+                w.length--;
+            }
+        };
+
+        if (w.removeLongest(endings.superlative)) {
+            undoubleN();
+        }
+        else if (w.length > w.rv && letters[w.length - 1] == softSign) {
+            w.length--;
+        }
+        else {
+            undoubleN();
+        }
+
+        // Обратно в UTF-8: все буквы двухбайтовые, слово только укорачивается
+        for (size_t k = 0; k < w.length; ++k) {
+            uint32_t cp = 0x430 + (static_cast<unsigned char>(letters[k]) - 0xE0);
+            word[2 * k] = static_cast<char>(0xC0 | (cp >> 6));
+            word[2 * k + 1] = static_cast<char>(0x80 | (cp & 0x3F));
+        }
+        return 2 * w.length;
+    }
+
+    // ---------- Стеммер Porter2 для английского ----------
+
+    bool isEnglishVowel(char c) {
+        return c == 'a' || c == 'e' || c == 'i' || c == 'o' || c == 'u' || c == 'y';
+    }
+
+    // Замена суффикса
+    struct Rule {
+        std::string_view suffix;
+        std::string_view replacement;
+    };
+
+    struct EnglishWord {
+        char* s;
+        size_t n;
+        size_t r1;
+        size_t r2;
+
+        bool endsWith(std::string_view suffix) const {
+            return n >= suffix.size() && s[n - 1] == suffix.back()
+                && std::memcmp(s + n - suffix.size(), suffix.data(), suffix.size()) == 0;
+        }
+
+        bool hasVowel(size_t end) const {
+            for (size_t i = 0; i < end; ++i) {
+                if (isEnglishVowel(s[i])) {
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        void replace(size_t suffixLength, std::string_view replacement) {
+            std::memcpy(s + n - suffixLength, replacement.data(), replacement.size());
+            n = n - suffixLength + replacement.size();
+        }
+
+        // Короткий слог в конце s[0..end)
+        bool endsWithShortSyllable(size_t end) const {
+            if (end == 2) {
+                return isEnglishVowel(s[0]) && !isEnglishVowel(s[1]);
+            }
+            if (end < 3) {
+                return false;
+            }
+            char last = s[end - 1];
+            return !isEnglishVowel(s[end - 3]) && isEnglishVowel(s[end - 2]) && !isEnglishVowel(last)
+                && last != 'w' && last != 'x' && last != 'Y';
+        }
+
+        bool isShort() const {
+            return r1 >= n && endsWithShortSyllable(n);
+        }
+
+        // Самое длинное правило, суффикс которого совпадает с концом слова
+        template <size_t N>
+        const Rule* findLongest(const Rule (&rules)[N]) const {
+            const Rule* best = nullptr;
+            for (const Rule& rule : rules) {
+                if (endsWith(rule.suffix) && (!best || rule.suffix.size() > best->suffix.size())) {
+                    best = &rule;
+                }
+            }
+            return best;
+        }
+    };
+
+    size_t regionStart(const char* s, size_t n, size_t from) {
+        size_t i = from;
+        while (i < n && !isEnglishVowel(s[i])) {
+            ++i;
+        }
+        while (i < n && isEnglishVowel(s[i])) {
+            ++i;
+        }
+        return i < n ? i + 1 : n;
+    }
+
+    size_t stemEnglish(char* s, size_t n) {
+        if (n <= 2 || n > MAX_STEM_LENGTH) {
+            return n;
+        }
+
+        static const Rule exceptions[] = {
+            { "skis", "ski" }, { "skies", "sky" }, { "dying", "die" }, { "lying", "lie" }, { "tying", "tie" },
+            { "idly", "idl" }, { "gently", "gentl" }, { "ugly", "ugli" }, { "early", "earli" }, { "only", "onli" },
+            { "singly", "singl" }, { "sky", "sky" }, { "news", "news" }, { "howe", "howe" }, { "atlas", "atlas" },
+            { "cosmos", "cosmos" }, { "bias", "bias" }, { "andes", "andes" }
+        };
+        std::string_view whole(s, n);
+        for (const Rule& rule : exceptions) {
+            if (whole == rule.suffix) {
+                std::memcpy(s, rule.replacement.data(), rule.replacement.size());
+                return rule.replacement.size();
+            }
+        }
+
+        // "y" в начале слова или после гласной считается согласной (Y)
+        for (size_t i = 0; i < n; ++i) {
+            if (s[i] == 'y' && (i == 0 || isEnglishVowel(s[i - 1]))) {
+                s[i] = 'Y';
+            }
+        }
+
+        EnglishWord w{ s, n, n, n };
+        static const std::string_view prefixes[] = { "gener", "commun", "arsen", "past", "univers", "later",
+            "emerg", "organ" };
+        w.r1 = regionStart(s, n, 0);
+        for (std::string_view prefix : prefixes) {
+            if (n >= prefix.size() && whole.substr(0, prefix.size()) == prefix) {
+                w.r1 = prefix.size();
+                break;
+            }
+        }
+        w.r2 = regionStart(s, n, w.r1);
+
+        auto finish = [&]() {
+            for (size_t i = 0; i < w.n; ++i) {
+                if (s[i] == 'Y') {
+                    s[i] = 'y';
+                }
+            }
+            return w.n;
+        };
+
+        // Шаг 1a: множественное число
+        if (w.endsWith("sses")) {
+            w.replace(4, "ss");
+        }
+        else if (w.endsWith("ied") || w.endsWith("ies")) {
+            w.replace(3, w.n > 4 ? "i" : "ie");
+        }
+        else if (w.endsWith("us") || w.endsWith("ss")) {
+        }
+        else if (w.endsWith("s") && w.hasVowel(w.n - 2)) {
+            w.n--;
+        }
+
+        static const std::string_view invariants[] = { "inning", "outing", "canning", "herring", "earring",
+            "proceed", "exceed", "succeed" };
+        for (std::string_view invariant : invariants) {
+            if (std::string_view(s, w.n) == invariant) {
+                return finish();
+            }
+        }
+
+        // Шаг 1b: -ed, -ing
+        if (w.endsWith("eedly") || w.endsWith("eed")) {
+            size_t length = w.endsWith("eedly") ? 5 : 3;
+            if (w.n - length >= w.r1) {
+                w.replace(length, "ee");
+            }
+        }
+        else {
+            size_t length = w.endsWith("ingly") ? 5 : w.endsWith("edly") ? 4 : w.endsWith("ing") ? 3
+                : w.endsWith("ed") ? 2 : 0;
+            if (length > 0 && w.hasVowel(w.n - length)) {
+                w.n -= length;
+                if (w.endsWith("at") || w.endsWith("bl") || w.endsWith("iz")) {
+                    s[w.n++] = 'e';
+                }
+                else if (w.n >= 2 && s[w.n - 1] == s[w.n - 2] && std::strchr("bdfgmnprt", s[w.n - 1])) {
+                    w.n--;
+                }
+                else if (w.isShort()) {
+                    s[w.n++] = 'e';
+                }
+            }
+        }
+
+        // Шаг 1c: конечное y после согласной
+        if (w.n > 2 && (s[w.n - 1] == 'y' || s[w.n - 1] == 'Y') && !isEnglishVowel(s[w.n - 2])) {
+            s[w.n - 1] = 'i';
+        }
+
+        // Шаг 2: суффиксы в R1
+        static const Rule step2[] = {
+            { "tional", "tion" }, { "enci", "ence" }, { "anci", "ance" }, { "abli", "able" }, { "entli", "ent" },
+            { "izer", "ize" }, { "ization", "ize" }, { "ational", "ate" }, { "ation", "ate" }, { "ator", "ate" },
+            { "alism", "al" }, { "aliti", "al" }, { "alli", "al" }, { "fulness", "ful" }, { "ousli", "ous" },
+            { "ousness", "ous" }, { "iveness", "ive" }, { "iviti", "ive" }, { "biliti", "ble" }, { "bli", "ble" },
+            { "ogi", "og" }, { "fulli", "ful" }, { "lessli", "less" }, { "li", "" }
+        };
+        if (const Rule* rule = w.findLongest(step2)) {
+            size_t start = w.n - rule->suffix.size();
+            bool allowed = start >= w.r1;
+            if (rule->suffix == "ogi") {
+                allowed = allowed && start > 0 && s[start - 1] == 'l';
+            }
+            else if (rule->suffix == "li") {
+                allowed = allowed && start > 0 && std::strchr("cdeghkmnrt", s[start - 1]);
+            }
+            if (allowed) {
+                w.replace(rule->suffix.size(), rule->replacement);
+            }
+        }
+
+        // Шаг 3: суффиксы в R1 (-ative в R2)
+        static const Rule step3[] = {
+            { "tional", "tion" }, { "ational", "ate" }, { "alize", "al" }, { "icate", "ic" }, { "iciti", "ic" },
+            { "ical", "ic" }, { "ful", "" }, { "ness", "" }, { "ative", "" }
+        };
+        if (const Rule* rule = w.findLongest(step3)) {
+            size_t start = w.n - rule->suffix.size();
+            if (start >= (rule->suffix == "ative" ? w.r2 : w.r1)) {
+                w.replace(rule->suffix.size(), rule->replacement);
+            }
+        }
+
+        // Шаг 4: суффиксы в R2
+        static const Rule step4[] = {
+            { "al", "" }, { "ance", "" }, { "ence", "" }, { "er", "" }, { "ic", "" }, { "able", "" }, { "ible", "" },
+            { "ant", "" }, { "ement", "" }, { "ment", "" }, { "ent", "" }, { "ism", "" }, { "ate", "" }, { "iti", "" },
+            { "ous", "" }, { "ive", "" }, { "ize", "" }, { "ion", "" }
+        };
+        if (const Rule* rule = w.findLongest(step4)) {
+            size_t start = w.n - rule->suffix.size();
+            bool allowed = start >= w.r2;
+            if (rule->suffix == "ion") {
+                allowed = allowed && start > 0 && (s[start - 1] == 's' || s[start - 1] == 't');
+            }
+            if (allowed) {
+                w.n = start;
+            }
+        }
+
+        // Шаг 5: конечные e и l
+        if (w.endsWith("e")) {
+            size_t start = w.n - 1;
+            if (start >= w.r2 || (start >= w.r1 && !w.endsWithShortSyllable(start))) {
+                w.n = start;
+            }
+        }
+        else if (w.endsWith("ll") && w.n - 1 >= w.r2) {
+            w.n--;
+        }
+
+        return finish();
+    }
+
+    bool isLatinWord(const char* word, size_t length) {
+        for (size_t i = 0; i < length; ++i) {
+            if (word[i] < 'a' || word[i] > 'z') {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // Строка UTF-8 из кодов символов
+    std::string toUtf8(std::u32string_view text) {
+        std::string utf8;
+        for (char32_t cp : text) {
+            if (cp < 0x80) {
+                utf8.push_back(static_cast<char>(cp));
+            }
+            else if (cp < 0x800) {
+                utf8.push_back(static_cast<char>(0xC0 | (cp >> 6)));
+                utf8.push_back(static_cast<char>(0x80 | (cp & 0x3F)));
+            }
+            else {
+                utf8.push_back(static_cast<char>(0xE0 | (cp >> 12)));
+                utf8.push_back(static_cast<char>(0x80 | ((cp >> 6) & 0x3F)));
+                utf8.push_back(static_cast<char>(0x80 | (cp & 0x3F)));
+            }
+        }
+        return utf8;
+    }
+
+    // Служебные слова русского и английского (в нормализованной форме, ё -> е);
+    // text хранит строки UTF-8, words ссылается на них
+    struct StopWords {
+        std::vector<std::string> text;
+        std::unordered_set<std::string_view> words;
+
+        StopWords() {
+            static const char32_t* const list[] = {
+                U"и", U"в", U"во", U"не", U"что", U"он", U"на", U"я", U"с", U"со", U"как", U"а", U"то", U"все", U"она",
+                U"так", U"его", U"но", U"да", U"ты", U"к", U"у", U"же", U"вы", U"за", U"бы", U"по", U"только", U"ее",
+                U"мне", U"было", U"вот", U"от", U"меня", U"еще", U"нет", U"о", U"из", U"ему", U"когда", U"даже", U"ну",
+                U"ли", U"если", U"уже", U"или", U"ни", U"быть", U"был", U"него", U"до", U"вас", U"уж", U"вам", U"ведь",
+                U"там", U"потом", U"себя", U"ей", U"может", U"они", U"тут", U"где", U"есть", U"надо", U"ней", U"для",
+                U"мы", U"тебя", U"их", U"чем", U"была", U"сам", U"чтоб", U"без", U"чего", U"себе", U"под", U"будет",
+                U"тогда", U"кто", U"этот", U"того", U"потому", U"этого", U"какой", U"ним", U"здесь", U"этом", U"мой",
+                U"тем", U"чтобы", U"нее", U"были", U"куда", U"зачем", U"всех", U"можно", U"при", U"об", U"хоть", U"после",
+                U"над", U"тот", U"через", U"эти", U"нас", U"про", U"всего", U"них", U"какая", U"эту", U"моя", U"свою",
+                U"этой", U"перед", U"им", U"между", U"это", U"также", U"который", U"которые", U"которая", U"которых",
+                U"the", U"a", U"an", U"and", U"or", U"but", U"in", U"on", U"at", U"to", U"for", U"of", U"with", U"by",
+                U"from", U"as", U"is", U"are", U"was", U"were", U"be", U"been", U"being", U"have", U"has", U"had", U"do",
+                U"does", U"did", U"it", U"its", U"this", U"that", U"these", U"those", U"what", U"where", U"when", U"how",
+                U"why", U"which", U"who", U"whom", U"there", U"their", U"they", U"them", U"he", U"she", U"his", U"her",
+                U"we", U"our", U"you", U"your", U"me", U"my", U"if", U"then", U"than", U"so", U"not", U"no", U"can",
+                U"could", U"would", U"should", U"will", U"shall", U"into", U"about", U"also", U"such", U"any", U"all"
+            };
+            text.reserve(std::size(list));
+            for (const char32_t* word : list) {
+                text.push_back(toUtf8(word));
+            }
+            words.insert(text.begin(), text.end());
+        }
+    };
+}
+
+TextAnalyzer::TextAnalyzer(const TextAnalyzerConfig& config)
+    : config(config) {
+}
+
+void TextAnalyzer::normalize(std::string_view text, std::string& normalized) {
+    const CharTables& tables = charTables();
+
+    normalized.resize(text.size());
+    const unsigned char* in = reinterpret_cast<const unsigned char*>(text.data());
+    const size_t size = text.size();
+    char* const begin = normalized.data();
+    char* out = begin;
+    size_t i = 0;
+
+    while (i < size) {
+#ifdef TEXT_ANALYZER_SSE2
+        // Блоки ASCII по 16 байт обрабатываются целиком, до первого байта не-ASCII - по таблице
+        if (i + 16 <= size) {
+            __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+            unsigned nonAscii = static_cast<unsigned>(_mm_movemask_epi8(block));
+            if (nonAscii == 0) {
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(out), foldAsciiBlock(block));
+                i += 16;
+                out += 16;
+                continue;
+            }
+            for (unsigned prefix = countTrailingZeros(nonAscii); prefix > 0; --prefix) {
+                *out++ = tables.ascii[in[i++]];
+            }
+        }
+#endif
+        unsigned char c = in[i];
+
+        if (c < 0x80) {
+            *out++ = tables.ascii[c];
+            ++i;
+            continue;
+        }
+
+        // Двухбайтовые символы (латиница с диакритикой, кириллица) - по таблице
+        if (c >= 0xC2 && c <= 0xDF && i + 1 < size && (in[i + 1] & 0xC0) == 0x80) {
+            uint16_t folded = tables.twoByte[((c & 0x1Fu) << 6) | (in[i + 1] & 0x3Fu)];
+            if (folded == 0) {
+                *out++ = ' ';
+            }
+            else if (folded != IGNORED) {
+                out[0] = static_cast<char>(0xC0 | (folded >> 6));
+                out[1] = static_cast<char>(0x80 | (folded & 0x3F));
+                out += 2;
+            }
+            i += 2;
+            continue;
+        }
+
+        // Трех- и четырехбайтовые последовательности копируются без изменения регистра
+        size_t length = (c >= 0xE0 && c <= 0xEF) ? 3 : (c >= 0xF0 && c <= 0xF4) ? 4 : 0;
+        uint32_t cp = length == 3 ? (c & 0x0Fu) : (c & 0x07u);
+        bool valid = length > 0 && i + length <= size;
+        for (size_t k = 1; valid && k < length; ++k) {
+            valid = (in[i + k] & 0xC0) == 0x80;
+            cp = (cp << 6) | (in[i + k] & 0x3Fu);
+        }
+        valid = valid && (length == 3 ? (cp >= 0x800 && (cp < 0xD800 || cp > 0xDFFF))
+            : (cp >= 0x10000 && cp <= 0x10FFFF));
+
+        if (!valid) {
+            *out++ = ' ';
+            ++i;
+            continue;
+        }
+
+        if (!isIgnored(cp)) {
+            if (isWordChar(cp)) {
+                std::memcpy(out, in + i, length);
+                out += length;
+            }
+            else {
+                *out++ = ' ';
+            }
+        }
+        i += length;
+    }
+
+    normalized.resize(out - begin);
+}
+
+void TextAnalyzer::segment(std::string_view normalized, std::vector<std::string_view>& words) {
+    const char* p = normalized.data();
+    const char* const end = p + normalized.size();
+
+    while (p < end) {
+        while (p < end && *p == ' ') {
+            ++p;
+        }
+
+        const char* start = p;
+        while (p < end && *p != ' ') {
+            ++p;
+        }
+
+        if (p > start) {
+            words.emplace_back(start, static_cast<size_t>(p - start));
+        }
+    }
+}
+
+size_t TextAnalyzer::stem(char* word, size_t length) {
+    if (length == 0) {
+        return 0;
+    }
+
+    unsigned char first = static_cast<unsigned char>(word[0]);
+    if (first == 0xD0 || first == 0xD1) {
+        return stemRussian(word, length);
+    }
+    if (isLatinWord(word, length)) {
+        return stemEnglish(word, length);
+    }
+    return length;
+}
+
+bool TextAnalyzer::isStopWord(std::string_view word) {
+    static const StopWords stopWords;
+    return stopWords.words.find(word) != stopWords.words.end();
+}
+
+void TextAnalyzer::analyze(std::string_view text, std::string& buffer, std::vector<std::string_view>& terms) const {
+    terms.clear();
+    normalize(text, buffer);
+    segment(buffer, terms);
+
+    size_t kept = 0;
+    for (size_t i = 0; i < terms.size(); ++i) {
+        std::string_view word = terms[i];
+        if (characterCount(word) < config.minTermLength) {
+            continue;
+        }
+        if (config.removeStopWords && isStopWord(word)) {
+            continue;
+        }
+
+        if (config.stemming) {
+            char* data = buffer.data() + (word.data() - buffer.data());
+            word = std::string_view(data, stem(data, word.size()));
+        }
+        terms[kept++] = word;
+    }
+
+    terms.resize(kept);
+}
+
+const TextAnalyzerConfig& TextAnalyzer::getConfig() const {
+    return config;
+}
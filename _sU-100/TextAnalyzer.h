@@ -0,0 +1,43 @@
+﻿// TextAnalyzer.h
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Параметры разбора текста на термины
+struct TextAnalyzerConfig {
+    bool stemming = true;           // отсечение окончаний (русский и английский по Snowball)
+    bool removeStopWords = true;    // отбрасывать служебные слова
+    size_t minTermLength = 2;       // минимальная длина термина в символах
+};
+
+// Разбор текста на термины для индекса и запросов: декодирование UTF-8,
+// приведение латиницы и кириллицы к нижнему регистру (ё -> е), разбиение на слова
+// и отсечение окончаний. Термины - string_view в буфер нормализованного текста
+class TextAnalyzer {
+public:
+    explicit TextAnalyzer(const TextAnalyzerConfig& config = TextAnalyzerConfig());
+
+    // Нормализация: буквы в нижнем регистре, цифры как есть, прочие символы - пробелы.
+    // Результат не длиннее исходного текста; некорректный UTF-8 считается разделителем
+    static void normalize(std::string_view text, std::string& normalized);
+
+    // Разбиение нормализованного текста на слова (ссылки на normalized)
+    static void segment(std::string_view normalized, std::vector<std::string_view>& words);
+
+    // Отсечение окончания нормализованного слова на месте; возвращает новую длину.
+    // Русские слова - по алгоритму Snowball для русского, латинские - Porter2
+    static size_t stem(char* word, size_t length);
+
+    // Служебное слово (в нормализованной форме)
+    static bool isStopWord(std::string_view word);
+
+    // Термины текста: buffer получает нормализованный текст, terms ссылаются на него
+    void analyze(std::string_view text, std::string& buffer, std::vector<std::string_view>& terms) const;
+
+    const TextAnalyzerConfig& getConfig() const;
+
+private:
+    TextAnalyzerConfig config;
+};
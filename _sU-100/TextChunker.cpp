@@ -0,0 +1,481 @@
+﻿// TextChunker.cpp
+#include "TextChunker.h"
+#include <algorithm>
+#include <cstring>
+
+namespace {
+    // Заголовок - строка не длиннее MAX_HEADING_LENGTH байт
+    constexpr size_t MAX_HEADING_LENGTH = 80;
+
+    // Начало текста, которое можно отбросить после завершения чанков, копится до COMPACT_BYTES
+    constexpr size_t COMPACT_BYTES = 4096;
+
+    bool isSpace(char c) {
+        return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+    }
+
+    std::string_view trim(std::string_view text) {
+        while (!text.empty() && isSpace(text.front())) {
+            text.remove_prefix(1);
+        }
+        while (!text.empty() && isSpace(text.back())) {
+            text.remove_suffix(1);
+        }
+        return text;
+    }
+
+    // Заглавная буква (латиница, кириллица в UTF-8) или открывающая кавычка в позиции pos
+    bool startsSentence(std::string_view text, size_t pos) {
+        unsigned char c = static_cast<unsigned char>(text[pos]);
+        if ((c >= 'A' && c <= 'Z') || c == '"') {
+            return true;
+        }
+        if (pos + 1 >= text.size()) {
+            return false;
+        }
+        unsigned char next = static_cast<unsigned char>(text[pos + 1]);
+        return (c == 0xD0 && (next == 0x81 || (next >= 0x90 && next <= 0xAF)))   // А-Я, Ё
+            || (c == 0xC2 && next == 0xAB);                                      // «
+    }
+
+    // Строчная буква (латиница, кириллица в UTF-8) в позиции pos
+    bool isLowercase(std::string_view text, size_t pos) {
+        unsigned char c = static_cast<unsigned char>(text[pos]);
+        if (c >= 'a' && c <= 'z') {
+            return true;
+        }
+        if (pos + 1 >= text.size()) {
+            return false;
+        }
+        unsigned char next = static_cast<unsigned char>(text[pos + 1]);
+        return (c == 0xD0 && next >= 0xB0 && next <= 0xBF)                      // а-п
+            || (c == 0xD1 && ((next >= 0x80 && next <= 0x8F) || next == 0x91));  // р-я, ё
+    }
+
+    // Строка с позиции pos начинается с разметки страницы, маркера или номера пункта списка
+    bool startsListItem(std::string_view text, size_t pos) {
+        std::string_view line = text.substr(pos);
+        if (line.rfind("===", 0) == 0 || line.rfind("- ", 0) == 0 || line.rfind("* ", 0) == 0
+            || line.rfind("\xE2\x80\xA2", 0) == 0) {
+            return true;
+        }
+
+        size_t digits = 0;
+        while (digits < line.size() && digits < 3 && line[digits] >= '0' && line[digits] <= '9') {
+            ++digits;
+        }
+        return digits > 0 && digits + 1 < line.size() && (line[digits] == '.' || line[digits] == ')')
+            && line[digits + 1] == ' ';
+    }
+
+    // Слово перед позицией end состоит из одного символа (инициал, сокращение "г.", "т.")
+    bool isSingleLetterWord(std::string_view text, size_t end) {
+        size_t start = end;
+        while (start > 0 && !isSpace(text[start - 1]) && text[start - 1] != '.') {
+            --start;
+        }
+
+        size_t letters = 0;
+        for (size_t i = start; i < end; ++i) {
+            if ((static_cast<unsigned char>(text[i]) & 0xC0) != 0x80) {
+                ++letters;
+            }
+        }
+        return letters == 1;
+    }
+
+    // Номер страницы строки разметки "=== Page N ===" (0 - строка не разметка)
+    uint32_t parsePageMarker(std::string_view line) {
+        constexpr std::string_view prefix = "=== Page ";
+        if (line.rfind(prefix, 0) != 0 || line.size() < prefix.size() + 4
+            || line.substr(line.size() - 4) != " ===") {
+            return 0;
+        }
+
+        uint32_t page = 0;
+        for (size_t i = prefix.size(); i < line.size() - 4; ++i) {
+            if (line[i] < '0' || line[i] > '9' || page > 100000000) {
+                return 0;
+            }
+            page = page * 10 + static_cast<uint32_t>(line[i] - '0');
+        }
+        return page;
+    }
+
+    // Короткая строка без знака препинания в конце - заголовок, если стоит отдельным абзацем
+    bool hasHeadingShape(std::string_view line) {
+        return !line.empty() && line.size() <= MAX_HEADING_LENGTH && std::strchr(".,;:", line.back()) == nullptr;
+    }
+
+    // Заголовок раздела и без пустой строки после него: "#", номер раздела, "Глава", "Статья",
+    // "Section" или строка заглавными буквами
+    bool isSectionHeading(std::string_view line) {
+        if (!hasHeadingShape(line)) {
+            return false;
+        }
+        if (line.front() == '#') {
+            return true;
+        }
+
+        // "Глава ", "Раздел ", "Статья " - байтами UTF-8: узкий литерал в кириллице зависит
+        // от кодировки исполнения компилятора, а текст документа всегда в UTF-8
+        static const std::string_view keywords[] = {
+            "\xD0\x93\xD0\xBB\xD0\xB0\xD0\xB2\xD0\xB0 ",
+            "\xD0\xA0\xD0\xB0\xD0\xB7\xD0\xB4\xD0\xB5\xD0\xBB ",
+            "\xD0\xA1\xD1\x82\xD0\xB0\xD1\x82\xD1\x8C\xD1\x8F ",
+            "Chapter ", "Section ", "Article "
+        };
+        for (std::string_view keyword : keywords) {
+            if (line.rfind(keyword, 0) == 0) {
+                return true;
+            }
+        }
+
+        // Многоуровневый номер раздела "2.3 Сроки", "2.3. Сроки"; "2. Сроки" и "2) Сроки" - пункты списка
+        size_t pos = 0;
+        bool sublevel = false;
+        while (pos < line.size() && ((line[pos] >= '0' && line[pos] <= '9') || line[pos] == '.')) {
+            if (line[pos] == '.' && pos > 0 && pos + 1 < line.size() && line[pos + 1] >= '0' && line[pos + 1] <= '9') {
+                sublevel = true;
+            }
+            ++pos;
+        }
+        if (sublevel && pos + 1 < line.size() && line[pos] == ' ' && startsSentence(line, pos + 1)) {
+            return true;
+        }
+
+        size_t letters = 0;
+        for (size_t i = 0; i < line.size(); ++i) {
+            if (isLowercase(line, i)) {
+                return false;
+            }
+            if (startsSentence(line, i)) {
+                ++letters;
+            }
+        }
+        return letters >= 3;
+    }
+}
+
+TextChunker::TextChunker(size_t maxChunkSize, size_t overlapTokens, TokenCounter countTokens)
+    : maxChunkSize(std::max(maxChunkSize, MIN_CHUNK_LENGTH)), overlapTokens(overlapTokens),
+    countTokens(std::move(countTokens)) {
+}
+
+ChunkList TextChunker::split(const std::string& content) const {
+    ChunkList chunks;
+    State state;
+
+    append(content, state, chunks);
+
+    // Добавляем последний чанк
+    flush(state, chunks);
+
+    return chunks;
+}
+
+void TextChunker::appendPage(int pageNumber, const std::string& pageText, State& state, ChunkList& chunks) const {
+    // Та же разметка страниц, что и в PDFProcessor::extractText
+    append("=== Page " + std::to_string(pageNumber) + " ===\n", state, chunks);
+    append(pageText, state, chunks);
+    append("\n\n", state, chunks);
+}
+
+void TextChunker::append(std::string_view text, State& state, ChunkList& chunks) const {
+    const uint64_t start = state.textOffset + state.text.size();
+    state.text.append(text);
+
+    // Разбираются только завершенные строки, остаток ждет следующего фрагмента
+    for (size_t pos = text.find('\n'); pos != std::string_view::npos; pos = text.find('\n', pos + 1)) {
+        addLine(start + pos, state, chunks);
+        state.lineStart = start + pos + 1;
+    }
+
+    // Текст до незавершенного чанка и абзаца больше не нужен
+    uint64_t keep = state.paragraphStart;
+    if (!state.units.empty()) {
+        keep = std::min(keep, state.units.front().begin);
+    }
+    const size_t unused = static_cast<size_t>(keep - state.textOffset);
+    if (unused >= COMPACT_BYTES && unused >= state.text.size() / 2) {
+        state.text.erase(0, unused);
+        state.textOffset = keep;
+    }
+}
+
+void TextChunker::appendAt(uint64_t offset, uint32_t page, std::string_view text, State& state,
+    ChunkList& chunks) const {
+    const uint64_t end = state.textOffset + state.text.size();
+    if (offset < end) {
+        // Перекрытие с уже добавленным текстом
+        if (end - offset >= text.size()) {
+            return;
+        }
+        text.remove_prefix(static_cast<size_t>(end - offset));
+    } else if (offset > end) {
+        append(std::string(static_cast<size_t>(offset - end), '\n'), state, chunks);
+    }
+
+    if (page != 0) {
+        state.page = page;
+    }
+    append(text, state, chunks);
+}
+
+void TextChunker::flush(State& state, ChunkList& chunks) const {
+    const uint64_t end = state.textOffset + state.text.size();
+    if (end > state.lineStart) {
+        addLine(end, state, chunks);
+    }
+    endParagraph(end, false, state, chunks);
+    emitChunk(false, state, chunks);
+    state = State();
+}
+
+std::string_view TextChunker::view(const State& state, uint64_t begin, uint64_t end) {
+    return std::string_view(state.text).substr(static_cast<size_t>(begin - state.textOffset),
+        static_cast<size_t>(end - begin));
+}
+
+void TextChunker::addLine(uint64_t end, State& state, ChunkList& chunks) const {
+    std::string_view line = trim(view(state, state.lineStart, end));
+
+    // Пустая строка и разметка страницы заканчивают абзац
+    uint32_t page = line.empty() ? 0 : parsePageMarker(line);
+    if (line.empty() || page > 0) {
+        endParagraph(state.lineStart, false, state, chunks);
+        state.paragraphStart = end + 1;
+        state.blankBefore = true;
+        if (page > 0) {
+            state.page = page;
+        }
+        return;
+    }
+
+    // Заголовок раздела и пункт списка начинают свой абзац
+    const bool heading = isSectionHeading(line);
+    if (heading || startsListItem(line, 0)) {
+        endParagraph(state.lineStart, false, state, chunks);
+        state.paragraphStart = state.lineStart;
+    }
+    if (heading) {
+        endParagraph(end, true, state, chunks);
+        state.paragraphStart = end + 1;
+    }
+    state.blankBefore = false;
+}
+
+void TextChunker::endParagraph(uint64_t end, bool heading, State& state, ChunkList& chunks) const {
+    if (end <= state.paragraphStart) {
+        return;
+    }
+
+    std::string_view paragraph = view(state, state.paragraphStart, end);
+    std::string_view trimmed = trim(paragraph);
+    if (trimmed.empty()) {
+        return;
+    }
+
+    // Отдельная короткая строка без точки в конце - тоже заголовок
+    heading = heading || (trimmed.find('\n') == std::string_view::npos && hasHeadingShape(trimmed)
+        && startsSentence(trimmed, 0));
+
+    const uint64_t base = state.paragraphStart;
+    if (heading) {
+        // Новый раздел - новый чанк, если в текущем уже есть содержание; разделы не перекрываются
+        if (state.units.size() <= state.overlapUnits) {
+            state.units.clear();
+            state.overlapUnits = 0;
+        } else if (state.units.back().end - state.units[state.overlapUnits].begin >= maxChunkSize / 4) {
+            emitChunk(false, state, chunks);
+        }
+        const uint64_t begin = base + (trimmed.data() - paragraph.data());
+        addUnit({ begin, begin + trimmed.size(), state.page, true }, state, chunks);
+        return;
+    }
+
+    for (std::string_view sentence : splitSentences(paragraph)) {
+        const uint64_t begin = base + (sentence.data() - paragraph.data());
+        addUnit({ begin, begin + sentence.size(), state.page, false }, state, chunks);
+    }
+
+    // Конец абзаца - предпочтительная граница чанка
+    if (!state.units.empty() && state.units.back().end - state.units.front().begin >= maxChunkSize / 2) {
+        emitChunk(true, state, chunks);
+    }
+}
+
+void TextChunker::addUnit(const Unit& unit, State& state, ChunkList& chunks) const {
+    // Предложение длиннее чанка (текст без знаков препинания) делится по пробелам
+    if (unit.end - unit.begin > maxChunkSize) {
+        std::string_view text = view(state, unit.begin, unit.end);
+        size_t begin = 0;
+        while (text.size() - begin > maxChunkSize) {
+            const size_t cut = cutPoint(text, begin, maxChunkSize);
+            addUnit({ unit.begin + begin, unit.begin + cut, unit.page, unit.heading }, state, chunks);
+
+            begin = cut;
+            while (begin < text.size() && isSpace(text[begin])) {
+                ++begin;
+            }
+        }
+        if (begin < text.size()) {
+            addUnit({ unit.begin + begin, unit.end, unit.page, unit.heading }, state, chunks);
+        }
+        return;
+    }
+
+    if (!state.units.empty() && unit.end - state.units.front().begin > maxChunkSize) {
+        // Заголовок без текста раздела не становится отдельным чанком
+        if (!std::all_of(state.units.begin() + state.overlapUnits, state.units.end(),
+            [](const Unit& u) { return u.heading; })) {
+            emitChunk(true, state, chunks);
+        }
+
+        // Перекрытие не помещается вместе с новой единицей
+        if (unit.end - state.units.front().begin > maxChunkSize) {
+            state.units.erase(state.units.begin(), state.units.begin() + state.overlapUnits);
+            state.overlapUnits = 0;
+        }
+    }
+
+    // Остались только заголовки, и единица с ними не помещается: заголовки завершаются вместе
+    // с началом единицы, а если места почти нет - отдельным чанком
+    if (!state.units.empty() && unit.end - state.units.front().begin > maxChunkSize) {
+        const uint64_t used = unit.begin - state.units.front().begin;
+        if (!unit.heading && used + maxChunkSize / 4 <= maxChunkSize) {
+            std::string_view text = view(state, unit.begin, unit.end);
+            const size_t cut = cutPoint(text, 0, static_cast<size_t>(maxChunkSize - used));
+            state.units.push_back({ unit.begin, unit.begin + cut, unit.page, false });
+            emitChunk(false, state, chunks);
+
+            size_t rest = cut;
+            while (rest < text.size() && isSpace(text[rest])) {
+                ++rest;
+            }
+            if (rest < text.size()) {
+                addUnit({ unit.begin + rest, unit.end, unit.page, false }, state, chunks);
+            }
+            return;
+        }
+        emitChunk(false, state, chunks);
+    }
+    state.units.push_back(unit);
+}
+
+size_t TextChunker::cutPoint(std::string_view text, size_t begin, size_t limit) {
+    size_t cut = text.find_last_of(" \t\n", begin + limit);
+    if (cut == std::string_view::npos || cut <= begin + limit / 2) {
+        // Без пробелов - по границе символа UTF-8
+        cut = begin + limit;
+        while (cut > begin + 1 && (static_cast<unsigned char>(text[cut]) & 0xC0) == 0x80) {
+            --cut;
+        }
+    }
+    return cut;
+}
+
+void TextChunker::emitChunk(bool overlap, State& state, ChunkList& chunks) const {
+    // Чанк только из перекрытия повторил бы предыдущий
+    if (state.units.size() <= state.overlapUnits) {
+        state.units.clear();
+        state.overlapUnits = 0;
+        return;
+    }
+
+    const Unit& first = state.units.front();
+    const Unit& last = state.units.back();
+    std::string_view text = view(state, first.begin, last.end);
+
+    // Слишком короткие чанки не несут полезного контекста
+    if (text.size() >= MIN_CHUNK_LENGTH) {
+        ChunkList::Source source;
+        source.offset = first.begin;
+        source.firstPage = first.page;
+        source.lastPage = last.page;
+        chunks.add(text, source);
+    }
+
+    // Последние предложения (не больше overlapTokens токенов и половины чанка) повторяются
+    // в следующем чанке; чанк целиком не переносится
+    size_t keep = 0;
+    if (overlap && overlapTokens > 0) {
+        size_t tokens = 0;
+        while (keep + 1 < state.units.size()) {
+            const Unit& unit = state.units[state.units.size() - 1 - keep];
+            std::string_view unitText = view(state, unit.begin, unit.end);
+            size_t unitTokens = countTokens ? countTokens(unitText) : unitText.size() / 4;
+            if (tokens + unitTokens > overlapTokens || last.end - unit.begin > maxChunkSize / 2) {
+                break;
+            }
+            tokens += unitTokens;
+            ++keep;
+        }
+    }
+
+    state.units.erase(state.units.begin(), state.units.end() - keep);
+    state.overlapUnits = keep;
+}
+
+std::vector<std::string_view> TextChunker::splitSentences(std::string_view text) {
+    std::vector<std::string_view> sentences;
+    size_t start = 0;
+
+    auto cut = [&](size_t end, size_t next) {
+        std::string_view sentence = trim(text.substr(start, end - start));
+        if (!sentence.empty()) {
+            sentences.push_back(sentence);
+        }
+        start = next;
+    };
+
+    for (size_t i = 0; i < text.size(); ++i) {
+        const char c = text[i];
+
+        if (c == '\n') {
+            size_t next = i + 1;
+            while (next < text.size() && (text[next] == ' ' || text[next] == '\t' || text[next] == '\r')) {
+                ++next;
+            }
+
+            // Строка разметки страницы заканчивается вместе с собой
+            const bool markerLine = trim(text.substr(start, i - start)).rfind("===", 0) == 0;
+            if (next >= text.size() || text[next] == '\n' || markerLine || startsListItem(text, next)) {
+                cut(i, next);
+                i = next - 1;
+            }
+            continue;
+        }
+
+        // Конец предложения: знак, пробелы и заглавная буква
+        size_t markEnd = 0;
+        if (c == '.' || c == '!' || c == '?') {
+            markEnd = i + 1;
+        } else if (text.compare(i, 3, "\xE2\x80\xA6") == 0) {
+            markEnd = i + 3;
+        } else {
+            continue;
+        }
+        while (markEnd < text.size() && (text[markEnd] == '.' || text[markEnd] == '!' || text[markEnd] == '?'
+            || text[markEnd] == '"' || text[markEnd] == ')')) {
+            ++markEnd;
+        }
+
+        size_t next = markEnd;
+        while (next < text.size() && isSpace(text[next])) {
+            ++next;
+        }
+        if (next == markEnd || next >= text.size() || !startsSentence(text, next)) {
+            continue;
+        }
+        if (c == '.' && isSingleLetterWord(text, i)) {
+            continue;
+        }
+
+        cut(markEnd, next);
+        i = next - 1;
+    }
+
+    cut(text.size(), text.size());
+    return sentences;
+}
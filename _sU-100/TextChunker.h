@@ -0,0 +1,94 @@
+﻿// TextChunker.h
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <functional>
+#include <cstdint>
+#include "ChunkList.h"
+
+// Разбиение текста на чанки за один проход по мере поступления текста. Единицы разбиения -
+// предложения, заголовки и пункты списков: чанк заканчивается на границе единицы, а не посреди
+// предложения, заголовок начинает новый чанк, пустая строка и разметка "=== Page N ===" -
+// границы абзацев. Соседние чанки могут перекрываться последними предложениями (по числу токенов).
+// Для каждого чанка записывается его место в документе: смещение в тексте и страницы
+class TextChunker {
+public:
+    // Число токенов текста (для перекрытия чанков)
+    using TokenCounter = std::function<size_t(std::string_view text)>;
+
+    // Единица разбиения: участок текста документа (смещения от начала документа)
+    struct Unit {
+        uint64_t begin;
+        uint64_t end;
+        uint32_t page;
+        bool heading;
+    };
+
+    // Состояние разбиения документа между фрагментами текста
+    struct State {
+        std::string text;                   // текст начиная с незавершенного чанка
+        uint64_t textOffset = 0;            // смещение text[0] в документе
+        uint64_t lineStart = 0;             // начало незавершенной строки
+        uint64_t paragraphStart = 0;        // начало незавершенного абзаца
+        uint32_t page = 0;                  // текущая страница (0 - без разметки)
+        bool blankBefore = true;            // перед текущей строкой - пустая строка или начало
+        std::vector<Unit> units;            // единицы незавершенного чанка
+        size_t overlapUnits = 0;            // из них перенесены из предыдущего чанка
+    };
+
+    // maxChunkSize - наибольший размер чанка в байтах UTF-8; overlapTokens - сколько токенов
+    // последних предложений чанка повторяется в начале следующего (0 - без перекрытия)
+    explicit TextChunker(size_t maxChunkSize, size_t overlapTokens = 0, TokenCounter countTokens = nullptr);
+
+    // Разбиение текста целиком
+    ChunkList split(const std::string& content) const;
+
+    // Добавление страницы с разметкой "=== Page N ==="
+    void appendPage(int pageNumber, const std::string& pageText, State& state, ChunkList& chunks) const;
+
+    // Добавление очередного фрагмента текста: готовые чанки попадают в chunks,
+    // незавершенный остается в state до следующего фрагмента
+    void append(std::string_view text, State& state, ChunkList& chunks) const;
+
+    // Добавление текста, начинающегося в документе со смещения offset на странице page
+    // (повторное разбиение по сохраненным чанкам). Уже добавленная часть пропускается, пропуск
+    // до offset заполняется переводами строк, поэтому смещения новых чанков совпадают с исходными
+    void appendAt(uint64_t offset, uint32_t page, std::string_view text, State& state, ChunkList& chunks) const;
+
+    // Завершение последнего чанка
+    void flush(State& state, ChunkList& chunks) const;
+
+    // Разбиение текста на предложения: конец предложения (. ! ? …) перед заглавной буквой,
+    // пустая строка, разметка страницы, заголовок или пункт списка с новой строки.
+    // Точка после одной буквы (инициалы, сокращения) предложение не заканчивает
+    static std::vector<std::string_view> splitSentences(std::string_view text);
+
+    // Минимальная длина чанка: более короткие не несут полезного контекста
+    static constexpr size_t MIN_CHUNK_LENGTH = 50;
+
+private:
+    size_t maxChunkSize;
+    size_t overlapTokens;
+    TokenCounter countTokens;
+
+    // Разбор завершенной строки [state.lineStart, end)
+    void addLine(uint64_t end, State& state, ChunkList& chunks) const;
+
+    // Завершение абзаца [state.paragraphStart, end): его предложения добавляются в чанк
+    void endParagraph(uint64_t end, bool heading, State& state, ChunkList& chunks) const;
+
+    // Добавление единицы в чанк; переполненный чанк завершается
+    void addUnit(const Unit& unit, State& state, ChunkList& chunks) const;
+
+    // Завершение чанка; overlap - следующий чанк начинается с последних предложений этого
+    void emitChunk(bool overlap, State& state, ChunkList& chunks) const;
+
+    // Граница разреза text не дальше limit байт от begin: последний пробел во второй половине
+    // участка, иначе граница символа UTF-8
+    static size_t cutPoint(std::string_view text, size_t begin, size_t limit);
+
+    // Текст документа [begin, end) из state
+    static std::string_view view(const State& state, uint64_t begin, uint64_t end);
+};
@@ -0,0 +1,56 @@
+﻿// ThreadPool.cpp
+#include "ThreadPool.h"
+#include <algorithm>
+
+ThreadPool::ThreadPool(size_t threadCount)
+    : stopping(false) {
+    if (threadCount == 0) {
+        threadCount = std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    workers.reserve(threadCount);
+    for (size_t i = 0; i < threadCount; ++i) {
+        workers.emplace_back(&ThreadPool::workerLoop, this);
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        stopping = true;
+    }
+    cv.notify_all();
+
+    for (auto& worker : workers) {
+        if (worker.joinable()) {
+            worker.join();
+        }
+    }
+}
+
+size_t ThreadPool::size() const {
+    return workers.size();
+}
+
+void ThreadPool::workerLoop() {
+    while (true) {
+        std::function<void()> task;
+
+        {
+            std::unique_lock<std::mutex> lock(mtx);
+            cv.wait(lock, [this]() { return stopping || !interactiveTasks.empty() || !tasks.empty(); });
+
+            // Дорабатываем оставшиеся задачи перед остановкой
+            if (stopping && interactiveTasks.empty() && tasks.empty()) {
+                return;
+            }
+
+            // Интерактивные задачи - вперед фоновых
+            auto& queue = !interactiveTasks.empty() ? interactiveTasks : tasks;
+            task = std::move(queue.front());
+            queue.pop();
+        }
+
+        task();
+    }
+}
@@ -0,0 +1,67 @@
+﻿// ThreadPool.h
+#pragma once
+
+#include <vector>
+#include <queue>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+#include <atomic>
+
+// Приоритет задачи пула
+enum class TaskPriority {
+    Interactive,    // запросы пользователя: берутся из очереди раньше фоновых
+    Background      // загрузка документов и прочая фоновая работа
+};
+
+// Пул потоков с очередями задач по приоритету. Выполняемая задача не прерывается,
+// но свободный поток всегда берет интерактивную задачу раньше фоновой
+class ThreadPool {
+public:
+    // Конструктор: 0 потоков означает hardware_concurrency()
+    explicit ThreadPool(size_t threadCount = 0);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    // Постановка задачи в очередь, результат доступен через future
+    template <typename F>
+    auto submit(F&& task, TaskPriority priority = TaskPriority::Background) -> std::future<decltype(task())> {
+        using Result = decltype(task());
+
+        auto packaged = std::make_shared<std::packaged_task<Result()>>(std::forward<F>(task));
+        std::future<Result> result = packaged->get_future();
+
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            auto& queue = priority == TaskPriority::Interactive ? interactiveTasks : tasks;
+            queue.emplace([packaged]() { (*packaged)(); });
+        }
+        cv.notify_one();
+
+        return result;
+    }
+
+    // Количество рабочих потоков
+    size_t size() const;
+
+private:
+    // Рабочие потоки
+    std::vector<std::thread> workers;
+
+    // Очереди задач: интерактивные и фоновые
+    std::queue<std::function<void()>> interactiveTasks;
+    std::queue<std::function<void()>> tasks;
+
+    // Синхронизация
+    std::mutex mtx;
+    std::condition_variable cv;
+    bool stopping;
+
+    // Цикл рабочего потока
+    void workerLoop();
+};
@@ -0,0 +1,86 @@
+﻿// VectorIndex.h
+#pragma once
+
+#include <vector>
+#include <string>
+#include <cstdint>
+#include <cmath>
+
+// Способ хранения эмбеддингов
+enum class VectorStorage {
+    Float,      // float32 в графе HNSW
+    Int8,       // скалярное квантование int8, перебор SIMD и уточнение по float32
+    Binary      // знаковые биты (расстояние Хэмминга), перебор и уточнение по float32
+};
+
+// Результат измерения полноты поиска относительно точного перебора float32
+struct RecallStats {
+    size_t queries = 0;
+    double recall = 0.0;           // доля точных k ближайших, найденных поиском
+    double searchMs = 0.0;         // средняя задержка поиска
+    double exactMs = 0.0;          // средняя задержка точного перебора
+};
+
+// Индекс эмбеддингов чанков. Векторы нормализуются, близость - косинусная.
+// Вставки, удаления и поиски потокобезопасны
+class VectorIndex {
+public:
+    using Label = uint32_t;
+
+    // Найденный вектор
+    struct Neighbor {
+        Label label;
+        float similarity;
+    };
+
+    virtual ~VectorIndex() = default;
+
+    // Добавление вектора; повторная вставка метки заменяет прежний вектор
+    virtual void insert(Label label, const std::vector<float>& vector) = 0;
+
+    // Удаление вектора по метке (неизвестная метка игнорируется)
+    virtual void remove(Label label) = 0;
+
+    // Сохраненный (нормализованный) вектор метки; false, если метки нет
+    virtual bool getVector(Label label, std::vector<float>& vector) const = 0;
+
+    // k ближайших по убыванию близости
+    virtual std::vector<Neighbor> search(const std::vector<float>& query, size_t k) const = 0;
+
+    // Полнота search на случайных сохраненных векторах
+    virtual RecallStats measureRecall(size_t queryCount, size_t k) const = 0;
+
+    // Ширина поиска: efSearch для HNSW, число кандидатов на уточнение для квантованных кодов
+    virtual void setSearchWidth(size_t width) = 0;
+    virtual size_t getSearchWidth() const = 0;
+
+    virtual size_t getDimension() const = 0;
+
+    // Количество векторов и удаленных записей
+    virtual size_t size() const = 0;
+    virtual size_t getDeletedCount() const = 0;
+
+    // Занимаемая оперативная память в байтах
+    virtual size_t getMemoryUsage() const = 0;
+
+    // Краткое описание устройства индекса
+    virtual std::string describe() const = 0;
+
+protected:
+    // Нормализация вектора к единичной длине
+    static void normalize(std::vector<float>& vector);
+};
+
+inline void VectorIndex::normalize(std::vector<float>& vector) {
+    double norm = 0.0;
+    for (float value : vector) {
+        norm += static_cast<double>(value) * value;
+    }
+
+    if (norm > 0.0) {
+        float scale = static_cast<float>(1.0 / std::sqrt(norm));
+        for (float& value : vector) {
+            value *= scale;
+        }
+    }
+}
@@ -0,0 +1,303 @@
+﻿// VectorKernels.cpp
+#include "VectorKernels.h"
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define VECTOR_KERNELS_X64 1
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#endif
+
+// GCC/Clang компилируют функцию под указанный набор инструкций без глобальных флагов;
+// MSVC допускает интринсики в любой функции
+#if defined(__GNUC__) || defined(__clang__)
+#define KERNEL_TARGET(isa) __attribute__((target(isa)))
+#else
+#define KERNEL_TARGET(isa)
+#endif
+
+namespace {
+    // Скалярные варианты
+
+    float dotFloatScalar(const float* a, const float* b, size_t n) {
+        float sum0 = 0.0f, sum1 = 0.0f, sum2 = 0.0f, sum3 = 0.0f;
+        size_t i = 0;
+        for (; i + 4 <= n; i += 4) {
+            sum0 += a[i] * b[i];
+            sum1 += a[i + 1] * b[i + 1];
+            sum2 += a[i + 2] * b[i + 2];
+            sum3 += a[i + 3] * b[i + 3];
+        }
+        for (; i < n; ++i) {
+            sum0 += a[i] * b[i];
+        }
+        return sum0 + sum1 + sum2 + sum3;
+    }
+
+    int32_t dotInt8Scalar(const int8_t* a, const int8_t* b, size_t n) {
+        int32_t sum = 0;
+        for (size_t i = 0; i < n; ++i) {
+            sum += static_cast<int32_t>(a[i]) * b[i];
+        }
+        return sum;
+    }
+
+    int32_t dotUint8Int8Scalar(const uint8_t* a, const int8_t* b, size_t n) {
+        int32_t sum = 0;
+        for (size_t i = 0; i < n; ++i) {
+            sum += static_cast<int32_t>(a[i]) * b[i];
+        }
+        return sum;
+    }
+
+    uint32_t popcount64(uint64_t x) {
+        x = x - ((x >> 1) & 0x5555555555555555ull);
+        x = (x & 0x3333333333333333ull) + ((x >> 2) & 0x3333333333333333ull);
+        x = (x + (x >> 4)) & 0x0F0F0F0F0F0F0F0Full;
+        return static_cast<uint32_t>((x * 0x0101010101010101ull) >> 56);
+    }
+
+    uint32_t hammingScalar(const uint64_t* a, const uint64_t* b, size_t words) {
+        uint32_t distance = 0;
+        for (size_t i = 0; i < words; ++i) {
+            distance += popcount64(a[i] ^ b[i]);
+        }
+        return distance;
+    }
+
+#ifdef VECTOR_KERNELS_X64
+    // Векторные варианты
+
+    KERNEL_TARGET("avx2")
+    int32_t horizontalSum(__m256i v) {
+        __m128i sum = _mm_add_epi32(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1));
+        sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(1, 0, 3, 2)));
+        sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(2, 3, 0, 1)));
+        return _mm_cvtsi128_si32(sum);
+    }
+
+    KERNEL_TARGET("avx2,fma")
+    float dotFloatAvx2(const float* a, const float* b, size_t n) {
+        __m256 acc0 = _mm256_setzero_ps();
+        __m256 acc1 = _mm256_setzero_ps();
+        size_t i = 0;
+
+        for (; i + 16 <= n; i += 16) {
+            acc0 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i), acc0);
+            acc1 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i + 8), _mm256_loadu_ps(b + i + 8), acc1);
+        }
+        for (; i + 8 <= n; i += 8) {
+            acc0 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i), acc0);
+        }
+
+        __m256 acc = _mm256_add_ps(acc0, acc1);
+        __m128 sum = _mm_add_ps(_mm256_castps256_ps128(acc), _mm256_extractf128_ps(acc, 1));
+        sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+        sum = _mm_add_ss(sum, _mm_shuffle_ps(sum, sum, 1));
+
+        float result = _mm_cvtss_f32(sum);
+        for (; i < n; ++i) {
+            result += a[i] * b[i];
+        }
+        return result;
+    }
+
+    KERNEL_TARGET("avx2")
+    int32_t dotInt8Avx2(const int8_t* a, const int8_t* b, size_t n) {
+        // maddubs умножает беззнаковое на знаковое: |a| * (b со знаком a).
+        // Коды не меньше -127, поэтому сумма пары произведений не переполняет int16
+        const __m256i ones = _mm256_set1_epi16(1);
+        __m256i acc = _mm256_setzero_si256();
+        size_t i = 0;
+
+        for (; i + 32 <= n; i += 32) {
+            __m256i va = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + i));
+            __m256i vb = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + i));
+            __m256i products = _mm256_maddubs_epi16(_mm256_sign_epi8(va, va), _mm256_sign_epi8(vb, va));
+            acc = _mm256_add_epi32(acc, _mm256_madd_epi16(products, ones));
+        }
+
+        int32_t result = horizontalSum(acc);
+        for (; i < n; ++i) {
+            result += static_cast<int32_t>(a[i]) * b[i];
+        }
+        return result;
+    }
+
+    KERNEL_TARGET("avx2,avx512vl,avx512vnni")
+    int32_t dotUint8Int8Avx512Vnni(const uint8_t* a, const int8_t* b, size_t n) {
+        __m256i acc = _mm256_setzero_si256();
+        size_t i = 0;
+
+        for (; i + 32 <= n; i += 32) {
+            __m256i va = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + i));
+            __m256i vb = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + i));
+            acc = _mm256_dpbusd_epi32(acc, va, vb);
+        }
+
+        int32_t result = horizontalSum(acc);
+        for (; i < n; ++i) {
+            result += static_cast<int32_t>(a[i]) * b[i];
+        }
+        return result;
+    }
+
+    KERNEL_TARGET("avx2,avxvnni")
+    int32_t dotUint8Int8AvxVnni(const uint8_t* a, const int8_t* b, size_t n) {
+        __m256i acc = _mm256_setzero_si256();
+        size_t i = 0;
+
+        for (; i + 32 <= n; i += 32) {
+            __m256i va = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + i));
+            __m256i vb = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + i));
+            acc = _mm256_dpbusd_avx_epi32(acc, va, vb);
+        }
+
+        int32_t result = horizontalSum(acc);
+        for (; i < n; ++i) {
+            result += static_cast<int32_t>(a[i]) * b[i];
+        }
+        return result;
+    }
+
+    KERNEL_TARGET("popcnt")
+    uint32_t hammingPopcnt(const uint64_t* a, const uint64_t* b, size_t words) {
+        uint64_t distance = 0;
+        for (size_t i = 0; i < words; ++i) {
+            distance += _mm_popcnt_u64(a[i] ^ b[i]);
+        }
+        return static_cast<uint32_t>(distance);
+    }
+
+    // Возможности процессора
+    struct CpuFeatures {
+        bool popcnt = false;
+        bool avx2 = false;
+        bool fma = false;
+        bool avx512vnni = false;
+        bool avxvnni = false;
+    };
+
+    void cpuid(int leaf, int subleaf, unsigned regs[4]) {
+#if defined(_MSC_VER)
+        int info[4];
+        __cpuidex(info, leaf, subleaf);
+        for (int i = 0; i < 4; ++i) {
+            regs[i] = static_cast<unsigned>(info[i]);
+        }
+#else
+        __cpuid_count(leaf, subleaf, regs[0], regs[1], regs[2], regs[3]);
+#endif
+    }
+
+    uint64_t readXcr0() {
+#if defined(_MSC_VER)
+        return _xgetbv(0);
+#else
+        unsigned eax = 0, edx = 0;
+        __asm__("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+        return (static_cast<uint64_t>(edx) << 32) | eax;
+#endif
+    }
+
+    CpuFeatures detectFeatures() {
+        CpuFeatures features;
+        unsigned regs[4] = {};
+
+        cpuid(0, 0, regs);
+        unsigned maxLeaf = regs[0];
+
+        cpuid(1, 0, regs);
+        features.popcnt = (regs[2] >> 23) & 1;
+        features.fma = (regs[2] >> 12) & 1;
+        bool osxsave = (regs[2] >> 27) & 1;
+
+        // Регистры AVX (и AVX-512) должны сохраняться операционной системой
+        uint64_t xcr0 = osxsave ? readXcr0() : 0;
+        bool avxState = (xcr0 & 0x6) == 0x6;
+        bool avx512State = (xcr0 & 0xE6) == 0xE6;
+
+        if (maxLeaf >= 7 && avxState) {
+            cpuid(7, 0, regs);
+            features.avx2 = (regs[1] >> 5) & 1;
+            bool avx512vl = (regs[1] >> 31) & 1;
+            features.avx512vnni = avx512State && avx512vl && ((regs[2] >> 11) & 1);
+
+            cpuid(7, 1, regs);
+            features.avxvnni = (regs[0] >> 4) & 1;
+        }
+
+        return features;
+    }
+#endif
+
+    // Выбранные реализации
+    struct Dispatch {
+        float (*dotFloat)(const float*, const float*, size_t) = dotFloatScalar;
+        int32_t (*dotInt8)(const int8_t*, const int8_t*, size_t) = dotInt8Scalar;
+        int32_t (*dotUint8Int8)(const uint8_t*, const int8_t*, size_t) = dotUint8Int8Scalar;
+        uint32_t (*hamming)(const uint64_t*, const uint64_t*, size_t) = hammingScalar;
+        bool preferUnsigned = false;
+        const char* name = "scalar";
+
+        Dispatch() {
+#ifdef VECTOR_KERNELS_X64
+            CpuFeatures features = detectFeatures();
+
+            if (features.popcnt) {
+                hamming = hammingPopcnt;
+                name = "POPCNT";
+            }
+            if (features.avx2 && features.fma) {
+                dotFloat = dotFloatAvx2;
+                dotInt8 = dotInt8Avx2;
+                name = "AVX2";
+            }
+            if (features.avx2 && features.avx512vnni) {
+                dotUint8Int8 = dotUint8Int8Avx512Vnni;
+                preferUnsigned = true;
+                name = "AVX2 + AVX-512 VNNI";
+            }
+            else if (features.avx2 && features.avxvnni) {
+                dotUint8Int8 = dotUint8Int8AvxVnni;
+                preferUnsigned = true;
+                name = "AVX2 + AVX-VNNI";
+            }
+#endif
+        }
+    };
+
+    const Dispatch& dispatch() {
+        static const Dispatch instance;
+        return instance;
+    }
+}
+
+namespace VectorKernels {
+    float dotFloat(const float* a, const float* b, size_t n) {
+        return dispatch().dotFloat(a, b, n);
+    }
+
+    int32_t dotInt8(const int8_t* a, const int8_t* b, size_t n) {
+        return dispatch().dotInt8(a, b, n);
+    }
+
+    int32_t dotUint8Int8(const uint8_t* a, const int8_t* b, size_t n) {
+        return dispatch().dotUint8Int8(a, b, n);
+    }
+
+    uint32_t hamming(const uint64_t* a, const uint64_t* b, size_t words) {
+        return dispatch().hamming(a, b, words);
+    }
+
+    bool preferUnsignedDot() {
+        return dispatch().preferUnsigned;
+    }
+
+    const char* getInstructionSet() {
+        return dispatch().name;
+    }
+}
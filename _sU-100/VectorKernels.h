@@ -0,0 +1,27 @@
+﻿// VectorKernels.h
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+
+// Ядра сравнения векторов. Набор инструкций выбирается при первом вызове по возможностям
+// процессора (AVX-512 VNNI / AVX-VNNI, AVX2, POPCNT), иначе используется скалярный вариант
+namespace VectorKernels {
+    // Скалярное произведение векторов float
+    float dotFloat(const float* a, const float* b, size_t n);
+
+    // Скалярное произведение кодов int8 (значения в [-127, 127])
+    int32_t dotInt8(const int8_t* a, const int8_t* b, size_t n);
+
+    // Скалярное произведение беззнакового вектора с кодами int8 (для VNNI: запрос смещен на 128)
+    int32_t dotUint8Int8(const uint8_t* a, const int8_t* b, size_t n);
+
+    // Расстояние Хэмминга между битовыми кодами из words 64-битных слов
+    uint32_t hamming(const uint64_t* a, const uint64_t* b, size_t words);
+
+    // Используется ли dotUint8Int8 (VNNI) вместо dotInt8 при поиске
+    bool preferUnsignedDot();
+
+    // Название выбранного набора инструкций
+    const char* getInstructionSet();
+}
@@ -1,15 +1,22 @@
 ﻿#include <iostream>
 #include <string>
+#include <sstream>
 #include <vector>
 #include <filesystem>
 #include <memory>
 #include <thread>
 #include <chrono>
+#include <mutex>
 
 #include "LLMInterface.h"
 #include "PDFProcessor.h"
 #include "ContextManager.h"
 #include "ConsoleUI.h"
+#include "IngestionPipeline.h"
+#include "DirectoryWatcher.h"
+#include "DocumentSource.h"
+#include "EmbeddingModel.h"
+#include "ThreadPool.h"
 #include <consoleapi2.h>
 #include <WinNls.h>
 
@@ -52,12 +59,33 @@ std::string findModelFile() {
     return "";
 }
 
+// Поиск модели эмбеддингов для векторного поиска (необязательна)
+std::string findEmbeddingModelFile() {
+    const std::string path = "models/embedding/";
+
+    if (!fs::exists(path) || !fs::is_directory(path)) {
+        return "";
+    }
+
+    for (const auto& entry : fs::directory_iterator(path)) {
+        std::string ext = entry.path().extension().string();
+        std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+
+        if (entry.is_regular_file() && ext == ".gguf") {
+            return entry.path().string();
+        }
+    }
+
+    return "";
+}
+
 // Функция для создания необходимых директорий
 void createDirectories() {
     const std::vector<std::string> directories = {
         "models",
         "documents",
-        "tessdata"
+        "tessdata",
+        "cache"
     };
 
     for (const auto& dir : directories) {
@@ -69,8 +97,7 @@ void createDirectories() {
 }
 
 // Функция для обработки PDF документов
-void processDocuments(std::shared_ptr<PDFProcessor> pdfProcessor,
-    std::shared_ptr<ContextManager> contextManager) {
+void processDocuments(std::shared_ptr<IngestionPipeline> ingestion, std::shared_ptr<ContextManager> contextManager) {
     const std::string documentsDir = "documents";
 
     if (!fs::exists(documentsDir) || !fs::is_directory(documentsDir)) {
@@ -78,9 +105,17 @@ void processDocuments(std::shared_ptr<PDFProcessor> pdfProcessor,
         return;
     }
 
+    // Файлы, удаленные, пока программа не работала, убираются из постоянного индекса
+    for (const auto& docName : contextManager->getDocumentNames()) {
+        if (contextManager->getSourceStamp(docName) != 0 && !fs::exists(fs::path(documentsDir) / docName)) {
+            contextManager->removeDocument(docName);
+        }
+    }
+
+    // Обходим и подкаталоги: по ним выбираются профили OCR
     std::vector<fs::path> pdfFiles;
-    for (const auto& entry : fs::directory_iterator(documentsDir)) {
-        if (entry.path().extension() == ".pdf") {
+    for (const auto& entry : fs::recursive_directory_iterator(documentsDir)) {
+        if (entry.is_regular_file() && entry.path().extension() == ".pdf") {
             pdfFiles.push_back(entry.path());
         }
     }
@@ -93,50 +128,169 @@ void processDocuments(std::shared_ptr<PDFProcessor> pdfProcessor,
     std::cout << "\n=== Processing PDF Documents ===" << std::endl;
     std::cout << "Found " << pdfFiles.size() << " PDF file(s) to process" << std::endl;
 
+    std::mutex outputMtx;
     int processed = 0;
     int failed = 0;
 
-    for (const auto& pdfPath : pdfFiles) {
-        std::cout << "\n(" << (processed + failed + 1) << "/" << pdfFiles.size()
-            << ") Processing: " << pdfPath.filename() << std::endl;
-
-        try {
-            auto startTime = std::chrono::steady_clock::now();
-
-            // Извлекаем текст из PDF
-            std::string pdfText = pdfProcessor->extractText(pdfPath.string());
+    // Файлы завершаются в порядке готовности, а не в порядке постановки в очередь
+    ingestion->setDoneCallback([&](const IngestionResult& result) {
+        std::lock_guard<std::mutex> lock(outputMtx);
 
-            auto endTime = std::chrono::steady_clock::now();
-            auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(endTime - startTime);
+        std::cout << "(" << (processed + failed + 1) << "/" << pdfFiles.size() << ") "
+            << result.docName << " [OCR profile: " << result.ocrProfile << "]" << std::endl;
 
-            if (!pdfText.empty() && pdfText.find("Error:") != 0) {
-                // Добавляем в контекст менеджер
-                contextManager->addDocument(pdfPath.filename().string(), pdfText);
-                processed++;
-
-                std::cout << "✓ Successfully processed in " << duration.count()
-                    << "ms (" << pdfText.length() << " characters)" << std::endl;
-            }
-            else {
-                std::cout << "✗ Failed to extract text: " << pdfText.substr(0, 100) << std::endl;
-                failed++;
-            }
+        if (result.success && result.fromIndex) {
+            processed++;
+            std::cout << "✓ Unchanged since last run, already indexed" << std::endl;
         }
-        catch (const std::exception& e) {
-            std::cout << "✗ Error processing file: " << e.what() << std::endl;
+        else if (result.success) {
+            processed++;
+            std::cout << "✓ Successfully processed in " << result.totalMs
+                << "ms (" << result.pageCount << " pages, " << result.characters
+                << " characters, first page searchable after " << result.firstPageMs << "ms"
+                << (result.fromCache ? ", from extraction cache" : "") << ")" << std::endl;
+        }
+        else {
             failed++;
+            std::cout << "✗ Failed to extract text: " << result.error.substr(0, 100) << std::endl;
         }
+    });
+
+    auto startTime = std::chrono::steady_clock::now();
+    ingestion->resetStats();
+
+    for (const auto& pdfPath : pdfFiles) {
+        // Имя документа - путь относительно каталога документов
+        std::string docName = fs::relative(pdfPath, documentsDir).generic_string();
+        ingestion->submit(pdfPath.string(), docName);
     }
 
+    ingestion->waitIdle();
+    ingestion->setDoneCallback(nullptr);
+
+    auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now() - startTime);
+
     std::cout << "\n=== Processing Summary ===" << std::endl;
     std::cout << "Successfully processed: " << processed << " files" << std::endl;
     std::cout << "Failed: " << failed << " files" << std::endl;
+    std::cout << "Total time: " << duration.count() << "ms" << std::endl;
+
+    // Загрузка этапов показывает, какой из них ограничивает скорость пакетной загрузки
+    std::cout << "\nIngestion pipeline utilization:\n" << ingestion->formatStats();
 
     if (processed > 0) {
         std::cout << "✓ Documents are ready for use as context" << std::endl;
     }
 }
 
+// Функция загрузки PDF из архивов, отдельных файлов и стандартного ввода (аргументы командной строки)
+void processSources(std::shared_ptr<IngestionPipeline> ingestion, const std::vector<std::string>& sources) {
+    std::cout << "\n=== Processing Document Sources ===" << std::endl;
+
+    std::mutex outputMtx;
+    int processed = 0;
+    int failed = 0;
+
+    ingestion->setDoneCallback([&](const IngestionResult& result) {
+        std::lock_guard<std::mutex> lock(outputMtx);
+
+        if (result.success) {
+            processed++;
+            std::cout << "✓ " << result.docName << " (" << result.pageCount << " pages, "
+                << result.characters << " characters, " << result.totalMs << "ms)" << std::endl;
+        }
+        else {
+            failed++;
+            std::cout << "✗ " << result.docName << ": " << result.error.substr(0, 100) << std::endl;
+        }
+    });
+
+    auto startTime = std::chrono::steady_clock::now();
+
+    for (const auto& path : sources) {
+        std::string error;
+        auto source = DocumentSource::open(path, error);
+        if (!source) {
+            std::lock_guard<std::mutex> lock(outputMtx);
+            std::cout << "✗ " << error << std::endl;
+            continue;
+        }
+
+        // Документы читаются из архива по одному и сразу уходят в конвейер;
+        // очередь загрузки ограничена, поэтому архив не распаковывается в память целиком
+        std::string name;
+        std::shared_ptr<MemoryBuffer> data;
+        while (source->next(name, data)) {
+            ingestion->submit(std::move(data), name);
+        }
+
+        if (!source->getError().empty()) {
+            std::lock_guard<std::mutex> lock(outputMtx);
+            std::cout << "✗ " << source->getError() << std::endl;
+        }
+    }
+
+    ingestion->waitIdle();
+    ingestion->setDoneCallback(nullptr);
+
+    auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now() - startTime);
+
+    std::cout << "Loaded from sources: " << processed << " documents, failed: " << failed
+        << " (" << duration.count() << "ms)" << std::endl;
+}
+
+// Функция запуска отслеживания каталога документов
+void startDocumentWatcher(std::shared_ptr<DirectoryWatcher> watcher,
+    std::shared_ptr<IngestionPipeline> ingestion,
+    std::shared_ptr<ConsoleUI> consoleUI) {
+    const std::string documentsDir = "documents";
+
+    // Обработчик хранится в самом конвейере, поэтому конвейер захватывается по указателю
+    IngestionPipeline* pipeline = ingestion.get();
+
+    ingestion->setDoneCallback([pipeline, consoleUI](const IngestionResult& result) {
+        // Замененная или удаленная версия файла не интересна
+        if (result.cancelled) {
+            return;
+        }
+
+        std::stringstream ss;
+        if (result.success) {
+            ss << "✓ " << result.docName << " searchable after " << result.firstPageMs
+                << "ms, fully indexed in " << result.totalMs << "ms (" << result.pageCount << " pages)";
+        }
+        else {
+            ss << "✗ " << result.docName << ": " << result.error.substr(0, 100);
+        }
+        // Завершенный файл еще числится в очереди
+        size_t pending = pipeline->getPendingCount();
+        ss << " [ingest queue: " << (pending > 0 ? pending - 1 : 0) << "]";
+
+        consoleUI->showNotification(ss.str());
+    });
+
+    bool started = watcher->start([documentsDir, ingestion, consoleUI](const FileChange& change) {
+        std::string docName = fs::relative(change.path, documentsDir).generic_string();
+
+        if (change.type == FileChange::Removed) {
+            ingestion->cancel(docName);
+            consoleUI->showNotification("- " + docName + " removed from context");
+            return;
+        }
+
+        ingestion->submit(change.path, docName);
+        consoleUI->showNotification(std::string(change.type == FileChange::Added ? "+ " : "~ ") + docName
+            + " queued for ingestion [ingest queue: " + std::to_string(ingestion->getPendingCount()) + "]");
+    });
+
+    if (started) {
+        std::cout << "Watching " << documentsDir << "/ for changes ("
+            << (watcher->isUsingNotifications() ? "inotify" : "polling") << ")" << std::endl;
+    }
+}
+
 // Функция отображения системной информации
 void displaySystemInfo() {
     std::cout << "\n=== LLM Pipeline System Information ===" << std::endl;
@@ -200,9 +354,20 @@ int main(int argc, char* argv[]) {
             return 1;
         }
 
+        // Общий пул потоков: рендеринг и OCR страниц в фоне, ранжирование запросов - вне очереди
+        auto workers = std::make_shared<ThreadPool>();
+
         // PDF Processor
         std::cout << "Initializing PDF Processor..." << std::endl;
         auto pdfProcessor = std::make_shared<PDFProcessor>();
+        pdfProcessor->setThreadPool(workers);
+
+        // Профили OCR по каталогам: массовая загрузка - быстро, юридические документы - точно
+        pdfProcessor->addDirectoryRule("documents/backfill", "fast");
+        pdfProcessor->addDirectoryRule("documents/legal", "best");
+
+        // Кэш извлеченного текста: при перезапуске неизмененные PDF не разбираются заново
+        pdfProcessor->setCacheDirectory("cache/extraction");
 
         // Context Manager
         std::cout << "Initializing Context Manager..." << std::endl;
@@ -210,22 +375,96 @@ int main(int argc, char* argv[]) {
             3000, // max context tokens
             800   // max chunk size
             );
+        contextManager->setThreadPool(workers);
+
+        // Токены чанков считаются токенизатором модели: контекст собирается по точному бюджету
+        contextManager->setTokenizer(llm->getModelInfo(), [llm](std::string_view text) {
+            return llm->countTokens(text);
+        });
+
+        // Из выбранных чанков в промпт идет половина токенов: предложения, полезные для вопроса.
+        // Сэкономленное время prefill оценивается по измеренной скорости модели
+        contextManager->setCompressionRatio(0.5);
+        contextManager->setPrefillRate([llm]() {
+            return llm->getPrefillRate();
+        });
+
+        // Соседние чанки перекрываются последними предложениями: ответ на стыке чанков не теряется
+        contextManager->setChunkOverlap(50);
+
+        // Постоянный индекс: документы прошлых запусков доступны для поиска сразу, без повторной загрузки
+        contextManager->openIndex("cache/index");
+
+        // Векторный поиск включается, если в models/embedding/ есть модель эмбеддингов
+        std::string embeddingModelPath = findEmbeddingModelFile();
+        if (!embeddingModelPath.empty()) {
+            try {
+                auto embeddingModel = std::make_shared<EmbeddingModel>(embeddingModelPath);
+                VectorSearchConfig vectorConfig;
+                vectorConfig.vectorDirectory = "cache/vectors";
+                contextManager->setEmbeddingModel(embeddingModel, vectorConfig);
+            }
+            catch (const std::exception& e) {
+                std::cout << "Warning: Vector search disabled: " << e.what() << std::endl;
+            }
+        }
 
         // Console UI
         std::cout << "Initializing Console UI..." << std::endl;
         auto consoleUI = std::make_shared<ConsoleUI>();
 
+        // Конвейер загрузки документов
+        std::cout << "Initializing Ingestion Pipeline..." << std::endl;
+        // memoryBudget > 0 ограничивает память загрузки огромных PDF и архивов
+        IngestionConfig ingestionConfig;
+        ingestionConfig.spillDirectory = "cache/spill";
+        ingestionConfig.workers = workers;
+        auto ingestion = std::make_shared<IngestionPipeline>(pdfProcessor, contextManager, ingestionConfig);
+
         std::cout << "✓ All components initialized successfully" << std::endl;
 
+        // Запоминаем состояние каталога до начальной загрузки: файлы, добавленные
+        // во время нее, подхватит отслеживание
+        auto watcher = std::make_shared<DirectoryWatcher>("documents", ".pdf");
+        watcher->snapshot();
+
         // Обработка PDF документов
-        processDocuments(pdfProcessor, contextManager);
+        processDocuments(ingestion, contextManager);
+
+        // Дополнительные источники из командной строки: архивы zip/tar, PDF, "-" для stdin
+        std::vector<std::string> sources(argv + 1, argv + argc);
+        if (!sources.empty()) {
+            processSources(ingestion, sources);
+        }
+        bool stdinConsumed = std::find(sources.begin(), sources.end(), "-") != sources.end();
+
+        // Загруженное записывается в постоянный индекс в фоне
+        contextManager->flushIndex();
+
+        // Новые, измененные и удаленные файлы обрабатываются в фоне, запросы при этом обслуживаются
+        startDocumentWatcher(watcher, ingestion, consoleUI);
 
         // Небольшая пауза перед запуском UI
         std::this_thread::sleep_for(std::chrono::milliseconds(500));
 
         // Запуск интерактивного режима
         std::cout << "\n=== Starting Interactive Mode ===" << std::endl;
-        consoleUI->startInteractiveMode(llm, contextManager);
+        consoleUI->setIngestionPipeline(ingestion);
+
+        // Стандартный ввод занят документами - вопросы задавать неоткуда
+        if (stdinConsumed) {
+            std::cout << "Standard input was used for documents, interactive mode is unavailable" << std::endl;
+        }
+        else {
+            consoleUI->startInteractiveMode(llm, contextManager);
+        }
+
+        watcher->stop();
+        ingestion->stop();
+        ingestion->setDoneCallback(nullptr);
+
+        // Документы, загруженные за сеанс, сохраняются до выхода
+        contextManager->flushIndex(true);
 
     }
     catch (const std::exception& e) {